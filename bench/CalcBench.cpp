@@ -0,0 +1,570 @@
+// calc_bench: reproducible workloads for the expression engine, the history database and
+// the history panel, reported as JSON so results can be compared between releases.
+//
+//   calc_bench [--filter TEXT] [--max-rows N] [--repetitions N] [--output FILE]
+//
+// Every workload is run --repetitions times and reported as the median and minimum time
+// per operation. Generated inputs come from a fixed seed, so every run measures the same
+// expressions and the same database contents.
+#include <QApplication>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QListView>
+#include <QTemporaryDir>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <random>
+#include <vector>
+#include "CalculatorCore.h"
+#include "ColumnarHistoryStore.h"
+#include "ConstexprExpression.h"
+#include "DatabaseManager.h"
+#include "NumberFormat.h"
+#include "VectorEvaluator.h"
+#include "HistoryPanel.h"
+
+namespace {
+
+struct Options
+{
+    QString filter;          // Only workloads whose name contains this run
+    qint64 maxRows = 1000000; // Largest history size for the database and panel workloads
+    int repetitions = 5;
+    QString outputPath;      // Standard output when empty
+};
+
+class Suite
+{
+public:
+    explicit Suite(const Options &options) : m_options(options) {}
+
+    bool selected(const QString &name) const
+    {
+        return m_options.filter.isEmpty() || name.contains(m_options.filter);
+    }
+
+    // For fast operations: body(iterations) is timed as a whole, with iterations grown
+    // until one repetition takes at least MinRepetitionNs so clock overhead is negligible.
+    void run(const QString &name, const std::function<void(qint64)> &body)
+    {
+        if (!selected(name)) {
+            return;
+        }
+        qint64 iterations = 1;
+        for (;;) {
+            const qint64 elapsed = timed([&] { body(iterations); });
+            if (elapsed >= MinRepetitionNs || iterations >= (qint64(1) << 40)) {
+                break;
+            }
+            // Aim slightly past the target so the next try usually ends the search.
+            const double scale = elapsed > 0 ? 1.4 * MinRepetitionNs / elapsed : 10.0;
+            iterations = std::max(iterations + 1, qint64(iterations * std::min(scale, 10.0)));
+        }
+
+        std::vector<double> samples;
+        for (int i = 0; i < m_options.repetitions; ++i) {
+            samples.push_back(double(timed([&] { body(iterations); })) / iterations);
+        }
+        record(name, iterations, samples);
+    }
+
+    // For slow operations that change state: setup() runs untimed before every repetition,
+    // then body() runs once and is credited with items operations.
+    void runOnce(const QString &name, qint64 items, const std::function<void()> &setup,
+                 const std::function<void()> &body)
+    {
+        if (!selected(name)) {
+            return;
+        }
+        std::vector<double> samples;
+        for (int i = 0; i < m_options.repetitions; ++i) {
+            setup();
+            samples.push_back(double(timed(body)) / items);
+        }
+        record(name, items, samples);
+    }
+
+    QJsonDocument report() const
+    {
+        QJsonObject context;
+        context["date"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+        context["qt_version"] = QString(qVersion());
+        context["instruction_set"] = QString(VectorEvaluator::instructionSet());
+        context["repetitions"] = m_options.repetitions;
+        context["max_rows"] = m_options.maxRows;
+#ifdef NDEBUG
+        context["build_type"] = QString("release");
+#else
+        context["build_type"] = QString("debug");
+#endif
+
+        QJsonObject root;
+        root["context"] = context;
+        root["benchmarks"] = m_results;
+        return QJsonDocument(root);
+    }
+
+private:
+    static constexpr qint64 MinRepetitionNs = 200000000; // 0.2 s
+
+    Options m_options;
+    QJsonArray m_results;
+
+    static qint64 timed(const std::function<void()> &body)
+    {
+        QElapsedTimer timer;
+        timer.start();
+        body();
+        return timer.nsecsElapsed();
+    }
+
+    void record(const QString &name, qint64 iterations, std::vector<double> samples)
+    {
+        std::sort(samples.begin(), samples.end());
+        QJsonObject result;
+        result["name"] = name;
+        result["iterations"] = iterations;
+        result["time_unit"] = QString("ns");
+        result["median_time"] = samples[samples.size() / 2];
+        result["min_time"] = samples.front();
+        m_results.append(result);
+        std::fprintf(stderr, "%-48s %14.1f ns/op\n", qPrintable(name), samples[samples.size() / 2]);
+    }
+};
+
+// Keeps results observable so the compiler cannot drop the work that produced them.
+volatile double sink = 0;
+
+QString generatedExpression(std::mt19937_64 &random, int terms)
+{
+    static const char *const operators[] = { " + ", " - ", " × ", " ÷ " };
+    std::uniform_int_distribution<int> number(1, 9999);
+    std::uniform_int_distribution<int> op(0, 3);
+    QString expression = QString::number(number(random));
+    for (int i = 1; i < terms; ++i) {
+        expression += QString::fromUtf8(operators[op(random)]);
+        expression += QString::number(number(random));
+    }
+    return expression;
+}
+
+QString nestedExpression(int depth)
+{
+    QString expression;
+    for (int i = 0; i < depth; ++i) {
+        expression += "(1 + ";
+    }
+    expression += '1';
+    expression += QString(depth, ')');
+    return expression;
+}
+
+void benchmarkCore(Suite &suite)
+{
+    std::mt19937_64 random(20240101);
+    const QList<QPair<QString, QString>> workloads = {
+        { "short", QString::fromUtf8("12.5 + 3 × 4") },
+        { "long", generatedExpression(random, 500) },
+        { "nested", nestedExpression(500) },
+    };
+
+    for (const auto &workload : workloads) {
+        const QString &expression = workload.second;
+
+        // calculate() as the GUI calls it: after the first call the program is cached.
+        CalculatorCore core;
+        suite.run("core/calculate/" + workload.first, [&](qint64 iterations) {
+            for (qint64 i = 0; i < iterations; ++i) {
+                sink = core.calculate(expression).value;
+            }
+        });
+
+        // Lexing and compiling from scratch every time, as for an expression never seen.
+        suite.run("core/compile/" + workload.first, [&](qint64 iterations) {
+            for (qint64 i = 0; i < iterations; ++i) {
+                sink = double(core.compile(expression).instructions().size());
+            }
+        });
+
+        suite.run("core/calculate_decimal/" + workload.first, [&](qint64 iterations) {
+            for (qint64 i = 0; i < iterations; ++i) {
+                sink = double(core.calculateDecimal(expression).value.digitCount());
+            }
+        });
+    }
+
+    // A formula compiled once and evaluated for many inputs, with and without the
+    // ExpressionOptimizer pass, to show what folding and strength reduction buy. Each
+    // program also runs as threaded code ("<name>_threaded") against the interpreter.
+    const std::string formula = "x^2 + 2*3*x - y/4 + (1+1)*y^3 + x*1 + 0 + 2*x*y*3 - (10/5)^2";
+    const CompiledExpression unoptimized =
+        ExpressionCompiler().compile(formula, nullptr, ExpressionCompiler::CollectVariables);
+    const QList<QPair<QString, CompiledExpression>> programs = {
+        { "compiled", unoptimized },
+        { "optimized", ExpressionOptimizer::optimize(unoptimized, ExpressionOptimizer::Strict) },
+        { "fast_math", ExpressionOptimizer::optimize(unoptimized, ExpressionOptimizer::FastMath) },
+    };
+    for (const auto &program : programs) {
+        CompiledExpression threaded = program.second;
+        threaded.setBackend(ExecutionBackend::ThreadedCode);
+        const QList<QPair<QString, const CompiledExpression *>> backends = {
+            { program.first, &program.second },
+            { program.first + "_threaded", &threaded },
+        };
+        for (const auto &backend : backends) {
+            suite.run("core/evaluate_formula/" + backend.first, [&](qint64 iterations) {
+                double values[2] = { 1.5, -2.25 };
+                for (qint64 i = 0; i < iterations; ++i) {
+                    values[0] += 1e-9; // Keeps every evaluation distinct
+                    sink = backend.second->evaluate(values, nullptr);
+                }
+            });
+        }
+    }
+}
+
+// Results as the GUI shows them and history stores them, against the QString conversions
+// they replaced ("qt", which keeps six digits, and "qt_17", which round-trips).
+void benchmarkNumbers(Suite &suite)
+{
+    std::mt19937_64 random(20240301);
+    std::uniform_real_distribution<double> mantissa(-10.0, 10.0);
+    std::uniform_int_distribution<int> exponent(-12, 20);
+    std::vector<double> values(1024);
+    QStringList texts;
+    for (double &value : values) {
+        value = mantissa(random) * std::pow(10.0, exponent(random));
+        texts.append(NumberFormat::toString(value));
+    }
+
+    suite.run("core/format_number/qt", [&](qint64 iterations) {
+        for (qint64 i = 0; i < iterations; ++i) {
+            sink = double(QString::number(values[size_t(i) % values.size()]).size());
+        }
+    });
+    suite.run("core/format_number/qt_17", [&](qint64 iterations) {
+        for (qint64 i = 0; i < iterations; ++i) {
+            sink = double(QString::number(values[size_t(i) % values.size()], 'g', 17).size());
+        }
+    });
+    suite.run("core/format_number/qstring", [&](qint64 iterations) {
+        for (qint64 i = 0; i < iterations; ++i) {
+            sink = double(NumberFormat::toString(values[size_t(i) % values.size()]).size());
+        }
+    });
+    suite.run("core/format_number/utf16_buffer", [&](qint64 iterations) {
+        char16_t buffer[NumberFormat::MaxLength];
+        for (qint64 i = 0; i < iterations; ++i) {
+            sink = double(NumberFormat::format(values[size_t(i) % values.size()], buffer));
+        }
+    });
+    suite.run("core/format_number/utf8_buffer", [&](qint64 iterations) {
+        char buffer[NumberFormat::MaxLength];
+        for (qint64 i = 0; i < iterations; ++i) {
+            sink = double(NumberFormat::format(values[size_t(i) % values.size()], buffer));
+        }
+    });
+
+    suite.run("core/parse_number/qt", [&](qint64 iterations) {
+        for (qint64 i = 0; i < iterations; ++i) {
+            sink = texts[qsizetype(i % texts.size())].toDouble();
+        }
+    });
+    suite.run("core/parse_number/utf16", [&](qint64 iterations) {
+        for (qint64 i = 0; i < iterations; ++i) {
+            double value = 0;
+            NumberFormat::parse(texts[qsizetype(i % texts.size())], &value);
+            sink = value;
+        }
+    });
+}
+
+// Formulas built into the binary with ConstexprExpression. Between them they use every
+// operator spelling, both meanings of '%', the built-in constants and each evaluation error.
+constexpr char BenchFormula[] = "x^2 + 2*3*x - y/4 + (1+1)*y^3 + x*1 + 0 + 2*x*y*3 - (10/5)^2";
+constexpr char GuardedFormula[] = "x / (y - 1) + √y - sqrt(x % y)";
+constexpr char DisplayFormula[] = "−x × (1 − y%) ÷ 3 + 2x3 - 2 x^y 3 + 50%-5";
+constexpr char ConstantFormula[] = "pi * x^2 + e^-y + 1.5e-3 - .25 * -(-y)";
+static constexpr auto BenchProgram = ConstexprExpression::compile(BenchFormula);
+static constexpr auto GuardedProgram = ConstexprExpression::compile(GuardedFormula);
+static constexpr auto DisplayProgram = ConstexprExpression::compile(DisplayFormula);
+static constexpr auto ConstantProgram = ConstexprExpression::compile(ConstantFormula);
+
+// Whether Formula<P>, and P interpreted, give exactly what the runtime engine gives for
+// text: the same bits, or the same error at the same position.
+template <const auto &P>
+bool matchesRuntimeEngine(const char *text)
+{
+    const SymbolTable symbols;
+    CalcError error;
+    const CompiledExpression program =
+        ExpressionCompiler().compile(text, &error, ExpressionCompiler::CollectVariables, &symbols);
+    if (error.isError() || program.variables().size() != P.variableCount) {
+        std::fprintf(stderr, "calc_bench: %s does not compile the same way\n", text);
+        return false;
+    }
+    const double samples[] = { 0.0, 1.0, -1.0, 2.0, 0.1, -7.25, 1e-300, 3e300, INFINITY, NAN };
+    for (const double x : samples) {
+        for (const double y : samples) {
+            const double values[2] = { x, y };
+            CalcError expectedError;
+            const double expected = program.evaluate(values, &expectedError);
+            const CalcResult results[] = { ConstexprExpression::Formula<P>::evaluate(values), P.evaluate(values) };
+            for (const CalcResult &result : results) {
+                const bool same = result.error.code == expectedError.code
+                                  && (!expectedError.isError() || result.error.position == expectedError.position)
+                                  && (std::memcmp(&result.value, &expected, sizeof(double)) == 0
+                                      || (std::isnan(result.value) && std::isnan(expected)));
+                if (!same) {
+                    std::fprintf(stderr, "calc_bench: %s differs from the runtime engine at x=%g y=%g\n", text, x, y);
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+// The benchmark formula inlined by ConstexprExpression::Formula and interpreted from the
+// same constexpr program, to compare with "core/evaluate_formula/compiled". Returns false
+// if the compile-time engine disagrees with the runtime one.
+bool benchmarkConstexprFormula(Suite &suite)
+{
+    const bool agrees = matchesRuntimeEngine<BenchProgram>(BenchFormula)
+                        && matchesRuntimeEngine<GuardedProgram>(GuardedFormula)
+                        && matchesRuntimeEngine<DisplayProgram>(DisplayFormula)
+                        && matchesRuntimeEngine<ConstantProgram>(ConstantFormula);
+
+    suite.run("core/evaluate_formula/constexpr", [&](qint64 iterations) {
+        double values[2] = { 1.5, -2.25 };
+        for (qint64 i = 0; i < iterations; ++i) {
+            values[0] += 1e-9;
+            sink = ConstexprExpression::Formula<BenchProgram>::evaluate(values).value;
+        }
+    });
+    suite.run("core/evaluate_formula/constexpr_interpreted", [&](qint64 iterations) {
+        double values[2] = { 1.5, -2.25 };
+        for (qint64 i = 0; i < iterations; ++i) {
+            values[0] += 1e-9;
+            sink = BenchProgram.evaluate(values).value;
+        }
+    });
+    return agrees;
+}
+
+// Fills store with rows distinct-looking entries; results are what calculate() returns.
+void addGeneratedHistory(HistoryStore &store, CalculatorCore &core, qint64 rows)
+{
+    std::mt19937_64 random(rows);
+    for (qint64 i = 0; i < rows; ++i) {
+        const QString expression = generatedExpression(random, 2);
+        store.addHistoryEntry(expression, NumberFormat::toString(core.calculate(expression).value));
+    }
+    store.flushHistory();
+}
+
+// The same workloads for either history backend: "db/..." for the SQLite database,
+// "col/..." for the columnar file.
+void benchmarkHistory(Suite &suite, const Options &options, HistoryBackend backend)
+{
+    QTemporaryDir directory;
+    if (!directory.isValid()) {
+        std::fprintf(stderr, "calc_bench: cannot create a temporary directory\n");
+        return;
+    }
+
+    const bool columnar = backend == HistoryBackend::Columnar;
+    const QString db = columnar ? "col/" : "db/";
+    const QString ui = columnar ? "ui/columnar_history_panel/" : "ui/history_panel/";
+    CalculatorCore core;
+    std::unique_ptr<HistoryStore> store;
+    int databaseIndex = 0;
+    // A new, empty history file each time, so repetitions do not see each other's rows.
+    const auto openEmpty = [&] {
+        store.reset();
+        const QString path = directory.filePath(QString("history%1").arg(databaseIndex++) + (columnar ? ".col" : ".db"));
+        if (columnar) {
+            auto columnarStore = std::make_unique<ColumnarHistoryStore>();
+            columnarStore->open(path);
+            store = std::move(columnarStore);
+        } else {
+            auto database = std::make_unique<DatabaseManager>();
+            database->openDatabase(path);
+            store = std::move(database);
+        }
+    };
+
+    for (const qint64 rows : { qint64(1000), qint64(100000), qint64(1000000) }) {
+        if (rows > options.maxRows) {
+            break;
+        }
+        const QString size = QString::number(rows);
+        const QStringList names = { db + "insert/", db + "fetch_page/newest/", db + "fetch_page/middle/",
+                                    db + "count/", db + "search/", ui + "populate/", ui + "scroll/",
+                                    db + "export/", db + "import/" };
+        if (std::none_of(names.begin(), names.end(), [&](const QString &name) { return suite.selected(name + size); })) {
+            continue; // Not worth filling a database nothing will read
+        }
+
+        suite.runOnce(db + "insert/" + size, rows, openEmpty, [&] { addGeneratedHistory(*store, core, rows); });
+        if (!suite.selected(db + "insert/" + size)) {
+            openEmpty();
+            addGeneratedHistory(*store, core, rows);
+        }
+
+        suite.run(db + "fetch_page/newest/" + size, [&](qint64 iterations) {
+            for (qint64 i = 0; i < iterations; ++i) {
+                sink = double(store->fetchHistoryPage().size());
+            }
+        });
+        suite.run(db + "fetch_page/middle/" + size, [&](qint64 iterations) {
+            for (qint64 i = 0; i < iterations; ++i) {
+                sink = double(store->fetchHistoryPage(rows / 2).size());
+            }
+        });
+        suite.run(db + "count/" + size, [&](qint64 iterations) {
+            for (qint64 i = 0; i < iterations; ++i) {
+                sink = double(store->historyCount());
+            }
+        });
+
+        // Round trip through the searcher thread, as the search box sees it.
+        const HistorySearch search = HistorySearch::parse("12 >100");
+        suite.run(db + "search/" + size, [&](qint64 iterations) {
+            for (qint64 i = 0; i < iterations; ++i) {
+                QEventLoop loop;
+                quint64 generation = 0;
+                const QMetaObject::Connection connection = QObject::connect(
+                    store.get(), &HistoryStore::historySearchFinished, &loop,
+                    [&](quint64 finished, const QList<HistoryEntry> &page) {
+                        if (finished == generation) {
+                            sink = double(page.size());
+                            loop.quit();
+                        }
+                    });
+                generation = store->searchHistory(search);
+                if (generation != 0) {
+                    loop.exec();
+                }
+                QObject::disconnect(connection);
+            }
+        });
+
+        // From an empty panel to the first screen of history painted.
+        suite.run(ui + "populate/" + size, [&](qint64 iterations) {
+            for (qint64 i = 0; i < iterations; ++i) {
+                HistoryPanel panel(store.get());
+                panel.resize(300, 500);
+                panel.reloadHistory();
+                sink = double(panel.grab().width());
+            }
+        });
+
+        // Scrolling to the end of the list ten times, which pages in ten more pages.
+        suite.run(ui + "scroll/" + size, [&](qint64 iterations) {
+            for (qint64 i = 0; i < iterations; ++i) {
+                HistoryPanel panel(store.get());
+                panel.resize(300, 500);
+                panel.show();
+                panel.reloadHistory();
+                QListView *view = panel.findChild<QListView *>();
+                for (int page = 0; page < 10; ++page) {
+                    view->scrollToBottom();
+                    QCoreApplication::processEvents();
+                }
+                sink = double(view->model()->rowCount());
+            }
+        });
+
+        // Round trip through a CSV file; the import goes into an empty history and so
+        // measures the bulk-load path.
+        const QString exportPath = directory.filePath("history" + size + ".csv");
+        const auto exportHistory = [&] { store->exportHistory(exportPath, HistoryExchange::Format::Csv); };
+        suite.runOnce(db + "export/" + size, rows, [] {}, exportHistory);
+        if (suite.selected(db + "import/" + size)) {
+            if (!suite.selected(db + "export/" + size)) {
+                exportHistory();
+            }
+            suite.runOnce(db + "import/" + size, rows, openEmpty,
+                          [&] { store->importHistory(exportPath, HistoryExchange::Format::Csv); });
+        }
+    }
+}
+
+bool parseArguments(const QStringList &arguments, Options *options, QString *error)
+{
+    for (int i = 1; i < arguments.size(); ++i) {
+        const QString &argument = arguments[i];
+        if (i + 1 >= arguments.size()) {
+            *error = "missing value for " + argument;
+            return false;
+        }
+        const QString value = arguments[++i];
+        bool ok = true;
+        if (argument == "--filter") {
+            options->filter = value;
+        } else if (argument == "--max-rows") {
+            options->maxRows = value.toLongLong(&ok);
+        } else if (argument == "--repetitions") {
+            options->repetitions = value.toInt(&ok);
+            ok = ok && options->repetitions > 0;
+        } else if (argument == "--output") {
+            options->outputPath = value;
+        } else {
+            *error = "unknown option " + argument;
+            return false;
+        }
+        if (!ok) {
+            *error = "invalid value for " + argument + ": " + value;
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    // The panel is rendered off screen, so the suite also runs on machines without a display.
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    QApplication application(argc, argv);
+
+    Options options;
+    QString error;
+    if (!parseArguments(QCoreApplication::arguments(), &options, &error)) {
+        std::fprintf(stderr, "calc_bench: %s\nusage: calc_bench [--filter TEXT] [--max-rows N] "
+                             "[--repetitions N] [--output FILE]\n", qPrintable(error));
+        return 2;
+    }
+
+    Suite suite(options);
+    benchmarkCore(suite);
+    benchmarkNumbers(suite);
+    const bool constexprAgrees = benchmarkConstexprFormula(suite);
+    benchmarkHistory(suite, options, HistoryBackend::Sqlite);
+    benchmarkHistory(suite, options, HistoryBackend::Columnar);
+
+    const QByteArray json = suite.report().toJson();
+    if (options.outputPath.isEmpty()) {
+        std::fwrite(json.constData(), 1, size_t(json.size()), stdout);
+        return constexprAgrees ? 0 : 1;
+    }
+    QFile output(options.outputPath);
+    if (!output.open(QIODevice::WriteOnly | QIODevice::Truncate) || output.write(json) != json.size()) {
+        std::fprintf(stderr, "calc_bench: cannot write %s\n", qPrintable(options.outputPath));
+        return 2;
+    }
+    return constexprAgrees ? 0 : 1;
+}
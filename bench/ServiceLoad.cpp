@@ -0,0 +1,352 @@
+// calc_service_load: drives a running `CalcPlusPlus --serve` and reports its throughput and
+// latency as JSON.
+//
+//   calc_service_load --socket PATH [--connections N] [--pipeline N] [--batch N]
+//                     [--frames N] [--precision N] [--output FILE]
+//
+// Every connection keeps --pipeline frames of --batch expressions unanswered until --frames
+// frames have been answered in total. The latency of a frame runs from the moment it was
+// handed to the socket to the moment its whole response was read, so it includes the time
+// it waited behind earlier frames. Expressions come from a fixed seed, so every run sends
+// the same ones.
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <random>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+#include "ServiceProtocol.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Options
+{
+    std::string socketPath;
+    int connections = 4;
+    int pipeline = 16;      // Frames each connection keeps unanswered
+    int batch = 8;          // Expressions per frame
+    long long frames = 200000;
+    int precision = 0;      // 0 evaluates doubles, as in the protocol
+    std::string outputPath; // Standard output when empty
+};
+
+struct Connection
+{
+    int fd = -1;
+    std::string output;
+    size_t outputStart = 0;
+    std::string input;
+    std::unordered_map<std::uint32_t, Clock::time_point> sentAt; // By request id
+    std::uint32_t nextId = 1;
+};
+
+constexpr size_t ReadChunk = 64 << 10;
+
+// A mix of the shapes the calculator sees: precedence, parentheses, square roots, powers
+// and percentages, with operands drawn from the seeded generator.
+std::vector<std::string> makeExpressions()
+{
+    std::mt19937 random(20240611);
+    std::uniform_int_distribution<int> operand(1, 999);
+    std::uniform_int_distribution<int> shape(0, 4);
+    std::vector<std::string> expressions;
+    for (int i = 0; i < 1024; ++i) {
+        const std::string a = std::to_string(operand(random));
+        const std::string b = std::to_string(operand(random));
+        const std::string c = std::to_string(operand(random));
+        switch (shape(random)) {
+        case 0: expressions.push_back(a + "+" + b + "*" + c); break;
+        case 1: expressions.push_back("(" + a + "-" + b + ")/" + c); break;
+        case 2: expressions.push_back("\u221A" + a + "+" + b); break;
+        case 3: expressions.push_back(a + "^3-" + b + "^2"); break;
+        default: expressions.push_back(a + "*" + b + "%-" + c); break;
+        }
+    }
+    return expressions;
+}
+
+bool parseCount(const char *text, long long minimum, long long *value)
+{
+    char *end = nullptr;
+    errno = 0;
+    const long long parsed = std::strtoll(text, &end, 10);
+    if (errno != 0 || end == text || *end != '\0' || parsed < minimum) {
+        return false;
+    }
+    *value = parsed;
+    return true;
+}
+
+bool parseArguments(int argc, char *argv[], Options *options, std::string *error)
+{
+    for (int i = 1; i < argc; ++i) {
+        const std::string flag = argv[i];
+        if (i + 1 >= argc) {
+            *error = flag + " needs a value";
+            return false;
+        }
+        const char *value = argv[++i];
+        long long number = 0;
+        const auto count = [&](long long minimum, long long maximum) {
+            if (!parseCount(value, minimum, &number) || number > maximum) {
+                *error = "invalid value for " + flag + ": " + value;
+                return false;
+            }
+            return true;
+        };
+        if (flag == "--socket") {
+            options->socketPath = value;
+        } else if (flag == "--output") {
+            options->outputPath = value;
+        } else if (flag == "--connections") {
+            if (!count(1, 1024)) return false;
+            options->connections = int(number);
+        } else if (flag == "--pipeline") {
+            if (!count(1, 65536)) return false;
+            options->pipeline = int(number);
+        } else if (flag == "--batch") {
+            if (!count(1, 65536)) return false;
+            options->batch = int(number);
+        } else if (flag == "--frames") {
+            if (!count(1, 1LL << 40)) return false;
+            options->frames = number;
+        } else if (flag == "--precision") {
+            if (!count(0, 1000)) return false;
+            options->precision = int(number);
+        } else {
+            *error = "unknown option " + flag;
+            return false;
+        }
+    }
+    if (options->socketPath.empty()) {
+        *error = "--socket is required";
+        return false;
+    }
+    if (options->socketPath.size() >= sizeof(sockaddr_un().sun_path)) {
+        *error = "socket path is too long";
+        return false;
+    }
+    return true;
+}
+
+int connectTo(const std::string &path)
+{
+    const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    if (connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0
+        || fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+double percentile(const std::vector<double> &sorted, double fraction)
+{
+    // Nearest rank, so every reported value is a latency that was observed.
+    const size_t rank = size_t(fraction * double(sorted.size()));
+    return sorted[std::min(rank, sorted.size() - 1)];
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    Options options;
+    std::string error;
+    if (!parseArguments(argc, argv, &options, &error)) {
+        std::fprintf(stderr, "calc_service_load: %s\nusage: calc_service_load --socket PATH [--connections N] "
+                             "[--pipeline N] [--batch N] [--frames N] [--precision N] [--output FILE]\n",
+                     error.c_str());
+        return 2;
+    }
+
+    const std::vector<std::string> expressions = makeExpressions();
+    std::vector<Connection> connections(size_t(options.connections));
+    for (Connection &connection : connections) {
+        connection.fd = connectTo(options.socketPath);
+        if (connection.fd < 0) {
+            std::fprintf(stderr, "calc_service_load: cannot connect to %s: %s\n", options.socketPath.c_str(),
+                         std::strerror(errno));
+            return 1;
+        }
+    }
+
+    std::vector<double> latencies;
+    latencies.reserve(size_t(options.frames));
+    long long sent = 0;
+    long long failedFrames = 0;
+    long long failedExpressions = 0;
+    size_t nextExpression = 0;
+    std::vector<pollfd> polled(connections.size());
+    std::vector<char> chunk(ReadChunk);
+    const Clock::time_point start = Clock::now();
+
+    while (static_cast<long long>(latencies.size()) < options.frames) {
+        for (size_t i = 0; i < connections.size(); ++i) {
+            Connection &connection = connections[i];
+            while (sent < options.frames && connection.sentAt.size() < size_t(options.pipeline)) {
+                const std::uint32_t id = connection.nextId++;
+                ServiceProtocol::FrameWriter frame(connection.output, id,
+                                                   std::uint8_t(ServiceProtocol::RequestType::Evaluate));
+                frame.putU32(std::uint32_t(options.precision));
+                frame.putU32(std::uint32_t(options.batch));
+                for (int e = 0; e < options.batch; ++e) {
+                    frame.putText(expressions[nextExpression++ % expressions.size()]);
+                }
+                frame.finish();
+                connection.sentAt.emplace(id, Clock::now());
+                ++sent;
+            }
+            const bool unsent = connection.outputStart < connection.output.size();
+            polled[i] = { connection.fd, short(POLLIN | (unsent ? POLLOUT : 0)), 0 };
+        }
+
+        if (poll(polled.data(), polled.size(), -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            std::perror("calc_service_load: poll");
+            return 1;
+        }
+
+        for (size_t i = 0; i < connections.size(); ++i) {
+            Connection &connection = connections[i];
+            if (polled[i].revents & POLLOUT) {
+                const ssize_t written = send(connection.fd, connection.output.data() + connection.outputStart,
+                                             connection.output.size() - connection.outputStart, MSG_NOSIGNAL);
+                if (written > 0) {
+                    connection.outputStart += size_t(written);
+                    if (connection.outputStart == connection.output.size()) {
+                        connection.output.clear();
+                        connection.outputStart = 0;
+                    }
+                } else if (written < 0 && errno != EAGAIN && errno != EINTR) {
+                    std::perror("calc_service_load: send");
+                    return 1;
+                }
+            }
+            if (!(polled[i].revents & (POLLIN | POLLHUP | POLLERR))) {
+                continue;
+            }
+            const ssize_t received = recv(connection.fd, chunk.data(), chunk.size(), 0);
+            if (received == 0 || (received < 0 && errno != EAGAIN && errno != EINTR)) {
+                std::fprintf(stderr, "calc_service_load: the service closed a connection\n");
+                return 1;
+            }
+            if (received < 0) {
+                continue;
+            }
+            connection.input.append(chunk.data(), size_t(received));
+
+            const Clock::time_point now = Clock::now();
+            size_t consumed = 0;
+            size_t frameBytes = 0;
+            ServiceProtocol::FrameState state;
+            while ((state = ServiceProtocol::peekFrame(std::string_view(connection.input).substr(consumed), &frameBytes))
+                   == ServiceProtocol::FrameState::Complete) {
+                ServiceProtocol::FrameReader response(
+                    std::string_view(connection.input).substr(consumed + ServiceProtocol::LengthBytes,
+                                                              frameBytes - ServiceProtocol::LengthBytes));
+                consumed += frameBytes;
+                std::uint32_t id = 0;
+                std::uint8_t status = 0;
+                std::uint32_t count = 0;
+                const auto sentAt = response.getU32(&id) ? connection.sentAt.find(id) : connection.sentAt.end();
+                if (sentAt == connection.sentAt.end() || !response.getU8(&status) || !response.getU32(&count)) {
+                    std::fprintf(stderr, "calc_service_load: unexpected response\n");
+                    return 1;
+                }
+                latencies.push_back(std::chrono::duration<double, std::nano>(now - sentAt->second).count());
+                connection.sentAt.erase(sentAt);
+                if (status != std::uint8_t(ServiceProtocol::Status::Ok)) {
+                    ++failedFrames;
+                    continue;
+                }
+                // Only errors are counted; the values themselves are not checked.
+                for (std::uint32_t r = 0; r < count; ++r) {
+                    std::uint8_t kind = 0;
+                    double number;
+                    std::string_view text;
+                    std::uint32_t position;
+                    std::uint8_t code;
+                    response.getU8(&kind);
+                    if (kind == std::uint8_t(ServiceProtocol::ResultKind::Number)) {
+                        response.getF64(&number);
+                    } else if (kind == std::uint8_t(ServiceProtocol::ResultKind::Text)) {
+                        response.getText(&text);
+                    } else {
+                        response.getU8(&code);
+                        response.getU32(&position);
+                        ++failedExpressions;
+                    }
+                }
+            }
+            if (state == ServiceProtocol::FrameState::Oversized) {
+                std::fprintf(stderr, "calc_service_load: oversized response\n");
+                return 1;
+            }
+            connection.input.erase(0, consumed);
+        }
+    }
+
+    const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    for (const Connection &connection : connections) {
+        close(connection.fd);
+    }
+    std::sort(latencies.begin(), latencies.end());
+
+    char json[2048];
+    const int length = std::snprintf(
+        json, sizeof(json),
+        "{\n"
+        "    \"context\": {\n"
+        "        \"connections\": %d,\n"
+        "        \"pipeline\": %d,\n"
+        "        \"batch\": %d,\n"
+        "        \"frames\": %lld,\n"
+        "        \"precision\": %d\n"
+        "    },\n"
+        "    \"seconds\": %.3f,\n"
+        "    \"frames_per_second\": %.1f,\n"
+        "    \"expressions_per_second\": %.1f,\n"
+        "    \"failed_frames\": %lld,\n"
+        "    \"failed_expressions\": %lld,\n"
+        "    \"latency\": {\n"
+        "        \"time_unit\": \"ns\",\n"
+        "        \"p50\": %.0f,\n"
+        "        \"p90\": %.0f,\n"
+        "        \"p99\": %.0f,\n"
+        "        \"p999\": %.0f,\n"
+        "        \"max\": %.0f\n"
+        "    }\n"
+        "}\n",
+        options.connections, options.pipeline, options.batch, options.frames, options.precision, seconds,
+        double(options.frames) / seconds, double(options.frames) * options.batch / seconds, failedFrames,
+        failedExpressions, percentile(latencies, 0.50), percentile(latencies, 0.90), percentile(latencies, 0.99),
+        percentile(latencies, 0.999), latencies.back());
+
+    FILE *output = options.outputPath.empty() ? stdout : std::fopen(options.outputPath.c_str(), "w");
+    if (!output || std::fwrite(json, 1, size_t(length), output) != size_t(length)
+        || (output != stdout && std::fclose(output) != 0)) {
+        std::fprintf(stderr, "calc_service_load: cannot write %s\n", options.outputPath.c_str());
+        return 2;
+    }
+    return 0;
+}
@@ -0,0 +1,147 @@
+#include "BatchRunner.h"
+#include "LineEvaluator.h"
+#include "LineReader.h"
+#include "OutputBuffer.h"
+#include "ParallelBatchEvaluator.h"
+#include "../core/SymbolDatabase.h"
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <unistd.h>
+
+bool BatchRunner::parseArguments(int argc, char *argv[], Options *options, std::string *error)
+{
+    bool batch = false;
+    const char *batchOnlyOption = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--batch") == 0) {
+            batch = true;
+            if (i + 1 >= argc) {
+                *error = "--batch expects a file name or '-' for standard input";
+                return true;
+            }
+            options->inputPath = argv[++i];
+        } else if (std::strcmp(argv[i], "--threads") == 0) {
+            batchOnlyOption = "--threads";
+            if (i + 1 >= argc) {
+                *error = "--threads expects a number";
+                return true;
+            }
+            const char *value = argv[++i];
+            const char *end = value + std::strlen(value);
+            const std::from_chars_result parsed = std::from_chars(value, end, options->threads);
+            if (parsed.ec != std::errc() || parsed.ptr != end || options->threads < 0) {
+                *error = std::string("invalid thread count '") + value + "'";
+                return true;
+            }
+        } else if (std::strcmp(argv[i], "--precision") == 0) {
+            batchOnlyOption = "--precision";
+            if (i + 1 >= argc) {
+                *error = "--precision expects a number of significant digits";
+                return true;
+            }
+            const char *value = argv[++i];
+            const char *end = value + std::strlen(value);
+            const std::from_chars_result parsed = std::from_chars(value, end, options->precision);
+            if (parsed.ec != std::errc() || parsed.ptr != end || options->precision < 1
+                || options->precision > DecimalContext::MaxPrecision) {
+                *error = std::string("invalid precision '") + value + "' (expected 1 to "
+                         + std::to_string(DecimalContext::MaxPrecision) + ")";
+                return true;
+            }
+        } else if (std::strcmp(argv[i], "--dump-ir") == 0) {
+            batchOnlyOption = "--dump-ir";
+            options->dumpIr = true;
+        } else if (std::strcmp(argv[i], "--definitions") == 0) {
+            batchOnlyOption = "--definitions";
+            if (i + 1 >= argc) {
+                *error = "--definitions expects a database file name";
+                return true;
+            }
+            options->definitionsPath = argv[++i];
+        }
+    }
+    if (batchOnlyOption && !batch) {
+        const bool sharedWithService = std::strcmp(batchOnlyOption, "--threads") == 0
+                                       || std::strcmp(batchOnlyOption, "--definitions") == 0;
+        *error = std::string(batchOnlyOption) + " is only valid together with --batch"
+                 + (sharedWithService ? " or --serve" : "");
+        return true;
+    }
+    // The listed programs are the ones double evaluation runs; decimal mode has none.
+    if (batch && options->dumpIr && options->precision > 0) {
+        *error = "--precision is not valid together with --dump-ir";
+        return true;
+    }
+    return batch;
+}
+
+BatchRunner::BatchRunner(const Options &options)
+    : m_options(options)
+{
+    if (m_options.threads == 0) {
+        m_options.threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    }
+}
+
+int BatchRunner::run()
+{
+    LineReader reader;
+    if (!reader.open(m_options.inputPath.c_str())) {
+        std::fprintf(stderr, "CalcPlusPlus: %s\n", reader.errorString().c_str());
+        return UsageOrIoError;
+    }
+
+    // Definitions of earlier runs are made again before the store is attached, so they
+    // are not written back.
+    SymbolDatabase symbols;
+    SymbolStore *store = nullptr;
+    std::string definitions;
+    if (!m_options.definitionsPath.empty()) {
+        std::string error;
+        if (!symbols.open(m_options.definitionsPath, &error)) {
+            std::fprintf(stderr, "CalcPlusPlus: cannot open definitions in '%s': %s\n",
+                         m_options.definitionsPath.c_str(), error.c_str());
+            return UsageOrIoError;
+        }
+        for (const std::string &definition : symbols.definitions()) {
+            definitions.append(definition).append(1, '\n');
+        }
+        store = &symbols;
+    }
+
+    // An interactive terminal should see each result as soon as its line is entered.
+    const bool flushEachLine = isatty(STDOUT_FILENO);
+    OutputBuffer out(STDOUT_FILENO);
+
+    size_t failures = 0;
+    if (m_options.threads > 1 && !m_options.dumpIr) {
+        ParallelBatchEvaluator pipeline(m_options.threads, m_options.precision);
+        pipeline.restoreDefinitions(definitions, store);
+        failures = pipeline.run(reader, out, flushEachLine);
+    } else {
+        LineEvaluator evaluator(m_options.precision);
+        evaluator.applyDefinitions(definitions);
+        evaluator.setSymbolStore(store);
+        std::string_view line;
+        while (reader.next(&line)) {
+            const bool ok = m_options.dumpIr ? evaluator.dumpLine(line, out) : evaluator.evaluateLine(line, out);
+            if (!ok) ++failures;
+            if (flushEachLine) out.flush();
+            if (out.hasError()) break;
+        }
+    }
+
+    if (!out.flush()) {
+        std::fprintf(stderr, "CalcPlusPlus: failed to write results: %s\n", std::strerror(errno));
+        return UsageOrIoError;
+    }
+    if (reader.hasError()) {
+        std::fprintf(stderr, "CalcPlusPlus: %s\n", reader.errorString().c_str());
+        return UsageOrIoError;
+    }
+    return failures == 0 ? Success : ExpressionFailed;
+}
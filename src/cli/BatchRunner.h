@@ -0,0 +1,45 @@
+#ifndef BATCHRUNNER_H
+#define BATCHRUNNER_H
+
+#include <string>
+
+// Headless mode: `CalcPlusPlus --batch <file|-> [--threads N] [--precision N]
+// [--definitions <database>]` evaluates one expression per input line and prints one
+// result per output line, in the same order. Blank lines are echoed as blank lines and
+// failures are printed as "Error: ..." so output stays line-aligned with the input.
+// Definitions such as "rate = 0.07" or "f(x) = x^2 + 1" apply to the lines that follow
+// them; with --definitions they are also kept in that history database and made again
+// at the start of the next run, as in the calculator window. --dump-ir prints each
+// line's program, compiled against those definitions, instead of its result. No
+// QApplication or widget is ever created on this path.
+class BatchRunner
+{
+public:
+    enum ExitCode {
+        Success = 0,
+        ExpressionFailed = 1, // At least one line did not evaluate
+        UsageOrIoError = 2
+    };
+
+    struct Options
+    {
+        std::string inputPath; // "-" reads standard input
+        int threads = 1;       // 0 picks one thread per hardware core
+        int precision = 0;     // Significant digits in decimal mode; 0 evaluates doubles
+        bool dumpIr = false;   // List compiled programs instead of results
+        std::string definitionsPath; // History database keeping definitions; empty for none
+    };
+
+    // Returns true when the command line asks for batch mode. If the arguments are
+    // malformed, *error describes the problem and the caller should exit.
+    static bool parseArguments(int argc, char *argv[], Options *options, std::string *error);
+
+    explicit BatchRunner(const Options &options);
+
+    int run();
+
+private:
+    Options m_options;
+};
+
+#endif // BATCHRUNNER_H
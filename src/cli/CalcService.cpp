@@ -0,0 +1,575 @@
+#include "CalcService.h"
+#include "ServiceProtocol.h"
+#include "../core/LatencyStats.h"
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace
+{
+    // epoll tokens below FirstConnection stand for the service's own descriptors.
+    constexpr std::uint64_t ListenerToken = 0;
+    constexpr std::uint64_t WakeUpToken = 1;
+    constexpr std::uint64_t SignalToken = 2;
+    constexpr std::uint64_t FirstConnection = 3;
+
+    constexpr int MaxEvents = 64;
+
+    void putError(ServiceProtocol::FrameWriter &writer, const CalcError &error)
+    {
+        writer.putU8(static_cast<std::uint8_t>(ServiceProtocol::ResultKind::Error));
+        writer.putU8(static_cast<std::uint8_t>(error.code));
+        writer.putU32(static_cast<std::uint32_t>(error.position));
+    }
+
+    bool setEvents(int epoll, int fd, std::uint64_t token, std::uint32_t events, int operation)
+    {
+        epoll_event event = {};
+        event.events = events;
+        event.data.u64 = token;
+        return epoll_ctl(epoll, operation, fd, &event) == 0;
+    }
+}
+
+bool CalcService::parseArguments(int argc, char *argv[], Options *options, std::string *error)
+{
+    bool serve = false;
+    const char *conflictingOption = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--serve") == 0) {
+            serve = true;
+            if (i + 1 >= argc) {
+                *error = "--serve expects a socket path";
+                return true;
+            }
+            options->socketPath = argv[++i];
+        } else if (std::strcmp(argv[i], "--threads") == 0) {
+            if (i + 1 >= argc) {
+                *error = "--threads expects a number";
+                return true;
+            }
+            const char *value = argv[++i];
+            const char *end = value + std::strlen(value);
+            const std::from_chars_result parsed = std::from_chars(value, end, options->threads);
+            if (parsed.ec != std::errc() || parsed.ptr != end || options->threads < 0) {
+                *error = std::string("invalid thread count '") + value + "'";
+                return true;
+            }
+        } else if (std::strcmp(argv[i], "--definitions") == 0) {
+            if (i + 1 >= argc) {
+                *error = "--definitions expects a database file name";
+                return true;
+            }
+            options->definitionsPath = argv[++i];
+        } else if (std::strcmp(argv[i], "--batch") == 0 || std::strcmp(argv[i], "--precision") == 0
+                   || std::strcmp(argv[i], "--dump-ir") == 0) {
+            conflictingOption = argv[i];
+        }
+    }
+    if (serve && conflictingOption) {
+        // Clients choose the precision per request.
+        *error = std::string(conflictingOption) + " is not valid together with --serve";
+        return true;
+    }
+    if (serve && options->socketPath.size() >= sizeof(sockaddr_un::sun_path)) {
+        *error = "socket path '" + options->socketPath + "' is too long";
+        return true;
+    }
+    return serve;
+}
+
+CalcService::CalcService(const Options &options)
+    : m_options(options),
+      m_nextConnection(FirstConnection)
+{
+    if (m_options.threads == 0) {
+        m_options.threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    }
+}
+
+CalcService::~CalcService()
+{
+    stopWorkers();
+    for (const auto &entry : m_connections) {
+        close(entry.second->fd);
+    }
+    for (const int fd : { m_listener, m_wakeUp, m_signals, m_epoll }) {
+        if (fd >= 0) close(fd);
+    }
+    if (m_boundSocket) {
+        unlink(m_options.socketPath.c_str());
+    }
+}
+
+int CalcService::run()
+{
+    // The signals are taken through a descriptor, so they must not reach a handler on any
+    // thread; the workers inherit the mask. It stays in place after run() returns, so a
+    // second Ctrl+C cannot end the process before the socket file is removed.
+    sigset_t stopSignals;
+    sigemptyset(&stopSignals);
+    sigaddset(&stopSignals, SIGINT);
+    sigaddset(&stopSignals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stopSignals, nullptr);
+
+    std::string error;
+    // Definitions of earlier runs are logged before any worker starts, so every core
+    // makes them first. Only those made from now on are written back.
+    if (!m_options.definitionsPath.empty()) {
+        if (!m_symbols.open(m_options.definitionsPath, &error)) {
+            std::fprintf(stderr, "CalcPlusPlus: cannot open definitions in '%s': %s\n",
+                         m_options.definitionsPath.c_str(), error.c_str());
+            return ServiceFailed;
+        }
+        m_definitions = m_symbols.definitions();
+        m_definitionCount.store(m_definitions.size(), std::memory_order_release);
+    }
+
+    m_epoll = epoll_create1(EPOLL_CLOEXEC);
+    m_wakeUp = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    m_signals = signalfd(-1, &stopSignals, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (m_epoll < 0 || m_wakeUp < 0 || m_signals < 0) {
+        error = std::strerror(errno);
+    } else if (listen(&error)
+               && !(setEvents(m_epoll, m_listener, ListenerToken, EPOLLIN, EPOLL_CTL_ADD)
+                    && setEvents(m_epoll, m_wakeUp, WakeUpToken, EPOLLIN, EPOLL_CTL_ADD)
+                    && setEvents(m_epoll, m_signals, SignalToken, EPOLLIN, EPOLL_CTL_ADD))) {
+        error = std::strerror(errno);
+    }
+    if (!error.empty()) {
+        std::fprintf(stderr, "CalcPlusPlus: cannot serve on '%s': %s\n", m_options.socketPath.c_str(), error.c_str());
+        return ServiceFailed;
+    }
+
+    for (int i = 0; i < m_options.threads; ++i) {
+        m_workers.push_back(std::make_unique<Worker>());
+    }
+    for (const auto &worker : m_workers) {
+        worker->thread = std::thread(&CalcService::workerLoop, this, std::ref(*worker));
+    }
+    std::fprintf(stderr, "CalcPlusPlus: serving on '%s' with %d threads\n", m_options.socketPath.c_str(),
+                 m_options.threads);
+
+    epoll_event events[MaxEvents];
+    bool stopping = false;
+    while (!stopping) {
+        const int count = epoll_wait(m_epoll, events, MaxEvents, -1);
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            std::fprintf(stderr, "CalcPlusPlus: epoll_wait failed: %s\n", std::strerror(errno));
+            break;
+        }
+        for (int i = 0; i < count; ++i) {
+            const std::uint64_t token = events[i].data.u64;
+            if (token == ListenerToken) {
+                acceptConnections();
+            } else if (token == WakeUpToken) {
+                collectCompletions();
+            } else if (token == SignalToken) {
+                signalfd_siginfo signal;
+                stopping = read(m_signals, &signal, sizeof(signal)) == sizeof(signal);
+            } else {
+                // An earlier event in this batch may have closed the connection.
+                const auto found = m_connections.find(token);
+                if (found == m_connections.end()) continue;
+                Connection &connection = *found->second;
+                if (events[i].events & (EPOLLERR | EPOLLHUP) && !(events[i].events & EPOLLIN)) {
+                    closeConnection(token);
+                    continue;
+                }
+                if (events[i].events & EPOLLIN) {
+                    readFrom(token, connection);
+                } else {
+                    pump(token, connection);
+                }
+            }
+        }
+    }
+
+    stopWorkers();
+    std::fprintf(stderr, "CalcPlusPlus: served %llu frames\n", static_cast<unsigned long long>(m_framesServed));
+    return Success;
+}
+
+bool CalcService::listen(std::string *error)
+{
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, m_options.socketPath.c_str(), m_options.socketPath.size() + 1);
+    const auto *socketAddress = reinterpret_cast<const sockaddr *>(&address);
+
+    m_listener = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (m_listener < 0) {
+        *error = std::strerror(errno);
+        return false;
+    }
+    int bound = bind(m_listener, socketAddress, sizeof(address));
+    if (bound != 0 && errno == EADDRINUSE) {
+        // A socket file left by a service that did not shut down cleanly refuses
+        // connections and can be replaced; one that accepts belongs to a running service.
+        struct stat info;
+        const int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        const bool stale = stat(address.sun_path, &info) == 0 && S_ISSOCK(info.st_mode) && probe >= 0
+                           && connect(probe, socketAddress, sizeof(address)) != 0 && errno == ECONNREFUSED;
+        if (probe >= 0) close(probe);
+        if (!stale) {
+            *error = "the path is in use";
+            return false;
+        }
+        unlink(address.sun_path);
+        bound = bind(m_listener, socketAddress, sizeof(address));
+    }
+    if (bound != 0) {
+        *error = std::strerror(errno);
+        return false;
+    }
+    m_boundSocket = true;
+    if (::listen(m_listener, SOMAXCONN) != 0) {
+        *error = std::strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+void CalcService::acceptConnections()
+{
+    for (;;) {
+        const int fd = accept4(m_listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                // Out of descriptors or memory: the pending connections wait in the backlog.
+                std::fprintf(stderr, "CalcPlusPlus: accept failed: %s\n", std::strerror(errno));
+            }
+            return;
+        }
+        const std::uint64_t id = m_nextConnection++;
+        auto connection = std::make_unique<Connection>();
+        connection->fd = fd;
+        connection->events = EPOLLIN;
+        if (!setEvents(m_epoll, fd, id, connection->events, EPOLL_CTL_ADD)) {
+            close(fd);
+            continue;
+        }
+        m_connections.emplace(id, std::move(connection));
+    }
+}
+
+void CalcService::readFrom(std::uint64_t id, Connection &connection)
+{
+    // One read per wake-up keeps a busy connection from starving the others; epoll
+    // reports the rest of its input on the next round.
+    const size_t kept = connection.input.size();
+    connection.input.resize(kept + ReadChunk);
+    ssize_t received;
+    do {
+        received = recv(connection.fd, &connection.input[kept], ReadChunk, 0);
+    } while (received < 0 && errno == EINTR);
+    connection.input.resize(kept + static_cast<size_t>(std::max<ssize_t>(received, 0)));
+
+    if (received == 0) {
+        connection.peerClosed = true; // Frames already received are still answered
+    } else if (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+        closeConnection(id);
+        return;
+    }
+    pump(id, connection);
+}
+
+bool CalcService::dispatchFrames(std::uint64_t id, Connection &connection)
+{
+    const auto received = std::chrono::steady_clock::now();
+    std::vector<Job> jobs;
+    size_t consumed = 0;
+    while (connection.inFlight + jobs.size() < MaxInFlightFrames) {
+        const std::string_view pending = std::string_view(connection.input).substr(consumed);
+        size_t frameBytes = 0;
+        const ServiceProtocol::FrameState state = ServiceProtocol::peekFrame(pending, &frameBytes);
+        if (state == ServiceProtocol::FrameState::Oversized) {
+            return false;
+        }
+        if (state == ServiceProtocol::FrameState::Incomplete) {
+            break;
+        }
+        jobs.push_back(Job{ id, std::string(pending.substr(ServiceProtocol::LengthBytes,
+                                                           frameBytes - ServiceProtocol::LengthBytes)),
+                            received });
+        consumed += frameBytes;
+    }
+    connection.input.erase(0, consumed);
+    if (jobs.empty()) {
+        return true;
+    }
+
+    connection.inFlight += jobs.size();
+    {
+        std::lock_guard<std::mutex> lock(m_jobsMutex);
+        for (Job &job : jobs) {
+            m_jobs.push_back(std::move(job));
+        }
+    }
+    if (jobs.size() == 1) {
+        m_jobAvailable.notify_one();
+    } else {
+        m_jobAvailable.notify_all();
+    }
+    return true;
+}
+
+void CalcService::collectCompletions()
+{
+    std::uint64_t signalled;
+    while (read(m_wakeUp, &signalled, sizeof(signalled)) < 0 && errno == EINTR) {
+    }
+
+    std::vector<Completion> completions;
+    {
+        std::lock_guard<std::mutex> lock(m_completionsMutex);
+        completions.swap(m_completions);
+    }
+    std::vector<std::uint64_t> touched;
+    for (Completion &completion : completions) {
+        const auto found = m_connections.find(completion.connection);
+        if (found == m_connections.end()) {
+            continue; // The client went away before its answer was ready
+        }
+        Connection &connection = *found->second;
+        connection.output.append(completion.response);
+        --connection.inFlight;
+        ++m_framesServed;
+        touched.push_back(completion.connection);
+    }
+    std::sort(touched.begin(), touched.end());
+    touched.erase(std::unique(touched.begin(), touched.end()), touched.end());
+    for (const std::uint64_t id : touched) {
+        pump(id, *m_connections.at(id));
+    }
+}
+
+void CalcService::pump(std::uint64_t id, Connection &connection)
+{
+    if (!writeTo(connection)) {
+        closeConnection(id);
+        return;
+    }
+    const bool room = connection.inFlight < MaxInFlightFrames
+                      && connection.output.size() - connection.outputStart < MaxPendingOutput;
+    if (room && !dispatchFrames(id, connection)) {
+        closeConnection(id); // Oversized frame
+        return;
+    }
+    const bool unsent = connection.outputStart < connection.output.size();
+    if (connection.peerClosed && connection.inFlight == 0 && !unsent) {
+        closeConnection(id);
+        return;
+    }
+
+    // Input is only taken while there is room for its frames, so a client that sends
+    // faster than it reads is slowed down by its own socket buffer.
+    const bool readable = !connection.peerClosed && connection.inFlight < MaxInFlightFrames
+                          && connection.output.size() - connection.outputStart < MaxPendingOutput;
+    const std::uint32_t events = (readable ? std::uint32_t(EPOLLIN) : 0) | (unsent ? std::uint32_t(EPOLLOUT) : 0);
+    if (events != connection.events) {
+        connection.events = events;
+        setEvents(m_epoll, connection.fd, id, events, EPOLL_CTL_MOD);
+    }
+}
+
+bool CalcService::writeTo(Connection &connection)
+{
+    while (connection.outputStart < connection.output.size()) {
+        const ssize_t written = send(connection.fd, connection.output.data() + connection.outputStart,
+                                     connection.output.size() - connection.outputStart, MSG_NOSIGNAL);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            return false;
+        }
+        connection.outputStart += static_cast<size_t>(written);
+    }
+    if (connection.outputStart == connection.output.size()) {
+        connection.output.clear();
+        connection.outputStart = 0;
+    } else if (connection.outputStart > connection.output.size() / 2) {
+        connection.output.erase(0, connection.outputStart);
+        connection.outputStart = 0;
+    }
+    return true;
+}
+
+void CalcService::closeConnection(std::uint64_t id)
+{
+    const auto found = m_connections.find(id);
+    if (found == m_connections.end()) {
+        return;
+    }
+    epoll_ctl(m_epoll, EPOLL_CTL_DEL, found->second->fd, nullptr);
+    close(found->second->fd);
+    m_connections.erase(found);
+}
+
+void CalcService::stopWorkers()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_jobsMutex);
+        m_stopping = true;
+        m_jobs.clear(); // Their clients are disconnected on exit anyway
+    }
+    m_jobAvailable.notify_all();
+    for (const auto &worker : m_workers) {
+        if (worker->thread.joinable()) worker->thread.join();
+    }
+}
+
+void CalcService::workerLoop(Worker &worker)
+{
+    for (;;) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(m_jobsMutex);
+            m_jobAvailable.wait(lock, [this]() { return !m_jobs.empty() || m_stopping; });
+            if (m_stopping) {
+                return;
+            }
+            job = std::move(m_jobs.front());
+            m_jobs.pop_front();
+        }
+
+        Completion completion{ job.connection, answer(worker, job.frame) };
+        if (LatencyStats::enabled()) {
+            LatencyStats::record(LatencyStats::ServiceRequest, std::chrono::steady_clock::now() - job.received);
+        }
+        bool wake;
+        {
+            std::lock_guard<std::mutex> lock(m_completionsMutex);
+            wake = m_completions.empty(); // Otherwise the loop has been woken already
+            m_completions.push_back(std::move(completion));
+        }
+        if (wake) {
+            const std::uint64_t one = 1;
+            while (write(m_wakeUp, &one, sizeof(one)) < 0 && errno == EINTR) {
+            }
+        }
+    }
+}
+
+std::string CalcService::answer(Worker &worker, std::string_view frame)
+{
+    using namespace ServiceProtocol;
+
+    FrameReader reader(frame);
+    std::uint32_t requestId = 0;
+    std::uint8_t type = 0;
+    std::uint32_t precision = 0;
+    std::uint32_t count = 0;
+    std::string response;
+    const auto reject = [&](Status status) {
+        response.clear();
+        FrameWriter writer(response, requestId, static_cast<std::uint8_t>(status));
+        writer.putU32(0);
+        writer.finish();
+        return response;
+    };
+
+    if (!reader.getU32(&requestId) || !reader.getU8(&type)) {
+        return reject(Status::MalformedRequest);
+    }
+    if (type != static_cast<std::uint8_t>(RequestType::Evaluate)) {
+        return reject(Status::UnknownRequestType);
+    }
+    // Every expression takes at least its length field, which bounds count before it
+    // is used to reserve anything.
+    if (!reader.getU32(&precision) || !reader.getU32(&count) || precision > DecimalContext::MaxPrecision
+        || count > frame.size() / 4) {
+        return reject(Status::MalformedRequest);
+    }
+    std::vector<std::string_view> expressions(count);
+    for (std::string_view &expression : expressions) {
+        if (!reader.getText(&expression)) {
+            return reject(Status::MalformedRequest);
+        }
+    }
+    if (!reader.atEnd()) {
+        return reject(Status::MalformedRequest);
+    }
+
+    catchUpDefinitions(worker);
+    FrameWriter writer(response, requestId, static_cast<std::uint8_t>(Status::Ok));
+    writer.putU32(count);
+    ExpressionCompiler::Definition definition;
+    for (const std::string_view expression : expressions) {
+        if (ExpressionCompiler::parseDefinition(expression, &definition)) {
+            // A variable answers with its new value, a function with the definition as stored.
+            std::string canonical;
+            const CalcResult result = define(worker, expression, &canonical);
+            if (!result.ok()) {
+                putError(writer, result.error);
+            } else if (definition.isFunction) {
+                writer.putU8(static_cast<std::uint8_t>(ResultKind::Text));
+                writer.putText(canonical);
+            } else {
+                writer.putU8(static_cast<std::uint8_t>(ResultKind::Number));
+                writer.putF64(result.value);
+            }
+        } else if (precision > 0) {
+            const DecimalResult result = worker.core.calculateDecimal(expression, static_cast<int>(precision));
+            if (!result.ok()) {
+                putError(writer, result.error);
+            } else {
+                writer.putU8(static_cast<std::uint8_t>(ResultKind::Text));
+                writer.putText(result.value.toString());
+            }
+        } else {
+            const CalcResult result = worker.core.calculate(expression);
+            if (!result.ok()) {
+                putError(writer, result.error);
+            } else {
+                writer.putU8(static_cast<std::uint8_t>(ResultKind::Number));
+                writer.putF64(result.value);
+            }
+        }
+    }
+    writer.finish();
+    return response;
+}
+
+CalcResult CalcService::define(Worker &worker, std::string_view definition, std::string *canonical)
+{
+    // Definitions are made one at a time and logged in that order, so every core
+    // replays them in the same order and ends up with the same symbols.
+    std::lock_guard<std::mutex> lock(m_definitionsMutex);
+    for (; worker.appliedDefinitions < m_definitions.size(); ++worker.appliedDefinitions) {
+        worker.core.define(m_definitions[worker.appliedDefinitions]);
+    }
+    worker.core.setSymbolStore(m_options.definitionsPath.empty() ? nullptr : &m_symbols);
+    const CalcResult result = worker.core.define(definition, canonical);
+    worker.core.setSymbolStore(nullptr);
+    if (result.ok()) {
+        m_definitions.emplace_back(definition);
+        worker.appliedDefinitions = m_definitions.size();
+        m_definitionCount.store(m_definitions.size(), std::memory_order_release);
+    }
+    return result;
+}
+
+void CalcService::catchUpDefinitions(Worker &worker)
+{
+    if (m_definitionCount.load(std::memory_order_acquire) == worker.appliedDefinitions) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_definitionsMutex);
+    for (; worker.appliedDefinitions < m_definitions.size(); ++worker.appliedDefinitions) {
+        worker.core.define(m_definitions[worker.appliedDefinitions]);
+    }
+}
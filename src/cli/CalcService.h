@@ -0,0 +1,145 @@
+#ifndef CALCSERVICE_H
+#define CALCSERVICE_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "../core/CalculatorCore.h"
+#include "../core/SymbolDatabase.h"
+
+// Calculation service: `CalcPlusPlus --serve <socket-path> [--threads N]
+// [--definitions <database>]` evaluates
+// expressions for other local programs over a Unix domain socket, in the binary protocol
+// of ServiceProtocol, until it receives SIGINT or SIGTERM. A frame may carry many
+// expressions, and a client may send any number of frames without waiting for their
+// responses; each response carries the id of its request and they can arrive in any
+// order. Expressions within a frame are evaluated in order.
+//
+// The calling thread runs an epoll loop that accepts connections, cuts their input into
+// frames and writes responses; it never evaluates. Frames go to a shared queue drained by
+// a pool of worker threads, each with a private CalculatorCore so evaluation shares
+// nothing. A definition ("rate = 0.07") is made on every worker's core in the order the
+// definitions were received, so it applies to every frame evaluated after its response
+// was sent, from any connection. With --definitions, definitions are also kept in that
+// history database and made again when the service next starts. A connection with MaxInFlightFrames frames unanswered or
+// MaxPendingOutput bytes unsent is not read until it catches up. No QApplication or
+// widget is created on this path.
+class CalcService
+{
+public:
+    enum ExitCode {
+        Success = 0,
+        ServiceFailed = 1, // The socket could not be set up
+        UsageError = 2
+    };
+
+    static constexpr size_t MaxInFlightFrames = 256;
+    static constexpr size_t MaxPendingOutput = 4 << 20;
+    static constexpr size_t ReadChunk = 64 << 10;
+
+    struct Options
+    {
+        std::string socketPath;
+        int threads = 0; // 0 picks one thread per hardware core
+        std::string definitionsPath; // History database keeping definitions; empty for none
+    };
+
+    // Returns true when the command line asks for the service. If the arguments are
+    // malformed, *error describes the problem and the caller should exit.
+    static bool parseArguments(int argc, char *argv[], Options *options, std::string *error);
+
+    explicit CalcService(const Options &options);
+    ~CalcService();
+
+    CalcService(const CalcService &) = delete;
+    CalcService &operator=(const CalcService &) = delete;
+
+    // Serves until SIGINT or SIGTERM, then removes the socket file.
+    int run();
+
+private:
+    struct Job
+    {
+        std::uint64_t connection;
+        std::string frame; // Without its length field
+        std::chrono::steady_clock::time_point received;
+    };
+
+    struct Completion
+    {
+        std::uint64_t connection;
+        std::string response;
+    };
+
+    // Touched only by the loop thread.
+    struct Connection
+    {
+        int fd = -1;
+        std::string input;  // Bytes read but not yet dispatched as frames
+        std::string output; // Responses not yet written, from outputStart on
+        size_t outputStart = 0;
+        size_t inFlight = 0;    // Frames dispatched and not yet answered
+        bool peerClosed = false; // No more input; closed once everything is answered
+        std::uint32_t events = 0; // As registered with epoll
+    };
+
+    struct Worker
+    {
+        CalculatorCore core;
+        size_t appliedDefinitions = 0; // Prefix of m_definitions made on core
+        std::thread thread;
+    };
+
+    Options m_options;
+    int m_epoll = -1;
+    int m_listener = -1;
+    int m_wakeUp = -1;  // eventfd: completions are waiting
+    int m_signals = -1; // signalfd for SIGINT and SIGTERM
+    bool m_boundSocket = false;
+
+    std::unordered_map<std::uint64_t, std::unique_ptr<Connection>> m_connections;
+    std::uint64_t m_nextConnection;
+    std::uint64_t m_framesServed = 0;
+
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    std::mutex m_jobsMutex;
+    std::condition_variable m_jobAvailable;
+    std::deque<Job> m_jobs;   // Guarded by m_jobsMutex
+    bool m_stopping = false;  // Guarded by m_jobsMutex
+
+    std::mutex m_completionsMutex;
+    std::vector<Completion> m_completions; // Guarded by m_completionsMutex
+
+    std::mutex m_definitionsMutex;
+    std::vector<std::string> m_definitions; // Guarded by m_definitionsMutex
+    SymbolDatabase m_symbols;               // Guarded by m_definitionsMutex
+    std::atomic<size_t> m_definitionCount{ 0 };
+
+    bool listen(std::string *error);
+    void acceptConnections();
+    void readFrom(std::uint64_t id, Connection &connection);
+    void collectCompletions();
+    // Writes what it can, dispatches buffered frames while there is room, and updates the
+    // epoll registration; closes the connection once it has nothing left to do.
+    void pump(std::uint64_t id, Connection &connection);
+    bool dispatchFrames(std::uint64_t id, Connection &connection);
+    bool writeTo(Connection &connection);
+    void closeConnection(std::uint64_t id);
+    void stopWorkers();
+
+    void workerLoop(Worker &worker);
+    std::string answer(Worker &worker, std::string_view frame);
+    CalcResult define(Worker &worker, std::string_view definition, std::string *canonical);
+    void catchUpDefinitions(Worker &worker);
+};
+
+#endif // CALCSERVICE_H
@@ -0,0 +1,252 @@
+#include "HistoryTool.h"
+#include "../core/ColumnarHistoryStore.h"
+#include "../core/DatabaseManager.h"
+#include <QDir>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QTemporaryFile>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
+namespace {
+
+// A columnar history for paths ending in ".col", the SQLite database otherwise. Null if
+// it cannot be opened.
+std::unique_ptr<HistoryStore> openStore(const std::string &path)
+{
+    const QString name = QString::fromStdString(path);
+    if (ColumnarHistoryStore::isColumnarPath(name)) {
+        auto store = std::make_unique<ColumnarHistoryStore>();
+        if (!store->open(name)) {
+            return nullptr;
+        }
+        return store;
+    }
+    auto database = std::make_unique<DatabaseManager>();
+    if (!database->openDatabase(name)) {
+        return nullptr;
+    }
+    return database;
+}
+
+// The limit a --history-max-* option sets, or null for any other argument.
+qint64 *retentionLimit(const char *argument, HistoryRetention *retention)
+{
+    if (std::strcmp(argument, "--history-max-rows") == 0) {
+        return &retention->maxRows;
+    }
+    if (std::strcmp(argument, "--history-max-age") == 0) {
+        return &retention->maxAgeDays;
+    }
+    if (std::strcmp(argument, "--history-max-size") == 0) {
+        return &retention->maxBytes;
+    }
+    return nullptr;
+}
+
+} // namespace
+
+bool HistoryTool::parseArguments(int argc, char *argv[], Options *options, std::string *error)
+{
+    bool transfer = false;
+    bool compact = false;
+    const char *transferOnlyOption = nullptr;
+    const char *retentionOption = nullptr;
+    HistoryRetention unused;
+    for (int i = 1; i < argc; ++i) {
+        const bool exportOption = std::strcmp(argv[i], "--export-history") == 0;
+        const bool convertOption = std::strcmp(argv[i], "--convert-history") == 0;
+        if (exportOption || convertOption || std::strcmp(argv[i], "--import-history") == 0) {
+            if (transfer) {
+                *error = "--export-history, --import-history and --convert-history cannot be combined";
+                return true;
+            }
+            transfer = true;
+            if (i + (convertOption ? 2 : 1) >= argc) {
+                *error = std::string(argv[i]) + (convertOption ? " expects a source and a target history" : " expects a file name");
+                return true;
+            }
+            options->mode = exportOption ? Mode::Export : convertOption ? Mode::Convert : Mode::Import;
+            options->path = argv[++i];
+            if (convertOption) {
+                options->targetPath = argv[++i];
+            }
+        } else if (std::strcmp(argv[i], "--format") == 0) {
+            transferOnlyOption = "--format";
+            if (i + 1 >= argc) {
+                *error = "--format expects csv or jsonl";
+                return true;
+            }
+            const char *value = argv[++i];
+            if (!HistoryExchange::parseFormat(value, &options->format)) {
+                *error = std::string("unknown format '") + value + "' (expected csv or jsonl)";
+                return true;
+            }
+            options->hasFormat = true;
+        } else if (std::strcmp(argv[i], "--database") == 0) {
+            transferOnlyOption = "--database";
+            if (i + 1 >= argc) {
+                *error = "--database expects a file name";
+                return true;
+            }
+            options->databasePath = argv[++i];
+        } else if (std::strcmp(argv[i], "--compact-history") == 0) {
+            compact = true;
+        } else if (retentionLimit(argv[i], &unused)) {
+            retentionOption = argv[i++]; // The value is checked by parseRetention()
+        }
+    }
+    if (compact) {
+        if (transfer) {
+            *error = "--compact-history cannot be combined with --export-history, --import-history or --convert-history";
+            return true;
+        }
+        if (transferOnlyOption && std::strcmp(transferOnlyOption, "--database") != 0) {
+            *error = std::string(transferOnlyOption) + " is not valid together with --compact-history";
+            return true;
+        }
+        if (ColumnarHistoryStore::isColumnarPath(QString::fromStdString(options->databasePath))) {
+            *error = "--compact-history only applies to a SQLite history database";
+            return true;
+        }
+        options->mode = Mode::Compact;
+        parseRetention(argc, argv, &options->retention, error);
+        return true;
+    }
+    if (transfer && retentionOption) {
+        *error = std::string(retentionOption) + " is only valid together with --compact-history or in the calculator window";
+        return true;
+    }
+    if (transferOnlyOption && (!transfer || options->mode == Mode::Convert)) {
+        *error = std::string(transferOnlyOption) + " is only valid together with --export-history or --import-history";
+        return true;
+    }
+    if (options->mode == Mode::Convert && options->path == options->targetPath) {
+        *error = "--convert-history needs two different histories";
+        return true;
+    }
+    return transfer;
+}
+
+bool HistoryTool::parseRetention(int argc, char *argv[], HistoryRetention *retention, std::string *error)
+{
+    for (int i = 1; i < argc; ++i) {
+        qint64 *limit = retentionLimit(argv[i], retention);
+        if (!limit) {
+            continue;
+        }
+        bool ok = false;
+        const qint64 value = i + 1 < argc ? QByteArray(argv[i + 1]).toLongLong(&ok) : 0;
+        if (!ok || value <= 0) {
+            *error = std::string(argv[i]) + " expects a positive whole number";
+            return false;
+        }
+        // Sizes are given in MB; the maintainer compares bytes.
+        *limit = limit == &retention->maxBytes ? value * 1024 * 1024 : value;
+        ++i;
+    }
+    return true;
+}
+
+HistoryTool::HistoryTool(const Options &options)
+    : m_options(options)
+{
+}
+
+int HistoryTool::run()
+{
+    if (m_options.mode == Mode::Convert) {
+        return convert();
+    }
+    if (m_options.mode == Mode::Compact) {
+        return compact();
+    }
+    const QString path = QString::fromStdString(m_options.path);
+    const HistoryExchange::Format format =
+        m_options.hasFormat ? m_options.format : HistoryExchange::formatForPath(path);
+
+    const std::unique_ptr<HistoryStore> store = openStore(m_options.databasePath);
+    if (!store) {
+        std::fprintf(stderr, "CalcPlusPlus: cannot open history '%s'\n", m_options.databasePath.c_str());
+        return TransferFailed;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    qint64 count = 0;
+    QString error;
+    const bool exporting = m_options.mode == Mode::Export;
+    const bool ok = exporting ? store->exportHistory(path, format, &count, &error)
+                              : store->importHistory(path, format, &count, &error);
+    if (!ok) {
+        std::fprintf(stderr, "CalcPlusPlus: %s '%s' failed: %s\n", exporting ? "export to" : "import from",
+                     m_options.path.c_str(), error.toUtf8().constData());
+        return TransferFailed;
+    }
+    std::fprintf(stderr, "CalcPlusPlus: %s %lld entries in %lld ms\n", exporting ? "exported" : "imported",
+                 static_cast<long long>(count), static_cast<long long>(timer.elapsed()));
+    return Success;
+}
+
+// The histories share no storage, so the entries travel through a temporary JSON Lines
+// file, which both backends stream at full speed.
+int HistoryTool::convert()
+{
+    const std::unique_ptr<HistoryStore> source = openStore(m_options.path);
+    const std::unique_ptr<HistoryStore> target = source ? openStore(m_options.targetPath) : nullptr;
+    if (!source || !target) {
+        std::fprintf(stderr, "CalcPlusPlus: cannot open history '%s'\n",
+                     (source ? m_options.targetPath : m_options.path).c_str());
+        return TransferFailed;
+    }
+    QTemporaryFile exchange(QDir::tempPath() + "/calc_history_XXXXXX.jsonl");
+    if (!exchange.open()) {
+        std::fprintf(stderr, "CalcPlusPlus: cannot create a temporary file: %s\n",
+                     exchange.errorString().toUtf8().constData());
+        return TransferFailed;
+    }
+    exchange.close(); // Replaced by the export; removed when exchange goes out of scope
+
+    QElapsedTimer timer;
+    timer.start();
+    qint64 count = 0;
+    QString error;
+    if (!source->exportHistory(exchange.fileName(), HistoryExchange::Format::JsonLines, &count, &error)
+        || !target->importHistory(exchange.fileName(), HistoryExchange::Format::JsonLines, &count, &error)) {
+        std::fprintf(stderr, "CalcPlusPlus: converting '%s' to '%s' failed: %s\n", m_options.path.c_str(),
+                     m_options.targetPath.c_str(), error.toUtf8().constData());
+        return TransferFailed;
+    }
+    std::fprintf(stderr, "CalcPlusPlus: converted %lld entries in %lld ms\n", static_cast<long long>(count),
+                 static_cast<long long>(timer.elapsed()));
+    return Success;
+}
+
+// The pass runs on the maintainer's thread, as it would in the window; the event loop
+// receives its report.
+int HistoryTool::compact()
+{
+    DatabaseManager database;
+    database.setHistoryRetention(m_options.retention);
+    if (!database.openDatabase(QString::fromStdString(m_options.databasePath))) {
+        std::fprintf(stderr, "CalcPlusPlus: cannot open history '%s'\n", m_options.databasePath.c_str());
+        return TransferFailed;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    HistoryMaintainer::Report report;
+    QEventLoop loop;
+    QObject::connect(&database, &DatabaseManager::historyMaintained, &loop,
+                     [&](const HistoryMaintainer::Report &finished) {
+                         report = finished;
+                         loop.quit();
+                     });
+    database.compactHistory();
+    loop.exec();
+    std::fprintf(stderr, "CalcPlusPlus: removed %lld entries and %lld memo rows, reclaimed %lld KiB in %lld ms\n",
+                 static_cast<long long>(report.historyRowsRemoved), static_cast<long long>(report.memoRowsRemoved),
+                 static_cast<long long>(report.bytesReclaimed() / 1024), static_cast<long long>(timer.elapsed()));
+    return Success;
+}
@@ -0,0 +1,65 @@
+#ifndef HISTORYTOOL_H
+#define HISTORYTOOL_H
+
+#include <string>
+#include "../core/HistoryExchange.h"
+#include "../core/HistoryMaintainer.h"
+
+// Headless history transfer: `CalcPlusPlus --export-history <file>` writes the history
+// to a CSV or JSON Lines file and `--import-history <file>` appends one (see
+// HistoryStore::exportHistory()). The format follows the file extension unless
+// `--format csv|jsonl` is given, and `--database <path>` picks another history: a
+// columnar history file if the name ends in ".col", a SQLite database otherwise.
+// `--convert-history <source> <target>` appends one history to another, across backends.
+// `--compact-history` runs a HistoryMaintainer pass on the database right away, applying
+// the limits given with `--history-max-rows N`, `--history-max-age DAYS` and
+// `--history-max-size MB`; without a tool option those limits apply to the window.
+// Unlike batch mode this needs a QCoreApplication for the SQL driver; the caller creates
+// it once parseArguments() has accepted the command line.
+class HistoryTool
+{
+public:
+    enum ExitCode {
+        Success = 0,
+        TransferFailed = 1, // Unreadable database or file, or a malformed entry
+        UsageError = 2
+    };
+
+    enum class Mode {
+        Export,
+        Import,
+        Convert,
+        Compact
+    };
+
+    struct Options
+    {
+        Mode mode = Mode::Export;
+        std::string path; // The source when converting
+        std::string targetPath; // Only when converting
+        std::string databasePath = "calc_history.db"; // As opened by the calculator window
+        bool hasFormat = false;
+        HistoryExchange::Format format = HistoryExchange::Format::Csv;
+        HistoryRetention retention; // Only when compacting
+    };
+
+    // Returns true when the command line asks for an export, import, conversion or
+    // compaction. If the arguments are malformed, *error describes the problem and the
+    // caller should exit.
+    static bool parseArguments(int argc, char *argv[], Options *options, std::string *error);
+    // Reads the --history-max-* options. Returns false with *error set if one of them has
+    // no valid value.
+    static bool parseRetention(int argc, char *argv[], HistoryRetention *retention, std::string *error);
+
+    explicit HistoryTool(const Options &options);
+
+    int run();
+
+private:
+    int convert();
+    int compact();
+
+    Options m_options;
+};
+
+#endif // HISTORYTOOL_H
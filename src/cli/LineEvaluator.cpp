@@ -0,0 +1,165 @@
+#include "LineEvaluator.h"
+#include "OutputBuffer.h"
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+
+namespace
+{
+    bool isBlank(std::string_view line)
+    {
+        for (const char c : line) {
+            if (c != ' ' && c != '\t') return false;
+        }
+        return true;
+    }
+
+    // Calls visit with every line of block, without its line terminator.
+    template <typename Visit>
+    void forEachLine(std::string_view block, Visit visit)
+    {
+        const char *cursor = block.data();
+        const char *end = cursor + block.size();
+        while (cursor < end) {
+            const char *newline = static_cast<const char *>(std::memchr(cursor, '\n', static_cast<size_t>(end - cursor)));
+            const char *lineEnd = newline ? newline : end;
+            std::string_view line(cursor, static_cast<size_t>(lineEnd - cursor));
+            if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+            visit(line);
+            cursor = newline ? newline + 1 : end;
+        }
+    }
+
+    void writeError(OutputBuffer &out, const CalcError &error)
+    {
+        out.append("Error");
+        if (error.isSyntaxError() && error.position >= 0) {
+            // Syntax errors point at the offending column (1-based, in bytes).
+            char digits[16];
+            const std::to_chars_result written = std::to_chars(digits, digits + sizeof(digits), error.position + 1);
+            out.append(" at position ");
+            out.append(std::string_view(digits, static_cast<size_t>(written.ptr - digits)));
+        }
+        out.append(": ");
+        out.append(calcErrorMessage(error.code));
+    }
+}
+
+LineEvaluator::LineEvaluator(int precision)
+    : m_precision(precision)
+{
+    m_core.setCacheCapacity(0);
+}
+
+bool LineEvaluator::evaluateLine(std::string_view line, OutputBuffer &out)
+{
+    if (isBlank(line)) {
+        out.append('\n');
+        return true;
+    }
+
+    ExpressionCompiler::Definition definition;
+    if (ExpressionCompiler::parseDefinition(line, &definition)) {
+        // A variable shows its new value, a function the definition as stored.
+        std::string canonical;
+        const CalcResult result = m_core.define(line, &canonical);
+        if (!result.ok()) {
+            writeError(out, result.error);
+        } else if (definition.isFunction) {
+            out.append(canonical);
+        } else {
+            out.appendNumber(result.value);
+        }
+        out.append('\n');
+        return result.ok();
+    }
+
+    bool ok = true;
+    if (m_precision > 0) {
+        const DecimalResult result = m_core.calculateDecimal(line, m_precision);
+        if (result.ok()) {
+            out.append(result.value.toString());
+        } else {
+            writeError(out, result.error);
+            ok = false;
+        }
+    } else {
+        const CalcResult result = m_core.calculate(line);
+        if (result.ok()) {
+            out.appendNumber(result.value);
+        } else {
+            writeError(out, result.error);
+            ok = false;
+        }
+    }
+    out.append('\n');
+    return ok;
+}
+
+bool LineEvaluator::dumpLine(std::string_view line, OutputBuffer &out)
+{
+    if (isBlank(line)) {
+        return true;
+    }
+
+    out.append("; ");
+    out.append(line);
+    out.append('\n');
+    ExpressionCompiler::Definition definition;
+    if (ExpressionCompiler::parseDefinition(line, &definition)) {
+        std::string canonical;
+        const CalcResult result = m_core.define(line, &canonical);
+        if (result.ok()) {
+            out.append("defined ");
+            out.append(canonical);
+        } else {
+            writeError(out, result.error);
+        }
+        out.append("\n\n");
+        return result.ok();
+    }
+
+    CalcError error;
+    const CompiledExpression program = m_core.compileUnoptimized(line, &error);
+    if (error.isError()) {
+        writeError(out, error);
+        out.append("\n\n");
+        return false;
+    }
+
+    const struct
+    {
+        const char *title;
+        CompiledExpression program;
+    } stages[] = {
+        { "compiled", program },
+        { "optimized", ExpressionOptimizer::optimize(program, ExpressionOptimizer::Strict) },
+        { "fast-math", ExpressionOptimizer::optimize(program, ExpressionOptimizer::FastMath) },
+    };
+    for (const auto &stage : stages) {
+        char heading[64];
+        std::snprintf(heading, sizeof(heading), "%s (%zu instructions):\n", stage.title,
+                      stage.program.instructions().size());
+        out.append(heading);
+        out.append(ExpressionOptimizer::dump(stage.program));
+    }
+    out.append('\n');
+    return true;
+}
+
+size_t LineEvaluator::evaluateBlock(std::string_view block, OutputBuffer &out)
+{
+    size_t failures = 0;
+    forEachLine(block, [&](std::string_view line) {
+        if (!evaluateLine(line, out)) ++failures;
+    });
+    return failures;
+}
+
+void LineEvaluator::applyDefinitions(std::string_view block)
+{
+    ExpressionCompiler::Definition definition;
+    forEachLine(block, [&](std::string_view line) {
+        if (ExpressionCompiler::parseDefinition(line, &definition)) m_core.define(line);
+    });
+}
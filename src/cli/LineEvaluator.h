@@ -0,0 +1,47 @@
+#ifndef LINEEVALUATOR_H
+#define LINEEVALUATOR_H
+
+#include <cstddef>
+#include <string_view>
+#include "../core/CalculatorCore.h"
+
+class OutputBuffer;
+
+// Turns input lines into result lines for the batch modes. Each instance owns its own
+// CalculatorCore, so one evaluator per thread can run without any shared state. The
+// core's expression cache is turned off: input rarely repeats a line, and keeping every
+// line in the cache cost more than compiling it again. A non-zero precision switches to decimal mode,
+// see CalculatorCore::calculateDecimal().
+class LineEvaluator
+{
+public:
+    explicit LineEvaluator(int precision = 0);
+
+    // Appends the result of line plus '\n' to out. Blank lines produce blank lines and
+    // failures produce "Error: ...". A definition (see CalculatorCore::define()) applies
+    // to the lines after it and prints the assigned value, or the function as stored.
+    // Returns false if the line failed to evaluate.
+    bool evaluateLine(std::string_view line, OutputBuffer &out);
+
+    // For --dump-ir: appends the program compiled from line as it comes out of the
+    // compiler and after each ExpressionOptimizer mode, followed by a blank line.
+    // Definitions are made as in evaluateLine() and compiled into later programs; other
+    // identifiers are compiled as free variables. Returns false if line did not compile.
+    bool dumpLine(std::string_view line, OutputBuffer &out);
+
+    // Runs evaluateLine() over every line of block. Returns the number of failed lines.
+    size_t evaluateBlock(std::string_view block, OutputBuffer &out);
+
+    // Makes only the definitions in block, producing no output. Used to give another
+    // evaluator the same symbols as the one that evaluated block.
+    void applyDefinitions(std::string_view block);
+
+    // Every definition made from now on is passed to store, which may be null.
+    void setSymbolStore(SymbolStore *store) { m_core.setSymbolStore(store); }
+
+private:
+    CalculatorCore m_core;
+    int m_precision;
+};
+
+#endif // LINEEVALUATOR_H
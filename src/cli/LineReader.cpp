@@ -0,0 +1,215 @@
+#include "LineReader.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+    // Pages behind the cursor are handed back to the kernel in steps of this size, so the
+    // resident set stays flat even for multi-gigabyte inputs.
+    constexpr size_t ReleaseChunk = size_t(64) << 20;
+
+    inline std::string_view trimLineEnd(const char *begin, const char *end)
+    {
+        if (end > begin && end[-1] == '\r') --end;
+        return std::string_view(begin, static_cast<size_t>(end - begin));
+    }
+}
+
+LineReader::~LineReader()
+{
+    close();
+}
+
+bool LineReader::open(const char *path)
+{
+    close();
+
+    if (std::strcmp(path, "-") == 0) {
+        m_fd = STDIN_FILENO;
+        m_ownsFd = false;
+    } else {
+        m_fd = ::open(path, O_RDONLY | O_CLOEXEC);
+        if (m_fd < 0) {
+            setSystemError(path);
+            return false;
+        }
+        m_ownsFd = true;
+    }
+
+    struct stat info;
+    if (fstat(m_fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+        void *map = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, m_fd, 0);
+        if (map != MAP_FAILED) {
+            m_map = static_cast<const char *>(map);
+            m_mapSize = static_cast<size_t>(info.st_size);
+            madvise(map, m_mapSize, MADV_SEQUENTIAL);
+            return true;
+        }
+        // Fall back to plain reads, e.g. on file systems that cannot map.
+    }
+
+    m_buffer.resize(ReadBufferSize);
+    return true;
+}
+
+void LineReader::close()
+{
+    if (m_map) {
+        munmap(const_cast<char *>(m_map), m_mapSize);
+        m_map = nullptr;
+    }
+    if (m_ownsFd && m_fd >= 0) {
+        ::close(m_fd);
+    }
+    m_fd = -1;
+    m_ownsFd = false;
+    m_mapSize = m_mapCursor = m_releasedUpTo = 0;
+    m_buffer.clear();
+    m_buffer.shrink_to_fit();
+    m_begin = m_end = 0;
+    m_eof = false;
+    m_error.clear();
+}
+
+bool LineReader::next(std::string_view *line)
+{
+    if (m_map) {
+        return nextMapped(line);
+    }
+    return m_fd >= 0 && nextStreamed(line);
+}
+
+bool LineReader::nextMapped(std::string_view *line)
+{
+    if (m_mapCursor >= m_mapSize) {
+        return false;
+    }
+
+    const char *begin = m_map + m_mapCursor;
+    const char *end = m_map + m_mapSize;
+    const char *newline = static_cast<const char *>(std::memchr(begin, '\n', static_cast<size_t>(end - begin)));
+    const char *lineEnd = newline ? newline : end;
+    *line = trimLineEnd(begin, lineEnd);
+    m_mapCursor = static_cast<size_t>((newline ? newline + 1 : end) - m_map);
+
+    // The current line is still referenced by the caller, so only what precedes it goes.
+    releaseBefore(begin);
+    return true;
+}
+
+bool LineReader::nextBlock(std::string_view *block, std::string *storage)
+{
+    if (m_map) {
+        if (m_mapCursor >= m_mapSize) {
+            return false;
+        }
+        const char *begin = m_map + m_mapCursor;
+        const char *end = m_map + m_mapSize;
+        const char *cut = begin + std::min(BlockSize, static_cast<size_t>(end - begin));
+        if (cut < end) {
+            const char *newline = static_cast<const char *>(std::memchr(cut, '\n', static_cast<size_t>(end - cut)));
+            cut = newline ? newline + 1 : end;
+        }
+        *block = std::string_view(begin, static_cast<size_t>(cut - begin));
+        m_mapCursor = static_cast<size_t>(cut - m_map);
+        return true;
+    }
+    if (m_fd < 0) {
+        return false;
+    }
+
+    // Hand out whatever whole lines are buffered, reading only while there are none. On a
+    // slow pipe that keeps latency at one line instead of one full block.
+    for (;;) {
+        const char *begin = m_buffer.data() + m_begin;
+        const size_t available = m_end - m_begin;
+        const char *lastNewline = static_cast<const char *>(memrchr(begin, '\n', available));
+        if (lastNewline || (m_eof && available > 0)) {
+            const size_t length = lastNewline ? static_cast<size_t>(lastNewline - begin) + 1 : available;
+            storage->assign(begin, length);
+            *block = *storage;
+            m_begin += length;
+            return true;
+        }
+        if (m_eof || !refill()) {
+            return false;
+        }
+    }
+}
+
+void LineReader::releaseBefore(const char *position)
+{
+    if (!m_map) {
+        return;
+    }
+    const size_t consumed = static_cast<size_t>(position - m_map);
+    if (consumed > m_releasedUpTo && consumed - m_releasedUpTo >= ReleaseChunk) {
+        const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        const size_t releaseEnd = consumed / pageSize * pageSize;
+        madvise(const_cast<char *>(m_map) + m_releasedUpTo, releaseEnd - m_releasedUpTo, MADV_DONTNEED);
+        m_releasedUpTo = releaseEnd;
+    }
+}
+
+bool LineReader::nextStreamed(std::string_view *line)
+{
+    for (;;) {
+        const char *begin = m_buffer.data() + m_begin;
+        const size_t available = m_end - m_begin;
+        if (const char *newline = static_cast<const char *>(std::memchr(begin, '\n', available))) {
+            *line = trimLineEnd(begin, newline);
+            m_begin += static_cast<size_t>(newline - begin) + 1;
+            return true;
+        }
+        if (m_eof) {
+            if (available == 0) {
+                return false;
+            }
+            *line = trimLineEnd(begin, begin + available); // Last line without a trailing newline
+            m_begin = m_end;
+            return true;
+        }
+        if (!refill()) {
+            return false;
+        }
+    }
+}
+
+bool LineReader::refill()
+{
+    // Move the partial line to the front, growing only if it already fills the buffer.
+    if (m_begin > 0) {
+        std::memmove(m_buffer.data(), m_buffer.data() + m_begin, m_end - m_begin);
+        m_end -= m_begin;
+        m_begin = 0;
+    }
+    if (m_end == m_buffer.size()) {
+        m_buffer.resize(m_buffer.size() * 2);
+    }
+
+    for (;;) {
+        const ssize_t count = ::read(m_fd, m_buffer.data() + m_end, m_buffer.size() - m_end);
+        if (count > 0) {
+            m_end += static_cast<size_t>(count);
+            return true;
+        }
+        if (count == 0) {
+            m_eof = true;
+            return true;
+        }
+        if (errno != EINTR) {
+            setSystemError("read");
+            return false;
+        }
+    }
+}
+
+void LineReader::setSystemError(const char *what)
+{
+    m_error = std::string(what) + ": " + std::strerror(errno);
+}
@@ -0,0 +1,68 @@
+#ifndef LINEREADER_H
+#define LINEREADER_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Pull-style reader that hands out one line at a time without copying it. Regular files
+// are memory-mapped and walked in place; pipes, terminals and stdin ("-") go through a
+// fixed read buffer that only grows when a single line does not fit. Either way memory
+// use is independent of the input size.
+class LineReader
+{
+public:
+    static constexpr size_t ReadBufferSize = 1 << 20;
+    static constexpr size_t BlockSize = 256 << 10;
+
+    LineReader() = default;
+    ~LineReader();
+
+    LineReader(const LineReader &) = delete;
+    LineReader &operator=(const LineReader &) = delete;
+
+    // Opens path, or standard input for "-". On failure errorString() explains why.
+    bool open(const char *path);
+    void close();
+
+    // Stores the next line (without its "\n" / "\r\n") in *line. The view stays valid
+    // until the following call. Returns false at end of input or on a read error.
+    bool next(std::string_view *line);
+
+    // Block-wise alternative to next() for the parallel pipeline: *block receives one or
+    // more whole lines, roughly BlockSize bytes. Mapped input is returned in place;
+    // streamed input is copied into *storage and stays valid until that is reused.
+    bool nextBlock(std::string_view *block, std::string *storage);
+
+    // Lets the kernel reclaim mapped pages before position once nothing references them.
+    // next() does this on its own; nextBlock() callers do it as blocks retire.
+    void releaseBefore(const char *position);
+
+    bool hasError() const { return !m_error.empty(); }
+    const std::string &errorString() const { return m_error; }
+
+private:
+    int m_fd = -1;
+    bool m_ownsFd = false;
+    std::string m_error;
+
+    // Memory-mapped input
+    const char *m_map = nullptr;
+    size_t m_mapSize = 0;
+    size_t m_mapCursor = 0;
+    size_t m_releasedUpTo = 0;
+
+    // Streamed input
+    std::vector<char> m_buffer;
+    size_t m_begin = 0;
+    size_t m_end = 0;
+    bool m_eof = false;
+
+    bool nextMapped(std::string_view *line);
+    bool nextStreamed(std::string_view *line);
+    bool refill();
+    void setSystemError(const char *what);
+};
+
+#endif // LINEREADER_H
@@ -0,0 +1,67 @@
+#include "OutputBuffer.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include "../core/NumberFormat.h"
+
+static_assert(OutputBuffer::MaxNumberLength >= NumberFormat::MaxLength, "appendNumber() could overrun the buffer");
+
+OutputBuffer::OutputBuffer(int fd, size_t capacity)
+    : m_fd(fd), m_data(capacity < MaxNumberLength ? MaxNumberLength : capacity)
+{
+}
+
+OutputBuffer::~OutputBuffer()
+{
+    flush();
+}
+
+void OutputBuffer::append(std::string_view text)
+{
+    while (!text.empty()) {
+        if (m_size == m_data.size()) makeRoom(text.size());
+        const size_t count = std::min(text.size(), m_data.size() - m_size);
+        std::memcpy(m_data.data() + m_size, text.data(), count);
+        m_size += count;
+        text.remove_prefix(count);
+    }
+}
+
+void OutputBuffer::appendNumber(double value)
+{
+    if (m_data.size() - m_size < MaxNumberLength) makeRoom(MaxNumberLength);
+    char *begin = m_data.data() + m_size;
+    m_size += NumberFormat::format(value, begin);
+}
+
+bool OutputBuffer::flush()
+{
+    if (m_fd == NoFile) {
+        return true;
+    }
+
+    const char *cursor = m_data.data();
+    size_t remaining = m_failed ? 0 : m_size;
+    while (remaining > 0) {
+        const ssize_t written = ::write(m_fd, cursor, remaining);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            m_failed = true;
+            break;
+        }
+        cursor += written;
+        remaining -= static_cast<size_t>(written);
+    }
+    m_size = 0;
+    return !m_failed;
+}
+
+void OutputBuffer::makeRoom(size_t count)
+{
+    if (m_fd != NoFile) {
+        flush();
+        return;
+    }
+    m_data.resize(std::max(m_data.size() * 2, m_size + count));
+}
@@ -0,0 +1,52 @@
+#ifndef OUTPUTBUFFER_H
+#define OUTPUTBUFFER_H
+
+#include <cstddef>
+#include <string_view>
+#include <vector>
+
+// Large write-behind buffer in front of a file descriptor. Results are formatted straight
+// into it and handed to write(2) in big blocks instead of one stdio call per line.
+// Constructed with NoFile it is a growable in-memory buffer instead, read back through
+// text() and reset with clear(); the parallel batch pipeline uses that for its chunks.
+class OutputBuffer
+{
+public:
+    static constexpr int NoFile = -1;
+    static constexpr size_t DefaultCapacity = 1 << 20;
+    // Longest text a single appendNumber() call can produce (NumberFormat::MaxLength).
+    static constexpr size_t MaxNumberLength = 96;
+
+    explicit OutputBuffer(int fd, size_t capacity = DefaultCapacity);
+    ~OutputBuffer();
+
+    OutputBuffer(const OutputBuffer &) = delete;
+    OutputBuffer &operator=(const OutputBuffer &) = delete;
+
+    void append(std::string_view text);
+    void append(char c)
+    {
+        if (m_size == m_data.size()) makeRoom(1);
+        m_data[m_size++] = c;
+    }
+    // Formats value the way the GUI displays results: the shortest text that reads back
+    // as the same double (see NumberFormat).
+    void appendNumber(double value);
+
+    // Returns false once any write failed (e.g. a closed pipe); later output is dropped.
+    bool flush();
+    bool hasError() const { return m_failed; }
+
+    std::string_view text() const { return std::string_view(m_data.data(), m_size); }
+    void clear() { m_size = 0; }
+
+private:
+    int m_fd;
+    std::vector<char> m_data;
+    size_t m_size = 0;
+    bool m_failed = false;
+
+    void makeRoom(size_t count);
+};
+
+#endif // OUTPUTBUFFER_H
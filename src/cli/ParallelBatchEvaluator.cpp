@@ -0,0 +1,178 @@
+#include "ParallelBatchEvaluator.h"
+#include "LineReader.h"
+#include <cstring>
+
+ParallelBatchEvaluator::ParallelBatchEvaluator(int threadCount, int precision)
+{
+    const size_t count = threadCount > 0 ? static_cast<size_t>(threadCount) : 1;
+    m_workers.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        m_workers.push_back(std::make_unique<Worker>(precision));
+    }
+    m_window.reserve(count * InFlightPerThread);
+    for (size_t i = 0; i < count * InFlightPerThread; ++i) {
+        m_window.push_back(std::make_unique<Block>());
+    }
+    // Start the threads only once every worker exists, since any of them may be robbed.
+    for (size_t i = 0; i < count; ++i) {
+        m_workers[i]->thread = std::thread(&ParallelBatchEvaluator::workerLoop, this, i);
+    }
+}
+
+ParallelBatchEvaluator::~ParallelBatchEvaluator()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_workAvailable.notify_all();
+    for (const auto &worker : m_workers) {
+        worker->thread.join();
+    }
+}
+
+void ParallelBatchEvaluator::restoreDefinitions(std::string_view definitions, SymbolStore *store)
+{
+    for (const auto &worker : m_workers) {
+        worker->evaluator.applyDefinitions(definitions);
+    }
+    // Definition blocks are only ever evaluated by the first worker's evaluator.
+    m_workers[0]->evaluator.setSymbolStore(store);
+}
+
+size_t ParallelBatchEvaluator::run(LineReader &reader, OutputBuffer &out, bool flushEachBlock)
+{
+    const size_t windowSize = m_window.size();
+    size_t failures = 0;
+    size_t submitted = 0;
+    size_t emitted = 0;
+
+    auto emitNext = [&]() {
+        Block *block = m_window[emitted % windowSize].get();
+        waitFor(block);
+        out.append(block->output.text());
+        if (flushEachBlock) out.flush();
+        failures += block->failures;
+        reader.releaseBefore(block->input.data() + block->input.size());
+        ++emitted;
+    };
+
+    for (;;) {
+        // Forward whatever is already finished in order, then block only if the window is full.
+        while (emitted < submitted && isDone(m_window[emitted % windowSize].get())) {
+            emitNext();
+        }
+        if (submitted - emitted == windowSize) {
+            emitNext(); // Frees the slot the next block is about to reuse
+        }
+        if (out.hasError()) {
+            break;
+        }
+        Block *block = m_window[submitted % windowSize].get();
+        if (!reader.nextBlock(&block->input, &block->storage)) {
+            break;
+        }
+        if (std::memchr(block->input.data(), '=', block->input.size())) {
+            // Definitions change the meaning of every later line, so they are ordered
+            // like a barrier: all earlier blocks finish, this one runs here, and every
+            // worker's evaluator makes the same definitions before it sees later blocks.
+            while (emitted < submitted) {
+                emitNext();
+            }
+            block->output.clear();
+            block->failures = m_workers[0]->evaluator.evaluateBlock(block->input, block->output);
+            for (size_t i = 1; i < m_workers.size(); ++i) {
+                m_workers[i]->evaluator.applyDefinitions(block->input);
+            }
+            out.append(block->output.text());
+            if (flushEachBlock) out.flush();
+            failures += block->failures;
+            reader.releaseBefore(block->input.data() + block->input.size());
+            continue;
+        }
+        submit(block, submitted++);
+    }
+    while (emitted < submitted) {
+        emitNext();
+    }
+    return failures;
+}
+
+void ParallelBatchEvaluator::submit(Block *block, size_t sequence)
+{
+    block->output.clear();
+    block->failures = 0;
+    {
+        // Counted before the block becomes visible, so a thief can never see m_queued wrap;
+        // done is reset under the same lock the emitter reads it with.
+        std::lock_guard<std::mutex> lock(m_mutex);
+        block->done = false;
+        ++m_queued;
+    }
+
+    Worker &worker = *m_workers[sequence % m_workers.size()];
+    {
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        worker.queue.push_back(block);
+    }
+    m_workAvailable.notify_one();
+}
+
+bool ParallelBatchEvaluator::isDone(Block *block)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return block->done;
+}
+
+void ParallelBatchEvaluator::waitFor(Block *block)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_blockDone.wait(lock, [block]() { return block->done; });
+}
+
+ParallelBatchEvaluator::Block *ParallelBatchEvaluator::takeWork(size_t index)
+{
+    {
+        Worker &own = *m_workers[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.queue.empty()) {
+            Block *block = own.queue.front();
+            own.queue.pop_front();
+            return block;
+        }
+    }
+    // Steal the block furthest from being emitted, leaving the owner its oldest work.
+    for (size_t offset = 1; offset < m_workers.size(); ++offset) {
+        Worker &victim = *m_workers[(index + offset) % m_workers.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.queue.empty()) {
+            Block *block = victim.queue.back();
+            victim.queue.pop_back();
+            return block;
+        }
+    }
+    return nullptr;
+}
+
+void ParallelBatchEvaluator::workerLoop(size_t index)
+{
+    Worker &worker = *m_workers[index];
+    for (;;) {
+        if (Block *block = takeWork(index)) {
+            --m_queued;
+            block->failures = worker.evaluator.evaluateBlock(block->input, block->output);
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                block->done = true;
+            }
+            m_blockDone.notify_all();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_workAvailable.wait(lock, [this]() { return m_queued > 0 || m_stopping; });
+        if (m_stopping && m_queued == 0) {
+            return;
+        }
+    }
+}
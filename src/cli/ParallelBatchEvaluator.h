@@ -0,0 +1,84 @@
+#ifndef PARALLELBATCHEVALUATOR_H
+#define PARALLELBATCHEVALUATOR_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "LineEvaluator.h"
+#include "OutputBuffer.h"
+
+class LineReader;
+
+// Multi-threaded batch pipeline. The calling thread cuts the input into blocks of whole
+// lines and deals them out round-robin to per-worker deques; a worker drains its own
+// deque from the front and, once empty, steals from the back of the others. Every worker
+// has a private LineEvaluator, so evaluation shares nothing. Results are written back in
+// input order: the caller keeps at most InFlightPerThread blocks per worker outstanding
+// and emits them strictly by sequence number, which also bounds memory use. A block
+// containing a definition is evaluated on the calling thread once every earlier block is
+// done, and its definitions are then repeated on every other worker's evaluator.
+class ParallelBatchEvaluator
+{
+public:
+    static constexpr size_t InFlightPerThread = 4;
+
+    // precision is passed on to every worker's LineEvaluator.
+    explicit ParallelBatchEvaluator(int threadCount, int precision = 0);
+    ~ParallelBatchEvaluator();
+
+    ParallelBatchEvaluator(const ParallelBatchEvaluator &) = delete;
+    ParallelBatchEvaluator &operator=(const ParallelBatchEvaluator &) = delete;
+
+    // Makes definitions (one per line) on every worker's evaluator, then passes those
+    // in the input on to store, which may be null. Call before run().
+    void restoreDefinitions(std::string_view definitions, SymbolStore *store);
+
+    // Evaluates all of reader's input and writes the results to out in input order.
+    // flushEachBlock forwards every block as soon as it is in order (for terminals).
+    // Returns the number of lines that failed to evaluate.
+    size_t run(LineReader &reader, OutputBuffer &out, bool flushEachBlock);
+
+private:
+    struct Block
+    {
+        std::string storage; // Owns the text of streamed input; unused for mapped input
+        std::string_view input;
+        OutputBuffer output{ OutputBuffer::NoFile, 64 << 10 };
+        size_t failures = 0;
+        bool done = false; // Guarded by m_mutex
+    };
+
+    struct Worker
+    {
+        explicit Worker(int precision) : evaluator(precision) {}
+
+        std::mutex mutex;
+        std::deque<Block *> queue;
+        LineEvaluator evaluator;
+        std::thread thread;
+    };
+
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    std::vector<std::unique_ptr<Block>> m_window; // Ring of in-flight blocks
+
+    std::mutex m_mutex;
+    std::condition_variable m_workAvailable;
+    std::condition_variable m_blockDone;
+    std::atomic<size_t> m_queued{ 0 };
+    bool m_stopping = false; // Guarded by m_mutex
+
+    void workerLoop(size_t index);
+    Block *takeWork(size_t index);
+    void submit(Block *block, size_t sequence);
+    bool isDone(Block *block);
+    void waitFor(Block *block);
+};
+
+#endif // PARALLELBATCHEVALUATOR_H
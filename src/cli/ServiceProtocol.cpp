@@ -0,0 +1,117 @@
+#include "ServiceProtocol.h"
+#include <cstring>
+
+namespace
+{
+    std::uint32_t readU32(const char *bytes)
+    {
+        const auto *b = reinterpret_cast<const unsigned char *>(bytes);
+        return std::uint32_t(b[0]) | std::uint32_t(b[1]) << 8 | std::uint32_t(b[2]) << 16 | std::uint32_t(b[3]) << 24;
+    }
+
+    void writeU32(char *bytes, std::uint32_t value)
+    {
+        for (int i = 0; i < 4; ++i) {
+            bytes[i] = static_cast<char>(value >> (8 * i));
+        }
+    }
+}
+
+namespace ServiceProtocol
+{
+    FrameState peekFrame(std::string_view data, size_t *frameBytes)
+    {
+        if (data.size() < LengthBytes) {
+            return FrameState::Incomplete;
+        }
+        const std::uint32_t length = readU32(data.data());
+        if (length > MaxFrameBytes) {
+            return FrameState::Oversized;
+        }
+        if (data.size() - LengthBytes < length) {
+            return FrameState::Incomplete;
+        }
+        *frameBytes = LengthBytes + length;
+        return FrameState::Complete;
+    }
+
+    FrameWriter::FrameWriter(std::string &buffer, std::uint32_t requestId, std::uint8_t type)
+        : m_buffer(buffer), m_start(buffer.size())
+    {
+        m_buffer.append(LengthBytes, '\0');
+        putU32(requestId);
+        putU8(type);
+    }
+
+    void FrameWriter::putU32(std::uint32_t value)
+    {
+        char bytes[4];
+        writeU32(bytes, value);
+        m_buffer.append(bytes, sizeof(bytes));
+    }
+
+    void FrameWriter::putF64(double value)
+    {
+        std::uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        putU32(static_cast<std::uint32_t>(bits));
+        putU32(static_cast<std::uint32_t>(bits >> 32));
+    }
+
+    void FrameWriter::putText(std::string_view text)
+    {
+        putU32(static_cast<std::uint32_t>(text.size()));
+        m_buffer.append(text);
+    }
+
+    void FrameWriter::finish()
+    {
+        writeU32(&m_buffer[m_start], static_cast<std::uint32_t>(m_buffer.size() - m_start - LengthBytes));
+    }
+
+    bool FrameReader::getU8(std::uint8_t *value)
+    {
+        if (m_cursor == m_end) {
+            return false;
+        }
+        *value = static_cast<std::uint8_t>(*m_cursor++);
+        return true;
+    }
+
+    bool FrameReader::getU32(std::uint32_t *value)
+    {
+        if (m_end - m_cursor < 4) {
+            return false;
+        }
+        *value = readU32(m_cursor);
+        m_cursor += 4;
+        return true;
+    }
+
+    bool FrameReader::getF64(double *value)
+    {
+        std::uint32_t low, high;
+        if (m_end - m_cursor < 8 || !getU32(&low) || !getU32(&high)) {
+            return false;
+        }
+        const std::uint64_t bits = std::uint64_t(high) << 32 | low;
+        std::memcpy(value, &bits, sizeof(bits));
+        return true;
+    }
+
+    bool FrameReader::getText(std::string_view *text)
+    {
+        const char *start = m_cursor;
+        std::uint32_t length;
+        if (!getU32(&length)) {
+            return false;
+        }
+        if (static_cast<size_t>(m_end - m_cursor) < length) {
+            m_cursor = start;
+            return false;
+        }
+        *text = std::string_view(m_cursor, length);
+        m_cursor += length;
+        return true;
+    }
+}
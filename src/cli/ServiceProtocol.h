@@ -0,0 +1,96 @@
+#ifndef SERVICEPROTOCOL_H
+#define SERVICEPROTOCOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Wire format of the calculation service (see CalcService). Every message is a frame: a
+// u32 byte count followed by that many bytes. Integers are little-endian and doubles are
+// their IEEE 754 bits as a u64.
+//
+//   request:  u32 length | u32 request id | u8 RequestType | u32 precision | u32 count
+//             | count x (u32 length | UTF-8 expression)
+//   response: u32 length | u32 request id | u8 Status | u32 count | count x result
+//   result:   u8 ResultKind, then Number: f64 value
+//                                   Text:   u32 length | UTF-8 text
+//                                   Error:  u8 CalcErrorCode | i32 position (-1 if none)
+//
+// A precision of 0 evaluates doubles; otherwise results are decimal text with that many
+// significant digits. A response carries the request's id, its results in the order of
+// the expressions, and a count of 0 unless the status is Ok.
+namespace ServiceProtocol
+{
+    // Largest frame either side accepts, not counting the length field.
+    constexpr std::uint32_t MaxFrameBytes = 16u << 20;
+    constexpr size_t LengthBytes = 4;
+
+    enum class RequestType : std::uint8_t {
+        Evaluate = 1
+    };
+
+    enum class Status : std::uint8_t {
+        Ok,
+        MalformedRequest,  // Truncated fields, trailing bytes or an invalid precision
+        UnknownRequestType
+    };
+
+    enum class ResultKind : std::uint8_t {
+        Number,
+        Text, // Decimal results, and function definitions as stored
+        Error
+    };
+
+    enum class FrameState {
+        Incomplete,
+        Complete,
+        Oversized // Longer than MaxFrameBytes; the stream cannot be resynchronized
+    };
+
+    // Looks at the start of a byte stream. When a whole frame is there, *frameBytes is its
+    // size including the length field.
+    FrameState peekFrame(std::string_view data, size_t *frameBytes);
+
+    // Appends one frame to buffer. The length field is written by finish(), so fields can
+    // be put without knowing the size of the frame in advance.
+    class FrameWriter
+    {
+    public:
+        FrameWriter(std::string &buffer, std::uint32_t requestId, std::uint8_t type);
+
+        void putU8(std::uint8_t value) { m_buffer.push_back(static_cast<char>(value)); }
+        void putU32(std::uint32_t value);
+        void putF64(double value);
+        // A u32 length followed by the bytes.
+        void putText(std::string_view text);
+
+        void finish();
+
+    private:
+        std::string &m_buffer;
+        size_t m_start;
+    };
+
+    // Reads the fields of a frame body, everything after the length field. A getter that
+    // would run past the end returns false and leaves its output alone.
+    class FrameReader
+    {
+    public:
+        explicit FrameReader(std::string_view body) : m_cursor(body.data()), m_end(body.data() + body.size()) {}
+
+        bool getU8(std::uint8_t *value);
+        bool getU32(std::uint32_t *value);
+        bool getF64(double *value);
+        // A u32 length followed by the bytes; *text views into the body.
+        bool getText(std::string_view *text);
+
+        bool atEnd() const { return m_cursor == m_end; }
+
+    private:
+        const char *m_cursor;
+        const char *m_end;
+    };
+}
+
+#endif // SERVICEPROTOCOL_H
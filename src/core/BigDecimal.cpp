@@ -0,0 +1,793 @@
+#include "BigDecimal.h"
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+
+namespace
+{
+    using Limbs = BigDecimal::Limbs;
+
+    constexpr std::uint32_t Base = BigDecimal::LimbBase;
+    constexpr std::uint32_t Pow10[10] = { 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000 };
+
+    // Below this many limbs (~290 digits) schoolbook multiplication beats Karatsuba.
+    constexpr size_t KaratsubaThreshold = 32;
+
+    // Digits a Newton seed taken from a double can be trusted with.
+    constexpr int SeedDigits = 15;
+
+    void trim(Limbs &a)
+    {
+        while (!a.empty() && a.back() == 0) a.pop_back();
+    }
+
+    int digitsOfLimb(std::uint32_t limb)
+    {
+        int digits = 1;
+        while (digits < BigDecimal::LimbDigits && limb >= Pow10[digits]) ++digits;
+        return digits;
+    }
+
+    std::int64_t digitCount(const Limbs &a)
+    {
+        if (a.empty()) return 0;
+        return static_cast<std::int64_t>(a.size() - 1) * BigDecimal::LimbDigits + digitsOfLimb(a.back());
+    }
+
+    int compareLimbs(const Limbs &a, const Limbs &b)
+    {
+        if (a.size() != b.size()) return a.size() < b.size() ? -1 : 1;
+        for (size_t i = a.size(); i-- > 0;) {
+            if (a[i] != b[i]) return a[i] < b[i] ? -1 : 1;
+        }
+        return 0;
+    }
+
+    // a += b * Base^shift
+    void addInPlace(Limbs &a, const Limbs &b, size_t shift = 0)
+    {
+        if (a.size() < b.size() + shift) a.resize(b.size() + shift, 0);
+        std::uint32_t carry = 0;
+        size_t i = 0;
+        for (; i < b.size(); ++i) {
+            std::uint32_t sum = a[i + shift] + b[i] + carry;
+            carry = sum >= Base;
+            a[i + shift] = sum - (carry ? Base : 0);
+        }
+        for (size_t k = i + shift; carry; ++k) {
+            if (k == a.size()) a.push_back(0);
+            std::uint32_t sum = a[k] + carry;
+            carry = sum >= Base;
+            a[k] = sum - (carry ? Base : 0);
+        }
+    }
+
+    // a -= b * Base^shift; the result must not be negative.
+    void subtractInPlace(Limbs &a, const Limbs &b, size_t shift = 0)
+    {
+        std::uint32_t borrow = 0;
+        size_t i = 0;
+        for (; i < b.size(); ++i) {
+            const std::uint32_t subtrahend = b[i] + borrow;
+            borrow = a[i + shift] < subtrahend;
+            a[i + shift] = a[i + shift] + (borrow ? Base : 0) - subtrahend;
+        }
+        for (size_t k = i + shift; borrow; ++k) {
+            borrow = a[k] == 0;
+            a[k] = borrow ? Base - 1 : a[k] - 1;
+        }
+        trim(a);
+    }
+
+    void multiplySmallInPlace(Limbs &a, std::uint32_t factor)
+    {
+        std::uint64_t carry = 0;
+        for (std::uint32_t &limb : a) {
+            const std::uint64_t value = static_cast<std::uint64_t>(limb) * factor + carry;
+            limb = static_cast<std::uint32_t>(value % Base);
+            carry = value / Base;
+        }
+        while (carry) {
+            a.push_back(static_cast<std::uint32_t>(carry % Base));
+            carry /= Base;
+        }
+    }
+
+    std::uint32_t divideSmallInPlace(Limbs &a, std::uint32_t divisor)
+    {
+        std::uint64_t remainder = 0;
+        for (size_t i = a.size(); i-- > 0;) {
+            const std::uint64_t value = remainder * Base + a[i];
+            a[i] = static_cast<std::uint32_t>(value / divisor);
+            remainder = value % divisor;
+        }
+        trim(a);
+        return static_cast<std::uint32_t>(remainder);
+    }
+
+    void multiplyPow10InPlace(Limbs &a, std::int64_t count)
+    {
+        if (a.empty() || count <= 0) return;
+        const int partial = static_cast<int>(count % BigDecimal::LimbDigits);
+        if (partial) multiplySmallInPlace(a, Pow10[partial]);
+        a.insert(a.begin(), static_cast<size_t>(count / BigDecimal::LimbDigits), 0);
+    }
+
+    struct DroppedDigits
+    {
+        std::uint32_t roundDigit = 0; // Most significant dropped digit
+        bool sticky = false;          // Any non-zero digit below it
+    };
+
+    // Removes the count least significant digits of a, reporting what was dropped.
+    DroppedDigits dropDigits(Limbs &a, std::int64_t count)
+    {
+        DroppedDigits dropped;
+        if (count <= 0) return dropped;
+        if (count > digitCount(a)) {
+            dropped.sticky = !a.empty();
+            a.clear();
+            return dropped;
+        }
+
+        const size_t whole = static_cast<size_t>(count / BigDecimal::LimbDigits);
+        const int partial = static_cast<int>(count % BigDecimal::LimbDigits);
+        if (partial == 0) {
+            const std::uint32_t top = a[whole - 1];
+            dropped.roundDigit = top / Pow10[8];
+            dropped.sticky = top % Pow10[8] != 0;
+            for (size_t i = 0; i + 1 < whole && !dropped.sticky; ++i) dropped.sticky = a[i] != 0;
+            a.erase(a.begin(), a.begin() + static_cast<std::ptrdiff_t>(whole));
+        } else {
+            for (size_t i = 0; i < whole && !dropped.sticky; ++i) dropped.sticky = a[i] != 0;
+            a.erase(a.begin(), a.begin() + static_cast<std::ptrdiff_t>(whole));
+            const std::uint32_t rest = divideSmallInPlace(a, Pow10[partial]);
+            dropped.roundDigit = rest / Pow10[partial - 1];
+            dropped.sticky = dropped.sticky || rest % Pow10[partial - 1] != 0;
+        }
+        trim(a);
+        return dropped;
+    }
+
+    std::int64_t trailingZeroDigits(const Limbs &a)
+    {
+        std::int64_t zeros = 0;
+        for (const std::uint32_t limb : a) {
+            if (limb == 0) {
+                zeros += BigDecimal::LimbDigits;
+                continue;
+            }
+            for (std::uint32_t rest = limb; rest % 10 == 0; rest /= 10) ++zeros;
+            break;
+        }
+        return zeros;
+    }
+
+    Limbs multiplySchoolbook(const std::uint32_t *a, size_t aSize, const std::uint32_t *b, size_t bSize)
+    {
+        Limbs product(aSize + bSize, 0);
+        for (size_t i = 0; i < aSize; ++i) {
+            const std::uint64_t factor = a[i];
+            if (factor == 0) continue;
+            std::uint64_t carry = 0;
+            for (size_t j = 0; j < bSize; ++j) {
+                const std::uint64_t value = product[i + j] + factor * b[j] + carry;
+                product[i + j] = static_cast<std::uint32_t>(value % Base);
+                carry = value / Base;
+            }
+            product[i + bSize] = static_cast<std::uint32_t>(carry);
+        }
+        trim(product);
+        return product;
+    }
+
+    // a*b = z2*B^2m + z1*B^m + z0 with z1 = (a0+a1)(b0+b1) - z2 - z0: three half-size
+    // products instead of four.
+    Limbs multiplyKaratsuba(const std::uint32_t *a, size_t aSize, const std::uint32_t *b, size_t bSize)
+    {
+        while (aSize && a[aSize - 1] == 0) --aSize;
+        while (bSize && b[bSize - 1] == 0) --bSize;
+        if (aSize == 0 || bSize == 0) return Limbs();
+        if (aSize < bSize) {
+            std::swap(a, b);
+            std::swap(aSize, bSize);
+        }
+        if (bSize < KaratsubaThreshold) {
+            return multiplySchoolbook(a, aSize, b, bSize);
+        }
+
+        const size_t half = (aSize + 1) / 2;
+        if (bSize <= half) {
+            // Unbalanced operands: split only the longer one.
+            Limbs product = multiplyKaratsuba(a, half, b, bSize);
+            addInPlace(product, multiplyKaratsuba(a + half, aSize - half, b, bSize), half);
+            trim(product);
+            return product;
+        }
+
+        const Limbs low = multiplyKaratsuba(a, half, b, half);
+        const Limbs high = multiplyKaratsuba(a + half, aSize - half, b + half, bSize - half);
+
+        Limbs aSum(a, a + half);
+        trim(aSum);
+        addInPlace(aSum, Limbs(a + half, a + aSize));
+        Limbs bSum(b, b + half);
+        trim(bSum);
+        addInPlace(bSum, Limbs(b + half, b + bSize));
+
+        Limbs middle = multiplyKaratsuba(aSum.data(), aSum.size(), bSum.data(), bSum.size());
+        subtractInPlace(middle, low);
+        subtractInPlace(middle, high);
+
+        Limbs product = low;
+        addInPlace(product, middle, half);
+        addInPlace(product, high, 2 * half);
+        trim(product);
+        return product;
+    }
+
+    Limbs multiplyLimbs(const Limbs &a, const Limbs &b)
+    {
+        return multiplyKaratsuba(a.data(), a.size(), b.data(), b.size());
+    }
+
+    Limbs limbsFromDigits(std::string_view digits)
+    {
+        Limbs limbs;
+        limbs.reserve(digits.size() / BigDecimal::LimbDigits + 1);
+        for (size_t end = digits.size(); end > 0;) {
+            const size_t begin = end > static_cast<size_t>(BigDecimal::LimbDigits) ? end - BigDecimal::LimbDigits : 0;
+            std::uint32_t limb = 0;
+            for (size_t i = begin; i < end; ++i) limb = limb * 10 + static_cast<std::uint32_t>(digits[i] - '0');
+            limbs.push_back(limb);
+            end = begin;
+        }
+        trim(limbs);
+        return limbs;
+    }
+
+    std::string digitsOf(const Limbs &limbs)
+    {
+        if (limbs.empty()) return "0";
+        std::string digits = std::to_string(limbs.back());
+        char chunk[BigDecimal::LimbDigits];
+        for (size_t i = limbs.size() - 1; i-- > 0;) {
+            std::uint32_t limb = limbs[i];
+            for (int d = BigDecimal::LimbDigits - 1; d >= 0; --d) {
+                chunk[d] = static_cast<char>('0' + limb % 10);
+                limb /= 10;
+            }
+            digits.append(chunk, BigDecimal::LimbDigits);
+        }
+        return digits;
+    }
+}
+
+// ---- BigDecimal -----------------------------------------------------------------------
+
+BigDecimal BigDecimal::fromInteger(std::int64_t value)
+{
+    BigDecimal result;
+    result.m_negative = value < 0;
+    std::uint64_t magnitude = value < 0 ? 0 - static_cast<std::uint64_t>(value) : static_cast<std::uint64_t>(value);
+    while (magnitude) {
+        result.m_mantissa.push_back(static_cast<std::uint32_t>(magnitude % Base));
+        magnitude /= Base;
+    }
+    return result;
+}
+
+bool BigDecimal::fromString(std::string_view text, BigDecimal *value)
+{
+    size_t i = 0;
+    bool negative = false;
+    if (i < text.size() && (text[i] == '+' || text[i] == '-')) {
+        negative = text[i] == '-';
+        ++i;
+    }
+
+    std::string digits;
+    std::int64_t fractionDigits = 0;
+    bool anyDigit = false;
+    bool inFraction = false;
+    for (; i < text.size(); ++i) {
+        const char c = text[i];
+        if (c >= '0' && c <= '9') {
+            anyDigit = true;
+            if (!digits.empty() || c != '0') digits.push_back(c);
+            if (inFraction) ++fractionDigits;
+        } else if (c == '.' && !inFraction) {
+            inFraction = true;
+        } else {
+            break;
+        }
+    }
+    if (!anyDigit) return false;
+
+    std::int64_t exponent = 0;
+    if (i < text.size() && (text[i] == 'e' || text[i] == 'E')) {
+        ++i;
+        bool negativeExponent = false;
+        if (i < text.size() && (text[i] == '+' || text[i] == '-')) {
+            negativeExponent = text[i] == '-';
+            ++i;
+        }
+        if (i == text.size()) return false;
+        for (; i < text.size() && text[i] >= '0' && text[i] <= '9'; ++i) {
+            exponent = exponent * 10 + (text[i] - '0');
+            if (exponent > DecimalContext::MaxAdjustedExponent) return false;
+        }
+        if (negativeExponent) exponent = -exponent;
+    }
+    if (i != text.size()) return false;
+
+    BigDecimal result;
+    result.m_mantissa = limbsFromDigits(digits);
+    result.m_negative = negative;
+    result.m_exponent = exponent - fractionDigits;
+    result.normalizeZero();
+    *value = std::move(result);
+    return true;
+}
+
+std::string BigDecimal::toString() const
+{
+    if (isZero()) return "0";
+
+    Limbs mantissa = m_mantissa;
+    const std::int64_t zeros = trailingZeroDigits(mantissa);
+    dropDigits(mantissa, zeros);
+    const std::int64_t exponent = m_exponent + zeros;
+    const std::string digits = digitsOf(mantissa);
+    const std::int64_t length = static_cast<std::int64_t>(digits.size());
+    const std::int64_t adjusted = exponent + length - 1;
+
+    std::string text = m_negative ? "-" : "";
+    if (exponent >= 0 && exponent < 21) {
+        text += digits;
+        text.append(static_cast<size_t>(exponent), '0');
+    } else if (exponent < 0 && adjusted >= -7) {
+        if (adjusted >= 0) {
+            text.append(digits, 0, static_cast<size_t>(adjusted + 1));
+            text += '.';
+            text.append(digits, static_cast<size_t>(adjusted + 1), std::string::npos);
+        } else {
+            text += "0.";
+            text.append(static_cast<size_t>(-adjusted - 1), '0');
+            text += digits;
+        }
+    } else {
+        text += digits[0];
+        if (length > 1) {
+            text += '.';
+            text.append(digits, 1, std::string::npos);
+        }
+        text += adjusted < 0 ? "e-" : "e+";
+        text += std::to_string(adjusted < 0 ? -adjusted : adjusted);
+    }
+    return text;
+}
+
+bool BigDecimal::isInteger() const
+{
+    return m_exponent >= 0 || trailingZeroDigits(m_mantissa) >= -m_exponent;
+}
+
+int BigDecimal::digitCount() const
+{
+    return static_cast<int>(::digitCount(m_mantissa));
+}
+
+BigDecimal BigDecimal::negated() const
+{
+    BigDecimal result = *this;
+    result.m_negative = !m_negative && !isZero();
+    return result;
+}
+
+BigDecimal BigDecimal::abs() const
+{
+    BigDecimal result = *this;
+    result.m_negative = false;
+    return result;
+}
+
+int BigDecimal::compareMagnitude(const BigDecimal &a, const BigDecimal &b)
+{
+    if (a.isZero() || b.isZero()) return a.isZero() ? (b.isZero() ? 0 : -1) : 1;
+    const std::int64_t aAdjusted = a.adjustedExponent();
+    const std::int64_t bAdjusted = b.adjustedExponent();
+    if (aAdjusted != bAdjusted) return aAdjusted < bAdjusted ? -1 : 1;
+
+    // Same leading digit position: align to the smaller exponent and compare exactly.
+    Limbs aMantissa = a.m_mantissa;
+    Limbs bMantissa = b.m_mantissa;
+    multiplyPow10InPlace(aMantissa, a.m_exponent - b.m_exponent);
+    multiplyPow10InPlace(bMantissa, b.m_exponent - a.m_exponent);
+    return compareLimbs(aMantissa, bMantissa);
+}
+
+int BigDecimal::compare(const BigDecimal &a, const BigDecimal &b)
+{
+    if (a.m_negative != b.m_negative) return a.m_negative ? -1 : 1;
+    const int magnitude = compareMagnitude(a, b);
+    return a.m_negative ? -magnitude : magnitude;
+}
+
+void BigDecimal::normalizeZero()
+{
+    trim(m_mantissa);
+    if (m_mantissa.empty()) {
+        m_negative = false;
+        m_exponent = 0;
+    }
+}
+
+// ---- DecimalContext -------------------------------------------------------------------
+
+namespace
+{
+    // Leading digits of a non-zero value as a double in [1, 10), plus its exponent.
+    double leadingValue(const BigDecimal &value, const Limbs &mantissa, std::int64_t *adjusted)
+    {
+        // Up to three limbs, so a short top limb still leaves at least 17 digits.
+        double lead = 0;
+        int digits = 0;
+        for (size_t i = mantissa.size(); i-- > 0 && digits < 17;) {
+            lead = lead * Base + mantissa[i];
+            digits += digits == 0 ? digitsOfLimb(mantissa[i]) : BigDecimal::LimbDigits;
+        }
+        *adjusted = value.adjustedExponent();
+        return lead / std::pow(10.0, digits - 1);
+    }
+
+    // value * 10^scale, carrying the 17 significant digits of the double.
+    BigDecimal fromDouble(double value, std::int64_t scale)
+    {
+        char buffer[32];
+        const std::to_chars_result written = std::to_chars(buffer, buffer + sizeof(buffer), value,
+                                                           std::chars_format::scientific, 16);
+        std::string text(buffer, written.ptr);
+        const size_t e = text.find('e');
+        const std::int64_t exponent = std::stoll(text.substr(e + 1)) + scale;
+        text.resize(e + 1);
+        text += std::to_string(exponent);
+        BigDecimal result;
+        BigDecimal::fromString(text, &result);
+        return result;
+    }
+
+    // Value of an integral mantissa * 10^exponent known to fit in 64 bits.
+    std::uint64_t smallIntegerValue(Limbs mantissa, std::int64_t exponent)
+    {
+        if (exponent > 0) multiplyPow10InPlace(mantissa, exponent);
+        else dropDigits(mantissa, -exponent);
+        std::uint64_t value = 0;
+        for (size_t i = mantissa.size(); i-- > 0;) value = value * Base + mantissa[i];
+        return value;
+    }
+}
+
+DecimalContext::DecimalContext(int precision)
+    : m_precision(std::clamp(precision, 1, MaxPrecision))
+{
+}
+
+BigDecimal DecimalContext::roundTo(const BigDecimal &value, int precision, bool sticky)
+{
+    BigDecimal result = value;
+    const std::int64_t excess = ::digitCount(result.m_mantissa) - precision;
+    if (precision <= 0 || excess <= 0) {
+        return result;
+    }
+
+    const DroppedDigits dropped = dropDigits(result.m_mantissa, excess);
+    result.m_exponent += excess;
+    const bool odd = !result.m_mantissa.empty() && (result.m_mantissa[0] & 1u);
+    if (dropped.roundDigit > 5 || (dropped.roundDigit == 5 && (dropped.sticky || sticky || odd))) {
+        addInPlace(result.m_mantissa, Limbs{ 1 });
+        if (::digitCount(result.m_mantissa) > precision) {
+            dropDigits(result.m_mantissa, 1); // 999 -> 1000: the extra digit is a zero
+            ++result.m_exponent;
+        }
+    }
+    result.normalizeZero();
+    return result;
+}
+
+BigDecimal DecimalContext::addTo(const BigDecimal &a, const BigDecimal &b, int precision)
+{
+    if (a.isZero()) return roundTo(b, precision);
+    if (b.isZero()) return roundTo(a, precision);
+
+    const BigDecimal *high = &a;
+    const BigDecimal *low = &b;
+    if (low->adjustedExponent() > high->adjustedExponent()) std::swap(high, low);
+
+    // An operand entirely below the rounding position only matters as a sticky digit; a
+    // one-digit stand-in keeps 1e1000 + 1e-1000 from aligning two thousand digits.
+    BigDecimal standIn;
+    if (precision > 0) {
+        const std::int64_t floor = high->adjustedExponent() - precision - 2;
+        if (low->adjustedExponent() < floor && low->m_exponent < floor) {
+            standIn.m_negative = low->m_negative;
+            standIn.m_mantissa = Limbs{ 1 };
+            standIn.m_exponent = floor - 1;
+            low = &standIn;
+        }
+    }
+
+    const std::int64_t exponent = std::min(high->m_exponent, low->m_exponent);
+    Limbs highMantissa = high->m_mantissa;
+    Limbs lowMantissa = low->m_mantissa;
+    multiplyPow10InPlace(highMantissa, high->m_exponent - exponent);
+    multiplyPow10InPlace(lowMantissa, low->m_exponent - exponent);
+
+    BigDecimal result;
+    result.m_exponent = exponent;
+    if (high->m_negative == low->m_negative) {
+        addInPlace(highMantissa, lowMantissa);
+        result.m_mantissa = std::move(highMantissa);
+        result.m_negative = high->m_negative;
+    } else {
+        const int order = compareLimbs(highMantissa, lowMantissa);
+        if (order == 0) return BigDecimal();
+        if (order > 0) {
+            subtractInPlace(highMantissa, lowMantissa);
+            result.m_mantissa = std::move(highMantissa);
+            result.m_negative = high->m_negative;
+        } else {
+            subtractInPlace(lowMantissa, highMantissa);
+            result.m_mantissa = std::move(lowMantissa);
+            result.m_negative = low->m_negative;
+        }
+    }
+    result.normalizeZero();
+    return roundTo(result, precision);
+}
+
+BigDecimal DecimalContext::multiplyTo(const BigDecimal &a, const BigDecimal &b, int precision)
+{
+    if (a.isZero() || b.isZero()) return BigDecimal();
+    BigDecimal result;
+    result.m_mantissa = multiplyLimbs(a.m_mantissa, b.m_mantissa);
+    result.m_exponent = a.m_exponent + b.m_exponent;
+    result.m_negative = a.m_negative != b.m_negative;
+    return roundTo(result, precision);
+}
+
+BigDecimal DecimalContext::reciprocal(const BigDecimal &value, int precision)
+{
+    // x' = x + x(1 - v·x) doubles the number of correct digits per step, so every step
+    // runs at roughly twice the precision of the previous one and the total cost is a
+    // small multiple of one full-precision multiplication.
+    std::int64_t adjusted = 0;
+    const BigDecimal magnitude = value.abs();
+    const double lead = leadingValue(magnitude, magnitude.m_mantissa, &adjusted);
+    BigDecimal x = fromDouble(1.0 / lead, -adjusted);
+
+    const BigDecimal one = BigDecimal::fromInteger(1);
+    for (int digits = SeedDigits; digits < precision;) {
+        digits = std::min(2 * digits, precision);
+        const int working = digits + 3;
+        const BigDecimal product = multiplyTo(roundTo(magnitude, working), x, working);
+        const BigDecimal error = addTo(one, product.negated(), working);
+        x = addTo(x, multiplyTo(x, error, working), working);
+    }
+    return x;
+}
+
+void DecimalContext::divideTruncated(const BigDecimal &a, const BigDecimal &b, std::int64_t exponent,
+                                     BigDecimal *quotient, BigDecimal *remainder)
+{
+    // a and b are positive. Computes q = floor(a / (b·10^exponent)) so that
+    // a = q·b·10^exponent + r with 0 <= r < b·10^exponent, all exactly.
+    const std::int64_t digits = a.adjustedExponent() - b.adjustedExponent() - exponent + 1;
+    if (digits <= 0) {
+        *quotient = BigDecimal();
+        *remainder = a;
+        return;
+    }
+
+    // Newton estimate, within a few units of the last place...
+    const int working = static_cast<int>(digits) + 3;
+    const BigDecimal estimate = multiplyTo(roundTo(a, working + 3), reciprocal(b, working), working);
+    Limbs q = estimate.m_mantissa;
+    if (estimate.m_exponent >= exponent) {
+        multiplyPow10InPlace(q, estimate.m_exponent - exponent);
+    } else {
+        dropDigits(q, exponent - estimate.m_exponent);
+    }
+
+    // ...then corrected against the exact remainder.
+    BigDecimal step = b;
+    step.m_exponent += exponent;
+    BigDecimal q10;
+    q10.m_mantissa = q;
+    q10.m_exponent = exponent;
+    q10.normalizeZero();
+    BigDecimal r = addTo(a, multiplyTo(q10, b, 0).negated(), 0);
+    while (r.isNegative()) {
+        subtractInPlace(q, Limbs{ 1 });
+        r = addTo(r, step, 0);
+    }
+    while (BigDecimal::compare(r, step) >= 0) {
+        addInPlace(q, Limbs{ 1 });
+        r = addTo(r, step.negated(), 0);
+    }
+
+    quotient->m_negative = false;
+    quotient->m_mantissa = std::move(q);
+    quotient->m_exponent = exponent;
+    quotient->normalizeZero();
+    *remainder = std::move(r);
+}
+
+bool DecimalContext::inRange(const BigDecimal &value)
+{
+    if (value.isZero()) return true;
+    const std::int64_t adjusted = value.adjustedExponent();
+    return adjusted <= MaxAdjustedExponent && adjusted >= -MaxAdjustedExponent;
+}
+
+BigDecimal DecimalContext::round(const BigDecimal &value) const
+{
+    return roundTo(value, m_precision);
+}
+
+BigDecimal DecimalContext::add(const BigDecimal &a, const BigDecimal &b) const
+{
+    return addTo(a, b, m_precision);
+}
+
+BigDecimal DecimalContext::subtract(const BigDecimal &a, const BigDecimal &b) const
+{
+    return addTo(a, b.negated(), m_precision);
+}
+
+BigDecimal DecimalContext::multiply(const BigDecimal &a, const BigDecimal &b) const
+{
+    return multiplyTo(a, b, m_precision);
+}
+
+CalcErrorCode DecimalContext::divide(const BigDecimal &a, const BigDecimal &b, BigDecimal *result) const
+{
+    if (b.isZero()) return CalcErrorCode::DivisionByZero;
+    if (a.isZero()) {
+        *result = BigDecimal();
+        return CalcErrorCode::None;
+    }
+
+    // Truncate at a position that leaves P+1 or P+2 digits; the remainder then tells
+    // whether anything non-zero was cut off, which makes the final rounding exact.
+    const std::int64_t exponent = a.adjustedExponent() - b.adjustedExponent() - m_precision - 1;
+    BigDecimal quotient;
+    BigDecimal remainder;
+    divideTruncated(a.abs(), b.abs(), exponent, &quotient, &remainder);
+    quotient.m_negative = a.isNegative() != b.isNegative();
+    *result = roundTo(quotient, m_precision, !remainder.isZero());
+    return inRange(*result) ? CalcErrorCode::None : CalcErrorCode::PrecisionExceeded;
+}
+
+CalcErrorCode DecimalContext::remainder(const BigDecimal &a, const BigDecimal &b, BigDecimal *result) const
+{
+    if (b.isZero()) return CalcErrorCode::ModuloByZero;
+    if (BigDecimal::compareMagnitude(a, b) < 0) {
+        *result = round(a);
+        return CalcErrorCode::None;
+    }
+    if (a.adjustedExponent() - b.adjustedExponent() + 1 > m_precision) {
+        return CalcErrorCode::PrecisionExceeded;
+    }
+
+    BigDecimal quotient;
+    BigDecimal rest;
+    divideTruncated(a.abs(), b.abs(), 0, &quotient, &rest);
+    rest.m_negative = a.isNegative() && !rest.isZero();
+    *result = round(rest);
+    return CalcErrorCode::None;
+}
+
+CalcErrorCode DecimalContext::power(const BigDecimal &base, const BigDecimal &exponent, BigDecimal *result) const
+{
+    if (!exponent.isInteger()) return CalcErrorCode::NonIntegerExponent;
+    if (exponent.isZero()) {
+        *result = BigDecimal::fromInteger(1);
+        return CalcErrorCode::None;
+    }
+    if (base.isZero()) {
+        if (exponent.isNegative()) return CalcErrorCode::DivisionByZero;
+        *result = BigDecimal();
+        return CalcErrorCode::None;
+    }
+    if (exponent.adjustedExponent() >= 18) return CalcErrorCode::PrecisionExceeded;
+
+    std::uint64_t count = smallIntegerValue(exponent.m_mantissa, exponent.m_exponent);
+    // Every squaring rounds, so carry enough guard digits to absorb log2(n) roundings.
+    const int working = m_precision + static_cast<int>(std::to_string(count).size()) + 3;
+
+    BigDecimal value = BigDecimal::fromInteger(1);
+    BigDecimal square = base;
+    for (;;) {
+        if (count & 1u) value = multiplyTo(value, square, working);
+        count >>= 1;
+        if (!count) break;
+        square = multiplyTo(square, square, working);
+        if (!inRange(square) || !inRange(value)) return CalcErrorCode::PrecisionExceeded;
+    }
+    if (!inRange(value)) return CalcErrorCode::PrecisionExceeded;
+
+    if (exponent.isNegative()) {
+        return divide(BigDecimal::fromInteger(1), value, result);
+    }
+    *result = round(value);
+    return CalcErrorCode::None;
+}
+
+CalcErrorCode DecimalContext::squareRoot(const BigDecimal &value, BigDecimal *result) const
+{
+    if (value.isNegative()) return CalcErrorCode::NegativeSquareRoot;
+    if (value.isZero()) {
+        *result = BigDecimal();
+        return CalcErrorCode::None;
+    }
+
+    // Seed from the double square root of the leading digits, with an even exponent.
+    std::int64_t adjusted = 0;
+    double lead = leadingValue(value, value.m_mantissa, &adjusted);
+    if (adjusted % 2 != 0) {
+        lead *= 10.0;
+        --adjusted;
+    }
+    BigDecimal x = fromDouble(std::sqrt(lead), adjusted / 2);
+
+    // Heron's iteration x' = (x + v/x) / 2, doubling the precision each step.
+    BigDecimal half;
+    half.m_mantissa = Limbs{ 5 };
+    half.m_exponent = -1;
+    const int target = m_precision + 3;
+    for (int digits = SeedDigits; digits < target;) {
+        digits = std::min(2 * digits, target);
+        const int working = digits + 3;
+        BigDecimal quotient;
+        DecimalContext(working).divide(value, x, &quotient);
+        x = multiplyTo(addTo(x, quotient, working), half, working);
+    }
+
+    // Truncate to P+2 digits, then correct until q² <= v < (q+1)², exactly.
+    const std::int64_t exponent = x.adjustedExponent() - m_precision - 2;
+    Limbs q = x.m_mantissa;
+    if (x.m_exponent >= exponent) {
+        multiplyPow10InPlace(q, x.m_exponent - exponent);
+    } else {
+        dropDigits(q, exponent - x.m_exponent);
+    }
+    auto squareOf = [exponent](const Limbs &digits) {
+        BigDecimal root;
+        root.m_mantissa = digits;
+        root.m_exponent = exponent;
+        root.normalizeZero();
+        return multiplyTo(root, root, 0);
+    };
+
+    BigDecimal square = squareOf(q);
+    while (BigDecimal::compare(square, value) > 0) {
+        subtractInPlace(q, Limbs{ 1 });
+        square = squareOf(q);
+    }
+    for (;;) {
+        Limbs next = q;
+        addInPlace(next, Limbs{ 1 });
+        const BigDecimal nextSquare = squareOf(next);
+        if (BigDecimal::compare(nextSquare, value) > 0) break;
+        q = std::move(next);
+        square = nextSquare;
+    }
+
+    BigDecimal root;
+    root.m_mantissa = std::move(q);
+    root.m_exponent = exponent;
+    root.normalizeZero();
+    *result = roundTo(root, m_precision, BigDecimal::compare(square, value) != 0);
+    return CalcErrorCode::None;
+}
@@ -0,0 +1,102 @@
+#ifndef BIGDECIMAL_H
+#define BIGDECIMAL_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "ExpressionGrammar.h"
+
+// Arbitrary-precision decimal number: (-1)^sign * mantissa * 10^exponent. The mantissa
+// is an unbounded integer stored as base-10^9 limbs (least significant first), which
+// keeps digit counting, rounding and printing cheap while still packing nine digits
+// into every 32-bit limb. Values are immutable from the outside; arithmetic lives in
+// DecimalContext, which rounds every result to its precision.
+class BigDecimal
+{
+public:
+    using Limbs = std::vector<std::uint32_t>;
+    static constexpr std::uint32_t LimbBase = 1000000000;
+    static constexpr int LimbDigits = 9;
+
+    BigDecimal() = default; // Zero
+    static BigDecimal fromInteger(std::int64_t value);
+
+    // Parses "[+-]digits[.digits][(e|E)[+-]digits]". Returns false on malformed text.
+    static bool fromString(std::string_view text, BigDecimal *value);
+
+    // Shortest plain notation for moderate magnitudes ("0.1", "1234.5"), scientific
+    // ("1.5e+40", "2e-12") otherwise. Trailing zeros are never printed.
+    std::string toString() const;
+
+    bool isZero() const { return m_mantissa.empty(); }
+    bool isNegative() const { return m_negative; }
+    bool isInteger() const;
+    int digitCount() const;
+    // Exponent of the leading digit: 123.45 -> 2, 0.05 -> -2.
+    std::int64_t adjustedExponent() const { return m_exponent + digitCount() - 1; }
+
+    BigDecimal negated() const;
+    BigDecimal abs() const;
+
+    // Magnitude comparison and full signed comparison, both exact.
+    static int compareMagnitude(const BigDecimal &a, const BigDecimal &b);
+    static int compare(const BigDecimal &a, const BigDecimal &b);
+
+private:
+    friend class DecimalContext;
+
+    bool m_negative = false;
+    Limbs m_mantissa;
+    std::int64_t m_exponent = 0;
+
+    void normalizeZero();
+};
+
+// Precision and rounding for decimal arithmetic. Every operation returns the exact result
+// rounded half-to-even to precision() significant digits, the way IEEE 754 decimal and
+// Python's decimal module do. Large operands use Karatsuba multiplication; division and
+// square roots are computed with Newton iterations and then corrected against the exact
+// remainder, so they are correctly rounded as well.
+class DecimalContext
+{
+public:
+    static constexpr int DefaultPrecision = 34; // Same as IEEE 754 decimal128
+    static constexpr int MaxPrecision = 1000000;
+    // Results whose magnitude leaves this range are reported as PrecisionExceeded.
+    static constexpr std::int64_t MaxAdjustedExponent = 999999999999999;
+
+    explicit DecimalContext(int precision = DefaultPrecision);
+
+    int precision() const { return m_precision; }
+
+    BigDecimal round(const BigDecimal &value) const;
+
+    BigDecimal add(const BigDecimal &a, const BigDecimal &b) const;
+    BigDecimal subtract(const BigDecimal &a, const BigDecimal &b) const;
+    BigDecimal multiply(const BigDecimal &a, const BigDecimal &b) const;
+    // The fallible operations store their result in *result and return the error code.
+    CalcErrorCode divide(const BigDecimal &a, const BigDecimal &b, BigDecimal *result) const;
+    // Remainder with the sign of a, like std::fmod. The integer quotient must fit in the
+    // precision, otherwise PrecisionExceeded is returned.
+    CalcErrorCode remainder(const BigDecimal &a, const BigDecimal &b, BigDecimal *result) const;
+    // Integer exponents only, by repeated squaring.
+    CalcErrorCode power(const BigDecimal &base, const BigDecimal &exponent, BigDecimal *result) const;
+    CalcErrorCode squareRoot(const BigDecimal &value, BigDecimal *result) const;
+
+    // False when the magnitude is beyond MaxAdjustedExponent in either direction.
+    static bool inRange(const BigDecimal &value);
+
+private:
+    int m_precision;
+
+    static BigDecimal roundTo(const BigDecimal &value, int precision, bool sticky = false);
+    // A precision of 0 keeps the result exact.
+    static BigDecimal addTo(const BigDecimal &a, const BigDecimal &b, int precision);
+    static BigDecimal multiplyTo(const BigDecimal &a, const BigDecimal &b, int precision);
+    static BigDecimal reciprocal(const BigDecimal &value, int precision);
+    static void divideTruncated(const BigDecimal &a, const BigDecimal &b, std::int64_t exponent,
+                                BigDecimal *quotient, BigDecimal *remainder);
+};
+
+#endif // BIGDECIMAL_H
@@ -1,90 +1,290 @@
 #include "CalculatorCore.h"
+#include "LatencyStats.h"
+#include "NumberFormat.h"
+#include "VectorEvaluator.h"
 #include <QtMath>
-#include <QRegularExpression>
-#include <cmath> // For fmod
+#include <algorithm>
+#include <cmath>
 
-CalculatorCore::CalculatorCore(ErrorHandler *errorHandler)
-    : m_errorHandler(errorHandler)
+namespace
 {
+    // Lexes a lone operator spelling ("+", "×", "x^y", ...) into its token kind.
+    TokenKind lexOperator(const QString &token)
+    {
+        const char16_t *begin = reinterpret_cast<const char16_t *>(token.utf16());
+        ExpressionLexer<char16_t> lexer(begin, begin + token.size());
+        const Token first = lexer.next(ExpressionLexer<char16_t>::ExpectOperator);
+        if (lexer.next(ExpressionLexer<char16_t>::ExpectOperator).kind != TokenKind::End) {
+            return TokenKind::Invalid;
+        }
+        return first.kind;
+    }
+
+    OpCode binaryOpCode(TokenKind kind, bool *ok)
+    {
+        *ok = true;
+        switch (kind) {
+            case TokenKind::Plus:     return OpCode::Add;
+            case TokenKind::Minus:    return OpCode::Subtract;
+            case TokenKind::Multiply: return OpCode::Multiply;
+            case TokenKind::Divide:   return OpCode::Divide;
+            case TokenKind::Percent:  return OpCode::Modulo;
+            case TokenKind::Power:    return OpCode::Power;
+            default:
+                *ok = false;
+                return OpCode::PushConst;
+        }
+    }
+
+    std::u16string_view sourceView(const QString &expression)
+    {
+        return std::u16string_view(reinterpret_cast<const char16_t *>(expression.utf16()),
+                                   static_cast<size_t>(expression.size()));
+    }
+}
+
+CompiledExpression CalculatorCore::compile(const QString &expression, CalcError *error,
+                                           ExpressionOptimizer::Mode optimization) const
+{
+    return prepare(m_compiler.compile(sourceView(expression), error), optimization);
 }
 
-double CalculatorCore::calculate(const QString &expression, bool *ok)
+CompiledExpression CalculatorCore::compileWithVariables(const QString &expression, CalcError *error,
+                                                        ExpressionOptimizer::Mode optimization) const
 {
-    if (ok) *ok = true; // Assume success initially
+    return prepare(m_compiler.compile(sourceView(expression), error, ExpressionCompiler::CollectVariables),
+                   optimization);
+}
 
-    // Regex to match a simple binary operation: operand1 operator operand2
-    // Supports: +, -, x (multiply), ÷ (divide), * (multiply), / (divide), ^ (power), % (modulo), x^y (power)
-    // Numbers can be integers or floating-point, optionally negative.
-    // Using a raw string literal (R"(...)") to avoid C++ escape sequence interpretation issues.
-    // IMPORTANT: Added '×' (Unicode multiplication sign) to the operator character class.
-    QRegularExpression rx(R"((-?\d+(?:\.\d+)?)\s*(x\^y|\+|\-|x|÷|\*|/|\^|%|×)\s*(-?\d+(?:\.\d+)?))");
+CompiledExpression CalculatorCore::compileWithVariables(std::string_view utf8Expression, CalcError *error,
+                                                        ExpressionOptimizer::Mode optimization) const
+{
+    return prepare(m_compiler.compile(utf8Expression, error, ExpressionCompiler::CollectVariables), optimization);
+}
 
-    if (!rx.isValid()) {
-        if (m_errorHandler) {
-            m_errorHandler->handleError("Internal error: Invalid regex pattern.", rx.errorString());
-        }
-        if (ok) *ok = false;
-        return qQNaN();
+CompiledExpression CalculatorCore::compileUnoptimized(std::string_view utf8Expression, CalcError *error) const
+{
+    const std::shared_lock<std::shared_mutex> symbolsLock(m_symbolsMutex);
+    return m_compiler.compile(utf8Expression, error, ExpressionCompiler::CollectVariables, &m_symbols);
+}
+
+CompiledExpression CalculatorCore::prepare(const CompiledExpression &program, ExpressionOptimizer::Mode optimization) const
+{
+    CompiledExpression optimized = ExpressionOptimizer::optimize(program, optimization);
+    optimized.setBackend(m_backend);
+    return optimized;
+}
+
+const double *CalculatorCore::bindVariables(const CompiledExpression &program) const
+{
+    thread_local std::vector<double> values;
+    const std::vector<std::int32_t> &slots = program.symbolSlots();
+    values.resize(slots.size());
+    for (size_t i = 0; i < slots.size(); ++i) {
+        values[i] = m_symbols.value(slots[i]);
     }
+    return values.data();
+}
+
+size_t CalculatorCore::evaluateColumns(const CompiledExpression &program, const double *const *columns, size_t rows,
+                                       double *results, CalcErrorCode *rowErrors) const
+{
+    return VectorEvaluator::evaluate(program, columns, rows, results, rowErrors);
+}
 
-    QRegularExpressionMatch match = rx.match(expression);
-
-    if (match.hasMatch()) {
-        double operand1 = match.captured(1).toDouble();
-        QString op = match.captured(2);
-        double operand2 = match.captured(3).toDouble();
-
-        double result = 0.0;
-
-        if (op == "+") {
-            result = operand1 + operand2;
-        } else if (op == "-" || op == "−") { // Handle both hyphen and minus sign
-            result = operand1 - operand2;
-        } else if (op == "x" || op == "*" || op == "×") { // Handle 'x', '*', and '×' (Unicode multiplication sign)
-            result = operand1 * operand2;
-        } else if (op == "÷" || op == "/") { // Handle both '÷' and '/'
-            if (operand2 == 0.0) {
-                if (m_errorHandler) {
-                    m_errorHandler->handleError("Division by zero is not allowed.");
-                }
-                if (ok) *ok = false;
-                return qQNaN();
+template <typename CharT>
+CalcResult CalculatorCore::evaluateSource(std::basic_string_view<CharT> source)
+{
+    const LatencyStats::Scope timing(LatencyStats::Calculate);
+    CalcResult result;
+    const std::shared_lock<std::shared_mutex> symbolsLock(m_symbolsMutex);
+
+    // Reused across calls so building the key does not allocate in the steady state.
+    thread_local std::string key;
+    bool evaluated = false;
+    if (m_cache.enabled() && ExpressionCache::normalize(source, key)) {
+        ExpressionCache::Entry entry;
+        const bool hit = m_cache.lookup(key, &entry);
+        if (!hit) {
+            auto program = std::make_shared<CompiledExpression>(
+                m_compiler.compile(source, &result.error, ExpressionCompiler::RejectVariables, &m_symbols));
+            if (!result.ok()) {
+                return result;
             }
-            result = operand1 / operand2;
-        } else if (op == "^" || op == "x^y") { // Handle both '^' and 'x^y' for power
-            result = qPow(operand1, operand2);
-        } else if (op == "%") { // Modulo operator
-            if (operand2 == 0.0) {
-                if (m_errorHandler) {
-                    m_errorHandler->handleError("Modulo by zero is not allowed.");
-                }
-                if (ok) *ok = false;
-                return qQNaN();
+            // A program without variables is closed over its constant pool, so its value
+            // can be kept too. Redefining a function clears the cache.
+            if (program->variables().empty()) {
+                entry.value = program->evaluate(&entry.error);
+                entry.hasConstantResult = true;
             }
-            result = fmod(operand1, operand2); // fmod for floating point remainder
-        }
-        else {
-            // This case should ideally not be reached if the regex is correct
-            if (m_errorHandler) {
-                m_errorHandler->handleError("Unknown operator encountered: " + op);
+            entry.program = std::move(program);
+            // The position of an error belongs to this spelling of the text, so failed
+            // results are not kept.
+            if (!entry.error.isError()) {
+                m_cache.insert(key, entry);
             }
-            if (ok) *ok = false;
-            return qQNaN();
         }
+        if (entry.hasConstantResult) {
+            result.value = entry.value;
+            result.error = entry.error;
+        } else {
+            result.value = entry.program->evaluate(bindVariables(*entry.program), &result.error);
+        }
+        // Likewise a cached program reports positions in the spelling it was compiled
+        // from, so a failure is evaluated again from this text.
+        evaluated = result.ok() || !hit;
+    }
+    if (!evaluated) {
+        result = CalcResult();
+        const CompiledExpression program =
+            m_compiler.compile(source, &result.error, ExpressionCompiler::RejectVariables, &m_symbols);
+        if (result.ok()) {
+            result.value = program.evaluate(bindVariables(program), &result.error);
+        }
+    }
+
+    if (!result.ok()) {
+        result.value = qQNaN();
+    }
+    return result;
+}
+
+CalcResult CalculatorCore::calculate(const QString &expression)
+{
+    return evaluateSource(sourceView(expression));
+}
+
+CalcResult CalculatorCore::calculate(std::string_view utf8Expression)
+{
+    return evaluateSource(utf8Expression);
+}
+
+template <typename CharT>
+DecimalResult CalculatorCore::evaluateDecimal(std::basic_string_view<CharT> source, int precision) const
+{
+    const DecimalContext context(precision);
+    DecimalResult result;
+    const std::shared_lock<std::shared_mutex> symbolsLock(m_symbolsMutex);
+
+    const CompiledExpression program =
+        m_compiler.compile(source, &result.error, ExpressionCompiler::RejectVariables, &m_symbols);
+    if (!result.ok()) {
+        return result;
+    }
+
+    // Looked up by precision too: the same text rounds differently at another precision.
+    // Results that depend on definitions can change with them and are not memoized.
+    thread_local std::string key;
+    ResultMemo *memo = resultMemo();
+    const bool memoize = memo && !program.usesSymbols() && ExpressionCache::normalize(source, key);
+    if (memoize) {
+        std::string cached;
+        if (memo->lookup(key, context.precision(), &cached) && BigDecimal::fromString(cached, &result.value)) {
+            return result;
+        }
+    }
+
+    result = DecimalEvaluator::evaluate(program, source, context, bindVariables(program));
+    if (memoize && result.ok()) {
+        memo->store(key, context.precision(), result.value.toString());
+    }
+    return result;
+}
+
+DecimalResult CalculatorCore::calculateDecimal(const QString &expression, int precision) const
+{
+    return evaluateDecimal(sourceView(expression), precision);
+}
+
+DecimalResult CalculatorCore::calculateDecimal(std::string_view utf8Expression, int precision) const
+{
+    return evaluateDecimal(utf8Expression, precision);
+}
+
+CalcResult CalculatorCore::define(const QString &definition, std::string *canonical)
+{
+    return define(definition.toStdString(), canonical);
+}
+
+CalcResult CalculatorCore::define(std::string_view utf8Definition, std::string *canonical)
+{
+    CalcResult result;
+    ExpressionCompiler::Definition definition;
+    if (!ExpressionCompiler::parseDefinition(utf8Definition, &definition)) {
+        result.error = { CalcErrorCode::UnexpectedToken, 0 };
         return result;
     }
 
-    // If it's not a binary operation, try to convert directly (e.g., single number input)
-    bool conversionOk;
-    double result = expression.toDouble(&conversionOk);
-    if (conversionOk) {
+    std::unique_lock<std::shared_mutex> symbolsLock(m_symbolsMutex);
+    int slot = m_symbols.find(std::string_view(definition.name));
+    if (definition.name == "sqrt" || (slot >= 0 && m_symbols.kind(slot) == SymbolTable::Kind::Constant)) {
+        result.error = { CalcErrorCode::BuiltinRedefinition, 0 };
         return result;
     }
 
-    // If no match and not a single number, it's an invalid expression format
-    if (m_errorHandler) {
-        m_errorHandler->handleError("Invalid expression format: " + expression);
+    // Cached programs have functions inlined and variables bound to slots, so only
+    // binding a new value to an existing variable leaves them valid.
+    const bool wasVariable = slot >= 0 && m_symbols.kind(slot) == SymbolTable::Kind::Variable;
+    std::string text = definition.name;
+    if (definition.isFunction) {
+        slot = m_symbols.intern(definition.name);
+        result.error = m_compiler.checkFunction(definition, slot, m_symbols);
+        if (result.error.isError()) {
+            result.error.position += definition.bodyPosition;
+            return result;
+        }
+        text += '(';
+        for (size_t i = 0; i < definition.parameters.size(); ++i) {
+            text += (i == 0 ? "" : ", ") + definition.parameters[i];
+        }
+        text += ") = ";
+        text += definition.body.substr(std::min(definition.body.find_first_not_of(" \t"), definition.body.size()));
+        m_symbols.setFunction(slot, { definition.parameters, std::string(definition.body) });
+        m_cache.clear();
+    } else {
+        const CompiledExpression program =
+            m_compiler.compile(definition.body, &result.error, ExpressionCompiler::RejectVariables, &m_symbols);
+        if (result.ok()) {
+            result.value = program.evaluate(bindVariables(program), &result.error);
+        }
+        if (!result.ok()) {
+            result.error.position += definition.bodyPosition;
+            result.value = qQNaN();
+            return result;
+        }
+        slot = m_symbols.intern(definition.name);
+        m_symbols.setVariable(slot, result.value);
+        if (!wasVariable) {
+            m_cache.clear();
+        }
+
+        // Stored as the value rather than the expression, in its shortest exact form.
+        char digits[NumberFormat::MaxLength];
+        text += " = ";
+        text.append(digits, NumberFormat::format(result.value, digits));
     }
-    if (ok) *ok = false;
-    return qQNaN();
+    symbolsLock.unlock();
+
+    // Infinite values have no literal to be read back from.
+    if (m_symbolStore && (definition.isFunction || std::isfinite(result.value))) {
+        m_symbolStore->storeDefinition(definition.name, text);
+    }
+    if (canonical) {
+        *canonical = std::move(text);
+    }
+    return result;
+}
+
+bool CalculatorCore::isOperator(const QString &token) const
+{
+    bool known = false;
+    binaryOpCode(lexOperator(token), &known);
+    return known;
+}
+
+int CalculatorCore::getPrecedence(const QString &op) const
+{
+    bool known = false;
+    const OpCode code = binaryOpCode(lexOperator(op), &known);
+    return known ? ExpressionGrammar::precedence(code) : 0;
 }
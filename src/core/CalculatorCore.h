@@ -2,22 +2,124 @@
 #define CALCULATORCORE_H
 
 #include <QString>
-#include <QStack>
-#include "../utils/ErrorHandler.h"
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include "ExpressionCache.h"
+#include "DecimalEvaluator.h"
+#include "ExpressionCompiler.h"
+#include "ExpressionOptimizer.h"
+#include "ResultMemo.h"
+#include "SymbolStore.h"
+#include "SymbolTable.h"
 
+// Expression engine front end. It never shows UI: failures come back as a CalcResult
+// carrying an error code and source position, and turning those into messages is up to
+// the caller (MainWindow::handleCalculationError for the GUI). Safe to use from any
+// thread; concurrent callers share only the internally locked expression cache and
+// symbol table.
 class CalculatorCore
 {
 public:
-    CalculatorCore(ErrorHandler *errorHandler = nullptr);
+    CalculatorCore() = default;
 
-    double calculate(const QString &expression, bool *ok = nullptr);
+    CalcResult calculate(const QString &expression);
+    CalcResult calculate(std::string_view utf8Expression);
+
+    // Evaluates in decimal arithmetic rounded to precision significant digits, so
+    // "0.1 + 0.2" is exactly 0.3 and "2^200" keeps every digit. Bypasses the cache.
+    DecimalResult calculateDecimal(const QString &expression, int precision = DecimalContext::DefaultPrecision) const;
+    DecimalResult calculateDecimal(std::string_view utf8Expression,
+                                   int precision = DecimalContext::DefaultPrecision) const;
+
+    // Decimal results are looked up in memo before evaluating and recorded in it after;
+    // at high precision a lookup is far cheaper than the arithmetic. Double evaluation is
+    // cheaper than any lookup and never consults it. Expressions that name a symbol can
+    // change value and are never memoized. Only calls on the thread that set the memo use
+    // it, since a store such as DatabaseManager is bound to its thread. memo must outlive
+    // the core or be reset with nullptr.
+    void setResultMemo(ResultMemo *memo)
+    {
+        m_resultMemo = memo;
+        m_resultMemoThread = std::this_thread::get_id();
+    }
+
+    // "rate = 0.07" evaluates the right-hand side once and binds the name to the value;
+    // "f(x, y) = x^2 + y" defines a function that calculate() and calculateDecimal()
+    // inline wherever it is called. Names are resolved to symbol table slots when an
+    // expression is compiled, so evaluating it never looks a name up. A function body
+    // may use any name defined before it; pi and e are built in and read-only. Returns
+    // the assigned value, or NaN without an error for a function. Positions of errors
+    // count UTF-8 bytes. On success *canonical, if given, is the text passed to the store.
+    CalcResult define(const QString &definition, std::string *canonical = nullptr);
+    CalcResult define(std::string_view utf8Definition, std::string *canonical = nullptr);
+
+    // Every successful define() is passed on to store. store must outlive the core or be
+    // reset with nullptr.
+    void setSymbolStore(SymbolStore *store) { m_symbolStore = store; }
+
+    // Compiles an expression once so it can be evaluated any number of times. The program
+    // is run through ExpressionOptimizer; the default Strict mode never changes a result.
+    CompiledExpression compile(const QString &expression, CalcError *error = nullptr,
+                               ExpressionOptimizer::Mode optimization = ExpressionOptimizer::Strict) const;
+
+    // Compiles an expression whose identifiers are free variables, listed in order of first
+    // use by CompiledExpression::variables(), e.g. "a*b + c^2" -> { "a", "b", "c" }.
+    CompiledExpression compileWithVariables(const QString &expression, CalcError *error = nullptr,
+                                            ExpressionOptimizer::Mode optimization = ExpressionOptimizer::Strict) const;
+    CompiledExpression compileWithVariables(std::string_view utf8Expression, CalcError *error = nullptr,
+                                            ExpressionOptimizer::Mode optimization = ExpressionOptimizer::Strict) const;
+
+    // Compiles against the constants and definitions calculate() sees, with any other
+    // identifier as a free variable, and leaves the program unoptimized. For --dump-ir.
+    CompiledExpression compileUnoptimized(std::string_view utf8Expression, CalcError *error = nullptr) const;
+
+    // Backend that programs returned by compile() and compileWithVariables() run on.
+    // Threaded code is faster for programs evaluated many times and gives the same
+    // results; calculate() only evaluates each distinct expression once and ignores it.
+    // Set it before the core is shared between threads.
+    void setExecutionBackend(ExecutionBackend backend) { m_backend = backend; }
+    ExecutionBackend executionBackend() const { return m_backend; }
+
+    // Evaluates program once per row over struct-of-arrays input (columns[i] holds the
+    // values of program.variables()[i]) with SIMD kernels, see VectorEvaluator. Failures
+    // are reported per row through rowErrors. Returns the number of rows that failed.
+    size_t evaluateColumns(const CompiledExpression &program, const double *const *columns, size_t rows,
+                           double *results, CalcErrorCode *rowErrors = nullptr) const;
+
+    // Compiled-expression cache used by calculate(). Safe to call from any thread. With a
+    // capacity of 0, calculate() compiles every expression directly.
+    ExpressionCache::Stats cacheStats() const { return m_cache.stats(); }
+    void setCacheCapacity(size_t capacity) { m_cache.setCapacity(capacity); }
+    void clearCache() { m_cache.clear(); }
 
 private:
-    ErrorHandler *m_errorHandler;
+    ExpressionCompiler m_compiler;
+    ExpressionCache m_cache;
+    ResultMemo *m_resultMemo = nullptr;
+    std::thread::id m_resultMemoThread;
+    ExecutionBackend m_backend = ExecutionBackend::Interpreter;
+    SymbolTable m_symbols;
+    mutable std::shared_mutex m_symbolsMutex; // Exclusive for define(), shared for every compile
+    SymbolStore *m_symbolStore = nullptr;
+
+    ResultMemo *resultMemo() const
+    {
+        return std::this_thread::get_id() == m_resultMemoThread ? m_resultMemo : nullptr;
+    }
+    CompiledExpression prepare(const CompiledExpression &program, ExpressionOptimizer::Mode optimization) const;
+    // Values of the variables of a program compiled against m_symbols, read by slot into
+    // a per-thread buffer that stays valid until the next call on the same thread.
+    const double *bindVariables(const CompiledExpression &program) const;
+
+    template <typename CharT>
+    CalcResult evaluateSource(std::basic_string_view<CharT> source);
+    template <typename CharT>
+    DecimalResult evaluateDecimal(std::basic_string_view<CharT> source, int precision) const;
 
     bool isOperator(const QString &token) const;
     int getPrecedence(const QString &op) const;
-    double applyOperator(double operand1, double operand2, const QString &op, bool *ok);
 };
 
-#endif // CALCULATORCORE_H
\ No newline at end of file
+#endif // CALCULATORCORE_H
@@ -0,0 +1,629 @@
+#include "ColumnarHistoryStore.h"
+#include "LatencyStats.h"
+#include "NumberFormat.h"
+#include <QDateTime>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStringMatcher>
+#include <QThread>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+
+namespace {
+    constexpr char FileMagic[8] = { 'C', 'A', 'L', 'C', 'H', 'C', 'O', 'L' };
+    constexpr char FooterMagic[8] = { 'C', 'A', 'L', 'C', 'H', 'I', 'D', 'X' };
+    constexpr quint32 FileVersion = 1;
+    constexpr quint32 SegmentMagic = 0x4d474553; // "SEGM"
+
+    // At offset 0; segments start right after it.
+    struct FileHeader
+    {
+        char magic[8];
+        quint32 version;
+        quint32 segmentRows;
+        char reserved[48];
+    };
+    constexpr qint64 FileHeaderSize = sizeof(FileHeader);
+    static_assert(FileHeaderSize == 64);
+
+    // Last in a closed file, after the offsets of its segments.
+    struct Trailer
+    {
+        quint64 segmentCount;
+        quint64 rowCount;
+        char magic[8];
+    };
+
+    qint64 align8(qint64 offset)
+    {
+        return (offset + 7) & ~qint64(7);
+    }
+
+    qint64 floorDiv(qint64 value, qint64 divisor)
+    {
+        const qint64 quotient = value / divisor;
+        return quotient * divisor > value ? quotient - 1 : quotient;
+    }
+
+    // Days since 1970-01-01 of a proleptic Gregorian date, and back.
+    qint64 daysFromCivil(qint64 year, unsigned month, unsigned day)
+    {
+        year -= month <= 2;
+        const qint64 era = (year >= 0 ? year : year - 399) / 400;
+        const unsigned yearOfEra = static_cast<unsigned>(year - era * 400);
+        const unsigned dayOfYear = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+        const unsigned dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+        return era * 146097 + dayOfEra - 719468;
+    }
+
+    void civilFromDays(qint64 days, qint64 *year, unsigned *month, unsigned *day)
+    {
+        days += 719468;
+        const qint64 era = (days >= 0 ? days : days - 146096) / 146097;
+        const unsigned dayOfEra = static_cast<unsigned>(days - era * 146097);
+        const unsigned yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+        const unsigned dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+        const unsigned shiftedMonth = (5 * dayOfYear + 2) / 153;
+        *day = dayOfYear - (153 * shiftedMonth + 2) / 5 + 1;
+        *month = shiftedMonth < 10 ? shiftedMonth + 3 : shiftedMonth - 9;
+        *year = yearOfEra + era * 400 + (*month <= 2);
+    }
+}
+
+struct ColumnarHistoryStore::SegmentHeader
+{
+    quint32 magic;
+    quint32 rows;
+    quint64 heapUnits; // Text in the heap, in UTF-16 code units
+    quint64 reserved[2];
+};
+
+namespace {
+    constexpr qint64 SegmentHeaderSize = 32;
+    constexpr qint64 SegmentFixedSize = SegmentHeaderSize + qint64(ColumnarHistoryStore::SegmentRows)
+                                                                * (sizeof(qint64) + sizeof(quint64) + sizeof(double) + sizeof(quint32));
+}
+
+// Converts between seconds since the epoch and the local ISO 8601 text the SQLite
+// history keeps ("2024-05-01T12:00:00"). QDateTime takes microseconds per conversion,
+// which dominates exporting millions of entries, so it is only asked for the UTC offset,
+// once per hour of timestamps, and the calendar arithmetic is done here. Not shared
+// between threads.
+class ColumnarHistoryStore::TimeText
+{
+public:
+    QString format(qint64 seconds)
+    {
+        const qint64 hour = floorDiv(seconds, 3600);
+        if (hour != formatHour) {
+            formatHour = hour;
+            formatOffset = QDateTime::fromSecsSinceEpoch(seconds).offsetFromUtc();
+        }
+        const qint64 local = seconds + formatOffset;
+        const qint64 days = floorDiv(local, 86400);
+        const int secondOfDay = static_cast<int>(local - days * 86400);
+        qint64 year;
+        unsigned month, day;
+        civilFromDays(days, &year, &month, &day);
+        char text[40];
+        const int length = std::snprintf(text, sizeof text, "%04lld-%02u-%02uT%02d:%02d:%02d", static_cast<long long>(year),
+                                         month, day, secondOfDay / 3600, secondOfDay / 60 % 60, secondOfDay % 60);
+        return QString::fromLatin1(text, length);
+    }
+
+    // Text as written by the calculator is converted here; anything else QDateTime
+    // accepts as ISO 8601 goes through it. Empty or unreadable text gives fallback.
+    qint64 parse(std::string_view text, qint64 fallback)
+    {
+        int year, month, day, hour, minute, second;
+        if (text.size() == 19 && text[4] == '-' && text[7] == '-' && (text[10] == 'T' || text[10] == ' ')
+            && text[13] == ':' && text[16] == ':' && digits(text, 0, 4, &year) && digits(text, 5, 2, &month)
+            && digits(text, 8, 2, &day) && digits(text, 11, 2, &hour) && digits(text, 14, 2, &minute)
+            && digits(text, 17, 2, &second) && month >= 1 && month <= 12 && day >= 1
+            && day <= QDate(year, month, 1).daysInMonth() && hour < 24 && minute < 60 && second < 60) {
+            const qint64 local = daysFromCivil(year, month, day) * 86400 + hour * 3600 + minute * 60 + second;
+            const qint64 localHour = floorDiv(local, 3600);
+            if (localHour != parseHour) {
+                parseHour = localHour;
+                parseOffset = QDateTime(QDate(year, month, day), QTime(hour, 0)).offsetFromUtc();
+            }
+            return local - parseOffset;
+        }
+        if (text.empty()) {
+            return fallback;
+        }
+        const QDateTime parsed =
+            QDateTime::fromString(QString::fromUtf8(text.data(), static_cast<qsizetype>(text.size())), Qt::ISODate);
+        return parsed.isValid() ? parsed.toSecsSinceEpoch() : fallback;
+    }
+
+private:
+    static bool digits(std::string_view text, size_t at, size_t count, int *value)
+    {
+        *value = 0;
+        for (size_t i = at; i < at + count; ++i) {
+            if (text[i] < '0' || text[i] > '9') return false;
+            *value = *value * 10 + (text[i] - '0');
+        }
+        return true;
+    }
+
+    qint64 formatHour = std::numeric_limits<qint64>::min();
+    qint64 formatOffset = 0;
+    qint64 parseHour = std::numeric_limits<qint64>::min();
+    qint64 parseOffset = 0;
+};
+
+ColumnarHistoryStore::ColumnarHistoryStore(QObject *parent)
+    : HistoryStore(parent)
+{
+}
+
+ColumnarHistoryStore::~ColumnarHistoryStore()
+{
+    close();
+}
+
+bool ColumnarHistoryStore::isColumnarPath(const QString &path)
+{
+    return QFileInfo(path).suffix().compare("col", Qt::CaseInsensitive) == 0;
+}
+
+bool ColumnarHistoryStore::open(const QString &path)
+{
+    close();
+    QWriteLocker locker(&lock);
+    file.setFileName(path);
+    if (!file.open(QIODevice::ReadWrite)) {
+        return false;
+    }
+    const qint64 size = file.size();
+    FileHeader header = {};
+    if (size == 0) {
+        std::memcpy(header.magic, FileMagic, sizeof header.magic);
+        header.version = FileVersion;
+        header.segmentRows = SegmentRows;
+        if (file.write(reinterpret_cast<const char *>(&header), sizeof header) != FileHeaderSize) {
+            file.close();
+            return false;
+        }
+        dataEnd = FileHeaderSize;
+    } else {
+        if (file.read(reinterpret_cast<char *>(&header), sizeof header) != FileHeaderSize
+            || std::memcmp(header.magic, FileMagic, sizeof header.magic) != 0 || header.version != FileVersion
+            || header.segmentRows != SegmentRows) {
+            file.close();
+            return false;
+        }
+        mapping = file.map(0, size);
+        if (!mapping) {
+            file.close();
+            return false;
+        }
+        mappedSize = size;
+        if (!readFooter(size)) {
+            walkSegments(size);
+        }
+        file.unmap(mapping);
+        mapping = nullptr;
+        mappedSize = 0;
+    }
+    // Until close() the file ends in zeroed room for appends instead of the footer.
+    if (!file.resize(dataEnd) || !reserve(dataEnd)) {
+        file.close();
+        return false;
+    }
+    locker.unlock();
+
+    stopping = false;
+    searchThread = QThread::create([this] { runSearches(); });
+    searchThread->start();
+    return true;
+}
+
+void ColumnarHistoryStore::close()
+{
+    if (searchThread) {
+        {
+            QMutexLocker searchLocker(&searchMutex);
+            stopping = true;
+            searchRequested.wakeOne();
+        }
+        searchThread->wait();
+        delete searchThread;
+        searchThread = nullptr;
+    }
+
+    QWriteLocker locker(&lock);
+    if (!file.isOpen()) {
+        return;
+    }
+    if (mapping) {
+        file.unmap(mapping);
+        mapping = nullptr;
+        mappedSize = 0;
+    }
+    if (file.resize(dataEnd) && file.seek(dataEnd)) {
+        Trailer trailer = { segmentOffsets.size(), static_cast<quint64>(rowCount), {} };
+        std::memcpy(trailer.magic, FooterMagic, sizeof trailer.magic);
+        file.write(reinterpret_cast<const char *>(segmentOffsets.data()),
+                   static_cast<qint64>(segmentOffsets.size() * sizeof(qint64)));
+        file.write(reinterpret_cast<const char *>(&trailer), sizeof trailer);
+    }
+    file.close();
+    segmentOffsets.clear();
+    rowCount = 0;
+    dataEnd = 0;
+}
+
+ColumnarHistoryStore::Columns ColumnarHistoryStore::columns(size_t segment) const
+{
+    static_assert(sizeof(SegmentHeader) == SegmentHeaderSize);
+    uchar *base = mapping + segmentOffsets[segment];
+    Columns result;
+    result.header = reinterpret_cast<SegmentHeader *>(base);
+    base += SegmentHeaderSize;
+    result.timestamps = reinterpret_cast<qint64 *>(base);
+    base += SegmentRows * sizeof(qint64);
+    result.textEnds = reinterpret_cast<quint64 *>(base);
+    base += SegmentRows * sizeof(quint64);
+    result.values = reinterpret_cast<double *>(base);
+    base += SegmentRows * sizeof(double);
+    result.splits = reinterpret_cast<quint32 *>(base);
+    base += SegmentRows * sizeof(quint32);
+    result.heap = reinterpret_cast<char16_t *>(base);
+    return result;
+}
+
+HistoryEntry ColumnarHistoryStore::entryAt(qint64 row, TimeText &times) const
+{
+    const Columns segment = columns(static_cast<size_t>(row / SegmentRows));
+    const quint32 index = static_cast<quint32>(row % SegmentRows);
+    const quint64 start = index > 0 ? segment.textEnds[index - 1] : 0;
+    const qsizetype split = segment.splits[index];
+    const QChar *text = reinterpret_cast<const QChar *>(segment.heap + start);
+    return { row + 1, times.format(segment.timestamps[index]), QString(text, split),
+             QString(text + split, static_cast<qsizetype>(segment.textEnds[index] - start) - split) };
+}
+
+bool ColumnarHistoryStore::readFooter(qint64 size)
+{
+    Trailer trailer;
+    if (size < FileHeaderSize + qint64(sizeof trailer)) {
+        return false;
+    }
+    std::memcpy(&trailer, mapping + size - sizeof trailer, sizeof trailer);
+    if (std::memcmp(trailer.magic, FooterMagic, sizeof trailer.magic) != 0
+        || trailer.segmentCount > quint64(size) / sizeof(qint64)) {
+        return false;
+    }
+    const qint64 footerStart = size - qint64(sizeof trailer) - qint64(trailer.segmentCount * sizeof(qint64));
+    if (footerStart < FileHeaderSize) {
+        return false;
+    }
+    std::vector<qint64> offsets(trailer.segmentCount);
+    std::memcpy(offsets.data(), mapping + footerStart, trailer.segmentCount * sizeof(qint64));
+
+    // Every segment but the last is full, so only the last one's header needs reading.
+    qint64 end = FileHeaderSize;
+    quint64 rows = 0;
+    if (!offsets.empty()) {
+        for (size_t i = 1; i < offsets.size(); ++i) {
+            if (offsets[i] <= offsets[i - 1]) return false;
+        }
+        const qint64 last = offsets.back();
+        if (offsets.front() != FileHeaderSize || last % 8 != 0 || last + SegmentFixedSize > footerStart) {
+            return false;
+        }
+        SegmentHeader header;
+        std::memcpy(&header, mapping + last, sizeof header);
+        if (header.magic != SegmentMagic || header.rows > SegmentRows || header.heapUnits > quint64(size)) {
+            return false;
+        }
+        end = last + SegmentFixedSize + qint64(header.heapUnits) * 2;
+        rows = (offsets.size() - 1) * quint64(SegmentRows) + header.rows;
+    }
+    if (end != footerStart || rows != trailer.rowCount) {
+        return false;
+    }
+    segmentOffsets = std::move(offsets);
+    rowCount = static_cast<qint64>(rows);
+    dataEnd = end;
+    return true;
+}
+
+void ColumnarHistoryStore::walkSegments(qint64 size)
+{
+    segmentOffsets.clear();
+    rowCount = 0;
+    dataEnd = FileHeaderSize;
+    for (qint64 offset = FileHeaderSize; offset + SegmentFixedSize <= size;) {
+        SegmentHeader header;
+        std::memcpy(&header, mapping + offset, sizeof header);
+        if (header.magic != SegmentMagic || header.rows > SegmentRows || header.heapUnits > quint64(size)
+            || offset + SegmentFixedSize + qint64(header.heapUnits) * 2 > size) {
+            break;
+        }
+        segmentOffsets.push_back(offset);
+        rowCount += header.rows;
+        dataEnd = offset + SegmentFixedSize + qint64(header.heapUnits) * 2;
+        if (header.rows < SegmentRows) {
+            break;
+        }
+        offset = align8(dataEnd);
+    }
+}
+
+bool ColumnarHistoryStore::reserve(qint64 size)
+{
+    if (size <= mappedSize) {
+        return true;
+    }
+    // Grown sparsely, at least doubling, so appends remap rarely; close() trims the rest.
+    const qint64 target = std::max(size, mappedSize * 2);
+    const qint64 newSize = (target + GrowthStep - 1) / GrowthStep * GrowthStep;
+    if (mapping) {
+        file.unmap(mapping);
+        mapping = nullptr;
+        mappedSize = 0;
+    }
+    const bool grown = file.resize(newSize);
+    const qint64 mapSize = file.size();
+    mapping = file.map(0, mapSize);
+    mappedSize = mapping ? mapSize : 0;
+    return grown && mapping;
+}
+
+bool ColumnarHistoryStore::append(qint64 timestamp, QStringView expression, QStringView result)
+{
+    if (expression.size() > std::numeric_limits<quint32>::max()) {
+        return false;
+    }
+    if (segmentOffsets.empty() || columns(segmentOffsets.size() - 1).header->rows == SegmentRows) {
+        const qint64 offset = align8(dataEnd);
+        if (!reserve(offset + SegmentFixedSize)) {
+            return false;
+        }
+        *reinterpret_cast<SegmentHeader *>(mapping + offset) = { SegmentMagic, 0, 0, { 0, 0 } };
+        segmentOffsets.push_back(offset);
+        dataEnd = offset + SegmentFixedSize;
+    }
+    const qint64 units = expression.size() + result.size();
+    if (!reserve(dataEnd + units * 2)) {
+        return false;
+    }
+
+    const Columns segment = columns(segmentOffsets.size() - 1);
+    const quint32 row = segment.header->rows;
+    const quint64 textStart = segment.header->heapUnits;
+    std::memcpy(segment.heap + textStart, expression.utf16(), expression.size() * sizeof(char16_t));
+    std::memcpy(segment.heap + textStart + expression.size(), result.utf16(), result.size() * sizeof(char16_t));
+    double value = 0;
+    const bool numeric = NumberFormat::parse(result, &value);
+    segment.timestamps[row] = timestamp;
+    segment.textEnds[row] = textStart + units;
+    segment.values[row] = numeric ? value : std::numeric_limits<double>::quiet_NaN();
+    segment.splits[row] = static_cast<quint32>(expression.size());
+    // Counted only once written, so an interrupted append leaves no half row behind.
+    segment.header->heapUnits = textStart + units;
+    segment.header->rows = row + 1;
+    dataEnd += units * 2;
+    ++rowCount;
+    return true;
+}
+
+void ColumnarHistoryStore::truncateRows(qint64 rows)
+{
+    const size_t keep = static_cast<size_t>((rows + SegmentRows - 1) / SegmentRows);
+    for (size_t segment = keep; segment < segmentOffsets.size(); ++segment) {
+        columns(segment).header->magic = 0; // Not picked up again by walkSegments()
+    }
+    segmentOffsets.resize(keep);
+    rowCount = rows;
+    dataEnd = FileHeaderSize;
+    if (keep > 0) {
+        const Columns last = columns(keep - 1);
+        const quint32 lastRows = static_cast<quint32>(rows - qint64(keep - 1) * SegmentRows);
+        last.header->rows = lastRows;
+        last.header->heapUnits = last.textEnds[lastRows - 1];
+        dataEnd = segmentOffsets.back() + SegmentFixedSize + qint64(last.header->heapUnits) * 2;
+    }
+}
+
+bool ColumnarHistoryStore::addHistoryEntry(const QString &expression, const QString &result)
+{
+    const LatencyStats::Scope timing(LatencyStats::AddHistoryEntry);
+    QWriteLocker locker(&lock);
+    return file.isOpen() && append(QDateTime::currentSecsSinceEpoch(), expression, result);
+}
+
+QList<HistoryEntry> ColumnarHistoryStore::fetchHistoryPage(qint64 beforeId, int limit)
+{
+    const LatencyStats::Scope timing(LatencyStats::FetchHistoryPage);
+    QList<HistoryEntry> page;
+    QReadLocker locker(&lock);
+    if (!file.isOpen() || limit <= 0) {
+        return page;
+    }
+    const qint64 end = beforeId > 0 ? std::min(beforeId - 1, rowCount) : rowCount;
+    page.reserve(std::min<qint64>(limit, end));
+    TimeText times;
+    for (qint64 row = end - 1; row >= 0 && page.size() < limit; --row) {
+        page.append(entryAt(row, times));
+    }
+    return page;
+}
+
+qint64 ColumnarHistoryStore::historyCount()
+{
+    QReadLocker locker(&lock);
+    return rowCount;
+}
+
+quint64 ColumnarHistoryStore::searchHistory(const HistorySearch &search, qint64 beforeId, int limit)
+{
+    if (!searchThread) {
+        return 0;
+    }
+    QMutexLocker locker(&searchMutex);
+    pendingSearch = { search, beforeId, limit, ++lastSearchGeneration };
+    hasPendingSearch = true;
+    searchRequested.wakeOne();
+    return lastSearchGeneration;
+}
+
+bool ColumnarHistoryStore::isSearchCurrent(quint64 generation)
+{
+    QMutexLocker locker(&searchMutex);
+    return generation == lastSearchGeneration && !stopping;
+}
+
+void ColumnarHistoryStore::runSearches()
+{
+    QMutexLocker locker(&searchMutex);
+    for (;;) {
+        while (!hasPendingSearch && !stopping) {
+            searchRequested.wait(&searchMutex);
+        }
+        if (stopping) {
+            return;
+        }
+        const SearchRequest request = pendingSearch;
+        hasPendingSearch = false;
+        locker.unlock();
+
+        const HistorySearch &search = request.search;
+        const QStringMatcher matcher(search.text, Qt::CaseInsensitive);
+        TimeText times;
+        QList<HistoryEntry> page;
+        bool current = true;
+        qint64 row = std::numeric_limits<qint64>::max();
+        if (request.beforeId > 0) {
+            row = request.beforeId - 2;
+        }
+        // One segment per read lock, so added entries never wait for a whole scan.
+        while (row >= 0 && page.size() < request.limit) {
+            if (!isSearchCurrent(request.generation)) {
+                current = false;
+                break;
+            }
+            QReadLocker readLocker(&lock);
+            row = std::min(row, rowCount - 1); // The history may have been cleared meanwhile
+            if (row < 0) {
+                break;
+            }
+            const Columns segment = columns(static_cast<size_t>(row / SegmentRows));
+            for (qint64 index = row % SegmentRows; index >= 0 && page.size() < request.limit; --index, --row) {
+                const double value = segment.values[index];
+                if ((search.minValue && !(value >= *search.minValue)) || (search.maxValue && !(value <= *search.maxValue))) {
+                    continue; // NaN, a result that is not a number, fails both
+                }
+                if (!search.text.isEmpty()) {
+                    const quint64 start = index > 0 ? segment.textEnds[index - 1] : 0;
+                    const qsizetype split = segment.splits[index];
+                    const QStringView expression(segment.heap + start, split);
+                    const QStringView result(segment.heap + start + split,
+                                             static_cast<qsizetype>(segment.textEnds[index] - start) - split);
+                    if (matcher.indexIn(expression) < 0 && matcher.indexIn(result) < 0) {
+                        continue;
+                    }
+                }
+                page.append(entryAt(row, times));
+            }
+        }
+
+        locker.relock();
+        if (current && request.generation == lastSearchGeneration && !stopping) {
+            emit historySearchFinished(request.generation, page);
+        }
+    }
+}
+
+bool ColumnarHistoryStore::clearHistory()
+{
+    QWriteLocker locker(&lock);
+    if (!file.isOpen()) {
+        return false;
+    }
+    truncateRows(0);
+    // Hand the space back; the next entry grows the file again.
+    file.unmap(mapping);
+    mapping = nullptr;
+    mappedSize = 0;
+    return file.resize(dataEnd) && reserve(dataEnd);
+}
+
+bool ColumnarHistoryStore::exportHistory(const QString &path, HistoryExchange::Format format, qint64 *count,
+                                         QString *error)
+{
+    if (!isOpen()) {
+        return fail(error, "The history file is not open.");
+    }
+    QSaveFile output(path);
+    if (!output.open(QIODevice::WriteOnly)) {
+        return fail(error, output.errorString());
+    }
+    HistoryExchange::Writer writer(&output, format);
+    TimeText times;
+    qint64 row = 0;
+    bool ok = true;
+    // Locked a segment at a time, as searches are; entries added meanwhile are included.
+    while (ok) {
+        QReadLocker locker(&lock);
+        const qint64 segmentEnd = std::min(rowCount, (row / SegmentRows + 1) * SegmentRows);
+        if (row >= segmentEnd) {
+            break;
+        }
+        for (; ok && row < segmentEnd; ++row) {
+            const HistoryEntry entry = entryAt(row, times);
+            ok = writer.write(entry.timestamp, entry.expression, entry.result);
+        }
+    }
+    if (!ok || !writer.finish() || !output.commit()) {
+        return fail(error, output.errorString());
+    }
+    if (count) *count = row;
+    return true;
+}
+
+bool ColumnarHistoryStore::importHistory(const QString &path, HistoryExchange::Format format, qint64 *count,
+                                         QString *error)
+{
+    QFile input(path);
+    if (!input.open(QIODevice::ReadOnly)) {
+        return fail(error, input.errorString());
+    }
+    const qint64 size = input.size();
+    uchar *data = size > 0 ? input.map(0, size) : nullptr;
+    if (size > 0 && !data) {
+        return fail(error, input.errorString());
+    }
+
+    HistoryExchange::Reader reader(reinterpret_cast<const char *>(data), size, format);
+    TimeText times;
+    const qint64 now = QDateTime::currentSecsSinceEpoch();
+    QWriteLocker locker(&lock);
+    if (!file.isOpen()) {
+        return fail(error, "The history file is not open.");
+    }
+    const qint64 before = rowCount;
+    HistoryExchange::Record record;
+    QString expression;
+    QString result;
+    while (reader.next(&record)) {
+        expression = QString::fromUtf8(record.expression.data(), static_cast<qsizetype>(record.expression.size()));
+        result = QString::fromUtf8(record.result.data(), static_cast<qsizetype>(record.result.size()));
+        if (!append(times.parse(record.timestamp, now), expression, result)) {
+            truncateRows(before);
+            return fail(error, file.errorString());
+        }
+    }
+    if (reader.hasError()) {
+        truncateRows(before);
+        return fail(error, reader.errorString());
+    }
+    if (count) *count = rowCount - before;
+    return true;
+}
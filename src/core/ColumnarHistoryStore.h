@@ -0,0 +1,120 @@
+#ifndef COLUMNARHISTORYSTORE_H
+#define COLUMNARHISTORYSTORE_H
+
+#include <QFile>
+#include <QMutex>
+#include <QReadWriteLock>
+#include <QWaitCondition>
+#include <vector>
+#include "HistoryStore.h"
+
+class QThread;
+
+// History kept in an append-only, memory-mapped file of fixed-width columns rather than
+// SQLite rows, for histories of many millions of entries. Entry ids are row numbers
+// counted from 1. Rows are stored in segments of SegmentRows; a segment holds one array
+// per column, sized for the whole segment, followed by a heap with the UTF-16 text of
+// its entries:
+//
+//   timestamp  int64   seconds since the epoch
+//   textEnd    uint64  end of the entry's text in the heap, in UTF-16 code units
+//   value      double  the result as a number, NaN if it is not one
+//   split      uint32  length of the expression; the result text follows it
+//
+// Reading an entry is O(1) (its segment by index, then one slot per column) and copies
+// its text straight out of the mapping, with no decoding and no QVariant in between.
+// The result text is kept as well as its value, so decimal-mode digits survive.
+//
+// Only the last segment grows. The index of segment offsets is written as a footer
+// when the file is closed; after a crash it is rebuilt by walking the segment headers,
+// which are updated after the row they count. Numbers are in the byte order of the
+// machine. Searches scan the columns newest first on a thread of their own.
+class ColumnarHistoryStore : public HistoryStore
+{
+    Q_OBJECT
+
+public:
+    static constexpr quint32 SegmentRows = 1 << 16;
+    static constexpr qint64 GrowthStep = 16 << 20; // The file grows by at least this much
+    static constexpr const char *DefaultPath = "calc_history.col";
+
+    explicit ColumnarHistoryStore(QObject *parent = nullptr);
+    ~ColumnarHistoryStore() override;
+
+    // Opens path, creating it if it does not exist. Fails for a file that is not a
+    // columnar history, which is left untouched.
+    bool open(const QString &path);
+    void close();
+    bool isOpen() const { return file.isOpen(); }
+
+    // True for the file names open() is meant for, those ending in ".col". The command
+    // line tools use it to tell a columnar history from a SQLite database.
+    static bool isColumnarPath(const QString &path);
+
+    bool addHistoryEntry(const QString &expression, const QString &result) override;
+    // Entries are in the mapping as soon as they are added; nothing is buffered.
+    void flushHistory() override {}
+
+    QList<HistoryEntry> fetchHistoryPage(qint64 beforeId = 0, int limit = DefaultPageSize) override;
+    qint64 historyCount() override;
+    quint64 searchHistory(const HistorySearch &search, qint64 beforeId = 0, int limit = DefaultPageSize) override;
+    bool clearHistory() override;
+
+    bool exportHistory(const QString &path, HistoryExchange::Format format, qint64 *count = nullptr,
+                       QString *error = nullptr) override;
+    // Appends straight into the mapping; a malformed entry truncates the file back to
+    // the rows it had before.
+    bool importHistory(const QString &path, HistoryExchange::Format format, qint64 *count = nullptr,
+                       QString *error = nullptr) override;
+
+private:
+    struct SegmentHeader;
+    class TimeText;
+
+    // A segment's columns, pointing into the current mapping.
+    struct Columns
+    {
+        SegmentHeader *header;
+        qint64 *timestamps;
+        quint64 *textEnds;
+        double *values;
+        quint32 *splits;
+        char16_t *heap;
+    };
+
+    struct SearchRequest
+    {
+        HistorySearch search;
+        qint64 beforeId = 0;
+        int limit = 0;
+        quint64 generation = 0;
+    };
+
+    QFile file;
+    uchar *mapping = nullptr;
+    qint64 mappedSize = 0;
+    std::vector<qint64> segmentOffsets;
+    qint64 rowCount = 0;
+    qint64 dataEnd = 0;     // End of the last segment's heap
+    mutable QReadWriteLock lock; // Guards the members above against the search thread
+
+    QThread *searchThread = nullptr;
+    QMutex searchMutex;
+    QWaitCondition searchRequested;
+    SearchRequest pendingSearch;     // Guarded by searchMutex
+    bool hasPendingSearch = false;   // Guarded by searchMutex
+    quint64 lastSearchGeneration = 0; // Guarded by searchMutex
+    bool stopping = false;           // Guarded by searchMutex
+
+    Columns columns(size_t segment) const;
+    HistoryEntry entryAt(qint64 row, TimeText &times) const;
+    bool readFooter(qint64 size);
+    void walkSegments(qint64 size);
+    bool reserve(qint64 size);
+    bool append(qint64 timestamp, QStringView expression, QStringView result);
+    void truncateRows(qint64 rows);
+    void runSearches();
+    bool isSearchCurrent(quint64 generation);
+};
+
+#endif // COLUMNARHISTORYSTORE_H
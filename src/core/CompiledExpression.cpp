@@ -0,0 +1,107 @@
+#include "CompiledExpression.h"
+
+namespace
+{
+    // Programs produced from typical input need only a handful of stack slots; deeper
+    // ones fall back to a heap buffer.
+    constexpr int InlineStackSize = 64;
+}
+
+int CompiledExpression::variableIndex(std::string_view name) const
+{
+    for (size_t i = 0; i < m_variables.size(); ++i) {
+        if (m_variables[i] == name) return static_cast<int>(i);
+    }
+    return -1;
+}
+
+void CompiledExpression::setBackend(ExecutionBackend backend)
+{
+    if (backend == ExecutionBackend::ThreadedCode) {
+        m_threadedCode = ThreadedCode::lower(*this);
+    } else {
+        m_threadedCode.clear();
+        m_threadedCode.shrink_to_fit();
+    }
+}
+
+double CompiledExpression::evaluate(const double *values, CalcError *error) const
+{
+    if (m_code.empty()) {
+        if (error) *error = { CalcErrorCode::EmptyExpression, 0 };
+        return NAN;
+    }
+    if (!values && !m_variables.empty()) {
+        for (size_t i = 0; i < m_code.size(); ++i) {
+            if (m_code[i].op == OpCode::PushVariable) {
+                if (error) *error = { CalcErrorCode::UnknownIdentifier, sourcePosition(i) };
+                break;
+            }
+        }
+        return NAN;
+    }
+    if (!m_threadedCode.empty()) {
+        return ThreadedCode::run(m_threadedCode, m_maxStackDepth, values, error);
+    }
+
+    double inlineStack[InlineStackSize];
+    std::vector<double> heapStack;
+    double *stack = inlineStack;
+    if (m_maxStackDepth > InlineStackSize) {
+        heapStack.resize(static_cast<size_t>(m_maxStackDepth));
+        stack = heapStack.data();
+    }
+
+    const double *constants = m_constants.data();
+    CalcErrorCode status = CalcErrorCode::None;
+    int top = -1;
+
+    const size_t count = m_code.size();
+    for (size_t i = 0; i < count; ++i) {
+        const Instruction &instruction = m_code[i];
+        switch (instruction.op) {
+            case OpCode::PushConst:
+                stack[++top] = constants[instruction.operand];
+                break;
+            case OpCode::PushVariable:
+                stack[++top] = values[instruction.operand];
+                break;
+            case OpCode::Negate:
+                stack[top] = -stack[top];
+                break;
+            case OpCode::Add:
+                --top;
+                stack[top] += stack[top + 1];
+                break;
+            case OpCode::Subtract:
+                --top;
+                stack[top] -= stack[top + 1];
+                break;
+            case OpCode::Multiply:
+                --top;
+                stack[top] *= stack[top + 1];
+                break;
+            case OpCode::Square:
+                stack[top] *= stack[top];
+                break;
+            case OpCode::PowInt:
+                stack[top] = ExpressionGrammar::powInt(stack[top], static_cast<std::int32_t>(instruction.operand));
+                break;
+            case OpCode::Sqrt:
+            case OpCode::Percent:
+                stack[top] = ExpressionGrammar::applyUnary(instruction.op, stack[top], status);
+                break;
+            default:
+                --top;
+                stack[top] = ExpressionGrammar::applyBinary(instruction.op, stack[top], stack[top + 1], status);
+                break;
+        }
+        if (status != CalcErrorCode::None) {
+            if (error) *error = { status, sourcePosition(i) };
+            return NAN;
+        }
+    }
+
+    if (error) *error = CalcError();
+    return stack[0];
+}
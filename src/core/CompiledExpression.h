@@ -0,0 +1,78 @@
+#ifndef COMPILEDEXPRESSION_H
+#define COMPILEDEXPRESSION_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "ExpressionGrammar.h"
+#include "ThreadedCode.h"
+
+// How CompiledExpression::evaluate() runs a program.
+enum class ExecutionBackend {
+    Interpreter,  // Switch over the opcodes
+    ThreadedCode  // Specialized handlers, see ThreadedCode
+};
+
+// A parsed expression lowered to a flat postfix program. Instructions are 8 bytes and
+// stored contiguously next to their constant pool, so evaluation is a single linear
+// walk over two small arrays with no pointer chasing and no allocation.
+class CompiledExpression
+{
+public:
+    struct Instruction
+    {
+        OpCode op;
+        std::uint32_t operand; // Constant pool index for PushConst, variable index for PushVariable,
+                               // the exponent (as int32) for PowInt
+    };
+
+    CompiledExpression() = default;
+
+    bool isEmpty() const { return m_code.empty(); }
+    int maxStackDepth() const { return m_maxStackDepth; }
+
+    const std::vector<Instruction> &instructions() const { return m_code; }
+    const std::vector<double> &constants() const { return m_constants; }
+
+    // Variables in order of first use; operand i of PushVariable refers to entry i. They
+    // are free variables of programs compiled with ExpressionCompiler::CollectVariables
+    // and symbol table variables of programs compiled against a SymbolTable.
+    const std::vector<std::string> &variables() const { return m_variables; }
+    int variableIndex(std::string_view name) const;
+    // SymbolTable slot of each variable, -1 for a free one.
+    const std::vector<std::int32_t> &symbolSlots() const { return m_symbolSlots; }
+    // Whether the program refers to a user-defined variable or function, so its value
+    // depends on definitions that may change.
+    bool usesSymbols() const { return m_usesSymbols; }
+
+    // Source offset of the token that produced the given instruction, used for error positions.
+    int sourcePosition(size_t instruction) const { return static_cast<int>(m_positions[instruction]); }
+
+    // Selects how evaluate() runs; lowering to threaded code is done once, here.
+    void setBackend(ExecutionBackend backend);
+    ExecutionBackend backend() const
+    {
+        return m_threadedCode.empty() ? ExecutionBackend::Interpreter : ExecutionBackend::ThreadedCode;
+    }
+
+    double evaluate(CalcError *error = nullptr) const { return evaluate(nullptr, error); }
+    // values[i] is the value of variables()[i]. A program with variables fails with
+    // UnknownIdentifier if values is null.
+    double evaluate(const double *values, CalcError *error) const;
+
+private:
+    friend class ExpressionCompiler;
+    friend class ExpressionOptimizer;
+
+    std::vector<Instruction> m_code;
+    std::vector<double> m_constants;
+    std::vector<std::uint32_t> m_positions; // Cold data, only read on the error path
+    std::vector<std::string> m_variables;
+    std::vector<std::int32_t> m_symbolSlots;
+    std::vector<ThreadedCode::Step> m_threadedCode; // Empty unless that backend is selected
+    int m_maxStackDepth = 0;
+    bool m_usesSymbols = false;
+};
+
+#endif // COMPILEDEXPRESSION_H
@@ -0,0 +1,768 @@
+#ifndef CONSTEXPREXPRESSION_H
+#define CONSTEXPREXPRESSION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string_view>
+#include <type_traits>
+#include "ExpressionGrammar.h"
+#include "ExpressionLexer.h"
+
+// Header-only front end to the expression engine for formulas fixed in C++ source. The
+// lexer and parser below are constexpr mirrors of ExpressionLexer and ExpressionCompiler
+// (same tokens, precedence, '%' disambiguation, sign folding, error codes and positions),
+// and every operator is evaluated by ExpressionGrammar, so a formula gives bit for bit
+// the result CalculatorCore gives for it. pi and e are the built-in constants; any
+// other name is a variable, numbered in order of first appearance.
+//
+//     static constexpr auto Discount = ConstexprExpression::compile("price * (1 - rate%)");
+//     using DiscountFormula = ConstexprExpression::Formula<Discount>;
+//     CalcResult r = DiscountFormula::evaluate(price, rate); // no parsing, fully inlined
+//
+// A formula that does not compile fails the build with a static_assert. For text known
+// only at run time, compile<Capacity>(text) returns a Program whose evaluate()
+// interprets it; nothing here allocates or needs the engine's library.
+namespace ConstexprExpression
+{
+    struct Instruction
+    {
+        OpCode op = OpCode::PushConst;
+        std::uint32_t operand = 0; // Index into the constants or variables
+        int position = 0;          // Offset in the source, reported with evaluation errors
+    };
+
+    // A compiled expression of at most Capacity instructions, in the post-order form of
+    // CompiledExpression. Plain data, so it can be a constexpr variable.
+    template <size_t Capacity>
+    struct Program
+    {
+        Instruction code[Capacity] = {};
+        double constants[Capacity] = {};
+        std::string_view variables[Capacity] = {}; // Views of the source text
+        size_t size = 0;
+        size_t constantCount = 0;
+        size_t variableCount = 0;
+        int maxStackDepth = 0;
+        CalcError error;
+
+        constexpr bool ok() const { return !error.isError(); }
+
+        constexpr int variableIndex(std::string_view name) const
+        {
+            for (size_t i = 0; i < variableCount; ++i) {
+                if (variables[i] == name) return static_cast<int>(i);
+            }
+            return -1;
+        }
+
+        // Index of the first instruction of the operand that ends with instruction last.
+        constexpr size_t operandStart(size_t last) const
+        {
+            int pending = 1;
+            size_t i = last;
+            for (;; --i) {
+                const OpCode op = code[i].op;
+                pending += op == OpCode::PushConst || op == OpCode::PushVariable ? -1
+                           : ExpressionGrammar::isBinary(op)                     ? 1
+                                                                                 : 0;
+                if (pending == 0) return i;
+            }
+        }
+
+        // Interprets the program, like CompiledExpression::evaluate(). values holds one
+        // value per variable and may be null when there are none.
+        CalcResult evaluate(const double *values = nullptr) const
+        {
+            if (error.isError()) {
+                return { NAN, error };
+            }
+            if (!values && variableCount > 0) {
+                for (size_t i = 0; i < size; ++i) {
+                    if (code[i].op == OpCode::PushVariable) return { NAN, { CalcErrorCode::UnknownIdentifier, code[i].position } };
+                }
+            }
+            double stack[Capacity];
+            int top = -1;
+            for (size_t i = 0; i < size; ++i) {
+                const Instruction &instruction = code[i];
+                CalcErrorCode status = CalcErrorCode::None;
+                switch (instruction.op) {
+                    case OpCode::PushConst:
+                        stack[++top] = constants[instruction.operand];
+                        break;
+                    case OpCode::PushVariable:
+                        stack[++top] = values[instruction.operand];
+                        break;
+                    default:
+                        if (ExpressionGrammar::isBinary(instruction.op)) {
+                            --top;
+                            stack[top] = ExpressionGrammar::applyBinary(instruction.op, stack[top], stack[top + 1], status);
+                        } else {
+                            stack[top] = ExpressionGrammar::applyUnary(instruction.op, stack[top], status);
+                        }
+                        break;
+                }
+                if (status != CalcErrorCode::None) {
+                    return { NAN, { status, instruction.position } };
+                }
+            }
+            return { stack[0], CalcError() };
+        }
+    };
+
+    namespace Detail
+    {
+        constexpr char32_t MultiplicationSign = 0x00D7; // ×
+        constexpr char32_t DivisionSign = 0x00F7;       // ÷
+        constexpr char32_t MinusSign = 0x2212;          // −
+        constexpr char32_t SquareRootSign = 0x221A;     // √
+        constexpr char32_t InvalidCodePoint = 0xFFFFFFFF;
+
+        constexpr bool isDigit(char32_t c) { return c >= '0' && c <= '9'; }
+        constexpr bool isIdentifierStart(char32_t c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_'; }
+        constexpr bool isIdentifierPart(char32_t c) { return isIdentifierStart(c) || isDigit(c); }
+
+        // Unsigned integer of fixed width, wide enough for every quotient and remainder
+        // numberValue() forms from a literal cut to MaxLiteralDigits digits.
+        class BigUnsigned
+        {
+        public:
+            static constexpr int Limbs = 128;
+
+            constexpr explicit BigUnsigned(std::uint32_t value = 0)
+            {
+                m_limbs[0] = value;
+                m_size = value ? 1 : 0;
+            }
+
+            constexpr bool isZero() const { return m_size == 0; }
+
+            constexpr void multiplyAdd(std::uint32_t factor, std::uint32_t addend)
+            {
+                std::uint64_t carry = addend;
+                for (int i = 0; i < m_size; ++i) {
+                    carry += static_cast<std::uint64_t>(m_limbs[i]) * factor;
+                    m_limbs[i] = static_cast<std::uint32_t>(carry);
+                    carry >>= 32;
+                }
+                if (carry) m_limbs[m_size++] = static_cast<std::uint32_t>(carry);
+            }
+
+            constexpr void multiplyPow10(int exponent)
+            {
+                for (; exponent >= 9; exponent -= 9) multiplyAdd(1000000000u, 0);
+                std::uint32_t factor = 1;
+                for (; exponent > 0; --exponent) factor *= 10;
+                multiplyAdd(factor, 0);
+            }
+
+            constexpr void shiftLeft(int bits)
+            {
+                if (isZero() || bits == 0) return;
+                const int limbShift = bits / 32;
+                const int bitShift = bits % 32;
+                int size = m_size + limbShift + 1;
+                for (int i = size - 1; i >= 0; --i) {
+                    const int from = i - limbShift;
+                    const std::uint64_t high = from >= 0 && from < m_size ? m_limbs[from] : 0;
+                    const std::uint64_t low = from >= 1 && from - 1 < m_size ? m_limbs[from - 1] : 0;
+                    m_limbs[i] = static_cast<std::uint32_t>(((high << 32 | low) << bitShift) >> 32);
+                }
+                while (size > 0 && m_limbs[size - 1] == 0) --size;
+                m_size = size;
+            }
+
+            constexpr void shiftRightOne()
+            {
+                for (int i = 0; i < m_size; ++i) {
+                    const std::uint32_t next = i + 1 < m_size ? m_limbs[i + 1] : 0;
+                    m_limbs[i] = m_limbs[i] >> 1 | next << 31;
+                }
+                if (m_size > 0 && m_limbs[m_size - 1] == 0) --m_size;
+            }
+
+            constexpr int bitLength() const
+            {
+                if (isZero()) return 0;
+                int bits = (m_size - 1) * 32;
+                for (std::uint32_t top = m_limbs[m_size - 1]; top; top >>= 1) ++bits;
+                return bits;
+            }
+
+            constexpr int compare(const BigUnsigned &other) const
+            {
+                if (m_size != other.m_size) return m_size < other.m_size ? -1 : 1;
+                for (int i = m_size - 1; i >= 0; --i) {
+                    if (m_limbs[i] != other.m_limbs[i]) return m_limbs[i] < other.m_limbs[i] ? -1 : 1;
+                }
+                return 0;
+            }
+
+            // Requires other <= *this.
+            constexpr void subtract(const BigUnsigned &other)
+            {
+                std::int64_t borrow = 0;
+                for (int i = 0; i < m_size; ++i) {
+                    std::int64_t difference = static_cast<std::int64_t>(m_limbs[i]) - borrow
+                                              - (i < other.m_size ? static_cast<std::int64_t>(other.m_limbs[i]) : 0);
+                    borrow = difference < 0 ? 1 : 0;
+                    m_limbs[i] = static_cast<std::uint32_t>(difference + (borrow << 32));
+                }
+                while (m_size > 0 && m_limbs[m_size - 1] == 0) --m_size;
+            }
+
+        private:
+            std::uint32_t m_limbs[Limbs] = {};
+            int m_size = 0;
+        };
+
+        // Digits beyond this only matter as a nonzero tail, kept as one sticky digit. No
+        // double needs more than 767 significant digits to be told apart from its
+        // neighbours' midpoints.
+        constexpr int MaxLiteralDigits = 800;
+        constexpr double Infinity = std::numeric_limits<double>::infinity();
+
+        // value * 2^exponent, exactly: every intermediate lies between value and the
+        // representable result.
+        constexpr double scaleByPowerOfTwo(double value, int exponent)
+        {
+            for (; exponent > 0; exponent -= exponent > 60 ? 60 : exponent) {
+                value *= static_cast<double>(std::uint64_t(1) << (exponent > 60 ? 60 : exponent));
+            }
+            for (; exponent < 0; exponent += exponent < -60 ? 60 : -exponent) {
+                value /= static_cast<double>(std::uint64_t(1) << (exponent < -60 ? 60 : -exponent));
+            }
+            return value;
+        }
+
+        // The nearest double to a number token's text (digits [. digits] [e [sign] digits],
+        // as lexed), rounding halfway cases to even like std::from_chars. Beyond the range
+        // of a double it is infinity or zero, as ExpressionLexer makes it.
+        constexpr double numberValue(std::string_view text)
+        {
+            char digits[MaxLiteralDigits + 1] = {};
+            int count = 0;
+            bool truncated = false; // Nonzero digits were dropped
+            int integerDigits = 0;  // Significant digits before the point
+            int leadingZeros = 0;   // Zeros between the point and the first significant digit
+            bool inFraction = false;
+            size_t i = 0;
+            for (; i < text.size() && text[i] != 'e' && text[i] != 'E'; ++i) {
+                const char c = text[i];
+                if (c == '.') {
+                    inFraction = true;
+                } else if (count == 0 && c == '0') {
+                    leadingZeros += inFraction ? 1 : 0;
+                } else {
+                    integerDigits += inFraction ? 0 : 1;
+                    if (count < MaxLiteralDigits) {
+                        digits[count++] = c;
+                    } else {
+                        truncated = truncated || c != '0';
+                    }
+                }
+            }
+            int exponent = 0;
+            if (i < text.size()) {
+                const bool negative = text[i + 1] == '-';
+                for (i += text[i + 1] == '-' || text[i + 1] == '+' ? 2 : 1; i < text.size(); ++i) {
+                    if (exponent < 100000) exponent = exponent * 10 + (text[i] - '0');
+                }
+                exponent = negative ? -exponent : exponent;
+            }
+            if (count == 0) {
+                return 0.0;
+            }
+            while (!truncated && digits[count - 1] == '0') --count;
+            if (truncated) digits[count++] = '1';
+
+            // The value is 0.d1d2d3... * 10^pointExponent with d1 nonzero.
+            const int pointExponent = integerDigits - leadingZeros + exponent;
+            if (pointExponent > 310) return Infinity;
+            if (pointExponent < -324) return 0.0;
+            const int decimalExponent = pointExponent - count; // value = digits * 10^decimalExponent
+
+            // Exact for a mantissa and power of ten that are both doubles (Clinger).
+            if (count <= 19 && decimalExponent >= -22 && decimalExponent <= 22) {
+                std::uint64_t mantissa = 0;
+                for (int d = 0; d < count; ++d) mantissa = mantissa * 10 + static_cast<std::uint64_t>(digits[d] - '0');
+                if (mantissa <= std::uint64_t(1) << 53) {
+                    constexpr double Powers[] = { 1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+                                                  1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+                                                  1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+                    return decimalExponent >= 0 ? static_cast<double>(mantissa) * Powers[decimalExponent]
+                                                : static_cast<double>(mantissa) / Powers[-decimalExponent];
+                }
+            }
+
+            // Otherwise value = numerator / denominator exactly, and a quotient of 56 or 57
+            // bits, q = floor(value / 2^binaryExponent), is enough to round correctly.
+            BigUnsigned numerator;
+            for (int d = 0; d < count; ++d) numerator.multiplyAdd(10, static_cast<std::uint32_t>(digits[d] - '0'));
+            BigUnsigned denominator(1);
+            if (decimalExponent >= 0) {
+                numerator.multiplyPow10(decimalExponent);
+            } else {
+                denominator.multiplyPow10(-decimalExponent);
+            }
+            const int binaryExponent = numerator.bitLength() - denominator.bitLength() - 56;
+            if (binaryExponent < 0) {
+                numerator.shiftLeft(-binaryExponent);
+            } else {
+                denominator.shiftLeft(binaryExponent);
+            }
+            std::uint64_t quotient = 0;
+            denominator.shiftLeft(57);
+            for (int bit = 57; bit >= 0; --bit) {
+                if (numerator.compare(denominator) >= 0) {
+                    numerator.subtract(denominator);
+                    quotient |= std::uint64_t(1) << bit;
+                }
+                denominator.shiftRightOne();
+            }
+
+            // Keep 53 bits, or fewer where the result is subnormal.
+            int quotientBits = 0;
+            for (std::uint64_t rest = quotient; rest; rest >>= 1) ++quotientBits;
+            int shift = quotientBits - 53;
+            if (binaryExponent + shift < -1074) shift = -1074 - binaryExponent;
+            if (shift > 57) return 0.0;
+            const std::uint64_t dropped = quotient & ((std::uint64_t(1) << shift) - 1);
+            const std::uint64_t half = std::uint64_t(1) << (shift - 1);
+            quotient >>= shift;
+            if (dropped > half || (dropped == half && (!numerator.isZero() || (quotient & 1)))) ++quotient;
+            if (quotient == 0) return 0.0;
+
+            const int resultExponent = binaryExponent + shift;
+            int resultBits = 0;
+            for (std::uint64_t rest = quotient; rest; rest >>= 1) ++resultBits;
+            if (resultExponent + resultBits > 1024) return Infinity;
+            return scaleByPowerOfTwo(static_cast<double>(quotient), resultExponent);
+        }
+
+        // ExpressionLexer<char> in constexpr form.
+        class Lexer
+        {
+        public:
+            enum Mode {
+                ExpectOperand,
+                ExpectOperator
+            };
+
+            constexpr explicit Lexer(std::string_view source) : m_source(source) {}
+
+            constexpr std::string_view text(const Token &token) const
+            {
+                return m_source.substr(static_cast<size_t>(token.position), static_cast<size_t>(token.length));
+            }
+
+            constexpr Token next(Mode mode)
+            {
+                skipWhitespace();
+                if (m_cursor >= m_source.size()) {
+                    return makeToken(TokenKind::End, m_cursor, 0);
+                }
+
+                const size_t start = m_cursor;
+                int units = 0;
+                const char32_t cp = peekCodePoint(&units);
+
+                if (isDigit(cp) || (cp == '.' && m_cursor + 1 < m_source.size() && isDigit(at(m_cursor + 1)))) {
+                    return lexNumber();
+                }
+
+                if (cp == 'x' && mode == ExpectOperator) {
+                    const size_t remaining = m_source.size() - m_cursor;
+                    if (remaining >= 3 && at(m_cursor + 1) == '^' && at(m_cursor + 2) == 'y'
+                        && (remaining == 3 || !isIdentifierPart(at(m_cursor + 3)))) {
+                        m_cursor += 3;
+                        return makeToken(TokenKind::Power, start, 3);
+                    }
+                    if (remaining == 1 || !isIdentifierStart(at(m_cursor + 1))) {
+                        m_cursor += 1;
+                        return makeToken(TokenKind::Multiply, start, 1);
+                    }
+                }
+
+                if (isIdentifierStart(cp)) {
+                    ++m_cursor;
+                    while (m_cursor < m_source.size() && isIdentifierPart(at(m_cursor))) ++m_cursor;
+                    return makeToken(TokenKind::Identifier, start, static_cast<int>(m_cursor - start));
+                }
+
+                TokenKind kind = TokenKind::Invalid;
+                switch (cp) {
+                    case '+':                kind = TokenKind::Plus; break;
+                    case '-':
+                    case MinusSign:          kind = TokenKind::Minus; break;
+                    case '*':
+                    case MultiplicationSign: kind = TokenKind::Multiply; break;
+                    case '/':
+                    case DivisionSign:       kind = TokenKind::Divide; break;
+                    case '%':                kind = TokenKind::Percent; break;
+                    case '^':                kind = TokenKind::Power; break;
+                    case SquareRootSign:     kind = TokenKind::Sqrt; break;
+                    case '(':                kind = TokenKind::LeftParen; break;
+                    case ')':                kind = TokenKind::RightParen; break;
+                    case ',':                kind = TokenKind::Comma; break;
+                    case '=':                kind = TokenKind::Equals; break;
+                    default:                 break;
+                }
+                m_cursor += static_cast<size_t>(units);
+                return makeToken(kind, start, units);
+            }
+
+        private:
+            std::string_view m_source;
+            size_t m_cursor = 0;
+
+            constexpr char32_t at(size_t index) const { return static_cast<unsigned char>(m_source[index]); }
+
+            constexpr char32_t peekCodePoint(int *units) const
+            {
+                const char32_t lead = at(m_cursor);
+                if (lead < 0x80) {
+                    *units = 1;
+                    return lead;
+                }
+                const int length = (lead >= 0xF0) ? 4 : (lead >= 0xE0) ? 3 : (lead >= 0xC0) ? 2 : 1;
+                if (length == 1 || m_source.size() - m_cursor < static_cast<size_t>(length)) {
+                    *units = 1;
+                    return InvalidCodePoint;
+                }
+                char32_t cp = lead & (0x7F >> length);
+                for (int i = 1; i < length; ++i) {
+                    cp = (cp << 6) | (at(m_cursor + static_cast<size_t>(i)) & 0x3F);
+                }
+                *units = length;
+                return cp;
+            }
+
+            constexpr void skipWhitespace()
+            {
+                while (m_cursor < m_source.size()) {
+                    const char c = m_source[m_cursor];
+                    if (c != ' ' && c != '\t' && c != '\r' && c != '\n') {
+                        break;
+                    }
+                    ++m_cursor;
+                }
+            }
+
+            constexpr Token makeToken(TokenKind kind, size_t start, int units) const
+            {
+                Token token;
+                token.kind = kind;
+                token.position = static_cast<int>(start);
+                token.length = units;
+                return token;
+            }
+
+            constexpr Token lexNumber()
+            {
+                const size_t start = m_cursor;
+                while (m_cursor < m_source.size() && isDigit(at(m_cursor))) ++m_cursor;
+                if (m_cursor < m_source.size() && m_source[m_cursor] == '.') {
+                    ++m_cursor;
+                    while (m_cursor < m_source.size() && isDigit(at(m_cursor))) ++m_cursor;
+                }
+                if (m_cursor < m_source.size() && (m_source[m_cursor] == 'e' || m_source[m_cursor] == 'E')) {
+                    size_t exponent = m_cursor + 1;
+                    if (exponent < m_source.size() && (m_source[exponent] == '+' || m_source[exponent] == '-')) ++exponent;
+                    if (exponent < m_source.size() && isDigit(at(exponent))) {
+                        m_cursor = exponent;
+                        while (m_cursor < m_source.size() && isDigit(at(m_cursor))) ++m_cursor;
+                    }
+                }
+
+                Token token = makeToken(TokenKind::Number, start, static_cast<int>(m_cursor - start));
+                token.number = numberValue(text(token));
+                return token;
+            }
+        };
+
+        // ExpressionCompiler's parser in constexpr form, resolving names the way
+        // compile() does with the default SymbolTable and CollectVariables.
+        template <size_t Capacity>
+        class Compiler
+        {
+        public:
+            constexpr explicit Compiler(std::string_view source) : m_lexer(source) {}
+
+            constexpr Program<Capacity> run()
+            {
+                advance(Lexer::ExpectOperand);
+                if (m_token.kind == TokenKind::End) {
+                    fail(CalcErrorCode::EmptyExpression, 0);
+                } else if (parseExpression(0) && m_token.kind != TokenKind::End) {
+                    fail(m_token.kind == TokenKind::RightParen ? CalcErrorCode::MismatchedParenthesis
+                                                               : CalcErrorCode::UnexpectedToken,
+                         m_token.position);
+                }
+                m_program.maxStackDepth = m_maxDepth;
+                return m_program;
+            }
+
+        private:
+            Lexer m_lexer;
+            Token m_token;
+            Program<Capacity> m_program;
+            int m_nesting = 0;
+            int m_depth = 0;
+            int m_maxDepth = 0;
+
+            constexpr void advance(Lexer::Mode mode) { m_token = m_lexer.next(mode); }
+
+            constexpr bool fail(CalcErrorCode code, int position)
+            {
+                if (!m_program.error.isError()) {
+                    m_program.error = { code, position };
+                }
+                return false;
+            }
+
+            constexpr bool emitInstruction(OpCode op, int position, std::uint32_t operand = 0)
+            {
+                if (m_program.size == Capacity) {
+                    return fail(CalcErrorCode::ExpressionTooLarge, position);
+                }
+                m_program.code[m_program.size++] = { op, operand, position };
+                if (op == OpCode::PushConst || op == OpCode::PushVariable) {
+                    if (++m_depth > m_maxDepth) m_maxDepth = m_depth;
+                } else if (ExpressionGrammar::isBinary(op)) {
+                    --m_depth;
+                }
+                return true;
+            }
+
+            constexpr bool emitConstant(double value, int position)
+            {
+                // Never more constants than instructions, so the pool cannot fill first.
+                if (m_program.size == Capacity) {
+                    return fail(CalcErrorCode::ExpressionTooLarge, position);
+                }
+                m_program.constants[m_program.constantCount] = value;
+                return emitInstruction(OpCode::PushConst, position, static_cast<std::uint32_t>(m_program.constantCount++));
+            }
+
+            constexpr bool emitVariable(std::string_view name, int position)
+            {
+                if (m_program.size == Capacity) {
+                    return fail(CalcErrorCode::ExpressionTooLarge, position);
+                }
+                int index = m_program.variableIndex(name);
+                if (index < 0) {
+                    index = static_cast<int>(m_program.variableCount);
+                    m_program.variables[m_program.variableCount++] = name;
+                }
+                return emitInstruction(OpCode::PushVariable, position, static_cast<std::uint32_t>(index));
+            }
+
+            constexpr bool parseExpression(int minPrecedence)
+            {
+                if (++m_nesting > ExpressionGrammar::MaxNestingDepth) {
+                    return fail(CalcErrorCode::NestingTooDeep, m_token.position);
+                }
+                if (!parseOperand()) {
+                    return false;
+                }
+
+                for (;;) {
+                    OpCode op = OpCode::Add;
+                    switch (m_token.kind) {
+                        case TokenKind::Plus:     op = OpCode::Add; break;
+                        case TokenKind::Minus:    op = OpCode::Subtract; break;
+                        case TokenKind::Multiply: op = OpCode::Multiply; break;
+                        case TokenKind::Divide:   op = OpCode::Divide; break;
+                        case TokenKind::Power:    op = OpCode::Power; break;
+                        case TokenKind::Percent: {
+                            Lexer lookahead = m_lexer;
+                            op = startsUnsignedOperand(lookahead.next(Lexer::ExpectOperand).kind) ? OpCode::Modulo
+                                                                                                  : OpCode::Percent;
+                            break;
+                        }
+                        default:
+                            --m_nesting;
+                            return true;
+                    }
+
+                    const int precedence = ExpressionGrammar::precedence(op);
+                    if (precedence < minPrecedence) {
+                        break;
+                    }
+
+                    const int position = m_token.position;
+                    if (op == OpCode::Percent) {
+                        if (!emitInstruction(op, position)) {
+                            return false;
+                        }
+                        advance(Lexer::ExpectOperator);
+                        continue;
+                    }
+
+                    advance(Lexer::ExpectOperand);
+                    const int nextPrecedence = ExpressionGrammar::isRightAssociative(op) ? precedence : precedence + 1;
+                    if (!parseExpression(nextPrecedence) || !emitInstruction(op, position)) {
+                        return false;
+                    }
+                }
+
+                --m_nesting;
+                return true;
+            }
+
+            constexpr bool parseOperand()
+            {
+                const Token token = m_token;
+                switch (token.kind) {
+                    case TokenKind::Number:
+                        advance(Lexer::ExpectOperator);
+                        return emitConstant(token.number, token.position);
+
+                    case TokenKind::LeftParen:
+                        advance(Lexer::ExpectOperand);
+                        if (!parseExpression(0)) {
+                            return false;
+                        }
+                        if (m_token.kind != TokenKind::RightParen) {
+                            return fail(m_token.kind == TokenKind::End ? CalcErrorCode::MismatchedParenthesis
+                                                                       : CalcErrorCode::UnexpectedToken,
+                                        m_token.kind == TokenKind::End ? token.position : m_token.position);
+                        }
+                        advance(Lexer::ExpectOperator);
+                        return true;
+
+                    case TokenKind::Plus:
+                    case TokenKind::Minus:
+                    case TokenKind::Sqrt: {
+                        const size_t codeStart = m_program.size;
+                        advance(Lexer::ExpectOperand);
+                        if (!parseExpression(ExpressionGrammar::UnaryPrecedence)) {
+                            return false;
+                        }
+                        if (token.kind == TokenKind::Minus) {
+                            const Instruction &last = m_program.code[m_program.size - 1];
+                            if (m_program.size == codeStart + 1 && last.op == OpCode::PushConst) {
+                                m_program.constants[last.operand] = -m_program.constants[last.operand];
+                                return true;
+                            }
+                            return emitInstruction(OpCode::Negate, token.position);
+                        }
+                        return token.kind == TokenKind::Sqrt ? emitInstruction(OpCode::Sqrt, token.position) : true;
+                    }
+
+                    case TokenKind::Identifier: {
+                        const std::string_view name = m_lexer.text(token);
+                        if (name == "sqrt") {
+                            advance(Lexer::ExpectOperand);
+                            if (m_token.kind != TokenKind::LeftParen) {
+                                return fail(CalcErrorCode::UnexpectedToken, m_token.position);
+                            }
+                            return parseOperand() && emitInstruction(OpCode::Sqrt, token.position);
+                        }
+                        advance(Lexer::ExpectOperator);
+                        for (const ExpressionGrammar::Constant &constant : ExpressionGrammar::BuiltinConstants) {
+                            if (name == constant.name) return emitConstant(constant.value, token.position);
+                        }
+                        return emitVariable(name, token.position);
+                    }
+
+                    case TokenKind::End:
+                        return fail(CalcErrorCode::UnexpectedEnd, token.position);
+
+                    case TokenKind::RightParen:
+                        return fail(CalcErrorCode::MismatchedParenthesis, token.position);
+
+                    case TokenKind::Invalid: {
+                        const std::string_view text = m_lexer.text(token);
+                        const bool numeric = !text.empty() && (isDigit(static_cast<unsigned char>(text[0])) || text[0] == '.');
+                        return fail(numeric ? CalcErrorCode::InvalidNumber : CalcErrorCode::UnexpectedToken, token.position);
+                    }
+
+                    default:
+                        return fail(CalcErrorCode::UnexpectedToken, token.position);
+                }
+            }
+        };
+    }
+
+    // Compiles source into a program of at most Capacity instructions; a longer one
+    // fails with ExpressionTooLarge. Usable at compile time and at run time.
+    template <size_t Capacity>
+    constexpr Program<Capacity> compile(std::string_view source)
+    {
+        return Detail::Compiler<Capacity>(source).run();
+    }
+
+    // A literal never compiles to more instructions than it has characters.
+    template <size_t N>
+    constexpr Program<N> compile(const char (&source)[N])
+    {
+        return compile<N>(std::string_view(source, N - 1));
+    }
+
+    // A program turned into code: each instruction of P becomes a node of an expression
+    // tree the compiler sees whole, so constants fold and nothing is interpreted. P must
+    // be a constexpr Program with static storage duration.
+    template <const auto &P>
+    class Formula
+    {
+        static_assert(P.ok(), "expression does not compile; P.error says why and where");
+
+    public:
+        static constexpr size_t VariableCount = P.variableCount;
+
+        static constexpr int variableIndex(std::string_view name) { return P.variableIndex(name); }
+
+        // values holds VariableCount values, ordered as variableIndex() numbers them.
+        static CalcResult evaluate(const double *values)
+        {
+            CalcError error;
+            const double value = node<P.size - 1>(values, error);
+            if (error.isError()) {
+                return { NAN, error };
+            }
+            return { value, CalcError() };
+        }
+
+        template <typename... Values, typename = std::enable_if_t<(std::is_arithmetic_v<Values> && ...)>>
+        static CalcResult evaluate(Values... values)
+        {
+            static_assert(sizeof...(Values) == VariableCount, "one value is needed per variable");
+            const double bound[sizeof...(Values) + 1] = { static_cast<double>(values)... };
+            return evaluate(bound);
+        }
+
+    private:
+        // Operands are evaluated in program order and only the first failure is kept, so
+        // errors and their positions are those the interpreter reports.
+        template <size_t I>
+        static double node(const double *values, CalcError &error)
+        {
+            constexpr Instruction instruction = P.code[I];
+            if constexpr (instruction.op == OpCode::PushConst) {
+                return P.constants[instruction.operand];
+            } else if constexpr (instruction.op == OpCode::PushVariable) {
+                return values[instruction.operand];
+            } else {
+                CalcErrorCode status = CalcErrorCode::None;
+                double value = 0.0;
+                if constexpr (ExpressionGrammar::isBinary(instruction.op)) {
+                    constexpr size_t Lhs = P.operandStart(I - 1) - 1;
+                    const double lhs = node<Lhs>(values, error);
+                    const double rhs = node<I - 1>(values, error);
+                    value = ExpressionGrammar::applyBinary(instruction.op, lhs, rhs, status);
+                } else {
+                    value = ExpressionGrammar::applyUnary(instruction.op, node<I - 1>(values, error), status);
+                }
+                if (status != CalcErrorCode::None && !error.isError()) {
+                    error = { status, instruction.position };
+                }
+                return value;
+            }
+        }
+    };
+}
+
+#endif // CONSTEXPREXPRESSION_H
@@ -1,8 +1,109 @@
 #include "DatabaseManager.h"
+#include "ExpressionCache.h"
+#include "HistorySearcher.h"
+#include "HistoryWriter.h"
+#include "LatencyStats.h"
+#include "NumberFormat.h"
+#include "SymbolDatabase.h"
+#include <QFile>
+#include <QHash>
+#include <QPair>
+#include <QSaveFile>
 #include <QSqlError>
+#include <QThread>
+#include <algorithm>
+#include <initializer_list>
+#include <limits>
+#include <utility>
+
+namespace
+{
+    const char *const OpenerConnectionName = "CalcPlusPlus.databaseOpener";
+
+    // Dropped by importHistory() while it loads and created again afterwards.
+    const char *const CreateMemoHashIndex = "CREATE INDEX IF NOT EXISTS memo_hash ON memo (hash)";
+    const char *const CreateMemoResultIndex = "CREATE INDEX IF NOT EXISTS memo_result_value ON memo (result_value)";
+    const char *const CreateHistoryMemoIndex = "CREATE INDEX IF NOT EXISTS history_memo ON history (memo_id, id)";
+    const char *const CreateMemoFtsTrigger = "CREATE TRIGGER IF NOT EXISTS memo_fts_insert AFTER INSERT ON memo BEGIN "
+                                             "INSERT INTO memo_fts (rowid, expression, result) "
+                                             "VALUES (new.id, new.expression, new.result); END";
+
+    // INSERT of up to BatchRows rows per statement. Qt's SQL layer costs about as much
+    // per executed statement as SQLite does per row, so binding many rows at once is
+    // what makes loading millions of them fast.
+    class BulkInsert
+    {
+    public:
+        static constexpr int BatchRows = 128; // Stays below SQLite's 999 bound parameters
+
+        // insert is the statement up to VALUES, row the parenthesized placeholders of
+        // one row with columns of them.
+        BulkInsert(QSqlDatabase &connection, const QString &insert, const QString &row, int columns)
+            : connection(connection),
+              insert(insert),
+              row(row),
+              columns(columns),
+              batch(connection)
+        {
+            pending.reserve(BatchRows * columns);
+        }
+
+        bool add(std::initializer_list<QVariant> values)
+        {
+            for (const QVariant &value : values) {
+                pending.append(value);
+            }
+            return pending.size() < BatchRows * columns || execute(batch);
+        }
+
+        // Writes the rows of a last, partial batch.
+        bool finish()
+        {
+            if (pending.isEmpty()) {
+                return true;
+            }
+            QSqlQuery tail(connection);
+            return execute(tail);
+        }
+
+        QSqlError lastError() const { return error; }
+
+    private:
+        QSqlDatabase connection;
+        QString insert;
+        QString row;
+        int columns;
+        QSqlQuery batch; // Statement for BatchRows rows, prepared on first use
+        bool batchPrepared = false;
+        QVector<QVariant> pending;
+        QSqlError error;
+
+        bool execute(QSqlQuery &query)
+        {
+            const int rows = static_cast<int>(pending.size()) / columns;
+            if (&query != &batch || !batchPrepared) {
+                QStringList placeholders;
+                for (int i = 0; i < rows; ++i) {
+                    placeholders.append(row);
+                }
+                query.prepare(insert + placeholders.join(", "));
+                batchPrepared = batchPrepared || &query == &batch;
+            }
+            for (int i = 0; i < pending.size(); ++i) {
+                query.bindValue(i, pending[i]);
+            }
+            pending.clear();
+            if (!query.exec()) {
+                error = query.lastError();
+                return false;
+            }
+            return true;
+        }
+    };
+}
 
 DatabaseManager::DatabaseManager(QObject *parent)
-    : QObject(parent)
+    : HistoryStore(parent)
 {
     db = QSqlDatabase::addDatabase("QSQLITE");
 }
@@ -14,78 +115,444 @@ DatabaseManager::~DatabaseManager()
 
 bool DatabaseManager::openDatabase(const QString &dbPath)
 {
+    return attachDatabase(dbPath, prepareDatabase(dbPath));
+}
+
+void DatabaseManager::openDatabaseAsync(const QString &dbPath)
+{
+    closeDatabase();
     databasePath = dbPath;
-    db.setDatabaseName(databasePath);
+    // Created now but started once the schema is ready, so that entries added while the
+    // database opens wait in its queue.
+    historyWriter = new HistoryWriter(databasePath);
+    databaseOpener = QThread::create([this, dbPath] {
+        openerResult = prepareDatabase(dbPath);
+        QMetaObject::invokeMethod(this, [this] { finishOpening(); }, Qt::QueuedConnection);
+    });
+    databaseOpener->start();
+}
+
+void DatabaseManager::finishOpening()
+{
+    if (!databaseOpener) {
+        return; // Already finished by closeDatabase()
+    }
+    databaseOpener->wait();
+    delete databaseOpener;
+    databaseOpener = nullptr;
+    emit databaseOpened(attachDatabase(databasePath, openerResult));
+}
+
+DatabaseManager::PreparedDatabase DatabaseManager::prepareDatabase(const QString &dbPath)
+{
+    // Everything slow happens here, over a connection of its own so that it can run on
+    // any thread: schema checks, a one-time migration or index build, the first page and
+    // the stored definitions.
+    PreparedDatabase prepared;
+    {
+        QSqlDatabase connection = QSqlDatabase::addDatabase("QSQLITE", OpenerConnectionName);
+        connection.setDatabaseName(dbPath);
+        if (connection.open()) {
+            // Lets HistoryMaintainer shrink the file in small steps. Only takes effect
+            // before the first table exists; older databases are converted by it.
+            QSqlQuery pragma(connection);
+            pragma.exec("PRAGMA auto_vacuum=INCREMENTAL");
+            // WAL lets the writer thread commit while other connections read, and appends
+            // to a log instead of rewriting pages on every commit. The mode is stored in
+            // the file itself.
+            if (!pragma.exec("PRAGMA journal_mode=WAL")) {
+                logError("Error enabling write-ahead logging", pragma.lastError());
+            }
+            prepared.ok = createHistoryTable(connection, &prepared.fullTextSearch);
+            if (prepared.ok) {
+                prepared.firstPage = readHistoryPage(connection, 0, DefaultPageSize);
+            }
+            // History works without it; definitions are then just not kept.
+            if (prepared.ok && createSymbolTable(connection)) {
+                prepared.symbolDefinitions = readSymbolDefinitions(connection);
+            }
+        } else {
+            logError("Error opening database", connection.lastError());
+        }
+        connection.close();
+    }
+    QSqlDatabase::removeDatabase(OpenerConnectionName);
+    return prepared;
+}
 
-    if (!db.open()) {
+bool DatabaseManager::attachDatabase(const QString &dbPath, const PreparedDatabase &prepared)
+{
+    databasePath = dbPath;
+    db.setDatabaseName(databasePath);
+    if (!prepared.ok || !db.open()) {
         logError("Error opening database", db.lastError());
+        // Entries queued while opening have nowhere to go.
+        delete historyWriter;
+        historyWriter = nullptr;
         return false;
     }
-    return createHistoryTable();
+    fullTextSearch = prepared.fullTextSearch;
+    prefetchedPage = prepared.firstPage;
+    storedDefinitions = prepared.symbolDefinitions;
+
+    if (!historyWriter) {
+        historyWriter = new HistoryWriter(databasePath);
+    }
+    if (!historyWriter->isRunning()) {
+        historyWriter->start(QThread::LowPriority);
+    }
+    if (!historySearcher) {
+        historySearcher = new HistorySearcher(databasePath, fullTextSearch);
+        connect(historySearcher, &HistorySearcher::resultsReady, this, &DatabaseManager::historySearchFinished);
+        historySearcher->start();
+    }
+    if (!historyMaintainer) {
+        historyMaintainer = new HistoryMaintainer(databasePath, fullTextSearch);
+        historyMaintainer->setRetention(retention);
+        connect(historyMaintainer, &HistoryMaintainer::passFinished, this, &DatabaseManager::finishMaintenance);
+        historyMaintainer->start(QThread::LowPriority);
+    }
+    return true;
 }
 
 void DatabaseManager::closeDatabase()
 {
+    // An open still in progress is completed first, so that the entries queued while it
+    // ran get written below.
+    if (databaseOpener) {
+        databaseOpener->wait();
+        delete databaseOpener;
+        databaseOpener = nullptr;
+        attachDatabase(databasePath, openerResult);
+    }
+    prefetchedPage.clear();
+    storedDefinitions.clear();
+
+    // Deleting the writer commits whatever is still queued.
+    delete historyWriter;
+    historyWriter = nullptr;
+    delete historySearcher;
+    historySearcher = nullptr;
+    delete historyMaintainer;
+    historyMaintainer = nullptr;
+
     if (db.isOpen()) {
         db.close();
     }
 }
 
-bool DatabaseManager::createHistoryTable()
+bool DatabaseManager::createHistoryTable(QSqlDatabase &connection, bool *fullTextSearch)
 {
-    QSqlQuery query(db);
+    QSqlQuery query(connection);
+    QString createMemoSql = "CREATE TABLE IF NOT EXISTS memo ("
+                            "id INTEGER PRIMARY KEY,"
+                            "hash INTEGER NOT NULL," // ResultMemo::hashKey(key)
+                            "key TEXT NOT NULL,"
+                            "expression TEXT NOT NULL," // As first entered
+                            "result TEXT NOT NULL,"
+                            "result_value REAL," // Numeric result for range filters, NULL if none
+                            "use_count INTEGER NOT NULL,"
+                            "last_used TEXT NOT NULL,"
+                            "decimal_precision INTEGER" // Set once the result serves as a ResultMemo one
+                            ");";
+    if (!query.exec(createMemoSql) || !query.exec(CreateMemoHashIndex) || !query.exec(CreateMemoResultIndex)) {
+        logError("Error creating memo table", query.lastError());
+        return false;
+    }
+    bool hasPrecision = false;
+    if (query.exec("PRAGMA table_info(memo)")) {
+        while (query.next()) {
+            hasPrecision = hasPrecision || query.value(1).toString() == "decimal_precision";
+        }
+    }
+    if (!hasPrecision && !query.exec("ALTER TABLE memo ADD COLUMN decimal_precision INTEGER")) {
+        logError("Error upgrading memo table", query.lastError());
+        return false;
+    }
+
+    // Databases from before the memo table keep expression and result in every row.
+    bool legacy = false;
+    if (query.exec("PRAGMA table_info(history)")) {
+        while (query.next()) {
+            legacy = legacy || query.value(1).toString() == "expression";
+        }
+    }
+    if (legacy && !migrateLegacyHistory(connection)) {
+        return false;
+    }
+
     QString createTableSql = "CREATE TABLE IF NOT EXISTS history ("
                              "id INTEGER PRIMARY KEY AUTOINCREMENT,"
                              "timestamp TEXT NOT NULL,"
-                             "expression TEXT NOT NULL,"
-                             "result TEXT NOT NULL"
+                             "memo_id INTEGER NOT NULL REFERENCES memo (id)"
                              ");";
 
     if (!query.exec(createTableSql)) {
         logError("Error creating history table", query.lastError());
         return false;
     }
+    if (!query.exec(CreateHistoryMemoIndex)) {
+        logError("Error creating history index", query.lastError());
+    }
+
+    *fullTextSearch = createSearchIndex(connection);
     return true;
 }
 
-bool DatabaseManager::addHistoryEntry(const QString &expression, const QString &result)
+bool DatabaseManager::migrateLegacyHistory(QSqlDatabase &connection)
 {
-    if (!db.isOpen()) {
-        // Error handled by ErrorHandler if db fails to open initially
+    // One-time rewrite of a history table holding the text of every entry into memo rows
+    // plus references, keeping ids (and so the order) of all entries.
+    connection.transaction();
+    QSqlQuery query(connection);
+    if (!query.exec("DROP TRIGGER IF EXISTS history_fts_insert")
+        || !query.exec("DROP TABLE IF EXISTS history_fts")
+        || !query.exec("ALTER TABLE history RENAME TO history_legacy")
+        || !query.exec("CREATE TABLE history ("
+                       "id INTEGER PRIMARY KEY AUTOINCREMENT,"
+                       "timestamp TEXT NOT NULL,"
+                       "memo_id INTEGER NOT NULL REFERENCES memo (id))")) {
+        logError("Error migrating history", query.lastError());
+        connection.rollback();
+        return false;
+    }
+
+    QSqlQuery insertMemo(connection);
+    insertMemo.prepare("INSERT INTO memo (hash, key, expression, result, result_value, use_count, last_used) "
+                       "VALUES (?, ?, ?, ?, ?, 1, ?)");
+    QSqlQuery countMemoUse(connection);
+    countMemoUse.prepare("UPDATE memo SET use_count = use_count + 1, last_used = ? WHERE id = ?");
+    QSqlQuery insertHistory(connection);
+    insertHistory.prepare("INSERT INTO history (id, timestamp, memo_id) VALUES (?, ?, ?)");
+
+    // Keyed by result too, as HistoryWriter shares rows (see HistoryWriter::Operation).
+    QHash<QPair<QString, QString>, qint64> memoIds;
+    QSqlQuery rows(connection);
+    rows.setForwardOnly(true);
+    bool ok = rows.exec("SELECT id, timestamp, expression, result FROM history_legacy ORDER BY id");
+    while (ok && rows.next()) {
+        const QString timestamp = rows.value(1).toString();
+        const QString expression = rows.value(2).toString();
+        const QString key = memoKey(expression);
+        const QString result = rows.value(3).toString();
+        qint64 memoId = memoIds.value({ key, result });
+        if (memoId) {
+            countMemoUse.bindValue(0, timestamp);
+            countMemoUse.bindValue(1, memoId);
+            ok = countMemoUse.exec();
+        } else {
+            double value = 0;
+            const bool numeric = NumberFormat::parse(result, &value);
+            insertMemo.bindValue(0, static_cast<qint64>(ResultMemo::hashKey(key.toStdString())));
+            insertMemo.bindValue(1, key);
+            insertMemo.bindValue(2, expression);
+            insertMemo.bindValue(3, result);
+            insertMemo.bindValue(4, numeric ? QVariant(value) : QVariant());
+            insertMemo.bindValue(5, timestamp);
+            ok = insertMemo.exec();
+            memoId = insertMemo.lastInsertId().toLongLong();
+            memoIds.insert({ key, result }, memoId);
+        }
+        if (ok) {
+            insertHistory.bindValue(0, rows.value(0));
+            insertHistory.bindValue(1, timestamp);
+            insertHistory.bindValue(2, memoId);
+            ok = insertHistory.exec();
+        }
+    }
+    rows.finish();
+
+    if (!ok || !query.exec("DROP TABLE history_legacy") || !connection.commit()) {
+        logError("Error migrating history", ok ? query.lastError() : rows.lastError());
+        connection.rollback();
+        return false;
+    }
+    // Give the space of the duplicated text back to the file system.
+    query.exec("VACUUM");
+    return true;
+}
+
+bool DatabaseManager::createSearchIndex(QSqlDatabase &connection)
+{
+    // A trigram FTS5 index over the expression and result of every memo row answers
+    // substring queries of three or more characters without scanning; since memo rows
+    // are deduplicated it is much smaller than an index over history would be. It is an
+    // external-content table: it stores only the index, the text stays in memo. Inserts
+    // reach it through a trigger; deletes are done explicitly (see clearHistory and
+    // HistoryMaintainer) since a per-row delete trigger would make clearing a large
+    // history crawl.
+    QSqlQuery query(connection);
+    const bool existed = query.exec("SELECT 1 FROM sqlite_master WHERE name = 'memo_fts'") && query.next();
+
+    const bool fullTextSearch = query.exec("CREATE VIRTUAL TABLE IF NOT EXISTS memo_fts USING fts5("
+                                "expression, result, content='memo', content_rowid='id', tokenize='trigram')")
+                     && query.exec(CreateMemoFtsTrigger);
+    if (!fullTextSearch) {
+        // SQLite without FTS5 or the trigram tokenizer: searches fall back to LIKE scans.
+        logError("Full-text search unavailable", query.lastError());
+        return false;
+    }
+    if (!existed && !query.exec("INSERT INTO memo_fts (memo_fts) VALUES ('rebuild')")) {
+        logError("Error indexing existing history", query.lastError());
+    }
+    return true;
+}
+
+bool DatabaseManager::createSymbolTable(QSqlDatabase &connection)
+{
+    QSqlQuery query(connection);
+    if (!query.exec(SymbolDatabase::CreateTableSql)) {
+        logError("Error creating symbols table", query.lastError());
+        return false;
+    }
+    return true;
+}
+
+QStringList DatabaseManager::readSymbolDefinitions(QSqlDatabase &connection)
+{
+    QStringList definitions;
+    QSqlQuery query(connection);
+    query.setForwardOnly(true);
+    if (!query.exec("SELECT definition FROM symbols ORDER BY id")) {
+        logError("Error reading definitions", query.lastError());
+        return definitions;
+    }
+    while (query.next()) {
+        definitions.append(query.value(0).toString());
+    }
+    return definitions;
+}
+
+QString DatabaseManager::memoKey(const QString &expression)
+{
+    std::string key;
+    const std::u16string_view source(reinterpret_cast<const char16_t *>(expression.utf16()),
+                                     static_cast<size_t>(expression.size()));
+    // Text the lexer rejects is still deduplicated, just by its exact spelling.
+    return ExpressionCache::normalize(source, key) ? QString::fromStdString(key) : expression;
+}
+
+bool DatabaseManager::lookup(std::string_view key, int precision, std::string *result)
+{
+    if (!db.isOpen() || !historyWriter) {
         return false;
     }
 
+    const QString keyText = QString::fromUtf8(key.data(), static_cast<qsizetype>(key.size()));
     QSqlQuery query(db);
-    query.prepare("INSERT INTO history (timestamp, expression, result) VALUES (:timestamp, :expression, :result)");
-    query.bindValue(":timestamp", QDateTime::currentDateTime().toString(Qt::ISODate));
-    query.bindValue(":expression", expression);
-    query.bindValue(":result", result);
+    query.prepare("SELECT result FROM memo WHERE hash = ? AND key = ? AND decimal_precision = ?");
+    query.addBindValue(static_cast<qint64>(ResultMemo::hashKey(key)));
+    query.addBindValue(keyText);
+    query.addBindValue(precision);
+    if (!query.exec() || !query.next()) {
+        return false;
+    }
+    *result = query.value(0).toString().toStdString();
 
-    if (!query.exec()) {
-        logError("Error adding history entry", query.lastError());
+    historyWriter->enqueue({ HistoryWriter::Operation::CountMemoUse,
+                             QDateTime::currentDateTime().toString(Qt::ISODate), keyText, QString(), QString(),
+                             precision });
+    return true;
+}
+
+void DatabaseManager::store(std::string_view key, int precision, std::string_view result)
+{
+    if (!db.isOpen() || !historyWriter) {
+        return;
+    }
+    const QString keyText = QString::fromUtf8(key.data(), static_cast<qsizetype>(key.size()));
+    historyWriter->enqueue({ HistoryWriter::Operation::StoreMemo, QDateTime::currentDateTime().toString(Qt::ISODate),
+                             keyText, keyText, QString::fromUtf8(result.data(), static_cast<qsizetype>(result.size())),
+                             precision });
+}
+
+void DatabaseManager::storeDefinition(std::string_view name, std::string_view definition)
+{
+    if (!db.isOpen() || !historyWriter) {
+        return;
+    }
+    historyWriter->enqueue({ HistoryWriter::Operation::StoreSymbol, QDateTime::currentDateTime().toString(Qt::ISODate),
+                             QString::fromUtf8(name.data(), static_cast<qsizetype>(name.size())),
+                             QString::fromUtf8(definition.data(), static_cast<qsizetype>(definition.size())),
+                             QString() });
+}
+
+bool DatabaseManager::addHistoryEntry(const QString &expression, const QString &result)
+{
+    const LatencyStats::Scope timing(LatencyStats::AddHistoryEntry);
+    if (!historyWriter) {
+        // Error handled by ErrorHandler if db fails to open initially
         return false;
     }
+    prefetchedPage.clear();
+
+    historyWriter->enqueue({ HistoryWriter::Operation::AddHistory, QDateTime::currentDateTime().toString(Qt::ISODate),
+                             memoKey(expression), expression, result });
     return true;
 }
 
-QList<QPair<QString, QString>> DatabaseManager::getHistory()
+void DatabaseManager::flushHistory()
 {
-    QList<QPair<QString, QString>> history;
-    if (!db.isOpen()) {
+    if (historyWriter) {
+        historyWriter->flush();
+    }
+}
+
+QList<HistoryEntry> DatabaseManager::fetchHistoryPage(qint64 beforeId, int limit)
+{
+    const LatencyStats::Scope timing(LatencyStats::FetchHistoryPage);
+    if (!db.isOpen() || limit <= 0) {
         // Error handled by ErrorHandler if db fails to open initially
-        return history;
+        return QList<HistoryEntry>();
+    }
+    // The newest page was read while opening; nothing has been added since.
+    if (beforeId <= 0 && limit == DefaultPageSize && !prefetchedPage.isEmpty()) {
+        return std::exchange(prefetchedPage, QList<HistoryEntry>());
     }
+    flushHistory(); // Include entries that are still queued
+    return readHistoryPage(db, beforeId, limit);
+}
 
-    QSqlQuery query("SELECT expression, result FROM history ORDER BY timestamp DESC", db);
+QList<HistoryEntry> DatabaseManager::readHistoryPage(QSqlDatabase &connection, qint64 beforeId, int limit)
+{
+    QList<HistoryEntry> page;
+    QSqlQuery query(connection);
+    query.setForwardOnly(true);
+    query.prepare("SELECT h.id, h.timestamp, m.expression, m.result FROM history h "
+                  "JOIN memo m ON m.id = h.memo_id WHERE h.id < ? ORDER BY h.id DESC LIMIT ?");
+    query.addBindValue(beforeId > 0 ? beforeId : std::numeric_limits<qint64>::max());
+    query.addBindValue(limit);
     if (!query.exec()) {
         logError("Error retrieving history", query.lastError());
-        return history;
+        return page;
     }
 
+    page.reserve(limit);
     while (query.next()) {
-        history.append(qMakePair(query.value(0).toString(), query.value(1).toString()));
+        page.append({ query.value(0).toLongLong(), query.value(1).toString(), query.value(2).toString(),
+                      query.value(3).toString() });
+    }
+    return page;
+}
+
+qint64 DatabaseManager::historyCount()
+{
+    if (!db.isOpen()) {
+        return 0;
+    }
+    flushHistory();
+
+    QSqlQuery query(db);
+    if (!query.exec("SELECT COUNT(*) FROM history") || !query.next()) {
+        logError("Error counting history", query.lastError());
+        return 0;
     }
-    return history;
+    return query.value(0).toLongLong();
+}
+
+quint64 DatabaseManager::searchHistory(const HistorySearch &search, qint64 beforeId, int limit)
+{
+    return historySearcher ? historySearcher->search(search, beforeId, limit) : 0;
 }
 
 bool DatabaseManager::clearHistory()
@@ -94,12 +561,244 @@ bool DatabaseManager::clearHistory()
         // Error handled by ErrorHandler if db fails to open initially
         return false;
     }
+    flushHistory(); // Otherwise queued entries would be written after the DELETE
 
+    db.transaction();
     QSqlQuery query(db);
-    if (!query.exec("DELETE FROM history")) {
+    if (!query.exec("DELETE FROM history") || !query.exec("DELETE FROM memo")
+        || (fullTextSearch && !query.exec("INSERT INTO memo_fts (memo_fts) VALUES ('delete-all')"))) {
         logError("Error clearing history", query.lastError());
+        db.rollback();
+        return false;
+    }
+    prefetchedPage.clear();
+    if (!db.commit()) {
+        return false;
+    }
+    // The file keeps its size until the freed pages are vacuumed away.
+    if (historyMaintainer) {
+        historyMaintainer->requestPass();
+    }
+    return true;
+}
+
+void DatabaseManager::setHistoryRetention(const HistoryRetention &newRetention)
+{
+    retention = newRetention;
+    if (historyMaintainer) {
+        historyMaintainer->setRetention(retention);
+    }
+}
+
+void DatabaseManager::compactHistory()
+{
+    if (historyMaintainer) {
+        historyMaintainer->requestPass(true);
+    }
+}
+
+void DatabaseManager::finishMaintenance(const HistoryMaintainer::Report &report)
+{
+    if (report.historyRowsRemoved > 0) {
+        prefetchedPage.clear(); // May hold removed entries
+        emit historyPruned(report.firstKeptId);
+    }
+    emit historyMaintained(report);
+}
+
+bool DatabaseManager::exportHistory(const QString &path, HistoryExchange::Format format, qint64 *count, QString *error)
+{
+    if (!db.isOpen()) {
+        return fail(error, "The history database is not open.");
+    }
+    flushHistory(); // Include entries that are still queued
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return fail(error, file.errorString());
+    }
+    QSqlQuery query(db);
+    query.setForwardOnly(true);
+    if (!query.exec("SELECT h.timestamp, m.expression, m.result FROM history h "
+                    "JOIN memo m ON m.id = h.memo_id ORDER BY h.id")) {
+        logError("Error exporting history", query.lastError());
+        return fail(error, query.lastError().text());
+    }
+
+    HistoryExchange::Writer writer(&file, format);
+    qint64 written = 0;
+    bool ok = true;
+    while (ok && query.next()) {
+        ok = writer.write(query.value(0).toString(), query.value(1).toString(), query.value(2).toString());
+        ++written;
+    }
+    if (query.lastError().isValid()) {
+        logError("Error exporting history", query.lastError());
+        return fail(error, query.lastError().text()); // The incomplete file is discarded
+    }
+    if (!ok || !writer.finish() || !file.commit()) {
+        return fail(error, file.errorString());
+    }
+    if (count) *count = written;
+    return true;
+}
+
+bool DatabaseManager::importHistory(const QString &path, HistoryExchange::Format format, qint64 *count, QString *error)
+{
+    if (!db.isOpen()) {
+        return fail(error, "The history database is not open.");
+    }
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return fail(error, file.errorString());
+    }
+    const qint64 size = file.size();
+    uchar *data = size > 0 ? file.map(0, size) : nullptr;
+    if (size > 0 && !data) {
+        return fail(error, file.errorString());
+    }
+    flushHistory(); // Queued entries keep their place before the imported ones
+
+    // Rebuilding the indexes pays off unless the history already dwarfs the file
+    // (entries take a few dozen bytes each).
+    QSqlQuery query(db);
+    const qint64 existing = query.exec("SELECT max(id) FROM history") && query.next() ? query.value(0).toLongLong() : 0;
+    const bool deferIndexes = size / 32 >= existing;
+
+    // The bulk load is committed without waiting for the disk to confirm each write; the
+    // previous level is put back afterwards for regular entries.
+    const QVariant synchronous = query.exec("PRAGMA synchronous") && query.next() ? query.value(0) : QVariant(2);
+    query.exec("PRAGMA synchronous=OFF");
+
+    HistoryExchange::Reader reader(reinterpret_cast<const char *>(data), size, format);
+    qint64 imported = 0;
+    const bool ok = importRecords(reader, deferIndexes, &imported, error);
+
+    query.exec("PRAGMA synchronous=" + synchronous.toString());
+    if (data) {
+        file.unmap(data);
+    }
+    if (!ok) {
         return false;
     }
+    prefetchedPage.clear();
+    if (count) *count = imported;
+    return true;
+}
+
+bool DatabaseManager::importRecords(HistoryExchange::Reader &reader, bool deferIndexes, qint64 *count, QString *error)
+{
+    const auto failImport = [this, error](const QSqlError &sqlError) {
+        logError("Error importing history", sqlError);
+        db.rollback();
+        return fail(error, sqlError.text());
+    };
+
+    db.transaction();
+    QSqlQuery query(db);
+    if (deferIndexes
+        && (!query.exec("DROP INDEX IF EXISTS memo_hash") || !query.exec("DROP INDEX IF EXISTS memo_result_value")
+            || !query.exec("DROP INDEX IF EXISTS history_memo"))) {
+        return failImport(query.lastError());
+    }
+    // The search index is filled from all new memo rows at once instead of row by row.
+    if (fullTextSearch && !query.exec("DROP TRIGGER IF EXISTS memo_fts_insert")) {
+        return failImport(query.lastError());
+    }
+
+    // Imported entries share memo rows with each other and with existing entries when
+    // both expression and result agree, as added ones do. Memo ids are handed out here
+    // so that history rows can reference them before they are written.
+    struct MemoUse
+    {
+        qint64 id;
+        qint64 addedUses; // Beyond the one a new memo row is inserted with
+        QString lastUsed; // Latest of those uses
+    };
+    QHash<QPair<QString, QString>, MemoUse> memoUses;
+    qint64 nextMemoId = 1;
+    query.setForwardOnly(true);
+    if (!query.exec("SELECT id, key, result FROM memo")) {
+        return failImport(query.lastError());
+    }
+    while (query.next()) {
+        const qint64 id = query.value(0).toLongLong();
+        memoUses.insert({ query.value(1).toString(), query.value(2).toString() }, { id, 0, QString() });
+        nextMemoId = std::max(nextMemoId, id + 1);
+    }
+    const qint64 firstNewMemoId = nextMemoId;
+
+    BulkInsert memoRows(db,
+                        "INSERT INTO memo (id, hash, key, expression, result, result_value, use_count, last_used) VALUES ",
+                        "(?, ?, ?, ?, ?, ?, 1, ?)", 7);
+    BulkInsert historyRows(db, "INSERT INTO history (timestamp, memo_id) VALUES ", "(?, ?)", 2);
+    const QString now = QDateTime::currentDateTime().toString(Qt::ISODate);
+    HistoryExchange::Record record;
+    while (reader.next(&record)) {
+        const QString timestamp = record.timestamp.empty()
+                                      ? now
+                                      : QString::fromUtf8(record.timestamp.data(), static_cast<qsizetype>(record.timestamp.size()));
+        const QString expression = QString::fromUtf8(record.expression.data(), static_cast<qsizetype>(record.expression.size()));
+        const QString key = memoKey(expression);
+        const QString result = QString::fromUtf8(record.result.data(), static_cast<qsizetype>(record.result.size()));
+        auto memo = memoUses.find({ key, result });
+        if (memo == memoUses.end()) {
+            double value = 0;
+            const bool numeric = NumberFormat::parse(record.result, &value);
+            memo = memoUses.insert({ key, result }, { nextMemoId++, 0, QString() });
+            if (!memoRows.add({ memo->id, static_cast<qint64>(ResultMemo::hashKey(key.toStdString())), key, expression,
+                                result, numeric ? QVariant(value) : QVariant(), timestamp })) {
+                return failImport(memoRows.lastError());
+            }
+        } else {
+            ++memo->addedUses;
+            if (timestamp > memo->lastUsed) memo->lastUsed = timestamp;
+        }
+        if (!historyRows.add({ timestamp, memo->id })) {
+            return failImport(historyRows.lastError());
+        }
+        ++*count;
+    }
+    if (reader.hasError()) {
+        db.rollback();
+        return fail(error, reader.errorString());
+    }
+    if (!memoRows.finish()) {
+        return failImport(memoRows.lastError());
+    }
+    if (!historyRows.finish()) {
+        return failImport(historyRows.lastError());
+    }
+
+    QSqlQuery countUse(db);
+    countUse.prepare("UPDATE memo SET use_count = use_count + ?, last_used = max(last_used, ?) WHERE id = ?");
+    for (auto memo = memoUses.cbegin(); memo != memoUses.cend(); ++memo) {
+        if (memo->addedUses == 0) {
+            continue;
+        }
+        countUse.bindValue(0, memo->addedUses);
+        countUse.bindValue(1, memo->lastUsed);
+        countUse.bindValue(2, memo->id);
+        if (!countUse.exec()) {
+            return failImport(countUse.lastError());
+        }
+    }
+
+    if (deferIndexes
+        && (!query.exec(CreateMemoHashIndex) || !query.exec(CreateMemoResultIndex)
+            || !query.exec(CreateHistoryMemoIndex))) {
+        return failImport(query.lastError());
+    }
+    if (fullTextSearch) {
+        query.prepare("INSERT INTO memo_fts (rowid, expression, result) SELECT id, expression, result FROM memo WHERE id >= ?");
+        query.addBindValue(firstNewMemoId);
+        if (!query.exec() || !query.exec(CreateMemoFtsTrigger)) {
+            return failImport(query.lastError());
+        }
+    }
+    if (!db.commit()) {
+        return failImport(db.lastError());
+    }
     return true;
 }
 
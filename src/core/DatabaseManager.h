@@ -6,8 +6,30 @@
 #include <QSqlQuery>
 #include <QSqlError>
 #include <QDateTime>
+#include <QStringList>
+#include "HistoryMaintainer.h"
+#include "HistoryStore.h"
+#include "ResultMemo.h"
+#include "SymbolStore.h"
 
-class DatabaseManager : public QObject
+class HistorySearcher;
+class HistoryWriter;
+class QThread;
+
+// Owns the history database. Reads and clears run on the calling thread; new entries
+// are handed to a HistoryWriter thread and written in batches, so addHistoryEntry()
+// never blocks on disk I/O. Everything queued is committed before the database closes.
+// openDatabaseAsync() moves opening itself off the calling thread as well.
+//
+// Each distinct expression is stored once, in the memo table, together with its result,
+// a use count and the time it was last used; history rows only reference a memo row.
+// The same rows back the ResultMemo interface that CalculatorCore consults, a decimal
+// result marked with the precision it was computed at; call lookup() and store() from
+// the thread that owns this object. Variable and function
+// definitions are kept in the symbols table, one row per name, through SymbolStore.
+// With the columnar history backend only the memo and symbols are used. A
+// HistoryMaintainer thread enforces the retention limits and reclaims free space.
+class DatabaseManager : public HistoryStore, public ResultMemo, public SymbolStore
 {
     Q_OBJECT
 
@@ -15,18 +37,95 @@ public:
     explicit DatabaseManager(QObject *parent = nullptr);
     ~DatabaseManager();
 
+    // Opens the database and brings its schema up to date before returning.
     bool openDatabase(const QString &dbPath);
+    // Does the same on a background thread and reports the outcome through
+    // databaseOpened(). Opening can take long on first start after an upgrade (history
+    // migration, index build); meanwhile reads return nothing and added entries are
+    // queued, to be written once the database is ready.
+    void openDatabaseAsync(const QString &dbPath);
     void closeDatabase();
-    bool createHistoryTable();
-    bool addHistoryEntry(const QString &expression, const QString &result);
-    QList<QPair<QString, QString>> getHistory();
-    bool clearHistory();
+    // Queues the entry for the writer thread.
+    bool addHistoryEntry(const QString &expression, const QString &result) override;
+    void flushHistory() override;
+
+    bool lookup(std::string_view key, int precision, std::string *result) override;
+    void store(std::string_view key, int precision, std::string_view result) override;
+    void storeDefinition(std::string_view name, std::string_view definition) override;
+    // Definitions stored by earlier sessions in the order they were first made, as
+    // read while opening. Replaying them with CalculatorCore::define() in this order
+    // restores them, since a definition only refers to names defined before it.
+    QStringList symbolDefinitions() const { return storedDefinitions; }
+
+    // Normalized form of an expression used to deduplicate it, so "2×3" and "2 * 3"
+    // share one memo row.
+    static QString memoKey(const QString &expression);
+
+    // Each page is a range scan of the id primary key, so its cost does not grow with
+    // the table.
+    QList<HistoryEntry> fetchHistoryPage(qint64 beforeId = 0, int limit = DefaultPageSize) override;
+    qint64 historyCount() override;
+
+    // Runs on a HistorySearcher thread against the trigram index.
+    quint64 searchHistory(const HistorySearch &search, qint64 beforeId = 0, int limit = DefaultPageSize) override;
+    bool hasFullTextSearch() const { return fullTextSearch; }
+    bool clearHistory() override;
+
+    // Applies from the next maintenance pass on, for this and later opened databases.
+    void setHistoryRetention(const HistoryRetention &retention);
+    // Starts a maintenance pass now instead of on schedule, converting a database created
+    // before incremental vacuum was enabled; its outcome is reported through
+    // historyMaintained() like that of every pass.
+    void compactHistory();
+
+    // Streams rows from a forward-only query, so memory use does not depend on the size
+    // of the history.
+    bool exportHistory(const QString &path, HistoryExchange::Format format, qint64 *count = nullptr,
+                       QString *error = nullptr) override;
+    // The file is memory-mapped and loaded in one transaction with multi-row inserts,
+    // with indexes rebuilt once at the end and without syncing to disk before the commit.
+    bool importHistory(const QString &path, HistoryExchange::Format format, qint64 *count = nullptr,
+                       QString *error = nullptr) override;
+
+signals:
+    void databaseOpened(bool ok);
+    void historyMaintained(const HistoryMaintainer::Report &report);
 
 private:
+    // Outcome of the part of opening that can run on any thread.
+    struct PreparedDatabase
+    {
+        bool ok = false;
+        bool fullTextSearch = false;
+        QList<HistoryEntry> firstPage; // Newest DefaultPageSize entries
+        QStringList symbolDefinitions;
+    };
+
     QSqlDatabase db;
     QString databasePath;
+    HistoryWriter *historyWriter = nullptr;
+    HistorySearcher *historySearcher = nullptr;
+    HistoryMaintainer *historyMaintainer = nullptr;
+    HistoryRetention retention;
+    bool fullTextSearch = false;
+    QList<HistoryEntry> prefetchedPage; // firstPage until it is read or goes stale
+    QStringList storedDefinitions;
+
+    QThread *databaseOpener = nullptr;
+    PreparedDatabase openerResult; // Written by databaseOpener, read after it finished
 
-    void logError(const QString &message, const QSqlError &error);
+    static PreparedDatabase prepareDatabase(const QString &dbPath);
+    bool attachDatabase(const QString &dbPath, const PreparedDatabase &prepared);
+    void finishOpening();
+    void finishMaintenance(const HistoryMaintainer::Report &report);
+    static bool createHistoryTable(QSqlDatabase &connection, bool *fullTextSearch);
+    static bool migrateLegacyHistory(QSqlDatabase &connection);
+    static bool createSearchIndex(QSqlDatabase &connection);
+    static bool createSymbolTable(QSqlDatabase &connection);
+    static QStringList readSymbolDefinitions(QSqlDatabase &connection);
+    static QList<HistoryEntry> readHistoryPage(QSqlDatabase &connection, qint64 beforeId, int limit);
+    bool importRecords(HistoryExchange::Reader &reader, bool deferIndexes, qint64 *count, QString *error);
+    static void logError(const QString &message, const QSqlError &error);
 };
 
 #endif // DATABASEMANAGER_H
\ No newline at end of file
@@ -0,0 +1,144 @@
+#include "DecimalEvaluator.h"
+#include <charconv>
+#include <cmath>
+#include "ExpressionLexer.h"
+
+namespace
+{
+    // The shortest decimal that reads back as value, so 0.1 is one tenth.
+    BigDecimal shortestDecimal(double value)
+    {
+        char buffer[32];
+        const std::to_chars_result written = std::to_chars(buffer, buffer + sizeof(buffer), value);
+        BigDecimal decimal;
+        BigDecimal::fromString(std::string_view(buffer, static_cast<size_t>(written.ptr - buffer)), &decimal);
+        return decimal;
+    }
+
+    // Exact value of the literal behind a PushConst, read from its text, so it is not
+    // limited to the range of a double. A constant with no number at its position (pi,
+    // e, or one inside an inlined function body) is the shortest decimal form of the
+    // pooled double. False if the value is beyond the decimal range.
+    template <typename CharT>
+    bool literalAt(std::basic_string_view<CharT> source, int position, double constant, BigDecimal *value)
+    {
+        bool parsed = false;
+        if (position >= 0 && static_cast<size_t>(position) < source.size()) {
+            ExpressionLexer<CharT> lexer(source.data() + position, source.data() + source.size());
+            const Token token = lexer.next(ExpressionLexer<CharT>::ExpectOperand);
+            if (token.kind == TokenKind::Number) {
+                // Numbers are pure ASCII, so narrowing is a plain copy.
+                const std::basic_string_view<CharT> text = lexer.text(token);
+                std::string narrow(text.size(), '\0');
+                for (size_t i = 0; i < text.size(); ++i) narrow[i] = static_cast<char>(text[i]);
+                if (!BigDecimal::fromString(narrow, value)) {
+                    return false;
+                }
+                parsed = true;
+            }
+        }
+        if (!parsed) {
+            if (!std::isfinite(constant)) {
+                return false;
+            }
+            *value = shortestDecimal(std::fabs(constant));
+        }
+        // The compiler folds "-<number>" into the constant pool.
+        if (std::signbit(constant)) {
+            *value = value->negated();
+        }
+        return true;
+    }
+
+    template <typename CharT>
+    DecimalResult run(const CompiledExpression &program, std::basic_string_view<CharT> source,
+                      const DecimalContext &context, const double *values)
+    {
+        DecimalResult result;
+        if (program.isEmpty()) {
+            result.error = { CalcErrorCode::EmptyExpression, 0 };
+            return result;
+        }
+
+        const BigDecimal hundred = BigDecimal::fromInteger(100);
+        std::vector<BigDecimal> stack;
+        stack.reserve(static_cast<size_t>(program.maxStackDepth()));
+
+        const std::vector<CompiledExpression::Instruction> &code = program.instructions();
+        for (size_t i = 0; i < code.size(); ++i) {
+            const CompiledExpression::Instruction &instruction = code[i];
+            CalcErrorCode status = CalcErrorCode::None;
+            switch (instruction.op) {
+                case OpCode::PushConst: {
+                    BigDecimal literal;
+                    if (!literalAt(source, program.sourcePosition(i), program.constants()[instruction.operand], &literal)) {
+                        status = CalcErrorCode::PrecisionExceeded;
+                    }
+                    stack.push_back(context.round(literal));
+                    break;
+                }
+                case OpCode::PushVariable:
+                    if (!values || !std::isfinite(values[instruction.operand])) {
+                        result.error = { values ? CalcErrorCode::PrecisionExceeded : CalcErrorCode::UnknownIdentifier,
+                                         program.sourcePosition(i) };
+                        return result;
+                    }
+                    stack.push_back(context.round(shortestDecimal(values[instruction.operand])));
+                    continue;
+                case OpCode::Negate:
+                    stack.back() = stack.back().negated();
+                    continue;
+                case OpCode::Sqrt:
+                    status = context.squareRoot(stack.back(), &stack.back());
+                    break;
+                case OpCode::Percent:
+                    status = context.divide(stack.back(), hundred, &stack.back());
+                    break;
+                case OpCode::Square:
+                    stack.back() = context.multiply(stack.back(), stack.back());
+                    break;
+                case OpCode::PowInt:
+                    status = context.power(stack.back(), BigDecimal::fromInteger(static_cast<std::int32_t>(instruction.operand)),
+                                           &stack.back());
+                    break;
+                default: {
+                    const BigDecimal right = std::move(stack.back());
+                    stack.pop_back();
+                    BigDecimal &left = stack.back();
+                    switch (instruction.op) {
+                        case OpCode::Add:      left = context.add(left, right); break;
+                        case OpCode::Subtract: left = context.subtract(left, right); break;
+                        case OpCode::Multiply: left = context.multiply(left, right); break;
+                        case OpCode::Divide:   status = context.divide(left, right, &left); break;
+                        case OpCode::Modulo:   status = context.remainder(left, right, &left); break;
+                        case OpCode::Power:    status = context.power(left, right, &left); break;
+                        default: break;
+                    }
+                    break;
+                }
+            }
+            if (status == CalcErrorCode::None && !DecimalContext::inRange(stack.back())) {
+                status = CalcErrorCode::PrecisionExceeded;
+            }
+            if (status != CalcErrorCode::None) {
+                result.error = { status, program.sourcePosition(i) };
+                return result;
+            }
+        }
+
+        result.value = std::move(stack.back());
+        return result;
+    }
+}
+
+DecimalResult DecimalEvaluator::evaluate(const CompiledExpression &program, std::string_view source,
+                                         const DecimalContext &context, const double *values)
+{
+    return run(program, source, context, values);
+}
+
+DecimalResult DecimalEvaluator::evaluate(const CompiledExpression &program, std::u16string_view source,
+                                         const DecimalContext &context, const double *values)
+{
+    return run(program, source, context, values);
+}
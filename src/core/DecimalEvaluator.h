@@ -0,0 +1,32 @@
+#ifndef DECIMALEVALUATOR_H
+#define DECIMALEVALUATOR_H
+
+#include <string_view>
+#include "BigDecimal.h"
+#include "CompiledExpression.h"
+
+struct DecimalResult
+{
+    BigDecimal value;
+    CalcError error;
+
+    bool ok() const { return !error.isError(); }
+};
+
+// Runs a compiled program in arbitrary-precision decimal arithmetic instead of doubles.
+// The constant pool only holds doubles, so every literal is read again from the source
+// text at its instruction's position: "0.1" stays exactly one tenth and a 40-digit
+// literal keeps all of its digits, as does 1e400, which no double holds. source must be
+// the text the program was compiled from, without ExpressionOptimizer: a folded constant
+// no longer matches the literal at its position.
+// values[i] is the value of program.variables()[i], read as its shortest decimal form.
+class DecimalEvaluator
+{
+public:
+    static DecimalResult evaluate(const CompiledExpression &program, std::string_view source,
+                                  const DecimalContext &context, const double *values = nullptr);
+    static DecimalResult evaluate(const CompiledExpression &program, std::u16string_view source,
+                                  const DecimalContext &context, const double *values = nullptr);
+};
+
+#endif // DECIMALEVALUATOR_H
@@ -0,0 +1,161 @@
+#include "ExpressionCache.h"
+#include "ExpressionLexer.h"
+
+namespace
+{
+    inline bool isWordToken(TokenKind kind)
+    {
+        return kind == TokenKind::Number || kind == TokenKind::Identifier;
+    }
+
+    template <typename CharT>
+    bool isSqrtName(std::basic_string_view<CharT> name)
+    {
+        constexpr std::string_view Sqrt = "sqrt";
+        if (name.size() != Sqrt.size()) return false;
+        for (size_t i = 0; i < Sqrt.size(); ++i) {
+            if (name[i] != static_cast<CharT>(Sqrt[i])) return false;
+        }
+        return true;
+    }
+
+    template <typename CharT>
+    bool normalizeTokens(const CharT *begin, const CharT *end, std::string &key)
+    {
+        using Lexer = ExpressionLexer<CharT>;
+
+        key.clear();
+        if (static_cast<size_t>(end - begin) > ExpressionCache::MaxKeyLength) {
+            return false;
+        }
+
+        Lexer lexer(begin, end);
+        typename Lexer::Mode mode = Lexer::ExpectOperand;
+        TokenKind previous = TokenKind::End;
+        for (;;) {
+            const Token token = lexer.next(mode);
+            switch (token.kind) {
+                case TokenKind::End:
+                    return true;
+                case TokenKind::Invalid:
+                case TokenKind::Equals: // Definitions are never cached
+                    return false;
+                case TokenKind::Number:
+                case TokenKind::Identifier: {
+                    // Keep adjacent words apart: "2 3" must not collapse into "23".
+                    if (isWordToken(previous)) key.push_back(' ');
+                    // Numbers and identifiers are pure ASCII, so narrowing is a plain copy.
+                    const auto text = lexer.text(token);
+                    for (const CharT c : text) key.push_back(static_cast<char>(c));
+                    // The parser reads on in operator mode after any operand, and in operand
+                    // mode only after "sqrt", whose '(' follows. After a function name only
+                    // '(' parses, which lexes the same either way.
+                    mode = token.kind == TokenKind::Identifier && isSqrtName(text) ? Lexer::ExpectOperand
+                                                                                   : Lexer::ExpectOperator;
+                    break;
+                }
+                case TokenKind::Plus:       key.push_back('+'); mode = Lexer::ExpectOperand; break;
+                case TokenKind::Minus:      key.push_back('-'); mode = Lexer::ExpectOperand; break;
+                case TokenKind::Multiply:   key.push_back('*'); mode = Lexer::ExpectOperand; break;
+                case TokenKind::Divide:     key.push_back('/'); mode = Lexer::ExpectOperand; break;
+                case TokenKind::Power:      key.push_back('^'); mode = Lexer::ExpectOperand; break;
+                case TokenKind::Sqrt:       key.append("\xE2\x88\x9A"); mode = Lexer::ExpectOperand; break;
+                case TokenKind::LeftParen:  key.push_back('('); mode = Lexer::ExpectOperand; break;
+                case TokenKind::RightParen: key.push_back(')'); mode = Lexer::ExpectOperator; break;
+                case TokenKind::Comma:      key.push_back(','); mode = Lexer::ExpectOperand; break;
+                case TokenKind::Percent: {
+                    key.push_back('%');
+                    Lexer lookahead = lexer;
+                    mode = startsUnsignedOperand(lookahead.next(Lexer::ExpectOperand).kind) ? Lexer::ExpectOperand
+                                                                                             : Lexer::ExpectOperator;
+                    break;
+                }
+            }
+            previous = token.kind;
+        }
+    }
+}
+
+ExpressionCache::ExpressionCache(size_t capacity)
+    : m_capacity(capacity)
+{
+}
+
+bool ExpressionCache::normalize(std::u16string_view source, std::string &key)
+{
+    return normalizeTokens(source.data(), source.data() + source.size(), key);
+}
+
+bool ExpressionCache::normalize(std::string_view utf8Source, std::string &key)
+{
+    return normalizeTokens(utf8Source.data(), utf8Source.data() + utf8Source.size(), key);
+}
+
+bool ExpressionCache::lookup(const std::string &key, Entry *entry)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const auto found = m_index.find(key);
+    if (found == m_index.end()) {
+        ++m_misses;
+        return false;
+    }
+    ++m_hits;
+    m_order.splice(m_order.begin(), m_order, found->second);
+    *entry = found->second->second;
+    return true;
+}
+
+void ExpressionCache::insert(const std::string &key, Entry entry)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_capacity == 0) {
+        return;
+    }
+
+    const auto found = m_index.find(key);
+    if (found != m_index.end()) {
+        // Another thread compiled the same expression concurrently; keep the newer copy.
+        found->second->second = std::move(entry);
+        m_order.splice(m_order.begin(), m_order, found->second);
+        return;
+    }
+
+    m_order.emplace_front(key, std::move(entry));
+    m_index.emplace(m_order.front().first, m_order.begin());
+    evictToCapacity();
+}
+
+void ExpressionCache::setCapacity(size_t capacity)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_capacity = capacity;
+    evictToCapacity();
+}
+
+void ExpressionCache::clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_index.clear();
+    m_order.clear();
+}
+
+ExpressionCache::Stats ExpressionCache::stats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Stats stats;
+    stats.hits = m_hits;
+    stats.misses = m_misses;
+    stats.evictions = m_evictions;
+    stats.size = m_order.size();
+    stats.capacity = m_capacity;
+    return stats;
+}
+
+void ExpressionCache::evictToCapacity()
+{
+    while (m_order.size() > m_capacity) {
+        m_index.erase(m_order.back().first);
+        m_order.pop_back();
+        ++m_evictions;
+    }
+}
@@ -0,0 +1,81 @@
+#ifndef EXPRESSIONCACHE_H
+#define EXPRESSIONCACHE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include "CompiledExpression.h"
+
+// Bounded, thread-safe LRU cache of compiled expressions keyed by a normalized form of
+// the expression text. Only expressions that compiled successfully are stored; for
+// programs without free inputs the evaluation outcome is cached as well, so a hit
+// skips both parsing and execution.
+class ExpressionCache
+{
+public:
+    static constexpr size_t DefaultCapacity = 1024;
+    // Longer inputs are evaluated uncached so a single paste cannot pin megabytes of keys.
+    static constexpr size_t MaxKeyLength = 4096;
+
+    struct Entry
+    {
+        std::shared_ptr<const CompiledExpression> program;
+        bool hasConstantResult = false;
+        double value = 0.0;
+        CalcError error; // Evaluation outcome that belongs to value
+    };
+
+    struct Stats
+    {
+        std::uint64_t hits = 0;
+        std::uint64_t misses = 0;
+        std::uint64_t evictions = 0;
+        size_t size = 0;
+        size_t capacity = 0;
+    };
+
+    explicit ExpressionCache(size_t capacity = DefaultCapacity);
+
+    ExpressionCache(const ExpressionCache &) = delete;
+    ExpressionCache &operator=(const ExpressionCache &) = delete;
+
+    // Builds the lookup key for source: whitespace dropped and every spelling of an
+    // operator ('×'/'x'/'*', '÷'/'/', '−'/'-', "x^y"/'^') unified. Operator/operand
+    // context is tracked exactly like the parser does, so 'x' only folds into '*' where
+    // it really is multiplication. Returns false if the text contains tokens the lexer
+    // rejects or exceeds MaxKeyLength; such input is never cached.
+    static bool normalize(std::u16string_view source, std::string &key);
+    static bool normalize(std::string_view utf8Source, std::string &key);
+
+    // Copies the entry for key into *entry and marks it most recently used.
+    bool lookup(const std::string &key, Entry *entry);
+    void insert(const std::string &key, Entry entry);
+
+    // A capacity of 0 turns the cache off: callers check enabled() and then skip building
+    // keys as well as the lock, since nothing would ever be found.
+    void setCapacity(size_t capacity);
+    bool enabled() const { return m_capacity.load(std::memory_order_relaxed) != 0; }
+    void clear();
+    Stats stats() const;
+
+private:
+    using Node = std::pair<std::string, Entry>;
+
+    mutable std::mutex m_mutex;
+    std::list<Node> m_order; // Most recently used first
+    std::unordered_map<std::string_view, std::list<Node>::iterator> m_index; // Views into m_order keys
+    std::atomic<size_t> m_capacity; // Written under m_mutex
+    std::uint64_t m_hits = 0;
+    std::uint64_t m_misses = 0;
+    std::uint64_t m_evictions = 0;
+
+    void evictToCapacity();
+};
+
+#endif // EXPRESSIONCACHE_H
@@ -0,0 +1,487 @@
+#include "ExpressionCompiler.h"
+#include <algorithm>
+
+namespace
+{
+    template <typename CharT>
+    bool equalsAscii(std::basic_string_view<CharT> text, std::string_view ascii)
+    {
+        if (text.size() != ascii.size()) return false;
+        for (size_t i = 0; i < text.size(); ++i) {
+            if (text[i] != static_cast<CharT>(ascii[i])) return false;
+        }
+        return true;
+    }
+
+    // Code of one call argument, spliced in wherever the body uses its parameter.
+    struct Fragment
+    {
+        std::vector<CompiledExpression::Instruction> code;
+        std::vector<std::uint32_t> positions;
+    };
+}
+
+// A function body being inlined at a call.
+struct ExpressionCompiler::Expansion
+{
+    const Expansion *caller; // Enclosing expansion, to detect recursion
+    int slot;
+    const std::vector<std::string> *parameters;
+    std::vector<Fragment> arguments;
+    int callPosition; // Reported for everything in the body; -1 when checking a definition
+};
+
+template <typename CharT>
+class ExpressionCompiler::Parser
+{
+public:
+    using Lexer = ExpressionLexer<CharT>;
+
+    Parser(const CharT *begin, const CharT *end, CompiledExpression &program, VariablePolicy variables,
+           const SymbolTable *symbols, const Expansion *expansion = nullptr)
+        : m_lexer(begin, end), m_program(program), m_variablePolicy(variables), m_symbols(symbols),
+          m_expansion(expansion)
+    {
+    }
+
+    CalcError run()
+    {
+        advance(Lexer::ExpectOperand);
+        if (m_token.kind == TokenKind::End) {
+            return { CalcErrorCode::EmptyExpression, 0 };
+        }
+        if (parseExpression(0) && m_token.kind != TokenKind::End) {
+            fail(m_token.kind == TokenKind::RightParen ? CalcErrorCode::MismatchedParenthesis
+                                                       : CalcErrorCode::UnexpectedToken,
+                 m_token.position);
+        }
+        m_program.m_maxStackDepth = m_maxDepth;
+        return m_error;
+    }
+
+    // Parses a function body into the program of its caller, which has depth values on
+    // the stack and has needed maxDepth so far. Both are updated. The body continues at
+    // the caller's nesting, so MaxNestingDepth also bounds the depth of calls.
+    CalcError runInline(int nesting, int &depth, int &maxDepth)
+    {
+        m_nesting = nesting;
+        m_depth = depth;
+        m_maxDepth = maxDepth;
+        advance(Lexer::ExpectOperand);
+        if (parseExpression(0) && m_token.kind != TokenKind::End) {
+            fail(CalcErrorCode::UnexpectedToken, m_token.position);
+        }
+        depth = m_depth;
+        maxDepth = m_maxDepth;
+        return m_error;
+    }
+
+private:
+    Lexer m_lexer;
+    Token m_token;
+    CompiledExpression &m_program;
+    VariablePolicy m_variablePolicy;
+    const SymbolTable *m_symbols;
+    const Expansion *m_expansion;
+    CalcError m_error;
+    int m_nesting = 0;
+    int m_depth = 0;
+    int m_maxDepth = 0;
+
+    void advance(typename Lexer::Mode mode) { m_token = m_lexer.next(mode); }
+
+    // Inside an inlined body every position is that of the outermost call, since the
+    // body is not part of the source text.
+    int sourcePosition(int position) const
+    {
+        return m_expansion && m_expansion->callPosition >= 0 ? m_expansion->callPosition : position;
+    }
+
+    bool fail(CalcErrorCode code, int position)
+    {
+        if (!m_error.isError()) {
+            m_error = { code, sourcePosition(position) };
+        }
+        return false;
+    }
+
+    void append(OpCode op, std::uint32_t operand, std::uint32_t position)
+    {
+        m_program.m_code.push_back({ op, operand });
+        m_program.m_positions.push_back(position);
+        if (op == OpCode::PushConst || op == OpCode::PushVariable) {
+            if (++m_depth > m_maxDepth) m_maxDepth = m_depth;
+        } else if (ExpressionGrammar::isBinary(op)) {
+            --m_depth;
+        }
+    }
+
+    void emit(OpCode op, int position, std::uint32_t operand = 0)
+    {
+        append(op, operand, static_cast<std::uint32_t>(sourcePosition(position)));
+    }
+
+    void emitConstant(double value, int position)
+    {
+        m_program.m_constants.push_back(value);
+        emit(OpCode::PushConst, position, static_cast<std::uint32_t>(m_program.m_constants.size() - 1));
+    }
+
+    // slot is the variable's SymbolTable slot, or -1 for a free variable.
+    void emitVariable(std::basic_string_view<CharT> name, int position, int slot = -1)
+    {
+        // Identifiers are pure ASCII, so narrowing is a plain copy.
+        std::string narrow(name.size(), '\0');
+        for (size_t i = 0; i < name.size(); ++i) narrow[i] = static_cast<char>(name[i]);
+
+        int index = m_program.variableIndex(narrow);
+        if (index < 0) {
+            index = static_cast<int>(m_program.m_variables.size());
+            m_program.m_variables.push_back(std::move(narrow));
+            m_program.m_symbolSlots.push_back(slot);
+        }
+        m_program.m_usesSymbols = m_program.m_usesSymbols || slot >= 0;
+        emit(OpCode::PushVariable, position, static_cast<std::uint32_t>(index));
+    }
+
+    int parameterIndex(std::basic_string_view<CharT> name) const
+    {
+        const std::vector<std::string> &parameters = *m_expansion->parameters;
+        for (size_t i = 0; i < parameters.size(); ++i) {
+            if (equalsAscii(name, parameters[i])) return static_cast<int>(i);
+        }
+        return -1;
+    }
+
+    bool splice(const Fragment &argument, int position)
+    {
+        if (m_program.m_code.size() + argument.code.size() > MaxInstructions) {
+            return fail(CalcErrorCode::ExpressionTooLarge, position);
+        }
+        for (size_t i = 0; i < argument.code.size(); ++i) {
+            CompiledExpression::Instruction instruction = argument.code[i];
+            if (instruction.op == OpCode::PushConst) {
+                // Every copy gets its own constant, which "-x" may negate in place.
+                m_program.m_constants.push_back(m_program.m_constants[instruction.operand]);
+                instruction.operand = static_cast<std::uint32_t>(m_program.m_constants.size() - 1);
+            }
+            append(instruction.op, instruction.operand, argument.positions[i]);
+        }
+        return true;
+    }
+
+    bool isExpanding(int slot) const
+    {
+        for (const Expansion *caller = m_expansion; caller; caller = caller->caller) {
+            if (caller->slot == slot) return true;
+        }
+        return false;
+    }
+
+    // Parses "(a, b)" after the name of a function and inlines its body.
+    bool parseCall(const Token &name, int slot)
+    {
+        if (m_program.m_code.size() > MaxInstructions) {
+            return fail(CalcErrorCode::ExpressionTooLarge, name.position);
+        }
+
+        advance(Lexer::ExpectOperand);
+        if (m_token.kind != TokenKind::LeftParen) {
+            return fail(CalcErrorCode::UnexpectedToken, m_token.position);
+        }
+        const int open = m_token.position;
+        const SymbolTable::Function &function = m_symbols->function(slot);
+        Expansion expansion = { m_expansion, slot, &function.parameters, {}, sourcePosition(name.position) };
+
+        advance(Lexer::ExpectOperand);
+        while (m_token.kind != TokenKind::RightParen || !expansion.arguments.empty()) {
+            // Each argument is compiled in place, then cut out of the program.
+            const size_t start = m_program.m_code.size();
+            if (!parseExpression(0)) {
+                return false;
+            }
+            Fragment argument;
+            argument.code.assign(m_program.m_code.begin() + static_cast<std::ptrdiff_t>(start), m_program.m_code.end());
+            argument.positions.assign(m_program.m_positions.begin() + static_cast<std::ptrdiff_t>(start),
+                                      m_program.m_positions.end());
+            m_program.m_code.resize(start);
+            m_program.m_positions.resize(start);
+            --m_depth;
+            expansion.arguments.push_back(std::move(argument));
+
+            if (m_token.kind == TokenKind::Comma) {
+                advance(Lexer::ExpectOperand);
+            } else if (m_token.kind != TokenKind::RightParen) {
+                return fail(m_token.kind == TokenKind::End ? CalcErrorCode::MismatchedParenthesis
+                                                           : CalcErrorCode::UnexpectedToken,
+                            m_token.kind == TokenKind::End ? open : m_token.position);
+            } else {
+                break;
+            }
+        }
+        if (expansion.arguments.size() != function.parameters.size()) {
+            return fail(CalcErrorCode::ArgumentCountMismatch, name.position);
+        }
+
+        Parser<char> body(function.body.data(), function.body.data() + function.body.size(), m_program,
+                          m_variablePolicy, m_symbols, &expansion);
+        const CalcError status = body.runInline(m_nesting, m_depth, m_maxDepth);
+        if (status.isError()) {
+            return fail(status.code, status.position);
+        }
+        m_program.m_usesSymbols = true;
+        advance(Lexer::ExpectOperator);
+        return true;
+    }
+
+    // Parses operands and every binary/postfix operator binding at least as tightly as
+    // minPrecedence. On return m_token holds the first token that was not consumed.
+    bool parseExpression(int minPrecedence)
+    {
+        if (++m_nesting > MaxNestingDepth) {
+            return fail(CalcErrorCode::NestingTooDeep, m_token.position);
+        }
+        if (!parseOperand()) {
+            return false;
+        }
+
+        for (;;) {
+            OpCode op;
+            switch (m_token.kind) {
+                case TokenKind::Plus:     op = OpCode::Add; break;
+                case TokenKind::Minus:    op = OpCode::Subtract; break;
+                case TokenKind::Multiply: op = OpCode::Multiply; break;
+                case TokenKind::Divide:   op = OpCode::Divide; break;
+                case TokenKind::Power:    op = OpCode::Power; break;
+                case TokenKind::Percent: {
+                    // '%' directly followed by an operand is the modulo operator ("7 % 3"),
+                    // otherwise it is the postfix percentage ("50%", "50% + 1").
+                    Lexer lookahead = m_lexer;
+                    op = startsUnsignedOperand(lookahead.next(Lexer::ExpectOperand).kind) ? OpCode::Modulo
+                                                                                          : OpCode::Percent;
+                    break;
+                }
+                default:
+                    --m_nesting;
+                    return true;
+            }
+
+            const int precedence = ExpressionGrammar::precedence(op);
+            if (precedence < minPrecedence) {
+                break;
+            }
+
+            const int position = m_token.position;
+            if (op == OpCode::Percent) {
+                emit(op, position);
+                advance(Lexer::ExpectOperator);
+                continue;
+            }
+
+            advance(Lexer::ExpectOperand);
+            const int nextPrecedence = ExpressionGrammar::isRightAssociative(op) ? precedence : precedence + 1;
+            if (!parseExpression(nextPrecedence)) {
+                return false;
+            }
+            emit(op, position);
+        }
+
+        --m_nesting;
+        return true;
+    }
+
+    bool parseOperand()
+    {
+        const Token token = m_token;
+        switch (token.kind) {
+            case TokenKind::Number:
+                emitConstant(token.number, token.position);
+                advance(Lexer::ExpectOperator);
+                return true;
+
+            case TokenKind::LeftParen:
+                advance(Lexer::ExpectOperand);
+                if (!parseExpression(0)) {
+                    return false;
+                }
+                if (m_token.kind != TokenKind::RightParen) {
+                    return fail(m_token.kind == TokenKind::End ? CalcErrorCode::MismatchedParenthesis
+                                                               : CalcErrorCode::UnexpectedToken,
+                                m_token.kind == TokenKind::End ? token.position : m_token.position);
+                }
+                advance(Lexer::ExpectOperator);
+                return true;
+
+            case TokenKind::Plus:
+            case TokenKind::Minus:
+            case TokenKind::Sqrt: {
+                const size_t codeStart = m_program.m_code.size();
+                advance(Lexer::ExpectOperand);
+                if (!parseExpression(ExpressionGrammar::UnaryPrecedence)) {
+                    return false;
+                }
+                if (token.kind == TokenKind::Minus) {
+                    // Fold "-<number>" straight into the constant pool.
+                    if (m_program.m_code.size() == codeStart + 1 && m_program.m_code.back().op == OpCode::PushConst) {
+                        double &constant = m_program.m_constants[m_program.m_code.back().operand];
+                        constant = -constant;
+                    } else {
+                        emit(OpCode::Negate, token.position);
+                    }
+                } else if (token.kind == TokenKind::Sqrt) {
+                    emit(OpCode::Sqrt, token.position);
+                }
+                return true;
+            }
+
+            case TokenKind::Identifier:
+                if (equalsAscii(m_lexer.text(token), "sqrt")) {
+                    advance(Lexer::ExpectOperand);
+                    if (m_token.kind != TokenKind::LeftParen) {
+                        return fail(CalcErrorCode::UnexpectedToken, m_token.position);
+                    }
+                    if (!parseOperand()) {
+                        return false;
+                    }
+                    emit(OpCode::Sqrt, token.position);
+                    return true;
+                }
+                if (m_expansion) {
+                    const int parameter = parameterIndex(m_lexer.text(token));
+                    if (parameter >= 0) {
+                        if (!splice(m_expansion->arguments[static_cast<size_t>(parameter)], token.position)) {
+                            return false;
+                        }
+                        advance(Lexer::ExpectOperator);
+                        return true;
+                    }
+                }
+                if (m_symbols) {
+                    const int slot = m_symbols->find(m_lexer.text(token));
+                    if (slot >= 0 && isExpanding(slot)) {
+                        // Also catches a function whose own definition is being checked.
+                        return fail(CalcErrorCode::RecursiveFunction, token.position);
+                    }
+                    switch (slot < 0 ? SymbolTable::Kind::Undefined : m_symbols->kind(slot)) {
+                        case SymbolTable::Kind::Constant:
+                            emitConstant(m_symbols->value(slot), token.position);
+                            advance(Lexer::ExpectOperator);
+                            return true;
+                        case SymbolTable::Kind::Variable:
+                            emitVariable(m_lexer.text(token), token.position, slot);
+                            advance(Lexer::ExpectOperator);
+                            return true;
+                        case SymbolTable::Kind::Function:
+                            return parseCall(token, slot);
+                        case SymbolTable::Kind::Undefined:
+                            break;
+                    }
+                }
+                if (m_variablePolicy == CollectVariables) {
+                    emitVariable(m_lexer.text(token), token.position);
+                    advance(Lexer::ExpectOperator);
+                    return true;
+                }
+                return fail(CalcErrorCode::UnknownIdentifier, token.position);
+
+            case TokenKind::End:
+                return fail(CalcErrorCode::UnexpectedEnd, token.position);
+
+            case TokenKind::RightParen:
+                return fail(CalcErrorCode::MismatchedParenthesis, token.position);
+
+            case TokenKind::Invalid: {
+                const auto text = m_lexer.text(token);
+                const bool numeric = !text.empty() && ((text[0] >= '0' && text[0] <= '9') || text[0] == '.');
+                return fail(numeric ? CalcErrorCode::InvalidNumber : CalcErrorCode::UnexpectedToken, token.position);
+            }
+
+            default:
+                return fail(CalcErrorCode::UnexpectedToken, token.position);
+        }
+    }
+};
+
+CompiledExpression ExpressionCompiler::compile(std::u16string_view source, CalcError *error,
+                                               VariablePolicy variables, const SymbolTable *symbols) const
+{
+    CompiledExpression program;
+    Parser<char16_t> parser(source.data(), source.data() + source.size(), program, variables, symbols);
+    const CalcError status = parser.run();
+    if (error) *error = status;
+    if (status.isError()) {
+        return CompiledExpression();
+    }
+    return program;
+}
+
+CompiledExpression ExpressionCompiler::compile(std::string_view utf8Source, CalcError *error,
+                                               VariablePolicy variables, const SymbolTable *symbols) const
+{
+    CompiledExpression program;
+    Parser<char> parser(utf8Source.data(), utf8Source.data() + utf8Source.size(), program, variables, symbols);
+    const CalcError status = parser.run();
+    if (error) *error = status;
+    if (status.isError()) {
+        return CompiledExpression();
+    }
+    return program;
+}
+
+bool ExpressionCompiler::parseDefinition(std::string_view utf8Text, Definition *definition)
+{
+    using Lexer = ExpressionLexer<char>;
+    Lexer lexer(utf8Text.data(), utf8Text.data() + utf8Text.size());
+    Token token = lexer.next(Lexer::ExpectOperand);
+    if (token.kind != TokenKind::Identifier) {
+        return false;
+    }
+    definition->name = std::string(lexer.text(token));
+    definition->parameters.clear();
+    definition->isFunction = false;
+
+    token = lexer.next(Lexer::ExpectOperand);
+    if (token.kind == TokenKind::LeftParen) {
+        definition->isFunction = true;
+        token = lexer.next(Lexer::ExpectOperand);
+        while (token.kind != TokenKind::RightParen || !definition->parameters.empty()) {
+            if (token.kind != TokenKind::Identifier) {
+                return false;
+            }
+            std::string parameter(lexer.text(token));
+            if (std::find(definition->parameters.begin(), definition->parameters.end(), parameter)
+                != definition->parameters.end()) {
+                return false;
+            }
+            definition->parameters.push_back(std::move(parameter));
+            token = lexer.next(Lexer::ExpectOperand);
+            if (token.kind == TokenKind::RightParen) {
+                break;
+            }
+            if (token.kind != TokenKind::Comma) {
+                return false;
+            }
+            token = lexer.next(Lexer::ExpectOperand);
+        }
+        token = lexer.next(Lexer::ExpectOperand);
+    }
+    if (token.kind != TokenKind::Equals) {
+        return false;
+    }
+
+    definition->bodyPosition = lexer.position();
+    definition->body = utf8Text.substr(static_cast<size_t>(definition->bodyPosition));
+    return true;
+}
+
+CalcError ExpressionCompiler::checkFunction(const Definition &definition, int slot, const SymbolTable &symbols) const
+{
+    CompiledExpression program;
+    program.m_constants.push_back(1.0); // Stands in for every argument
+    const Fragment placeholder = { { { OpCode::PushConst, 0 } }, { 0 } };
+    const Expansion expansion = { nullptr, slot, &definition.parameters,
+                                  std::vector<Fragment>(definition.parameters.size(), placeholder), -1 };
+    Parser<char> parser(definition.body.data(), definition.body.data() + definition.body.size(), program,
+                        RejectVariables, &symbols, &expansion);
+    return parser.run();
+}
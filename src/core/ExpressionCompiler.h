@@ -0,0 +1,67 @@
+#ifndef EXPRESSIONCOMPILER_H
+#define EXPRESSIONCOMPILER_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include "CompiledExpression.h"
+#include "ExpressionLexer.h"
+#include "SymbolTable.h"
+
+// Precedence-climbing parser that turns expression text into a CompiledExpression in a
+// single pass. Supports + - × ÷ % ^ with the usual precedence, right-associative '^',
+// unary minus/plus, postfix percent, √ / sqrt(...) and arbitrarily nested parentheses
+// (bounded by MaxNestingDepth to keep recursion off the end of the stack).
+//
+// Compiled against a SymbolTable, constants become literals, variables become
+// PushVariable bound to their slot (see CompiledExpression::symbolSlots()) and a call
+// "f(a, b)" is replaced by the body of f with each parameter replaced by the code of its
+// argument. Programs therefore never call anything, and every evaluator runs them as is.
+class ExpressionCompiler
+{
+public:
+    static constexpr int MaxNestingDepth = ExpressionGrammar::MaxNestingDepth;
+    // Functions that use a parameter several times duplicate its argument, so nested
+    // calls can grow a program exponentially; larger ones fail with ExpressionTooLarge.
+    static constexpr size_t MaxInstructions = 1 << 16;
+
+    // What an identifier other than "sqrt" or a symbol means: an error, or a free
+    // variable that is recorded in CompiledExpression::variables() and bound at
+    // evaluation time.
+    enum VariablePolicy {
+        RejectVariables,
+        CollectVariables
+    };
+
+    // "name = body" or "name(a, b) = body" split into its parts.
+    struct Definition
+    {
+        std::string name;
+        std::vector<std::string> parameters;
+        bool isFunction = false; // Has a parameter list, possibly an empty one
+        std::string_view body;   // View into the parsed text
+        int bodyPosition = 0;    // Offset of body in the parsed text
+    };
+
+    CompiledExpression compile(std::u16string_view source, CalcError *error = nullptr,
+                               VariablePolicy variables = RejectVariables, const SymbolTable *symbols = nullptr) const;
+    CompiledExpression compile(std::string_view utf8Source, CalcError *error = nullptr,
+                               VariablePolicy variables = RejectVariables, const SymbolTable *symbols = nullptr) const;
+
+    // Returns true if text starts like a definition and fills *definition. The body is
+    // not looked at; a parameter list naming a parameter twice is not a definition.
+    static bool parseDefinition(std::string_view utf8Text, Definition *definition);
+
+    // Compiles the body of a function definition with placeholder arguments, so a
+    // mistake in it is reported when it is defined rather than at every call. slot is
+    // the function's own slot: a body that calls it fails with RecursiveFunction.
+    // Positions are offsets into definition.body.
+    CalcError checkFunction(const Definition &definition, int slot, const SymbolTable &symbols) const;
+
+private:
+    template <typename CharT>
+    class Parser;
+    struct Expansion;
+};
+
+#endif // EXPRESSIONCOMPILER_H
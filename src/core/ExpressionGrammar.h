@@ -0,0 +1,202 @@
+#ifndef EXPRESSIONGRAMMAR_H
+#define EXPRESSIONGRAMMAR_H
+
+#include <cmath>
+#include <cstdint>
+
+// Operation codes of the compiled expression program. The same values are used by
+// the compiler when emitting code and by the interpreter when executing it.
+enum class OpCode : std::uint8_t {
+    PushConst,  // push constants[operand]
+    PushVariable, // push the value bound to variables()[operand]
+    Negate,     // unary minus
+    Sqrt,       // √x
+    Percent,    // postfix x%  (x / 100)
+    Square,     // x*x, emitted by the optimizer for x^2
+    PowInt,     // x^operand for a small integer exponent, emitted by the optimizer (fast-math only)
+    Add,
+    Subtract,
+    Multiply,
+    Divide,
+    Modulo,
+    Power
+};
+
+enum class CalcErrorCode : std::uint8_t {
+    None,
+    EmptyExpression,
+    UnexpectedToken,
+    UnexpectedEnd,
+    MismatchedParenthesis,
+    InvalidNumber,
+    UnknownIdentifier,
+    NestingTooDeep,
+    ArgumentCountMismatch,
+    RecursiveFunction,
+    ExpressionTooLarge,
+    BuiltinRedefinition,
+    // Evaluation errors; everything above is detected while compiling
+    DivisionByZero,
+    ModuloByZero,
+    NegativeSquareRoot,
+    // Decimal mode only
+    NonIntegerExponent,
+    PrecisionExceeded
+};
+
+// Error code plus the offset (in code units of the source text) where it was detected.
+struct CalcError
+{
+    CalcErrorCode code = CalcErrorCode::None;
+    int position = -1;
+
+    constexpr bool isError() const { return code != CalcErrorCode::None; }
+    constexpr bool isSyntaxError() const { return isError() && code < CalcErrorCode::DivisionByZero; }
+};
+
+// Outcome of evaluating an expression: the value, or the error that prevented it. Plain
+// data, so reporting a failure costs nothing and works on any thread.
+struct CalcResult
+{
+    double value = NAN;
+    CalcError error;
+
+    constexpr bool ok() const { return !error.isError(); }
+};
+
+// One-line description of an error code, shared by the GUI alerts and the headless modes.
+inline const char *calcErrorMessage(CalcErrorCode code)
+{
+    switch (code) {
+        case CalcErrorCode::None:                  return "No error.";
+        case CalcErrorCode::EmptyExpression:       return "Empty expression.";
+        case CalcErrorCode::UnexpectedToken:       return "Unexpected token.";
+        case CalcErrorCode::UnexpectedEnd:         return "Unexpected end of expression.";
+        case CalcErrorCode::MismatchedParenthesis: return "Mismatched parenthesis.";
+        case CalcErrorCode::InvalidNumber:         return "Invalid number.";
+        case CalcErrorCode::UnknownIdentifier:     return "Unknown identifier.";
+        case CalcErrorCode::NestingTooDeep:        return "Expression is nested too deeply.";
+        case CalcErrorCode::ArgumentCountMismatch: return "Wrong number of arguments.";
+        case CalcErrorCode::RecursiveFunction:     return "A function cannot call itself.";
+        case CalcErrorCode::ExpressionTooLarge:    return "Expression is too large once functions are expanded.";
+        case CalcErrorCode::BuiltinRedefinition:   return "Built-in names cannot be redefined.";
+        case CalcErrorCode::DivisionByZero:        return "Division by zero is not allowed.";
+        case CalcErrorCode::ModuloByZero:          return "Modulo by zero is not allowed.";
+        case CalcErrorCode::NegativeSquareRoot:    return "Cannot calculate square root of a negative number.";
+        case CalcErrorCode::NonIntegerExponent:    return "Decimal mode supports only integer exponents.";
+        case CalcErrorCode::PrecisionExceeded:     return "Result exceeds the selected precision or range.";
+    }
+    return "Unknown error.";
+}
+
+// Operator table and semantics shared by every part of the expression engine, so that
+// precedence and the behaviour of each operator are defined in exactly one place.
+namespace ExpressionGrammar
+{
+    // Binding powers used by the precedence-climbing parser. Unary prefix operators bind
+    // tighter than multiplication but looser than '^', so -2^2 == -(2^2).
+    constexpr int AdditivePrecedence = 1;
+    constexpr int MultiplicativePrecedence = 2;
+    constexpr int UnaryPrecedence = 3;
+    constexpr int PowerPrecedence = 4;
+    constexpr int PostfixPrecedence = 5;
+
+    // Deepest nesting of parentheses and operators a parser accepts, which keeps its
+    // recursion off the end of the stack.
+    constexpr int MaxNestingDepth = 1000;
+
+    // Names every SymbolTable starts with, folded into programs as literals.
+    struct Constant
+    {
+        const char *name;
+        double value;
+    };
+    constexpr Constant BuiltinConstants[] = {
+        { "pi", 3.14159265358979323846 },
+        { "e", 2.71828182845904523536 },
+    };
+
+    constexpr bool isBinary(OpCode op)
+    {
+        return op >= OpCode::Add;
+    }
+
+    constexpr int precedence(OpCode op)
+    {
+        switch (op) {
+            case OpCode::Add:
+            case OpCode::Subtract: return AdditivePrecedence;
+            case OpCode::Multiply:
+            case OpCode::Divide:
+            case OpCode::Modulo:   return MultiplicativePrecedence;
+            case OpCode::Negate:
+            case OpCode::Sqrt:     return UnaryPrecedence;
+            case OpCode::Power:    return PowerPrecedence;
+            case OpCode::Percent:  return PostfixPrecedence;
+            default:               return 0;
+        }
+    }
+
+    constexpr bool isRightAssociative(OpCode op)
+    {
+        return op == OpCode::Power;
+    }
+
+    inline double applyUnary(OpCode op, double value, CalcErrorCode &error)
+    {
+        switch (op) {
+            case OpCode::Negate:  return -value;
+            case OpCode::Percent: return value / 100.0;
+            case OpCode::Sqrt:
+                if (value < 0.0) {
+                    error = CalcErrorCode::NegativeSquareRoot;
+                    return NAN;
+                }
+                return std::sqrt(value);
+            case OpCode::Square:  return value * value;
+            default:              return value;
+        }
+    }
+
+    // base^exponent by repeated squaring: log2(|exponent|) roundings, so it is not always
+    // as accurate as pow(). Never fails; 0^-n is infinite as with pow().
+    inline double powInt(double base, int exponent)
+    {
+        unsigned remaining = exponent < 0 ? 0u - static_cast<unsigned>(exponent) : static_cast<unsigned>(exponent);
+        double result = 1.0;
+        for (; remaining != 0; remaining >>= 1) {
+            if (remaining & 1u) result *= base;
+            base *= base;
+        }
+        return exponent < 0 ? 1.0 / result : result;
+    }
+
+    inline double applyBinary(OpCode op, double lhs, double rhs, CalcErrorCode &error)
+    {
+        switch (op) {
+            case OpCode::Add:      return lhs + rhs;
+            case OpCode::Subtract: return lhs - rhs;
+            case OpCode::Multiply: return lhs * rhs;
+            case OpCode::Divide:
+                if (rhs == 0.0) {
+                    error = CalcErrorCode::DivisionByZero;
+                    return NAN;
+                }
+                return lhs / rhs;
+            case OpCode::Modulo:
+                if (rhs == 0.0) {
+                    error = CalcErrorCode::ModuloByZero;
+                    return NAN;
+                }
+                return std::fmod(lhs, rhs); // fmod for floating point remainder
+            case OpCode::Power:
+                // x*x is the correctly rounded square, which pow() misses by an ulp for
+                // about one input in a thousand; it also keeps x^2 and the optimizer's
+                // Square in agreement.
+                return rhs == 2.0 ? lhs * lhs : std::pow(lhs, rhs);
+            default:               return NAN;
+        }
+    }
+}
+
+#endif // EXPRESSIONGRAMMAR_H
@@ -0,0 +1,227 @@
+#include "ExpressionLexer.h"
+#include <charconv>
+#include <cmath>
+#include <string>
+
+namespace
+{
+    constexpr char32_t MultiplicationSign = 0x00D7; // ×
+    constexpr char32_t DivisionSign = 0x00F7;       // ÷
+    constexpr char32_t MinusSign = 0x2212;          // −
+    constexpr char32_t SquareRootSign = 0x221A;     // √
+    constexpr char32_t InvalidCodePoint = 0xFFFFFFFF;
+
+    inline bool isDigit(char32_t c) { return c >= '0' && c <= '9'; }
+    inline bool isIdentifierStart(char32_t c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_'; }
+    inline bool isIdentifierPart(char32_t c) { return isIdentifierStart(c) || isDigit(c); }
+
+    // Whether a number from_chars found out of range is too large rather than too small,
+    // which the decimal exponent of its first significant digit decides.
+    bool overflows(const char *begin, const char *end)
+    {
+        long exponent = 0;
+        bool significant = false;
+        bool fraction = false;
+        const char *cursor = begin;
+        for (; cursor < end && *cursor != 'e' && *cursor != 'E'; ++cursor) {
+            if (*cursor == '.') {
+                fraction = true;
+            } else if (significant || *cursor != '0') {
+                significant = true;
+                exponent += fraction ? 0 : 1;
+            } else if (fraction) {
+                --exponent;
+            }
+        }
+        if (cursor < end) {
+            const bool negative = cursor[1] == '-';
+            long written = 0;
+            for (cursor += (cursor[1] == '-' || cursor[1] == '+') ? 2 : 1; cursor < end; ++cursor) {
+                if (written < 100000) written = written * 10 + (*cursor - '0');
+            }
+            exponent += negative ? -written : written;
+        }
+        return exponent > 0;
+    }
+}
+
+template <typename CharT>
+ExpressionLexer<CharT>::ExpressionLexer(const CharT *begin, const CharT *end)
+    : m_begin(begin), m_cursor(begin), m_end(end)
+{
+}
+
+template <typename CharT>
+char32_t ExpressionLexer<CharT>::peekCodePoint(const CharT *at, int *units) const
+{
+    if (at >= m_end) {
+        *units = 0;
+        return 0;
+    }
+
+    if constexpr (sizeof(CharT) == 2) {
+        // Every symbol the grammar knows lives in the BMP, so surrogates are simply invalid.
+        *units = 1;
+        return static_cast<char32_t>(*at);
+    } else {
+        const unsigned char lead = static_cast<unsigned char>(*at);
+        if (lead < 0x80) {
+            *units = 1;
+            return lead;
+        }
+        int length = (lead >= 0xF0) ? 4 : (lead >= 0xE0) ? 3 : (lead >= 0xC0) ? 2 : 1;
+        if (length == 1 || m_end - at < length) {
+            *units = 1;
+            return InvalidCodePoint;
+        }
+        char32_t cp = lead & (0x7F >> length);
+        for (int i = 1; i < length; ++i) {
+            cp = (cp << 6) | (static_cast<unsigned char>(at[i]) & 0x3F);
+        }
+        *units = length;
+        return cp;
+    }
+}
+
+template <typename CharT>
+void ExpressionLexer<CharT>::skipWhitespace()
+{
+    while (m_cursor < m_end) {
+        const CharT c = *m_cursor;
+        if (c != ' ' && c != '\t' && c != '\r' && c != '\n') {
+            break;
+        }
+        ++m_cursor;
+    }
+}
+
+template <typename CharT>
+Token ExpressionLexer<CharT>::makeToken(TokenKind kind, const CharT *start, int units) const
+{
+    Token token;
+    token.kind = kind;
+    token.position = static_cast<int>(start - m_begin);
+    token.length = units;
+    return token;
+}
+
+template <typename CharT>
+Token ExpressionLexer<CharT>::next(Mode mode)
+{
+    skipWhitespace();
+    if (m_cursor >= m_end) {
+        return makeToken(TokenKind::End, m_cursor, 0);
+    }
+
+    const CharT *start = m_cursor;
+    int units = 0;
+    const char32_t cp = peekCodePoint(m_cursor, &units);
+
+    if (isDigit(cp) || (cp == '.' && m_cursor + 1 < m_end && isDigit(m_cursor[1]))) {
+        return lexNumber();
+    }
+
+    if (cp == 'x' && mode == ExpectOperator) {
+        // "x^y" is the label of the power button and ends up verbatim in expressions.
+        if (m_end - m_cursor >= 3 && m_cursor[1] == '^' && m_cursor[2] == 'y'
+            && (m_end - m_cursor == 3 || !isIdentifierPart(static_cast<char32_t>(m_cursor[3])))) {
+            m_cursor += 3;
+            return makeToken(TokenKind::Power, start, 3);
+        }
+        // A lone 'x' after an operand is multiplication (2x3, 2 x 3).
+        if (m_cursor + 1 >= m_end || !isIdentifierStart(static_cast<char32_t>(m_cursor[1]))) {
+            m_cursor += 1;
+            return makeToken(TokenKind::Multiply, start, 1);
+        }
+    }
+
+    if (isIdentifierStart(cp)) {
+        return lexIdentifier();
+    }
+
+    TokenKind kind;
+    switch (cp) {
+        case '+':                kind = TokenKind::Plus; break;
+        case '-':
+        case MinusSign:          kind = TokenKind::Minus; break;
+        case '*':
+        case MultiplicationSign: kind = TokenKind::Multiply; break;
+        case '/':
+        case DivisionSign:       kind = TokenKind::Divide; break;
+        case '%':                kind = TokenKind::Percent; break;
+        case '^':                kind = TokenKind::Power; break;
+        case SquareRootSign:     kind = TokenKind::Sqrt; break;
+        case '(':                kind = TokenKind::LeftParen; break;
+        case ')':                kind = TokenKind::RightParen; break;
+        case ',':                kind = TokenKind::Comma; break;
+        case '=':                kind = TokenKind::Equals; break;
+        default:                 kind = TokenKind::Invalid; break;
+    }
+    m_cursor += units;
+    return makeToken(kind, start, units);
+}
+
+template <typename CharT>
+Token ExpressionLexer<CharT>::lexNumber()
+{
+    const CharT *start = m_cursor;
+    while (m_cursor < m_end && isDigit(*m_cursor)) ++m_cursor;
+    if (m_cursor < m_end && *m_cursor == '.') {
+        ++m_cursor;
+        while (m_cursor < m_end && isDigit(*m_cursor)) ++m_cursor;
+    }
+    // Exponent only when digits follow, so "2e" still lexes as 2 followed by an identifier.
+    if (m_cursor < m_end && (*m_cursor == 'e' || *m_cursor == 'E')) {
+        const CharT *exponent = m_cursor + 1;
+        if (exponent < m_end && (*exponent == '+' || *exponent == '-')) ++exponent;
+        if (exponent < m_end && isDigit(*exponent)) {
+            m_cursor = exponent;
+            while (m_cursor < m_end && isDigit(*m_cursor)) ++m_cursor;
+        }
+    }
+
+    const int units = static_cast<int>(m_cursor - start);
+    Token token = makeToken(TokenKind::Number, start, units);
+
+    const char *digits = nullptr;
+    char buffer[64];
+    std::string longNumber;
+    if constexpr (sizeof(CharT) == 1) {
+        digits = start;
+    } else {
+        // Numbers are pure ASCII, so narrowing is a plain copy.
+        char *narrow = buffer;
+        if (units > static_cast<int>(sizeof(buffer))) {
+            longNumber.resize(units);
+            narrow = longNumber.data();
+        }
+        for (int i = 0; i < units; ++i) {
+            narrow[i] = static_cast<char>(start[i]);
+        }
+        digits = narrow;
+    }
+    // Beyond the range of a double the literal is still a number: infinity or zero here,
+    // just as 10^400 and 10^-400 evaluate, and exactly its text in decimal mode.
+    if (std::from_chars(digits, digits + units, token.number).ec != std::errc()) {
+        token.number = overflows(digits, digits + units) ? HUGE_VAL : 0.0;
+    }
+    return token;
+}
+
+template <typename CharT>
+Token ExpressionLexer<CharT>::lexIdentifier()
+{
+    const CharT *start = m_cursor;
+    ++m_cursor;
+    while (m_cursor < m_end && isIdentifierPart(static_cast<char32_t>(*m_cursor))) ++m_cursor;
+    return makeToken(TokenKind::Identifier, start, static_cast<int>(m_cursor - start));
+}
+
+template <typename CharT>
+std::basic_string_view<CharT> ExpressionLexer<CharT>::text(const Token &token) const
+{
+    return std::basic_string_view<CharT>(m_begin + token.position, static_cast<size_t>(token.length));
+}
+
+template class ExpressionLexer<char>;
+template class ExpressionLexer<char16_t>;
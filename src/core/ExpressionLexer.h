@@ -0,0 +1,86 @@
+#ifndef EXPRESSIONLEXER_H
+#define EXPRESSIONLEXER_H
+
+#include <cstdint>
+#include <string_view>
+
+enum class TokenKind : std::uint8_t {
+    End,
+    Number,
+    Identifier,
+    Plus,
+    Minus,
+    Multiply,
+    Divide,
+    Percent,
+    Power,
+    Sqrt,
+    LeftParen,
+    RightParen,
+    Comma,
+    Equals,
+    Invalid
+};
+
+struct Token
+{
+    TokenKind kind = TokenKind::End;
+    int position = 0; // Offset of the first code unit in the source
+    int length = 0;   // Length in code units
+    double number = 0.0;
+};
+
+// Whether a token can begin an operand without a sign. A '%' followed by such a token is
+// the modulo operator, otherwise it is a postfix percentage. Signs are deliberately
+// excluded: in "50%-5" the '-' reads as subtraction.
+constexpr bool startsUnsignedOperand(TokenKind kind)
+{
+    switch (kind) {
+        case TokenKind::Number:
+        case TokenKind::Identifier:
+        case TokenKind::Sqrt:
+        case TokenKind::LeftParen:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Hand-written tokenizer over a UTF-8 (char) or UTF-16 (char16_t) buffer. It never
+// allocates and recognizes every spelling the calculator produces: '×', 'x', '*',
+// '÷', '/', '−', '√' and the "x^y" button label.
+//
+// The lexer is driven by the parser, which tells it whether an operand or an operator
+// is expected. This is what lets 'x' mean multiplication after an operand while still
+// being usable as the start of an identifier elsewhere.
+template <typename CharT>
+class ExpressionLexer
+{
+public:
+    enum Mode {
+        ExpectOperand,
+        ExpectOperator
+    };
+
+    ExpressionLexer(const CharT *begin, const CharT *end);
+
+    Token next(Mode mode);
+    std::basic_string_view<CharT> text(const Token &token) const;
+    int position() const { return static_cast<int>(m_cursor - m_begin); }
+
+private:
+    const CharT *m_begin;
+    const CharT *m_cursor;
+    const CharT *m_end;
+
+    char32_t peekCodePoint(const CharT *at, int *units) const;
+    void skipWhitespace();
+    Token lexNumber();
+    Token lexIdentifier();
+    Token makeToken(TokenKind kind, const CharT *start, int units) const;
+};
+
+extern template class ExpressionLexer<char>;
+extern template class ExpressionLexer<char16_t>;
+
+#endif // EXPRESSIONLEXER_H
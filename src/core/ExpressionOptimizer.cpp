@@ -0,0 +1,345 @@
+#include "ExpressionOptimizer.h"
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <utility>
+
+namespace
+{
+    // Larger exponents are left to pow(): every squaring adds a rounding.
+    constexpr int MaxPowIntExponent = 64;
+
+    struct Node
+    {
+        OpCode op;
+        std::uint32_t operand; // Variable index for PushVariable, exponent for PowInt
+        double value;          // PushConst only
+        int position;
+        int lhs;               // Operand of a unary operator, left operand of a binary one
+        int rhs;
+        bool canFail;          // Some operation in this subtree may report an error
+    };
+
+    bool isConstant(const Node &node, double value)
+    {
+        // Compares signs too, so -0 and +0 are told apart.
+        return node.op == OpCode::PushConst && node.value == value
+               && std::signbit(node.value) == std::signbit(value);
+    }
+
+    bool isZero(const Node &node)
+    {
+        return node.op == OpCode::PushConst && node.value == 0.0;
+    }
+
+    void makeConstant(Node &node, double value)
+    {
+        node.op = OpCode::PushConst;
+        node.value = value;
+        node.lhs = node.rhs = -1;
+        node.canFail = false;
+    }
+
+    // Division by 2^k is exact as multiplication by 2^-k whenever 2^-k is representable.
+    bool hasExactReciprocal(double value)
+    {
+        int exponent = 0;
+        return std::isfinite(value) && std::fabs(std::frexp(value, &exponent)) == 0.5
+               && std::isfinite(1.0 / value);
+    }
+
+    class Rewriter
+    {
+    public:
+        explicit Rewriter(bool fastMath) : m_fastMath(fastMath) {}
+
+        std::vector<Node> nodes;
+
+        // Simplifies nodes[index], whose operands are already simplified.
+        void simplify(int index)
+        {
+            Node &node = nodes[static_cast<size_t>(index)];
+            if (node.op == OpCode::PushConst || node.op == OpCode::PushVariable) {
+                return;
+            }
+            if (!ExpressionGrammar::isBinary(node.op)) {
+                simplifyUnary(node);
+            } else {
+                simplifyBinary(node);
+            }
+        }
+
+    private:
+        bool m_fastMath;
+
+        Node &at(int index) { return nodes[static_cast<size_t>(index)]; }
+
+        void simplifyUnary(Node &node)
+        {
+            Node &operand = at(node.lhs);
+            if (operand.op == OpCode::PushConst) {
+                CalcErrorCode error = CalcErrorCode::None;
+                const double value = node.op == OpCode::PowInt
+                                         ? ExpressionGrammar::powInt(operand.value, static_cast<std::int32_t>(node.operand))
+                                         : ExpressionGrammar::applyUnary(node.op, operand.value, error);
+                if (error == CalcErrorCode::None) {
+                    makeConstant(node, value);
+                    return;
+                }
+            }
+            if (node.op == OpCode::Negate && operand.op == OpCode::Negate) {
+                node = at(operand.lhs);
+                return;
+            }
+            node.canFail = operand.canFail || node.op == OpCode::Sqrt;
+        }
+
+        void simplifyBinary(Node &node)
+        {
+            Node &lhs = at(node.lhs);
+            Node &rhs = at(node.rhs);
+            if (lhs.op == OpCode::PushConst && rhs.op == OpCode::PushConst) {
+                CalcErrorCode error = CalcErrorCode::None;
+                const double value = ExpressionGrammar::applyBinary(node.op, lhs.value, rhs.value, error);
+                if (error == CalcErrorCode::None) {
+                    makeConstant(node, value);
+                    return;
+                }
+            }
+
+            switch (node.op) {
+                case OpCode::Add:
+                    // x + -0 is x for every x, but -0 + +0 is +0.
+                    if (isConstant(rhs, -0.0) || (m_fastMath && isZero(rhs))) {
+                        node = lhs;
+                        return;
+                    }
+                    if (isConstant(lhs, -0.0) || (m_fastMath && isZero(lhs))) {
+                        node = rhs;
+                        return;
+                    }
+                    break;
+                case OpCode::Subtract:
+                    if (isConstant(rhs, 0.0) || (m_fastMath && isZero(rhs))) {
+                        node = lhs;
+                        return;
+                    }
+                    if (m_fastMath && rhs.op == OpCode::PushConst) {
+                        // x - c == x + -c; as an addition it can join a chain below.
+                        node.op = OpCode::Add;
+                        rhs.value = -rhs.value;
+                    }
+                    break;
+                case OpCode::Multiply:
+                    if (isConstant(rhs, 1.0)) {
+                        node = lhs;
+                        return;
+                    }
+                    if (isConstant(lhs, 1.0)) {
+                        node = rhs;
+                        return;
+                    }
+                    if (m_fastMath && isZero(rhs) && !lhs.canFail) {
+                        node = rhs;
+                        return;
+                    }
+                    if (m_fastMath && isZero(lhs) && !rhs.canFail) {
+                        node = lhs;
+                        return;
+                    }
+                    break;
+                case OpCode::Divide:
+                    if (isConstant(rhs, 1.0)) {
+                        node = lhs;
+                        return;
+                    }
+                    if (rhs.op == OpCode::PushConst && hasExactReciprocal(rhs.value)) {
+                        node.op = OpCode::Multiply;
+                        rhs.value = 1.0 / rhs.value;
+                    }
+                    break;
+                case OpCode::Power:
+                    if (rhs.op != OpCode::PushConst) {
+                        break;
+                    }
+                    if (rhs.value == 1.0) {
+                        node = lhs;
+                        return;
+                    }
+                    if (rhs.value == 0.0 && !lhs.canFail) {
+                        makeConstant(node, 1.0); // pow(x, 0) is 1 even for NaN
+                        return;
+                    }
+                    if (rhs.value == 2.0) {
+                        node.op = OpCode::Square;
+                        node.rhs = -1;
+                        node.canFail = lhs.canFail;
+                        return;
+                    }
+                    if (m_fastMath && rhs.value == std::trunc(rhs.value) && std::fabs(rhs.value) <= MaxPowIntExponent) {
+                        node.op = OpCode::PowInt;
+                        node.operand = static_cast<std::uint32_t>(static_cast<std::int32_t>(rhs.value));
+                        node.rhs = -1;
+                        node.canFail = lhs.canFail;
+                        return;
+                    }
+                    break;
+                default:
+                    break;
+            }
+
+            if (m_fastMath) {
+                reassociate(node);
+            }
+            const Node &divisor = at(node.rhs);
+            const bool canFailItself = (node.op == OpCode::Divide || node.op == OpCode::Modulo)
+                                       && !(divisor.op == OpCode::PushConst && divisor.value != 0.0);
+            node.canFail = at(node.lhs).canFail || divisor.canFail || canFailItself;
+        }
+
+        // Keeps the constant of a + or * chain as the right operand of its top node, so
+        // "2 + x + 3" becomes "x + 5" and "2 * x * y * 3" becomes "x * y * 6". Only
+        // constants move, and they cannot fail, so errors still come in the same order.
+        void reassociate(Node &node)
+        {
+            if (node.op != OpCode::Add && node.op != OpCode::Multiply) {
+                return;
+            }
+            if (at(node.lhs).op == OpCode::PushConst) {
+                std::swap(node.lhs, node.rhs);
+            }
+            Node &lhs = at(node.lhs);
+            if (lhs.op != node.op || at(lhs.rhs).op != OpCode::PushConst) {
+                return;
+            }
+            Node &rhs = at(node.rhs);
+            if (rhs.op == OpCode::PushConst) {
+                // (a op c1) op c2 -> a op (c1 op c2)
+                CalcErrorCode error = CalcErrorCode::None;
+                rhs.value = ExpressionGrammar::applyBinary(node.op, at(lhs.rhs).value, rhs.value, error);
+                node.lhs = lhs.lhs;
+            } else {
+                // (a op c) op b -> (a op b) op c
+                std::swap(lhs.rhs, node.rhs);
+                lhs.canFail = at(lhs.lhs).canFail || at(lhs.rhs).canFail;
+            }
+        }
+    };
+
+    const char *mnemonic(OpCode op)
+    {
+        switch (op) {
+            case OpCode::PushConst:    return "push";
+            case OpCode::PushVariable: return "load";
+            case OpCode::Negate:       return "neg";
+            case OpCode::Sqrt:         return "sqrt";
+            case OpCode::Percent:      return "pct";
+            case OpCode::Square:       return "sqr";
+            case OpCode::PowInt:       return "powi";
+            case OpCode::Add:          return "add";
+            case OpCode::Subtract:     return "sub";
+            case OpCode::Multiply:     return "mul";
+            case OpCode::Divide:       return "div";
+            case OpCode::Modulo:       return "mod";
+            case OpCode::Power:        return "pow";
+        }
+        return "?";
+    }
+}
+
+CompiledExpression ExpressionOptimizer::optimize(const CompiledExpression &program, Mode mode)
+{
+    if (program.isEmpty()) {
+        return program;
+    }
+
+    // Postfix order visits operands before their operator, so every node can be
+    // simplified as soon as it is built.
+    Rewriter rewriter(mode == FastMath);
+    std::vector<Node> &nodes = rewriter.nodes;
+    nodes.reserve(program.m_code.size());
+    std::vector<int> operands;
+    for (size_t i = 0; i < program.m_code.size(); ++i) {
+        const CompiledExpression::Instruction &instruction = program.m_code[i];
+        Node node = { instruction.op, instruction.operand, 0.0, program.sourcePosition(i), -1, -1, false };
+        const int index = static_cast<int>(nodes.size());
+        if (instruction.op == OpCode::PushConst) {
+            node.value = program.m_constants[instruction.operand];
+            operands.push_back(index);
+        } else if (instruction.op == OpCode::PushVariable) {
+            operands.push_back(index);
+        } else if (!ExpressionGrammar::isBinary(instruction.op)) {
+            node.lhs = operands.back();
+            operands.back() = index;
+        } else {
+            node.rhs = operands.back();
+            operands.pop_back();
+            node.lhs = operands.back();
+            operands.back() = index;
+        }
+        nodes.push_back(node);
+        rewriter.simplify(index);
+    }
+
+    // Lowered back to postfix without recursion: a long chain like "1+2+...+n" is a tree
+    // as deep as it is long.
+    CompiledExpression optimized;
+    optimized.m_variables = program.m_variables;
+    optimized.m_symbolSlots = program.m_symbolSlots;
+    optimized.m_usesSymbols = program.m_usesSymbols;
+    optimized.m_code.reserve(nodes.size());
+    optimized.m_positions.reserve(nodes.size());
+    int depth = 0;
+    std::vector<std::pair<int, int>> pending = { { operands.back(), 0 } }; // Node, operands emitted
+    while (!pending.empty()) {
+        const int index = pending.back().first;
+        const Node &node = nodes[static_cast<size_t>(index)];
+        const int operandCount = node.lhs < 0 ? 0 : (node.rhs < 0 ? 1 : 2);
+        const int emitted = pending.back().second;
+        if (emitted < operandCount) {
+            ++pending.back().second;
+            pending.push_back({ emitted == 0 ? node.lhs : node.rhs, 0 });
+            continue;
+        }
+        pending.pop_back();
+
+        std::uint32_t operand = node.operand;
+        if (node.op == OpCode::PushConst) {
+            operand = static_cast<std::uint32_t>(optimized.m_constants.size());
+            optimized.m_constants.push_back(node.value);
+        }
+        if (node.op == OpCode::PushConst || node.op == OpCode::PushVariable) {
+            optimized.m_maxStackDepth = std::max(optimized.m_maxStackDepth, ++depth);
+        } else if (ExpressionGrammar::isBinary(node.op)) {
+            --depth;
+        }
+        optimized.m_code.push_back({ node.op, operand });
+        optimized.m_positions.push_back(static_cast<std::uint32_t>(node.position));
+    }
+    return optimized;
+}
+
+std::string ExpressionOptimizer::dump(const CompiledExpression &program)
+{
+    std::string text;
+    char line[160];
+    const std::vector<CompiledExpression::Instruction> &code = program.instructions();
+    for (size_t i = 0; i < code.size(); ++i) {
+        const CompiledExpression::Instruction &instruction = code[i];
+        char operand[64] = "";
+        if (instruction.op == OpCode::PushConst) {
+            const std::to_chars_result written = std::to_chars(operand, operand + sizeof(operand) - 1,
+                                                               program.constants()[instruction.operand]);
+            *written.ptr = '\0';
+        } else if (instruction.op == OpCode::PushVariable) {
+            std::snprintf(operand, sizeof(operand), "%s", program.variables()[instruction.operand].c_str());
+        } else if (instruction.op == OpCode::PowInt) {
+            std::snprintf(operand, sizeof(operand), "%d", static_cast<std::int32_t>(instruction.operand));
+        }
+        std::snprintf(line, sizeof(line), "%4zu  %-5s %-24s @%d\n", i, mnemonic(instruction.op), operand,
+                      program.sourcePosition(i));
+        text += line;
+    }
+    return text;
+}
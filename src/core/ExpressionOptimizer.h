@@ -0,0 +1,33 @@
+#ifndef EXPRESSIONOPTIMIZER_H
+#define EXPRESSIONOPTIMIZER_H
+
+#include <string>
+#include "CompiledExpression.h"
+
+// Rewrites a compiled program into a cheaper equivalent, for formulas that are compiled
+// once and evaluated many times (compileWithVariables, the vector evaluator). The
+// program is rebuilt as a tree, simplified bottom-up and lowered back to postfix.
+//
+// Strict mode only makes rewrites that give bit-identical results and the same error at
+// the same position: constant folding, x^2 -> x*x, x*1, x/1, x-0, x^1, --x, and
+// division by a power of two turned into a multiplication. An operation that would fail
+// is never folded, so its error is still reported when the program runs.
+//
+// FastMath also makes rewrites that may change rounding, signed zeros or NaN/infinity
+// results: x+0, x*0, small integer powers by repeated squaring, and reassociation of
+// + and * chains so that all their constants fold into one.
+class ExpressionOptimizer
+{
+public:
+    enum Mode {
+        Strict,
+        FastMath
+    };
+
+    static CompiledExpression optimize(const CompiledExpression &program, Mode mode = Strict);
+
+    // One instruction per line: index, mnemonic, operand and source position.
+    static std::string dump(const CompiledExpression &program);
+};
+
+#endif // EXPRESSIONOPTIMIZER_H
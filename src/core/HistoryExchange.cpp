@@ -0,0 +1,494 @@
+#include "HistoryExchange.h"
+#include <QFileInfo>
+#include <QIODevice>
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+    bool readHex4(const char *&position, const char *end, unsigned *code)
+    {
+        if (end - position < 4) return false;
+        *code = 0;
+        for (int i = 0; i < 4; ++i) {
+            const char c = *position++;
+            *code <<= 4;
+            if (c >= '0' && c <= '9') {
+                *code |= static_cast<unsigned>(c - '0');
+            } else if (c >= 'a' && c <= 'f') {
+                *code |= static_cast<unsigned>(c - 'a' + 10);
+            } else if (c >= 'A' && c <= 'F') {
+                *code |= static_cast<unsigned>(c - 'A' + 10);
+            } else {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void appendUtf8(std::string &text, unsigned code)
+    {
+        if (code < 0x80) {
+            text += static_cast<char>(code);
+        } else if (code < 0x800) {
+            text += static_cast<char>(0xC0 | (code >> 6));
+            text += static_cast<char>(0x80 | (code & 0x3F));
+        } else if (code < 0x10000) {
+            text += static_cast<char>(0xE0 | (code >> 12));
+            text += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            text += static_cast<char>(0x80 | (code & 0x3F));
+        } else {
+            text += static_cast<char>(0xF0 | (code >> 18));
+            text += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+            text += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            text += static_cast<char>(0x80 | (code & 0x3F));
+        }
+    }
+
+    bool isJsonScalarChar(char c)
+    {
+        return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '-' || c == '+'
+               || c == '.';
+    }
+}
+
+HistoryExchange::Format HistoryExchange::formatForPath(const QString &path)
+{
+    const QString suffix = QFileInfo(path).suffix().toLower();
+    return suffix == "jsonl" || suffix == "ndjson" || suffix == "json" ? Format::JsonLines : Format::Csv;
+}
+
+bool HistoryExchange::parseFormat(std::string_view name, Format *format)
+{
+    if (name == "csv") {
+        *format = Format::Csv;
+    } else if (name == "jsonl" || name == "ndjson" || name == "json") {
+        *format = Format::JsonLines;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+HistoryExchange::Writer::Writer(QIODevice *device, Format format)
+    : device(device),
+      format(format)
+{
+    buffer.reserve(BufferSize + 4096);
+    if (format == Format::Csv) {
+        buffer.append("timestamp,expression,result\n");
+    }
+}
+
+bool HistoryExchange::Writer::write(const QString &timestamp, const QString &expression, const QString &result)
+{
+    if (format == Format::Csv) {
+        appendCsvField(timestamp.toUtf8());
+        buffer.append(',');
+        appendCsvField(expression.toUtf8());
+        buffer.append(',');
+        appendCsvField(result.toUtf8());
+        buffer.append('\n');
+    } else {
+        buffer.append("{\"timestamp\":");
+        appendJsonString(timestamp.toUtf8());
+        buffer.append(",\"expression\":");
+        appendJsonString(expression.toUtf8());
+        buffer.append(",\"result\":");
+        appendJsonString(result.toUtf8());
+        buffer.append("}\n");
+    }
+    return buffer.size() < BufferSize || finish();
+}
+
+bool HistoryExchange::Writer::finish()
+{
+    const bool ok = device->write(buffer) == buffer.size();
+    buffer.resize(0); // Keeps the allocation for the next round
+    return ok;
+}
+
+void HistoryExchange::Writer::appendCsvField(const QByteArray &field)
+{
+    if (std::none_of(field.begin(), field.end(), [](char c) { return c == ',' || c == '"' || c == '\n' || c == '\r'; })) {
+        buffer.append(field);
+        return;
+    }
+    buffer.append('"');
+    for (const char c : field) {
+        if (c == '"') buffer.append('"');
+        buffer.append(c);
+    }
+    buffer.append('"');
+}
+
+void HistoryExchange::Writer::appendJsonString(const QByteArray &text)
+{
+    static const char hexDigits[] = "0123456789abcdef";
+    buffer.append('"');
+    for (const char c : text) {
+        const unsigned char byte = static_cast<unsigned char>(c);
+        if (c == '"' || c == '\\') {
+            buffer.append('\\');
+            buffer.append(c);
+        } else if (c == '\n') {
+            buffer.append("\\n");
+        } else if (c == '\r') {
+            buffer.append("\\r");
+        } else if (c == '\t') {
+            buffer.append("\\t");
+        } else if (byte < 0x20) {
+            buffer.append("\\u00");
+            buffer.append(hexDigits[byte >> 4]);
+            buffer.append(hexDigits[byte & 0xF]);
+        } else {
+            buffer.append(c); // UTF-8 passes through
+        }
+    }
+    buffer.append('"');
+}
+
+HistoryExchange::Reader::Reader(const char *data, qint64 size, Format format)
+    : position(data),
+      end(data + size),
+      format(format)
+{
+    if (size >= 3 && std::memcmp(data, "\xEF\xBB\xBF", 3) == 0) {
+        position += 3; // Byte order mark written by some spreadsheet programs
+    }
+}
+
+bool HistoryExchange::Reader::next(Record *record)
+{
+    if (hasError()) {
+        return false;
+    }
+    return format == Format::Csv ? nextCsv(record) : nextJson(record);
+}
+
+bool HistoryExchange::Reader::nextCsv(Record *record)
+{
+    for (;;) {
+        if (position >= end) {
+            return false;
+        }
+        recordLine = line;
+        if (!readCsvFields()) {
+            return false;
+        }
+        if (fields.size() == 1 && fields[0].raw.empty()) {
+            continue; // Blank line
+        }
+
+        if (!headerChecked) {
+            headerChecked = true;
+            // A header names the columns; without one, two fields are expression and result.
+            int timestamp = -1;
+            int expression = -1;
+            int result = -1;
+            for (size_t i = 0; i < fields.size(); ++i) {
+                const std::string_view name = unquote(fields[i], scratch[0]);
+                const int column = static_cast<int>(i);
+                if (name == "timestamp") timestamp = column;
+                if (name == "expression") expression = column;
+                if (name == "result") result = column;
+            }
+            if (expression >= 0 || result >= 0) {
+                if (expression < 0 || result < 0) {
+                    return fail("the header has no expression or no result column");
+                }
+                timestampColumn = timestamp;
+                expressionColumn = expression;
+                resultColumn = result;
+                continue;
+            }
+            if (fields.size() == 2) {
+                timestampColumn = -1;
+                expressionColumn = 0;
+                resultColumn = 1;
+            }
+        }
+
+        const int columns = std::max({ timestampColumn, expressionColumn, resultColumn }) + 1;
+        if (static_cast<int>(fields.size()) < columns) {
+            return fail("too few fields");
+        }
+        record->timestamp = timestampColumn >= 0 ? unquote(fields[static_cast<size_t>(timestampColumn)], scratch[0])
+                                                 : std::string_view();
+        record->expression = unquote(fields[static_cast<size_t>(expressionColumn)], scratch[1]);
+        record->result = unquote(fields[static_cast<size_t>(resultColumn)], scratch[2]);
+        if (record->expression.empty()) {
+            return fail("empty expression");
+        }
+        return true;
+    }
+}
+
+bool HistoryExchange::Reader::readCsvFields()
+{
+    fields.clear();
+    for (;;) {
+        const char *start = position;
+        if (position < end && *position == '"') {
+            ++position;
+            for (;;) {
+                const char *quote = static_cast<const char *>(std::memchr(position, '"', static_cast<size_t>(end - position)));
+                if (!quote) {
+                    return fail("unterminated quoted field");
+                }
+                line += std::count(position, quote, '\n');
+                position = quote + 1;
+                if (position < end && *position == '"') {
+                    ++position; // Escaped quote
+                    continue;
+                }
+                break;
+            }
+            fields.push_back({ std::string_view(start, static_cast<size_t>(position - start)), true });
+        } else {
+            while (position < end && *position != ',' && *position != '\n' && *position != '\r') {
+                ++position;
+            }
+            fields.push_back({ std::string_view(start, static_cast<size_t>(position - start)), false });
+        }
+
+        if (position == end) {
+            return true;
+        }
+        switch (*position++) {
+        case ',':
+            continue;
+        case '\r':
+            if (position < end && *position == '\n') ++position;
+            ++line;
+            return true;
+        case '\n':
+            ++line;
+            return true;
+        default:
+            return fail("unexpected character after a quoted field");
+        }
+    }
+}
+
+std::string_view HistoryExchange::Reader::unquote(const Field &field, std::string &storage)
+{
+    if (!field.quoted) {
+        return field.raw;
+    }
+    const std::string_view inner = field.raw.substr(1, field.raw.size() - 2);
+    if (inner.find('"') == std::string_view::npos) {
+        return inner;
+    }
+    storage.clear();
+    for (size_t i = 0; i < inner.size(); ++i) {
+        storage += inner[i];
+        if (inner[i] == '"') ++i; // Skip the second quote of a pair
+    }
+    return storage;
+}
+
+bool HistoryExchange::Reader::nextJson(Record *record)
+{
+    // Blank lines between objects are allowed.
+    while (position < end && (*position == ' ' || *position == '\t' || *position == '\r' || *position == '\n')) {
+        if (*position++ == '\n') ++line;
+    }
+    if (position >= end) {
+        return false;
+    }
+    recordLine = line;
+    if (*position != '{') {
+        return fail("expected a JSON object");
+    }
+    ++position;
+
+    *record = Record();
+    bool hasResult = false;
+    skipJsonSpace();
+    if (position < end && *position == '}') {
+        ++position;
+    } else {
+        for (;;) {
+            skipJsonSpace();
+            std::string_view key;
+            if (!readJsonString(&key, scratch[3])) {
+                return false;
+            }
+            skipJsonSpace();
+            if (position >= end || *position != ':') {
+                return fail("expected ':'");
+            }
+            ++position;
+            skipJsonSpace();
+
+            int member = -1;
+            if (key == "timestamp") member = 0;
+            if (key == "expression") member = 1;
+            if (key == "result") member = 2;
+            std::string_view *target = member == 0   ? &record->timestamp
+                                       : member == 1 ? &record->expression
+                                       : member == 2 ? &record->result
+                                                     : nullptr;
+            hasResult = hasResult || member == 2;
+            if (target && position < end && *position == '"') {
+                if (!readJsonString(target, scratch[member])) {
+                    return false;
+                }
+            } else {
+                // A number is taken as written, e.g. a numeric result; anything else such
+                // as null leaves the member empty.
+                const char *start = position;
+                if (!skipJsonValue()) {
+                    return false;
+                }
+                if (target && (*start == '-' || (*start >= '0' && *start <= '9'))) {
+                    *target = std::string_view(start, static_cast<size_t>(position - start));
+                }
+            }
+
+            skipJsonSpace();
+            if (position < end && *position == ',') {
+                ++position;
+                continue;
+            }
+            if (position < end && *position == '}') {
+                ++position;
+                break;
+            }
+            return fail("expected ',' or '}'");
+        }
+    }
+
+    skipJsonSpace();
+    if (position < end && *position != '\n') {
+        return fail("expected one object per line");
+    }
+    if (record->expression.empty()) {
+        return fail("missing expression");
+    }
+    if (!hasResult) {
+        return fail("missing result");
+    }
+    return true;
+}
+
+bool HistoryExchange::Reader::readJsonString(std::string_view *value, std::string &storage)
+{
+    if (position >= end || *position != '"') {
+        return fail("expected a string");
+    }
+    const char *start = ++position;
+    while (position < end && *position != '"' && *position != '\\' && static_cast<unsigned char>(*position) >= 0x20) {
+        ++position;
+    }
+    if (position < end && *position == '"') {
+        *value = std::string_view(start, static_cast<size_t>(position - start));
+        ++position;
+        return true;
+    }
+
+    // Escapes: decode into storage.
+    storage.assign(start, position);
+    while (position < end && *position != '"') {
+        const char c = *position++;
+        if (static_cast<unsigned char>(c) < 0x20) {
+            return fail("unterminated string");
+        }
+        if (c != '\\') {
+            storage += c;
+            continue;
+        }
+        if (position >= end) {
+            break;
+        }
+        switch (*position++) {
+        case '"': storage += '"'; break;
+        case '\\': storage += '\\'; break;
+        case '/': storage += '/'; break;
+        case 'b': storage += '\b'; break;
+        case 'f': storage += '\f'; break;
+        case 'n': storage += '\n'; break;
+        case 'r': storage += '\r'; break;
+        case 't': storage += '\t'; break;
+        case 'u': {
+            unsigned code = 0;
+            if (!readHex4(position, end, &code)) {
+                return fail("invalid \\u escape");
+            }
+            if (code >= 0xD800 && code < 0xDC00) {
+                unsigned low = 0;
+                if (end - position < 2 || position[0] != '\\' || position[1] != 'u') {
+                    return fail("unpaired surrogate");
+                }
+                position += 2;
+                if (!readHex4(position, end, &low) || low < 0xDC00 || low > 0xDFFF) {
+                    return fail("unpaired surrogate");
+                }
+                code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+            } else if (code >= 0xDC00 && code <= 0xDFFF) {
+                return fail("unpaired surrogate");
+            }
+            appendUtf8(storage, code);
+            break;
+        }
+        default:
+            return fail("invalid escape");
+        }
+    }
+    if (position >= end) {
+        return fail("unterminated string");
+    }
+    ++position;
+    *value = storage;
+    return true;
+}
+
+bool HistoryExchange::Reader::skipJsonValue()
+{
+    if (position >= end) {
+        return fail("expected a value");
+    }
+    if (*position == '"') {
+        std::string_view ignored;
+        return readJsonString(&ignored, scratch[3]);
+    }
+    if (*position == '{' || *position == '[') {
+        // Nested values are skipped by counting brackets outside of strings.
+        int depth = 0;
+        do {
+            if (*position == '"') {
+                std::string_view ignored;
+                if (!readJsonString(&ignored, scratch[3])) {
+                    return false;
+                }
+                continue;
+            }
+            if (*position == '\n') {
+                break;
+            }
+            if (*position == '{' || *position == '[') ++depth;
+            if (*position == '}' || *position == ']') --depth;
+            ++position;
+        } while (depth > 0 && position < end);
+        return depth == 0 || fail("unterminated value");
+    }
+    const char *start = position;
+    while (position < end && isJsonScalarChar(*position)) {
+        ++position;
+    }
+    return position > start || fail("expected a value");
+}
+
+void HistoryExchange::Reader::skipJsonSpace()
+{
+    while (position < end && (*position == ' ' || *position == '\t' || *position == '\r')) {
+        ++position;
+    }
+}
+
+bool HistoryExchange::Reader::fail(const char *message)
+{
+    error = QString("Line %1: %2").arg(recordLine).arg(QString::fromLatin1(message));
+    return false;
+}
@@ -0,0 +1,105 @@
+#ifndef HISTORYEXCHANGE_H
+#define HISTORYEXCHANGE_H
+
+#include <QByteArray>
+#include <QString>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class QIODevice;
+
+// Text formats that history is exported to and imported from by DatabaseManager: CSV
+// with a "timestamp,expression,result" header line (RFC 4180 quoting), or JSON Lines
+// with one {"timestamp": ..., "expression": ..., "result": ...} object per line. Files
+// list entries oldest first, so importing one keeps their order.
+class HistoryExchange
+{
+public:
+    enum class Format {
+        Csv,
+        JsonLines
+    };
+
+    // JSON Lines for a ".jsonl", ".ndjson" or ".json" file, CSV for anything else.
+    static Format formatForPath(const QString &path);
+    // "csv" or "jsonl" as given on the command line.
+    static bool parseFormat(std::string_view name, Format *format);
+
+    // One entry as UTF-8. The views stay valid until the next call to Reader::next().
+    struct Record
+    {
+        std::string_view timestamp; // Empty if the file has none
+        std::string_view expression;
+        std::string_view result;
+    };
+
+    // Serializes entries into a large buffer that is written out whenever it fills.
+    class Writer
+    {
+    public:
+        static constexpr int BufferSize = 1 << 20;
+
+        Writer(QIODevice *device, Format format);
+
+        bool write(const QString &timestamp, const QString &expression, const QString &result);
+        // Writes out whatever is still buffered.
+        bool finish();
+
+    private:
+        QIODevice *device;
+        Format format;
+        QByteArray buffer;
+
+        void appendCsvField(const QByteArray &field);
+        void appendJsonString(const QByteArray &text);
+    };
+
+    // Parses entries in place out of a whole file held in memory, typically mapped with
+    // QFile::map(). A CSV file may start with a header naming its columns (extra columns
+    // such as an id are ignored); without one its rows are "timestamp,expression,result"
+    // or "expression,result". Members of JSON objects other than the three are skipped.
+    class Reader
+    {
+    public:
+        Reader(const char *data, qint64 size, Format format);
+
+        // Returns false at the end of the data or at a malformed entry; hasError() tells
+        // them apart.
+        bool next(Record *record);
+        bool hasError() const { return !error.isEmpty(); }
+        QString errorString() const { return error; } // Names the offending line
+
+    private:
+        // A CSV field as it appears in the file, quotes included.
+        struct Field
+        {
+            std::string_view raw;
+            bool quoted;
+        };
+
+        const char *position;
+        const char *end;
+        Format format;
+        qint64 line = 1;
+        bool headerChecked = false;
+        int timestampColumn = 0; // -1 if the file has no timestamps
+        int expressionColumn = 1;
+        int resultColumn = 2;
+        qint64 recordLine = 1; // Where the entry being read starts
+        std::vector<Field> fields;
+        std::string scratch[4]; // Unescaped timestamp, expression, result and JSON key
+        QString error;
+
+        bool nextCsv(Record *record);
+        bool readCsvFields();
+        static std::string_view unquote(const Field &field, std::string &storage);
+        bool nextJson(Record *record);
+        bool readJsonString(std::string_view *value, std::string &storage);
+        bool skipJsonValue();
+        void skipJsonSpace();
+        bool fail(const char *message);
+    };
+};
+
+#endif // HISTORYEXCHANGE_H
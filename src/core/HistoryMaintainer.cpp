@@ -0,0 +1,339 @@
+#include "HistoryMaintainer.h"
+#include <QDateTime>
+#include <QDeadlineTimer>
+#include <QFileInfo>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <algorithm>
+#include <utility>
+
+namespace
+{
+    const char *const MaintainerConnectionName = "CalcPlusPlus.historyMaintainer";
+
+    // Removing entries frees less than their share of the file when memo rows they
+    // shared stay in use, so a size limit is approached in up to this many rounds.
+    constexpr int MaxSizeRounds = 4;
+
+    qint64 pragmaValue(QSqlDatabase &connection, const char *pragma)
+    {
+        QSqlQuery query(connection);
+        return query.exec(QString("PRAGMA ") + pragma) && query.next() ? query.value(0).toLongLong() : 0;
+    }
+
+    bool beginImmediate(QSqlDatabase &connection)
+    {
+        // Takes the write lock up front rather than on the first write, when a concurrent
+        // commit would make the transaction fail instead of wait.
+        return QSqlQuery(connection).exec("BEGIN IMMEDIATE");
+    }
+}
+
+HistoryMaintainer::HistoryMaintainer(const QString &dbPath, bool fullTextSearch, QObject *parent)
+    : QThread(parent),
+      databasePath(dbPath),
+      fullTextSearch(fullTextSearch)
+{
+}
+
+HistoryMaintainer::~HistoryMaintainer()
+{
+    {
+        QMutexLocker locker(&mutex);
+        stopping = true;
+        wakeUp.wakeOne();
+    }
+    wait();
+}
+
+void HistoryMaintainer::setRetention(const HistoryRetention &newRetention)
+{
+    QMutexLocker locker(&mutex);
+    retention = newRetention;
+    wakeUp.wakeOne();
+}
+
+void HistoryMaintainer::requestPass(bool convertFile)
+{
+    QMutexLocker locker(&mutex);
+    passRequested = true;
+    convertRequested = convertRequested || convertFile;
+    wakeUp.wakeOne();
+}
+
+bool HistoryMaintainer::isStopping()
+{
+    QMutexLocker locker(&mutex);
+    return stopping;
+}
+
+void HistoryMaintainer::run()
+{
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", MaintainerConnectionName);
+        db.setDatabaseName(databasePath);
+        db.setConnectOptions("QSQLITE_BUSY_TIMEOUT=5000");
+        if (db.open()) {
+            QDeadlineTimer nextPass(StartDelayMs);
+            QMutexLocker locker(&mutex);
+            for (;;) {
+                // Scheduled passes are only worth running while there is a limit to enforce.
+                while (!stopping && !passRequested && (retention.isEmpty() || !nextPass.hasExpired())) {
+                    if (retention.isEmpty()) {
+                        wakeUp.wait(&mutex);
+                    } else {
+                        wakeUp.wait(&mutex, nextPass);
+                    }
+                }
+                if (stopping) {
+                    break;
+                }
+                passRequested = false;
+                const HistoryRetention limits = retention;
+                const bool convertFile = std::exchange(convertRequested, false);
+                locker.unlock();
+
+                const Report report = runPass(db, limits, convertFile);
+                nextPass.setRemainingTime(IntervalMs);
+                emit passFinished(report);
+
+                locker.relock();
+            }
+        }
+        db.close();
+    }
+    QSqlDatabase::removeDatabase(MaintainerConnectionName);
+}
+
+HistoryMaintainer::Report HistoryMaintainer::runPass(QSqlDatabase &connection, const HistoryRetention &limits, bool convertFile)
+{
+    Report report;
+    report.bytesBefore = fileBytes();
+    for (int round = 0; round < MaxSizeRounds && !isStopping(); ++round) {
+        const qint64 keepFrom = firstKeptId(connection, limits);
+        const qint64 removed = keepFrom > 0 ? removeHistoryBefore(connection, keepFrom) : 0;
+        if (removed > 0) {
+            report.historyRowsRemoved += removed;
+            report.firstKeptId = keepFrom;
+        }
+        const qint64 memoRemoved = removeUnusedMemoRows(connection);
+        if (memoRemoved > 0 && fullTextSearch) {
+            compactSearchIndex(connection);
+        }
+        report.memoRowsRemoved += memoRemoved;
+        if (removed == 0 || limits.maxBytes <= 0) {
+            break; // Only the size estimate can fall short
+        }
+    }
+    if (!isStopping()) {
+        reclaimSpace(connection, convertFile);
+    }
+    report.bytesAfter = fileBytes();
+    return report;
+}
+
+qint64 HistoryMaintainer::firstKeptId(QSqlDatabase &connection, const HistoryRetention &limits)
+{
+    // Entries with ids below the returned one break a limit; 0 if none do.
+    qint64 keepFrom = 0;
+    QSqlQuery query(connection);
+    query.setForwardOnly(true);
+    const auto pastNewest = [&] {
+        return query.exec("SELECT coalesce(max(id), 0) + 1 FROM history") && query.next() ? query.value(0).toLongLong() : 0;
+    };
+
+    if (limits.maxRows > 0) {
+        query.prepare("SELECT id FROM history ORDER BY id DESC LIMIT 1 OFFSET ?");
+        query.addBindValue(limits.maxRows - 1);
+        if (query.exec() && query.next()) {
+            keepFrom = query.value(0).toLongLong();
+        }
+    }
+
+    if (limits.maxAgeDays > 0) {
+        // Entries are added in time order, so the limit ends at the oldest entry young
+        // enough to keep; older imported entries after it stay.
+        query.prepare("SELECT id FROM history WHERE timestamp >= ? ORDER BY id LIMIT 1");
+        query.addBindValue(QDateTime::currentDateTime().addDays(-limits.maxAgeDays).toString(Qt::ISODate));
+        if (query.exec()) {
+            keepFrom = std::max(keepFrom, query.next() ? query.value(0).toLongLong() : pastNewest());
+        }
+    }
+
+    if (limits.maxBytes > 0) {
+        const qint64 usedBytes = (pragmaValue(connection, "page_count") - pragmaValue(connection, "freelist_count"))
+                                 * pragmaValue(connection, "page_size");
+        if (usedBytes > limits.maxBytes && query.exec("SELECT count(*) FROM history") && query.next()) {
+            // The oldest entries, in proportion to how far the file is over the limit.
+            const qint64 rows = query.value(0).toLongLong();
+            const qint64 excess = rows - rows * limits.maxBytes / usedBytes;
+            query.prepare("SELECT id FROM history ORDER BY id LIMIT 1 OFFSET ?");
+            query.addBindValue(std::max<qint64>(excess, 1));
+            if (query.exec()) {
+                keepFrom = std::max(keepFrom, query.next() ? query.value(0).toLongLong() : pastNewest());
+            }
+        }
+    }
+    return keepFrom;
+}
+
+qint64 HistoryMaintainer::removeHistoryBefore(QSqlDatabase &connection, qint64 id)
+{
+    QSqlQuery remove(connection);
+    remove.prepare("DELETE FROM history WHERE id IN (SELECT id FROM history WHERE id < ? ORDER BY id LIMIT ?)");
+    qint64 removed = 0;
+    while (!isStopping()) {
+        remove.bindValue(0, id);
+        remove.bindValue(1, DeleteBatchRows);
+        if (!remove.exec()) {
+            break; // Tried again next pass
+        }
+        const int rows = remove.numRowsAffected();
+        removed += rows;
+        if (rows < DeleteBatchRows) {
+            break;
+        }
+        QThread::msleep(BatchPauseMs);
+    }
+    return removed;
+}
+
+qint64 HistoryMaintainer::removeUnusedMemoRows(QSqlDatabase &connection)
+{
+    // Memo rows double as the result cache, so one is only dropped once it is also older
+    // than every remaining entry.
+    QSqlQuery query(connection);
+    const QString usedBefore = query.exec("SELECT timestamp FROM history ORDER BY id LIMIT 1") && query.next()
+                                   ? query.value(0).toString()
+                                   : QDateTime::currentDateTime().toString(Qt::ISODate);
+    query.finish();
+
+    const QString unused = " AND last_used < ? AND NOT EXISTS (SELECT 1 FROM history h WHERE h.memo_id = memo.id)";
+    QSqlQuery find(connection);
+    find.setForwardOnly(true);
+    find.prepare("SELECT id FROM memo WHERE id > ?" + unused + " ORDER BY id LIMIT ?");
+    // The search index stores no text of its own, so rows leave it with the values they
+    // were indexed with, before they are deleted.
+    QSqlQuery unindex(connection);
+    unindex.prepare("INSERT INTO memo_fts (memo_fts, rowid, expression, result) "
+                    "SELECT 'delete', id, expression, result FROM memo WHERE id BETWEEN ? AND ?" + unused);
+    QSqlQuery remove(connection);
+    remove.prepare("DELETE FROM memo WHERE id BETWEEN ? AND ?" + unused);
+
+    qint64 removed = 0;
+    qint64 after = 0;
+    while (!isStopping()) {
+        // The batch is the id range of the next DeleteBatchRows unused rows; the
+        // statements below check each row again inside the transaction.
+        find.bindValue(0, after);
+        find.bindValue(1, usedBefore);
+        find.bindValue(2, DeleteBatchRows);
+        if (!find.exec()) {
+            break;
+        }
+        qint64 first = 0;
+        int found = 0;
+        while (find.next()) {
+            after = find.value(0).toLongLong();
+            first = first ? first : after;
+            ++found;
+        }
+        find.finish();
+        if (found == 0 || !beginImmediate(connection)) {
+            break;
+        }
+        for (QSqlQuery *statement : { &unindex, &remove }) {
+            statement->bindValue(0, first);
+            statement->bindValue(1, after);
+            statement->bindValue(2, usedBefore);
+        }
+        if ((fullTextSearch && !unindex.exec()) || !remove.exec() || !connection.commit()) {
+            connection.rollback();
+            break;
+        }
+        removed += remove.numRowsAffected();
+        if (found < DeleteBatchRows) {
+            break;
+        }
+        QThread::msleep(BatchPauseMs);
+    }
+    return removed;
+}
+
+void HistoryMaintainer::compactSearchIndex(QSqlDatabase &connection)
+{
+    // Removing rows from the index only records that they are gone; their entries take
+    // space until the segments holding them are merged. Each step writes about
+    // MergeBatchPages pages in its own transaction. The first, with a negative count,
+    // puts every segment up for merging as 'optimize' would; the rest carry on with the
+    // merge it started until a step changes at most one row, which means nothing was left.
+    // Like every batch of the writer, each step holds the write lock from start to
+    // commit, so the writer's inserts land between steps, never inside one, and the next
+    // step simply merges their segments too.
+    QSqlQuery merge(connection);
+    merge.prepare("INSERT INTO memo_fts (memo_fts, rank) VALUES ('merge', ?)");
+    QSqlQuery changes(connection);
+    changes.setForwardOnly(true);
+    changes.prepare("SELECT total_changes()");
+    const auto totalChanges = [&] {
+        const qint64 total = changes.exec() && changes.next() ? changes.value(0).toLongLong() : 0;
+        changes.finish();
+        return total;
+    };
+
+    for (int pages = -MergeBatchPages; !isStopping(); pages = MergeBatchPages) {
+        if (!beginImmediate(connection)) {
+            return;
+        }
+        const qint64 before = totalChanges();
+        merge.bindValue(0, pages);
+        if (!merge.exec() || !connection.commit()) {
+            connection.rollback();
+            return;
+        }
+        if (totalChanges() - before < 2) {
+            return;
+        }
+        QThread::msleep(BatchPauseMs);
+    }
+}
+
+void HistoryMaintainer::reclaimSpace(QSqlDatabase &connection, bool convertFile)
+{
+    qint64 freePages = pragmaValue(connection, "freelist_count");
+    if (freePages > 0) {
+        QSqlQuery query(connection);
+        if (pragmaValue(connection, "auto_vacuum") != 2) {
+            // Databases created before incremental vacuum was enabled can only be converted
+            // by a VACUUM that rewrites the file under a single lock, longer than the
+            // writer waits for it, so only on request. Until then free pages are reused.
+            if (convertFile) {
+                query.exec("PRAGMA auto_vacuum=INCREMENTAL");
+                query.exec("VACUUM");
+            }
+        } else {
+            // Every step of the pragma frees one page, but QSqlQuery steps a statement
+            // without result columns only once, so it is run once per page.
+            QSqlQuery step(connection);
+            step.prepare("PRAGMA incremental_vacuum(1)");
+            while (freePages > 0 && !isStopping() && beginImmediate(connection)) {
+                for (int i = 0; i < VacuumBatchPages && freePages > 0; ++i, --freePages) {
+                    step.exec();
+                }
+                step.finish(); // A statement left mid-step would make the commit fail
+                if (!connection.commit()) {
+                    connection.rollback();
+                    break;
+                }
+                QThread::msleep(BatchPauseMs);
+            }
+        }
+    }
+    // The pages are only gone from the disk once the log holding them is checkpointed.
+    QSqlQuery(connection).exec("PRAGMA wal_checkpoint(TRUNCATE)");
+}
+
+qint64 HistoryMaintainer::fileBytes() const
+{
+    return QFileInfo(databasePath).size() + QFileInfo(databasePath + "-wal").size();
+}
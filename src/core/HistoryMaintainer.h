@@ -0,0 +1,90 @@
+#ifndef HISTORYMAINTAINER_H
+#define HISTORYMAINTAINER_H
+
+#include <QMutex>
+#include <QString>
+#include <QThread>
+#include <QWaitCondition>
+
+class QSqlDatabase;
+
+// Limits on how much history the database keeps; zero means no limit. Entries are
+// removed oldest first until every limit holds.
+struct HistoryRetention
+{
+    qint64 maxRows = 0;
+    qint64 maxAgeDays = 0;
+    qint64 maxBytes = 0; // The database file and its write-ahead log
+
+    bool isEmpty() const { return maxRows <= 0 && maxAgeDays <= 0 && maxBytes <= 0; }
+};
+
+// Background thread that keeps the history database within its HistoryRetention, over
+// its own SQLite connection. A pass deletes the oldest history rows DeleteBatchRows at a
+// time, so the writer thread never waits long for the lock, then memo rows that no entry
+// refers to and that were not used since the oldest remaining entry, merges the search
+// index segments holding their entries MergeBatchPages at a time, and finally hands the
+// freed pages back to the file system with incremental vacuum. Passes run StartDelayMs
+// after start and every IntervalMs while a limit is set, and whenever requestPass() asks
+// for one.
+class HistoryMaintainer : public QThread
+{
+    Q_OBJECT
+
+public:
+    static constexpr int DeleteBatchRows = 500;
+    static constexpr int VacuumBatchPages = 256;
+    static constexpr int MergeBatchPages = 64;
+    static constexpr int BatchPauseMs = 10; // Between batches, so queued writes get in
+    static constexpr int StartDelayMs = 10 * 1000;
+    static constexpr int IntervalMs = 15 * 60 * 1000;
+
+    struct Report
+    {
+        qint64 historyRowsRemoved = 0;
+        qint64 memoRowsRemoved = 0;
+        qint64 firstKeptId = 0; // Entries with smaller ids are gone
+        qint64 bytesBefore = 0;
+        qint64 bytesAfter = 0;
+
+        qint64 bytesReclaimed() const { return bytesBefore > bytesAfter ? bytesBefore - bytesAfter : 0; }
+    };
+
+    HistoryMaintainer(const QString &dbPath, bool fullTextSearch, QObject *parent = nullptr);
+    // Stops at the next batch; the rest of a pass in progress is left for the next start.
+    ~HistoryMaintainer() override;
+
+    void setRetention(const HistoryRetention &retention);
+    // Runs a pass as soon as possible. Without limits it only removes unused memo rows
+    // and reclaims free space. A database created before incremental vacuum was enabled
+    // is only converted, with a VACUUM that locks it throughout, if convertFile is set.
+    void requestPass(bool convertFile = false);
+
+signals:
+    void passFinished(const HistoryMaintainer::Report &report);
+
+protected:
+    void run() override;
+
+private:
+    QString databasePath;
+    bool fullTextSearch;
+
+    QMutex mutex;
+    QWaitCondition wakeUp;
+    HistoryRetention retention; // Guarded by mutex
+    bool passRequested = false; // Guarded by mutex
+    bool convertRequested = false; // Guarded by mutex
+    bool stopping = false;      // Guarded by mutex
+
+    bool isStopping();
+    Report runPass(QSqlDatabase &connection, const HistoryRetention &limits, bool convertFile);
+    static qint64 firstKeptId(QSqlDatabase &connection, const HistoryRetention &limits);
+    qint64 removeHistoryBefore(QSqlDatabase &connection, qint64 id);
+    qint64 removeUnusedMemoRows(QSqlDatabase &connection);
+    void compactSearchIndex(QSqlDatabase &connection);
+    void reclaimSpace(QSqlDatabase &connection, bool convertFile);
+    qint64 fileBytes() const;
+};
+
+#endif // HISTORYMAINTAINER_H
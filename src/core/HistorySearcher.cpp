@@ -0,0 +1,161 @@
+#include "HistorySearcher.h"
+#include <QSqlDatabase>
+#include <QSqlDriver>
+#include <QSqlQuery>
+#include <limits>
+#include <sqlite3.h>
+#include <utility>
+
+namespace
+{
+    const char *const SearcherConnectionName = "CalcPlusPlus.historySearcher";
+
+    // The trigram tokenizer indexes three-character windows, so shorter text cannot
+    // use the index.
+    constexpr int MinFullTextLength = 3;
+
+    // Virtual machine instructions between checks for a newer search: well under a
+    // millisecond of work, so a full scan of a large history stops almost at once.
+    constexpr int StaleCheckInterval = 1000;
+
+    sqlite3 *sqliteHandle(const QSqlDatabase &db)
+    {
+        const QVariant handle = db.driver()->handle();
+        if (handle.isValid() && qstrcmp(handle.typeName(), "sqlite3*") == 0) {
+            return *static_cast<sqlite3 *const *>(handle.constData());
+        }
+        return nullptr;
+    }
+
+    // LIKE pattern matching text anywhere, with the wildcards in text escaped.
+    QString containsPattern(const QString &text)
+    {
+        QString escaped = text;
+        escaped.replace('\\', "\\\\").replace('%', "\\%").replace('_', "\\_");
+        return '%' + escaped + '%';
+    }
+
+    QList<HistoryEntry> runSearch(QSqlDatabase &db, bool fullTextSearch, const HistorySearch &search,
+                                  qint64 beforeId, int limit)
+    {
+        // Text and value filters apply to memo rows; history rows referencing a match are
+        // then paged newest first.
+        QString sql = "SELECT h.id, h.timestamp, m.expression, m.result "
+                      "FROM history h JOIN memo m ON m.id = h.memo_id WHERE h.id < ?";
+        QVariantList values;
+        values << (beforeId > 0 ? beforeId : std::numeric_limits<qint64>::max());
+        if (fullTextSearch && search.text.size() >= MinFullTextLength) {
+            // A quoted phrase is a plain substring match under the trigram tokenizer.
+            QString phrase = search.text;
+            phrase.replace('"', "\"\"");
+            sql += " AND h.memo_id IN (SELECT rowid FROM memo_fts WHERE memo_fts MATCH ?)";
+            values << ('"' + phrase + '"');
+        } else if (!search.text.isEmpty()) {
+            sql += " AND (m.expression LIKE ? ESCAPE '\\' OR m.result LIKE ? ESCAPE '\\')";
+            const QString pattern = containsPattern(search.text);
+            values << pattern << pattern;
+        }
+        if (search.minValue) {
+            sql += " AND m.result_value >= ?";
+            values << *search.minValue;
+        }
+        if (search.maxValue) {
+            sql += " AND m.result_value <= ?";
+            values << *search.maxValue;
+        }
+        sql += " ORDER BY h.id DESC LIMIT ?";
+        values << limit;
+
+        QList<HistoryEntry> page;
+        QSqlQuery query(db);
+        query.setForwardOnly(true);
+        query.prepare(sql);
+        for (const QVariant &value : std::as_const(values)) {
+            query.addBindValue(value);
+        }
+        if (!query.exec()) {
+            return page;
+        }
+        while (query.next()) {
+            page.append({ query.value(0).toLongLong(), query.value(1).toString(), query.value(2).toString(),
+                          query.value(3).toString() });
+        }
+        return page;
+    }
+}
+
+HistorySearcher::HistorySearcher(const QString &dbPath, bool fullTextSearch, QObject *parent)
+    : QThread(parent),
+      databasePath(dbPath),
+      fullTextSearch(fullTextSearch)
+{
+}
+
+HistorySearcher::~HistorySearcher()
+{
+    {
+        QMutexLocker locker(&mutex);
+        stopping = true;
+        ++lastGeneration; // Abandon a search still running
+        requestAvailable.wakeOne();
+    }
+    wait();
+}
+
+quint64 HistorySearcher::search(const HistorySearch &search, qint64 beforeId, int limit)
+{
+    QMutexLocker locker(&mutex);
+    const quint64 generation = ++lastGeneration;
+    pending = { search, beforeId, limit, generation };
+    hasPending = true;
+    requestAvailable.wakeOne();
+    return generation;
+}
+
+int HistorySearcher::isStale(void *searcher)
+{
+    const HistorySearcher *self = static_cast<const HistorySearcher *>(searcher);
+    return self->lastGeneration.load(std::memory_order_relaxed) != self->runningGeneration ? 1 : 0;
+}
+
+void HistorySearcher::run()
+{
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", SearcherConnectionName);
+        db.setDatabaseName(databasePath);
+        db.setConnectOptions("QSQLITE_OPEN_READONLY;QSQLITE_BUSY_TIMEOUT=5000");
+        const bool open = db.open();
+        if (sqlite3 *handle = open ? sqliteHandle(db) : nullptr) {
+            sqlite3_progress_handler(handle, StaleCheckInterval, &HistorySearcher::isStale, this);
+        }
+
+        QMutexLocker locker(&mutex);
+        for (;;) {
+            while (!hasPending && !stopping) {
+                requestAvailable.wait(&mutex);
+            }
+            if (stopping) {
+                break;
+            }
+            const Request request = pending;
+            hasPending = false;
+            locker.unlock();
+
+            QList<HistoryEntry> page;
+            runningGeneration = request.generation;
+            if (open) {
+                page = runSearch(db, fullTextSearch, request.search, request.beforeId, request.limit);
+            }
+
+            locker.relock();
+            // Not worth delivering if a newer search has been submitted meanwhile; its
+            // query was then interrupted and page is incomplete.
+            if (request.generation == lastGeneration) {
+                emit resultsReady(request.generation, page);
+            }
+        }
+        locker.unlock();
+        db.close();
+    }
+    QSqlDatabase::removeDatabase(SearcherConnectionName);
+}
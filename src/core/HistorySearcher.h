@@ -0,0 +1,57 @@
+#ifndef HISTORYSEARCHER_H
+#define HISTORYSEARCHER_H
+
+#include <QMutex>
+#include <QThread>
+#include <QWaitCondition>
+#include <atomic>
+#include "HistoryStore.h"
+
+// Background thread that runs history searches for DatabaseManager over its own
+// read-only SQLite connection, so the GUI thread never waits on a query. Only the
+// latest request is kept: a search submitted while another is still queued replaces
+// it, a search still running is aborted by SQLite as soon as a newer one is submitted,
+// and every result carries the generation number of its request so callers can drop
+// answers to searches they have already moved past.
+class HistorySearcher : public QThread
+{
+    Q_OBJECT
+
+public:
+    HistorySearcher(const QString &dbPath, bool fullTextSearch, QObject *parent = nullptr);
+    ~HistorySearcher() override;
+
+    // Returns the generation number that resultsReady() will report for this request.
+    quint64 search(const HistorySearch &search, qint64 beforeId, int limit);
+
+signals:
+    void resultsReady(quint64 generation, const QList<HistoryEntry> &page);
+
+protected:
+    void run() override;
+
+private:
+    struct Request
+    {
+        HistorySearch search;
+        qint64 beforeId = 0;
+        int limit = 0;
+        quint64 generation = 0;
+    };
+
+    QString databasePath;
+    bool fullTextSearch;
+
+    QMutex mutex;
+    QWaitCondition requestAvailable;
+    Request pending;            // Guarded by mutex
+    bool hasPending = false;    // Guarded by mutex
+    std::atomic<quint64> lastGeneration{ 0 }; // Written under mutex, read by isStale()
+    bool stopping = false;      // Guarded by mutex
+    quint64 runningGeneration = 0; // Search thread only
+
+    // SQLite progress handler: nonzero aborts the running query once it is outdated.
+    static int isStale(void *searcher);
+};
+
+#endif // HISTORYSEARCHER_H
@@ -0,0 +1,49 @@
+#include "HistoryStore.h"
+#include <QStringList>
+#include <cmath>
+#include <limits>
+#include "NumberFormat.h"
+
+HistorySearch HistorySearch::parse(const QString &input)
+{
+    HistorySearch search;
+    QStringList words;
+    const QStringList tokens = input.split(' ', Qt::SkipEmptyParts);
+    for (const QString &token : tokens) {
+        double bound = 0;
+        if (token.startsWith(">=") || token.startsWith("<=")) {
+            if (NumberFormat::parse(QStringView(token).mid(2), &bound)) {
+                (token[0] == '>' ? search.minValue : search.maxValue) = bound;
+                continue;
+            }
+        } else if (token.startsWith('>') || token.startsWith('<')) {
+            if (NumberFormat::parse(QStringView(token).mid(1), &bound)) {
+                // Strict bounds become inclusive bounds on the adjacent double.
+                if (token[0] == '>') {
+                    search.minValue = std::nextafter(bound, std::numeric_limits<double>::infinity());
+                } else {
+                    search.maxValue = std::nextafter(bound, -std::numeric_limits<double>::infinity());
+                }
+                continue;
+            }
+        } else if (token.contains("..")) {
+            const int dots = token.indexOf("..");
+            double high = 0;
+            if (NumberFormat::parse(QStringView(token).left(dots), &bound)
+                && NumberFormat::parse(QStringView(token).mid(dots + 2), &high)) {
+                search.minValue = bound;
+                search.maxValue = high;
+                continue;
+            }
+        }
+        words.append(token);
+    }
+    search.text = words.join(' ');
+    return search;
+}
+
+bool HistoryStore::fail(QString *error, const QString &message)
+{
+    if (error) *error = message;
+    return false;
+}
@@ -0,0 +1,88 @@
+#ifndef HISTORYSTORE_H
+#define HISTORYSTORE_H
+
+#include <QList>
+#include <QObject>
+#include <QString>
+#include <optional>
+#include "HistoryExchange.h"
+
+struct HistoryEntry
+{
+    qint64 id = 0; // Increases with every entry, so it also orders entries by age
+    QString timestamp;
+    QString expression;
+    QString result;
+};
+
+// A history search as typed into the search box: free text matched as a substring of
+// expression or result, plus optional bounds on the numeric result.
+struct HistorySearch
+{
+    QString text;
+    std::optional<double> minValue; // Inclusive
+    std::optional<double> maxValue; // Inclusive
+
+    bool isEmpty() const { return text.isEmpty() && !minValue && !maxValue; }
+
+    // Words like ">10", "<=2.5" or "1..100" become bounds, everything else is text:
+    // "sqrt >=2" finds square roots whose result is at least 2.
+    static HistorySearch parse(const QString &input);
+};
+
+// Where the calculation history is kept, chosen at startup with --history-store.
+enum class HistoryBackend {
+    Sqlite,  // History rows in the SQLite database, next to the memo and symbols (DatabaseManager)
+    Columnar // A memory-mapped file of fixed-width columns (ColumnarHistoryStore)
+};
+
+// Storage of the calculation history as the history panel, the calculator window and
+// the command-line tools see it. Entries are only ever appended, read newest first a
+// page at a time, searched, exported, imported or cleared as a whole.
+class HistoryStore : public QObject
+{
+    Q_OBJECT
+
+public:
+    static constexpr int DefaultPageSize = 200;
+
+    explicit HistoryStore(QObject *parent = nullptr) : QObject(parent) {}
+
+    // Stores the entry without waiting for the disk. Returns false if the store is not
+    // open (or being opened).
+    virtual bool addHistoryEntry(const QString &expression, const QString &result) = 0;
+    // Blocks until every entry added so far is stored.
+    virtual void flushHistory() = 0;
+
+    // Up to limit entries older than beforeId, newest first; beforeId <= 0 starts at the
+    // newest entry. Pass the id of the last entry of one page to get the next.
+    virtual QList<HistoryEntry> fetchHistoryPage(qint64 beforeId = 0, int limit = DefaultPageSize) = 0;
+    virtual qint64 historyCount() = 0;
+
+    // Starts an asynchronous search returning up to limit matches older than beforeId,
+    // newest first, and returns its generation number. The page arrives through
+    // historySearchFinished(). Starting a new search supersedes any search that has not
+    // run yet, so typing never queues up stale work. Returns 0 if the store is closed.
+    virtual quint64 searchHistory(const HistorySearch &search, qint64 beforeId = 0, int limit = DefaultPageSize) = 0;
+    virtual bool clearHistory() = 0;
+
+    // Writes every entry, oldest first, to path in format. The file is replaced only once
+    // it is complete.
+    virtual bool exportHistory(const QString &path, HistoryExchange::Format format, qint64 *count = nullptr,
+                               QString *error = nullptr) = 0;
+    // Appends the entries of path, in file order, as the newest history. A malformed
+    // entry leaves the history unchanged; *error then names its line.
+    virtual bool importHistory(const QString &path, HistoryExchange::Format format, qint64 *count = nullptr,
+                               QString *error = nullptr) = 0;
+
+signals:
+    void historySearchFinished(quint64 generation, const QList<HistoryEntry> &page);
+    // Entries with ids below firstKeptId were removed by a retention limit.
+    void historyPruned(qint64 firstKeptId);
+
+protected:
+    // Stores message in *error, if given, and returns false.
+    static bool fail(QString *error, const QString &message);
+};
+
+#endif // HISTORYSTORE_H
@@ -0,0 +1,205 @@
+#include "HistoryWriter.h"
+#include "NumberFormat.h"
+#include "ResultMemo.h"
+#include <QDeadlineTimer>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <utility>
+
+namespace
+{
+    const char *const WriterConnectionName = "CalcPlusPlus.historyWriter";
+}
+
+HistoryWriter::HistoryWriter(const QString &dbPath, QObject *parent)
+    : QThread(parent),
+      databasePath(dbPath)
+{
+}
+
+HistoryWriter::~HistoryWriter()
+{
+    {
+        QMutexLocker locker(&mutex);
+        stopping = true;
+        workAvailable.wakeOne();
+    }
+    wait();
+}
+
+void HistoryWriter::enqueue(const Entry &entry)
+{
+    QMutexLocker locker(&mutex);
+    pending.append(entry);
+    ++queuedCount;
+    // Wake the writer for the first entry of a batch (to start its time window) and for
+    // the one that fills it; everything in between just piles up.
+    if (pending.size() == 1 || pending.size() >= BatchSize) {
+        workAvailable.wakeOne();
+    }
+}
+
+void HistoryWriter::flush()
+{
+    QMutexLocker locker(&mutex);
+    const quint64 target = queuedCount;
+    if (writtenCount >= target || !isRunning()) {
+        return;
+    }
+    ++flushWaiters;
+    workAvailable.wakeOne();
+    while (writtenCount < target) {
+        batchWritten.wait(&mutex);
+    }
+    --flushWaiters;
+}
+
+void HistoryWriter::run()
+{
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", WriterConnectionName);
+        db.setDatabaseName(databasePath);
+        db.setConnectOptions("QSQLITE_BUSY_TIMEOUT=5000");
+        const bool open = db.open();
+
+        QSqlQuery findMemo(db);
+        QSqlQuery insertMemo(db);
+        QSqlQuery countMemoUse(db);
+        QSqlQuery markDecimal(db);
+        QSqlQuery insertHistory(db);
+        QSqlQuery storeSymbol(db);
+        if (open) {
+            // WAL already avoids rewriting the database on every commit; NORMAL additionally
+            // skips the fsync per transaction and only syncs at checkpoints.
+            findMemo.exec("PRAGMA synchronous=NORMAL");
+            findMemo.prepare("SELECT id, result, decimal_precision FROM memo WHERE hash = ? AND key = ? ORDER BY id");
+            insertMemo.prepare("INSERT INTO memo (hash, key, expression, result, result_value, use_count, last_used, "
+                               "decimal_precision) VALUES (?, ?, ?, ?, ?, 1, ?, ?)");
+            countMemoUse.prepare("UPDATE memo SET use_count = use_count + 1, last_used = ? WHERE id = ?");
+            markDecimal.prepare("UPDATE memo SET decimal_precision = ? WHERE id = ?");
+            insertHistory.prepare("INSERT INTO history (timestamp, memo_id) VALUES (?, ?)");
+            // Updated in place, so definitions keep the order in which they were first made.
+            storeSymbol.prepare("INSERT INTO symbols (name, definition) VALUES (?, ?) "
+                                "ON CONFLICT (name) DO UPDATE SET definition = excluded.definition");
+        }
+
+        // Applies one entry; false if a statement failed.
+        auto apply = [&](const Entry &entry) {
+            if (entry.operation == Operation::StoreSymbol) {
+                storeSymbol.bindValue(0, entry.key);
+                storeSymbol.bindValue(1, entry.expression);
+                return storeSymbol.exec();
+            }
+
+            const qint64 hash = static_cast<qint64>(ResultMemo::hashKey(entry.key.toStdString()));
+            findMemo.bindValue(0, hash);
+            findMemo.bindValue(1, entry.key);
+            if (!findMemo.exec()) {
+                return false;
+            }
+            // An expression that names a definition evaluates differently once it changes,
+            // so history entries share a memo row only if their results agree as well. A
+            // decimal result is found by its precision, and when it is first stored it
+            // marks a history row that already shows the same result instead of adding one.
+            qint64 memoId = 0;
+            qint64 sameResultId = 0;
+            while (memoId == 0 && findMemo.next()) {
+                const bool sameResult = findMemo.value(1).toString() == entry.result;
+                const QVariant precision = findMemo.value(2);
+                const bool matches = entry.operation == Operation::AddHistory
+                    ? sameResult
+                    : !precision.isNull() && precision.toInt() == entry.precision;
+                if (matches) {
+                    memoId = findMemo.value(0).toLongLong();
+                } else if (sameResult && precision.isNull() && sameResultId == 0) {
+                    sameResultId = findMemo.value(0).toLongLong();
+                }
+            }
+            findMemo.finish();
+
+            if (memoId == 0 && sameResultId != 0 && entry.operation == Operation::StoreMemo) {
+                markDecimal.bindValue(0, entry.precision);
+                markDecimal.bindValue(1, sameResultId);
+                return markDecimal.exec();
+            }
+            if (memoId != 0 && entry.operation != Operation::StoreMemo) {
+                countMemoUse.bindValue(0, entry.timestamp);
+                countMemoUse.bindValue(1, memoId);
+                if (!countMemoUse.exec()) {
+                    return false;
+                }
+            } else if (memoId == 0 && entry.operation != Operation::CountMemoUse) {
+                double value = 0;
+                const bool numeric = NumberFormat::parse(entry.result, &value);
+                insertMemo.bindValue(0, hash);
+                insertMemo.bindValue(1, entry.key);
+                insertMemo.bindValue(2, entry.expression);
+                insertMemo.bindValue(3, entry.result);
+                insertMemo.bindValue(4, numeric ? QVariant(value) : QVariant());
+                insertMemo.bindValue(5, entry.timestamp);
+                insertMemo.bindValue(6, entry.operation == Operation::StoreMemo ? QVariant(entry.precision) : QVariant());
+                if (!insertMemo.exec()) {
+                    return false;
+                }
+                memoId = insertMemo.lastInsertId().toLongLong();
+            }
+
+            if (entry.operation == Operation::AddHistory) {
+                insertHistory.bindValue(0, entry.timestamp);
+                insertHistory.bindValue(1, memoId);
+                return insertHistory.exec();
+            }
+            return true;
+        };
+
+        QVector<Entry> batch;
+        QMutexLocker locker(&mutex);
+        for (;;) {
+            while (pending.isEmpty() && !stopping) {
+                workAvailable.wait(&mutex);
+            }
+            if (pending.isEmpty()) {
+                break; // Stopping with nothing left to write
+            }
+
+            // Group entries until the batch is full, the time window closes, or somebody
+            // is waiting for them.
+            const QDeadlineTimer window(FlushIntervalMs);
+            while (pending.size() < BatchSize && !stopping && flushWaiters == 0 && !window.hasExpired()) {
+                workAvailable.wait(&mutex, window);
+            }
+            batch.swap(pending);
+            locker.unlock();
+
+            if (open) {
+                // IMMEDIATE takes the write lock before the first read, so a commit by the
+                // maintenance thread in between makes this wait rather than fail.
+                bool ok = QSqlQuery(db).exec("BEGIN IMMEDIATE");
+                for (const Entry &entry : std::as_const(batch)) {
+                    if (!ok) break;
+                    ok = apply(entry);
+                }
+                if (!ok || !db.commit()) {
+                    db.rollback();
+                }
+            }
+            // Entries of a failed batch are dropped rather than retried forever.
+            const quint64 written = static_cast<quint64>(batch.size());
+            batch.clear();
+
+            locker.relock();
+            writtenCount += written;
+            batchWritten.wakeAll();
+        }
+        locker.unlock();
+
+        findMemo.finish();
+        insertMemo.finish();
+        countMemoUse.finish();
+        markDecimal.finish();
+        insertHistory.finish();
+        storeSymbol.finish();
+        db.close();
+    }
+    QSqlDatabase::removeDatabase(WriterConnectionName);
+}
@@ -0,0 +1,65 @@
+#ifndef HISTORYWRITER_H
+#define HISTORYWRITER_H
+
+#include <QMutex>
+#include <QString>
+#include <QThread>
+#include <QVector>
+#include <QWaitCondition>
+
+// Background thread that persists history, memo and symbol updates for DatabaseManager. Updates
+// are queued without touching the disk and committed in group transactions of up to
+// BatchSize entries, or FlushIntervalMs after the first queued one, over the thread's
+// own SQLite connection with prepared statements. This keeps the GUI thread free of
+// disk I/O and turns a burst of calculations into one fsync instead of one per row.
+class HistoryWriter : public QThread
+{
+    Q_OBJECT
+
+public:
+    static constexpr int BatchSize = 256;
+    static constexpr int FlushIntervalMs = 250;
+
+    enum class Operation {
+        AddHistory,  // History row referencing the memo row of key and result, created if needed
+        StoreMemo,   // Memo row for key at precision unless one exists; takes over a history one
+        CountMemoUse, // Use count and last-used time of the memo row for key at precision
+        StoreSymbol   // Symbols row for key, replacing the definition of a known name
+    };
+
+    struct Entry
+    {
+        Operation operation;
+        QString timestamp;
+        QString key; // See DatabaseManager::memoKey(); the name for StoreSymbol
+        QString expression; // The definition for StoreSymbol
+        QString result;
+        int precision = 0; // Of a decimal result, for StoreMemo and CountMemoUse
+    };
+
+    explicit HistoryWriter(const QString &dbPath, QObject *parent = nullptr);
+    // Commits everything still queued before returning.
+    ~HistoryWriter() override;
+
+    void enqueue(const Entry &entry);
+
+    // Blocks until every entry queued so far has been committed (or has failed).
+    void flush();
+
+protected:
+    void run() override;
+
+private:
+    QString databasePath;
+
+    QMutex mutex;
+    QWaitCondition workAvailable;
+    QWaitCondition batchWritten;
+    QVector<Entry> pending;  // Guarded by mutex
+    quint64 queuedCount = 0; // Entries ever queued, guarded by mutex
+    quint64 writtenCount = 0; // Entries ever written or dropped, guarded by mutex
+    int flushWaiters = 0;    // Guarded by mutex
+    bool stopping = false;   // Guarded by mutex
+};
+
+#endif // HISTORYWRITER_H
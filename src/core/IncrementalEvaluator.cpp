@@ -0,0 +1,272 @@
+#include "IncrementalEvaluator.h"
+#include "CalculatorCore.h"
+#include "ExpressionCompiler.h"
+#include "ExpressionLexer.h"
+#include <algorithm>
+
+namespace
+{
+    using Lexer = ExpressionLexer<char16_t>;
+
+    // How far past the end of a token the lexer may have looked to decide where it ends
+    // ("x^y", exponents, ".5"): an edit this close to a token invalidates it.
+    constexpr size_t LookaheadMargin = 4;
+}
+
+CalcResult IncrementalEvaluator::evaluate(std::u16string_view source)
+{
+    const size_t common = static_cast<size_t>(
+        std::mismatch(m_source.begin(), m_source.end(), source.begin(), source.end()).first - m_source.begin());
+
+    // Tokens that depend on nothing at or after the first edited character stay valid.
+    const size_t firstStale = static_cast<size_t>(
+        std::upper_bound(m_extents.begin(), m_extents.end(), common) - m_extents.begin());
+    if (firstStale < m_extents.size()) {
+        const size_t checkpoint = firstStale / CheckpointInterval;
+        m_state = m_checkpoints[checkpoint];
+        m_checkpoints.resize(checkpoint + 1);
+        m_extents.resize(checkpoint * CheckpointInterval);
+    }
+
+    m_source.assign(source);
+    m_lastTokensScanned = 0;
+    feed(source);
+    return finish(source);
+}
+
+void IncrementalEvaluator::clear()
+{
+    m_source.clear();
+    m_state = State();
+    m_extents.clear();
+    m_checkpoints.clear();
+    m_lastTokensScanned = 0;
+}
+
+void IncrementalEvaluator::feed(std::u16string_view source)
+{
+    State &state = m_state;
+    const size_t offset = state.resume;
+    Lexer lexer(source.data() + offset, source.data() + source.size());
+
+    while (!state.syntaxError.isError() && !state.namesSymbol) {
+        const Token token = lexer.next(state.expectOperand ? Lexer::ExpectOperand : Lexer::ExpectOperator);
+        if (token.kind == TokenKind::End) {
+            break;
+        }
+        if (m_extents.size() == m_checkpoints.size() * CheckpointInterval) {
+            m_checkpoints.push_back(state);
+        }
+        ++m_lastTokensScanned;
+        state.sawToken = true;
+        state.resume = offset + static_cast<size_t>(lexer.position());
+        size_t extent = state.resume + LookaheadMargin;
+        const int position = static_cast<int>(offset) + token.position;
+
+        if (state.expectOperand) {
+            const bool awaitingSqrtArgument = !state.operators.empty()
+                                              && state.operators.back().kind == Pending::SqrtCall;
+            if (awaitingSqrtArgument && token.kind != TokenKind::LeftParen) {
+                state.syntaxError = { CalcErrorCode::UnexpectedToken, position };
+            } else if (!awaitingSqrtArgument && state.nesting + 1 > ExpressionCompiler::MaxNestingDepth) {
+                state.syntaxError = { CalcErrorCode::NestingTooDeep, position };
+            } else {
+                switch (token.kind) {
+                    case TokenKind::Number:
+                        state.operands.push_back({ token.number, CalcError() });
+                        state.expectOperand = false;
+                        break;
+                    case TokenKind::LeftParen:
+                        state.operators.push_back({ OpCode::PushConst, Pending::Paren, position });
+                        ++state.nesting;
+                        break;
+                    case TokenKind::Plus:
+                        // Changes nothing but still nests like the other prefix operators.
+                        state.operators.push_back({ OpCode::PushConst, Pending::Prefix, position });
+                        ++state.nesting;
+                        break;
+                    case TokenKind::Minus:
+                    case TokenKind::Sqrt:
+                        state.operators.push_back({ token.kind == TokenKind::Minus ? OpCode::Negate : OpCode::Sqrt,
+                                                    Pending::Prefix, position });
+                        ++state.nesting;
+                        break;
+                    case TokenKind::Identifier:
+                        if (lexer.text(token) == u"sqrt") {
+                            state.operators.push_back({ OpCode::Sqrt, Pending::SqrtCall, position });
+                        } else {
+                            state.namesSymbol = true;
+                        }
+                        break;
+                    case TokenKind::RightParen:
+                        state.syntaxError = { CalcErrorCode::MismatchedParenthesis, position };
+                        break;
+                    case TokenKind::Invalid: {
+                        const std::u16string_view text = lexer.text(token);
+                        const bool numeric = !text.empty() && ((text[0] >= '0' && text[0] <= '9') || text[0] == '.');
+                        state.syntaxError = { numeric ? CalcErrorCode::InvalidNumber : CalcErrorCode::UnexpectedToken,
+                                              position };
+                        break;
+                    }
+                    default:
+                        state.syntaxError = { CalcErrorCode::UnexpectedToken, position };
+                        break;
+                }
+            }
+        } else {
+            OpCode op = OpCode::PushConst;
+            switch (token.kind) {
+                case TokenKind::Plus:     op = OpCode::Add; break;
+                case TokenKind::Minus:    op = OpCode::Subtract; break;
+                case TokenKind::Multiply: op = OpCode::Multiply; break;
+                case TokenKind::Divide:   op = OpCode::Divide; break;
+                case TokenKind::Power:    op = OpCode::Power; break;
+                case TokenKind::Percent: {
+                    // Modulo or percentage depends on the next token, so this one also
+                    // depends on the text up to the end of that token.
+                    Lexer lookahead = lexer;
+                    op = startsUnsignedOperand(lookahead.next(Lexer::ExpectOperand).kind) ? OpCode::Modulo
+                                                                                          : OpCode::Percent;
+                    extent = offset + static_cast<size_t>(lookahead.position()) + LookaheadMargin;
+                    break;
+                }
+                case TokenKind::RightParen:
+                    while (!state.operators.empty() && state.operators.back().kind != Pending::Paren) {
+                        reduce(state);
+                    }
+                    if (state.operators.empty()) {
+                        state.syntaxError = { CalcErrorCode::MismatchedParenthesis, position };
+                        break;
+                    }
+                    state.operators.pop_back();
+                    --state.nesting;
+                    if (!state.operators.empty() && state.operators.back().kind == Pending::SqrtCall) {
+                        applyUnary(state.operands.back(), OpCode::Sqrt, state.operators.back().position);
+                        state.operators.pop_back();
+                    }
+                    break;
+                default:
+                    state.syntaxError = { CalcErrorCode::UnexpectedToken, position };
+                    break;
+            }
+
+            if (op == OpCode::Percent) {
+                // Postfix operators bind tighter than anything, so they apply right away.
+                applyUnary(state.operands.back(), OpCode::Percent, position);
+            } else if (op != OpCode::PushConst) {
+                const int precedence = ExpressionGrammar::precedence(op);
+                const bool rightAssociative = ExpressionGrammar::isRightAssociative(op);
+                while (!state.operators.empty()) {
+                    const Operator &top = state.operators.back();
+                    if (top.kind == Pending::Paren || top.kind == Pending::SqrtCall) {
+                        break;
+                    }
+                    const int topPrecedence = top.kind == Pending::Prefix ? ExpressionGrammar::UnaryPrecedence
+                                                                          : ExpressionGrammar::precedence(top.op);
+                    if (topPrecedence < precedence || (topPrecedence == precedence && rightAssociative)) {
+                        break;
+                    }
+                    reduce(state);
+                }
+                state.operators.push_back({ op, Pending::Binary, position });
+                ++state.nesting;
+                state.expectOperand = true;
+            }
+        }
+
+        m_extents.push_back(static_cast<std::uint32_t>(
+            std::max<size_t>(extent, m_extents.empty() ? 0 : m_extents.back())));
+    }
+}
+
+CalcResult IncrementalEvaluator::finish(std::u16string_view source)
+{
+    CalcResult result;
+    const int end = static_cast<int>(source.size());
+    if (m_state.syntaxError.isError()) {
+        result.error = m_state.syntaxError;
+        return result;
+    }
+    if (m_state.namesSymbol) {
+        return m_core.calculate(QString::fromUtf16(source.data(), static_cast<qsizetype>(source.size())));
+    }
+    if (!m_state.sawToken) {
+        result.error = { CalcErrorCode::EmptyExpression, 0 };
+        return result;
+    }
+    if (m_state.expectOperand) {
+        if (!m_state.operators.empty() && m_state.operators.back().kind == Pending::SqrtCall) {
+            result.error = { CalcErrorCode::UnexpectedToken, end };
+        } else if (m_state.nesting + 1 > ExpressionCompiler::MaxNestingDepth) {
+            result.error = { CalcErrorCode::NestingTooDeep, end };
+        } else {
+            result.error = { CalcErrorCode::UnexpectedEnd, end };
+        }
+        return result;
+    }
+
+    // Reduce a copy, so the next edit can continue from the state as it is.
+    State state = m_state;
+    while (!state.operators.empty()) {
+        if (state.operators.back().kind == Pending::Paren) {
+            result.error = { CalcErrorCode::MismatchedParenthesis, state.operators.back().position };
+            return result;
+        }
+        reduce(state);
+    }
+    const Operand &operand = state.operands.back();
+    if (operand.error.isError()) {
+        result.error = operand.error;
+    } else {
+        result.value = operand.value;
+    }
+    return result;
+}
+
+void IncrementalEvaluator::reduce(State &state)
+{
+    const Operator op = state.operators.back();
+    state.operators.pop_back();
+    --state.nesting;
+    apply(state, op);
+}
+
+void IncrementalEvaluator::apply(State &state, const Operator &op)
+{
+    if (op.kind == Pending::Prefix) {
+        if (op.op != OpCode::PushConst) {
+            applyUnary(state.operands.back(), op.op, op.position);
+        }
+        return;
+    }
+
+    // Errors are reported in program order: the left operand's, the right one's, then
+    // this operator's own.
+    const Operand rhs = state.operands.back();
+    state.operands.pop_back();
+    Operand &lhs = state.operands.back();
+    if (lhs.error.isError()) {
+        return;
+    }
+    if (rhs.error.isError()) {
+        lhs.error = rhs.error;
+        return;
+    }
+    CalcErrorCode error = CalcErrorCode::None;
+    lhs.value = ExpressionGrammar::applyBinary(op.op, lhs.value, rhs.value, error);
+    if (error != CalcErrorCode::None) {
+        lhs.error = { error, op.position };
+    }
+}
+
+void IncrementalEvaluator::applyUnary(Operand &operand, OpCode op, int position)
+{
+    if (operand.error.isError()) {
+        return;
+    }
+    CalcErrorCode error = CalcErrorCode::None;
+    operand.value = ExpressionGrammar::applyUnary(op, operand.value, error);
+    if (error != CalcErrorCode::None) {
+        operand.error = { error, position };
+    }
+}
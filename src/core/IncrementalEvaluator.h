@@ -0,0 +1,87 @@
+#ifndef INCREMENTALEVALUATOR_H
+#define INCREMENTALEVALUATOR_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "ExpressionGrammar.h"
+
+class CalculatorCore;
+
+// Evaluates an expression that is being edited, re-reading only what changed. It is an
+// operator-precedence (shunting-yard) evaluator: operands are reduced as soon as the
+// operators after them allow, so its state after any prefix of the text is a short
+// stack of pending values and operators. That state is checkpointed every
+// CheckpointInterval tokens; on the next call the evaluator rolls back to the last
+// checkpoint before the first edited character and resumes lexing from there, so
+// typing at the end of a 10,000-token expression only touches its last few tokens.
+//
+// Results, including error codes and positions, match CalculatorCore::calculate(): the
+// grammar and the operator semantics both come from ExpressionGrammar, and the
+// reductions happen in the order the compiled program would run them. Names other than
+// sqrt (pi, e, variables, functions) are resolved by the core's compiler instead: once
+// one appears, each call passes the whole text to core.calculate().
+class IncrementalEvaluator
+{
+public:
+    static constexpr size_t CheckpointInterval = 64;
+
+    // core must outlive the evaluator; it is only used for text that names a symbol.
+    explicit IncrementalEvaluator(CalculatorCore &core) : m_core(core) {}
+
+    CalcResult evaluate(std::u16string_view source);
+    void clear();
+
+    // Tokens lexed by the last evaluate() call, to tell how much work was reused.
+    size_t lastTokensScanned() const { return m_lastTokensScanned; }
+
+private:
+    enum class Pending : std::uint8_t {
+        Binary,
+        Prefix,   // Unary plus, minus or √
+        Paren,
+        SqrtCall  // "sqrt" waiting for its parenthesized argument
+    };
+
+    struct Operand
+    {
+        double value;
+        CalcError error; // First evaluation error inside this operand
+    };
+
+    struct Operator
+    {
+        OpCode op;
+        Pending kind;
+        int position;
+    };
+
+    struct State
+    {
+        std::vector<Operand> operands;
+        std::vector<Operator> operators;
+        int nesting = 0;           // Parser recursion the compiler would be in
+        size_t resume = 0;         // Source offset where lexing continues
+        bool expectOperand = true;
+        bool sawToken = false;
+        bool namesSymbol = false;  // Sticky: the core evaluates the whole text
+        CalcError syntaxError;     // Sticky: nothing after it changes the result
+    };
+
+    CalculatorCore &m_core;
+    std::u16string m_source;
+    State m_state;
+    std::vector<std::uint32_t> m_extents; // Per token: end of the source it depends on
+    std::vector<State> m_checkpoints;     // State before token k * CheckpointInterval
+    size_t m_lastTokensScanned = 0;
+
+    void feed(std::u16string_view source);
+    CalcResult finish(std::u16string_view source);
+
+    static void reduce(State &state);
+    static void apply(State &state, const Operator &op);
+    static void applyUnary(Operand &operand, OpCode op, int position);
+};
+
+#endif // INCREMENTALEVALUATOR_H
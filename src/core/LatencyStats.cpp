@@ -0,0 +1,225 @@
+#include "LatencyStats.h"
+#include <algorithm>
+#include <cstdio>
+#include <mutex>
+
+std::atomic<bool> LatencyStats::s_enabled{false};
+
+namespace {
+
+const std::chrono::steady_clock::time_point processStartTime = std::chrono::steady_clock::now();
+
+// Values below 16 ns get a bucket each; above that every power of two is split into 16.
+constexpr int SubBucketBits = 4;
+constexpr int SubBuckets = 1 << SubBucketBits;
+constexpr int BucketCount = (64 - SubBucketBits + 1) * SubBuckets;
+
+int bucketOf(std::uint64_t ns)
+{
+    if (ns < SubBuckets) {
+        return static_cast<int>(ns);
+    }
+    const int exponent = 63 - __builtin_clzll(ns);
+    return (exponent - SubBucketBits + 1) * SubBuckets
+           + static_cast<int>((ns >> (exponent - SubBucketBits)) & (SubBuckets - 1));
+}
+
+// Midpoint of the values that fall into bucket.
+std::uint64_t bucketValue(int bucket)
+{
+    const int group = bucket / SubBuckets;
+    if (group == 0) {
+        return static_cast<std::uint64_t>(bucket);
+    }
+    const std::uint64_t width = std::uint64_t(1) << (group - 1);
+    return static_cast<std::uint64_t>(SubBuckets + bucket % SubBuckets) * width + width / 2;
+}
+
+// Written only by the owning thread, so plain load/store pairs suffice; the atomics just
+// make concurrent reads from summarize() well defined.
+struct Histograms
+{
+    std::atomic<std::uint64_t> counts[LatencyStats::ProbeCount][BucketCount];
+    std::atomic<std::uint64_t> maxNs[LatencyStats::ProbeCount];
+};
+
+void bump(std::atomic<std::uint64_t> &counter, std::uint64_t amount)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+void raiseMax(std::atomic<std::uint64_t> &maximum, std::uint64_t value)
+{
+    if (value > maximum.load(std::memory_order_relaxed)) {
+        maximum.store(value, std::memory_order_relaxed);
+    }
+}
+
+struct Registry
+{
+    std::mutex mutex;
+    std::vector<Histograms *> live;
+    Histograms retired; // Counts of threads that have exited
+};
+
+// Never destroyed: threads may still exit, and fold their counts in, during static teardown.
+Registry &registry()
+{
+    static Registry *instance = new Registry();
+    return *instance;
+}
+
+struct ThreadSlot
+{
+    Histograms *histograms = nullptr;
+
+    ~ThreadSlot()
+    {
+        if (!histograms) {
+            return;
+        }
+        Registry &shared = registry();
+        std::lock_guard<std::mutex> lock(shared.mutex);
+        for (int probe = 0; probe < LatencyStats::ProbeCount; ++probe) {
+            for (int bucket = 0; bucket < BucketCount; ++bucket) {
+                bump(shared.retired.counts[probe][bucket],
+                     histograms->counts[probe][bucket].load(std::memory_order_relaxed));
+            }
+            raiseMax(shared.retired.maxNs[probe], histograms->maxNs[probe].load(std::memory_order_relaxed));
+        }
+        shared.live.erase(std::find(shared.live.begin(), shared.live.end(), histograms));
+        delete histograms;
+    }
+};
+
+Histograms &threadHistograms()
+{
+    thread_local ThreadSlot slot;
+    if (!slot.histograms) {
+        slot.histograms = new Histograms();
+        Registry &shared = registry();
+        std::lock_guard<std::mutex> lock(shared.mutex);
+        shared.live.push_back(slot.histograms);
+    }
+    return *slot.histograms;
+}
+
+std::string formatDuration(std::uint64_t ns)
+{
+    char text[32];
+    if (ns < 1000) {
+        std::snprintf(text, sizeof(text), "%llu ns", static_cast<unsigned long long>(ns));
+    } else if (ns < 1000000) {
+        std::snprintf(text, sizeof(text), "%.1f us", ns / 1e3);
+    } else if (ns < 1000000000) {
+        std::snprintf(text, sizeof(text), "%.1f ms", ns / 1e6);
+    } else {
+        std::snprintf(text, sizeof(text), "%.2f s", ns / 1e9);
+    }
+    return text;
+}
+
+} // namespace
+
+void LatencyStats::record(Probe probe, std::chrono::steady_clock::duration elapsed)
+{
+    const std::uint64_t ns =
+        static_cast<std::uint64_t>(std::max<std::int64_t>(0, std::chrono::nanoseconds(elapsed).count()));
+    Histograms &histograms = threadHistograms();
+    bump(histograms.counts[probe][bucketOf(ns)], 1);
+    raiseMax(histograms.maxNs[probe], ns);
+}
+
+std::vector<LatencyStats::Summary> LatencyStats::summarize()
+{
+    std::vector<Summary> summaries;
+    Registry &shared = registry();
+    std::lock_guard<std::mutex> lock(shared.mutex);
+
+    std::vector<const Histograms *> sources(shared.live.begin(), shared.live.end());
+    sources.push_back(&shared.retired);
+
+    for (int probe = 0; probe < ProbeCount; ++probe) {
+        std::vector<std::uint64_t> counts(BucketCount, 0);
+        Summary summary = { probeName(static_cast<Probe>(probe)), 0, 0, 0, 0 };
+        for (const Histograms *source : sources) {
+            for (int bucket = 0; bucket < BucketCount; ++bucket) {
+                const std::uint64_t count = source->counts[probe][bucket].load(std::memory_order_relaxed);
+                counts[bucket] += count;
+                summary.count += count;
+            }
+            summary.maxNs = std::max(summary.maxNs, source->maxNs[probe].load(std::memory_order_relaxed));
+        }
+
+        // Smallest bucket holding the ceil(q * count)-th fastest sample.
+        const auto percentile = [&](std::uint64_t permille) -> std::uint64_t {
+            const std::uint64_t rank = std::max<std::uint64_t>(1, (summary.count * permille + 999) / 1000);
+            std::uint64_t seen = 0;
+            for (int bucket = 0; bucket < BucketCount; ++bucket) {
+                seen += counts[bucket];
+                if (seen >= rank) {
+                    return std::min(bucketValue(bucket), summary.maxNs);
+                }
+            }
+            return summary.maxNs;
+        };
+        if (summary.count > 0) {
+            summary.p50Ns = percentile(500);
+            summary.p99Ns = percentile(990);
+        }
+        summaries.push_back(summary);
+    }
+    return summaries;
+}
+
+std::string LatencyStats::report()
+{
+    std::string text;
+    char line[160];
+    std::snprintf(line, sizeof(line), "%-34s %10s %10s %10s %10s\n", "probe", "count", "p50", "p99", "max");
+    text += line;
+    for (const Summary &summary : summarize()) {
+        std::snprintf(line, sizeof(line), "%-34s %10llu %10s %10s %10s\n", summary.name,
+                      static_cast<unsigned long long>(summary.count), formatDuration(summary.p50Ns).c_str(),
+                      formatDuration(summary.p99Ns).c_str(), formatDuration(summary.maxNs).c_str());
+        text += line;
+    }
+    return text;
+}
+
+void LatencyStats::reset()
+{
+    // Samples recorded while this runs may survive it or be lost; both are harmless.
+    Registry &shared = registry();
+    std::lock_guard<std::mutex> lock(shared.mutex);
+    std::vector<Histograms *> targets(shared.live.begin(), shared.live.end());
+    targets.push_back(&shared.retired);
+    for (Histograms *histograms : targets) {
+        for (int probe = 0; probe < ProbeCount; ++probe) {
+            for (int bucket = 0; bucket < BucketCount; ++bucket) {
+                histograms->counts[probe][bucket].store(0, std::memory_order_relaxed);
+            }
+            histograms->maxNs[probe].store(0, std::memory_order_relaxed);
+        }
+    }
+}
+
+const char *LatencyStats::probeName(Probe probe)
+{
+    switch (probe) {
+        case PerformCalculation:   return "MainWindow::performCalculation";
+        case Calculate:            return "CalculatorCore::calculate";
+        case AddHistoryEntry:      return "DatabaseManager::addHistoryEntry";
+        case FetchHistoryPage:     return "DatabaseManager::fetchHistoryPage";
+        case PanelAddHistoryEntry: return "HistoryPanel::addHistoryEntry";
+        case FirstFrame:           return "Time to first frame";
+        case ServiceRequest:       return "CalcService request";
+        case ProbeCount:           break;
+    }
+    return "unknown";
+}
+
+std::chrono::steady_clock::time_point LatencyStats::processStart()
+{
+    return processStartTime;
+}
@@ -0,0 +1,86 @@
+#ifndef LATENCYSTATS_H
+#define LATENCYSTATS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Latency instrumentation compiled into every build and switched on at runtime (--stats
+// or the debug dialog). Each probe feeds a log-linear histogram: 16 linear sub-buckets
+// per power of two, so any percentile is within 1/16 of the true value whether the
+// operation took nanoseconds or seconds. Histograms are per thread and written without
+// locks or read-modify-write atomics; summarize() merges them.
+//
+// While disabled a Scope costs one relaxed load and a predictable branch.
+class LatencyStats
+{
+public:
+    enum Probe {
+        PerformCalculation,   // MainWindow::performCalculation
+        Calculate,            // CalculatorCore::calculate
+        AddHistoryEntry,      // HistoryStore::addHistoryEntry
+        FetchHistoryPage,     // HistoryStore::fetchHistoryPage
+        PanelAddHistoryEntry, // HistoryPanel::addHistoryEntry
+        FirstFrame,           // Process start to the first paint of the main window
+        ServiceRequest,       // CalcService: a request frame read to its response ready
+        ProbeCount
+    };
+
+    struct Summary
+    {
+        const char *name;
+        std::uint64_t count;
+        std::uint64_t p50Ns;
+        std::uint64_t p99Ns;
+        std::uint64_t maxNs;
+    };
+
+    // Times the enclosing block when statistics are enabled.
+    class Scope
+    {
+    public:
+        explicit Scope(Probe probe)
+            : m_probe(probe), m_active(enabled())
+        {
+            if (m_active) {
+                m_start = std::chrono::steady_clock::now();
+            }
+        }
+        ~Scope()
+        {
+            if (m_active) {
+                record(m_probe, std::chrono::steady_clock::now() - m_start);
+            }
+        }
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+
+    private:
+        Probe m_probe;
+        bool m_active;
+        std::chrono::steady_clock::time_point m_start;
+    };
+
+    static bool enabled() { return s_enabled.load(std::memory_order_relaxed); }
+    static void setEnabled(bool enabled) { s_enabled.store(enabled, std::memory_order_relaxed); }
+
+    static void record(Probe probe, std::chrono::steady_clock::duration elapsed);
+
+    // Every probe, including those never hit, merged over all threads past and present.
+    static std::vector<Summary> summarize();
+    // summarize() as an aligned text table, one probe per line.
+    static std::string report();
+    static void reset();
+
+    static const char *probeName(Probe probe);
+
+    // Taken while static objects are initialized, before main() runs.
+    static std::chrono::steady_clock::time_point processStart();
+
+private:
+    static std::atomic<bool> s_enabled;
+};
+
+#endif // LATENCYSTATS_H
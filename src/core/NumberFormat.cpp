@@ -0,0 +1,236 @@
+#include "NumberFormat.h"
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <string>
+
+namespace
+{
+    constexpr int MaxDigits = 17;          // Enough for any double to round-trip
+    constexpr int FixedExponentLimit = 24; // Bounds the zeros fixed notation can write
+
+    // A finite, non-negative value as the digits d0 d1 ... times 10^(exponent - count + 1),
+    // without trailing zeros.
+    struct Digits
+    {
+        char digits[MaxDigits + 1];
+        int count = 0;
+        int exponent = 0;
+    };
+
+    Digits decompose(double magnitude, int significantDigits)
+    {
+        // Scientific output is "d.ddde-XX": the digits and the exponent as they are needed.
+        char text[48];
+        const std::to_chars_result written =
+            significantDigits > 0
+                ? std::to_chars(text, text + sizeof(text), magnitude, std::chars_format::scientific, significantDigits - 1)
+                : std::to_chars(text, text + sizeof(text), magnitude, std::chars_format::scientific);
+        Digits result;
+        const char *cursor = text;
+        for (; cursor < written.ptr && *cursor != 'e'; ++cursor) {
+            if (*cursor != '.') result.digits[result.count++] = *cursor;
+        }
+        ++cursor; // 'e'
+        const bool negative = *cursor == '-';
+        std::from_chars(cursor + 1, written.ptr, result.exponent);
+        result.exponent = negative ? -result.exponent : result.exponent;
+        while (result.count > 1 && result.digits[result.count - 1] == '0') --result.count;
+        return result;
+    }
+
+    template <typename CharT>
+    class Writer
+    {
+    public:
+        explicit Writer(CharT *buffer) : m_start(buffer), m_cursor(buffer) {}
+
+        void put(char c) { *m_cursor++ = static_cast<CharT>(c); }
+        void put(std::string_view text)
+        {
+            for (char c : text) put(c);
+        }
+        void put(const char *begin, const char *end) { put(std::string_view(begin, static_cast<size_t>(end - begin))); }
+
+        void putSeparator(char16_t separator)
+        {
+            if constexpr (sizeof(CharT) == 2) {
+                *m_cursor++ = separator;
+            } else if (separator < 0x80) {
+                put(static_cast<char>(separator));
+            } else if (separator < 0x800) {
+                put(static_cast<char>(0xC0 | separator >> 6));
+                put(static_cast<char>(0x80 | (separator & 0x3F)));
+            } else {
+                put(static_cast<char>(0xE0 | separator >> 12));
+                put(static_cast<char>(0x80 | (separator >> 6 & 0x3F)));
+                put(static_cast<char>(0x80 | (separator & 0x3F)));
+            }
+        }
+
+        size_t size() const { return static_cast<size_t>(m_cursor - m_start); }
+
+    private:
+        CharT *m_start;
+        CharT *m_cursor;
+    };
+
+    template <typename CharT>
+    size_t formatTo(double value, CharT *buffer, const NumberStyle &style)
+    {
+        Writer<CharT> out(buffer);
+        if (std::isnan(value)) {
+            out.put("nan");
+            return out.size();
+        }
+        if (std::signbit(value)) {
+            out.put('-');
+        }
+        if (std::isinf(value)) {
+            out.put("inf");
+            return out.size();
+        }
+
+        const Digits d = decompose(std::fabs(value), std::clamp(style.significantDigits, 0, MaxDigits));
+        const int minFixed = std::max(style.minFixedExponent, -FixedExponentLimit);
+        const int maxFixed = std::min(style.maxFixedExponent, FixedExponentLimit);
+        if (d.exponent < minFixed || d.exponent >= maxFixed) {
+            // Written like %g: "1.5e+20", "2e-07".
+            out.put(d.digits[0]);
+            if (d.count > 1) {
+                out.put('.');
+                out.put(d.digits + 1, d.digits + d.count);
+            }
+            out.put(d.exponent < 0 ? "e-" : "e+");
+            const int exponent = std::abs(d.exponent);
+            if (exponent < 10) out.put('0');
+            char text[4];
+            out.put(text, std::to_chars(text, text + sizeof(text), exponent).ptr);
+        } else if (d.exponent < 0) {
+            out.put("0.");
+            for (int i = -1; i > d.exponent; --i) out.put('0');
+            out.put(d.digits, d.digits + d.count);
+        } else {
+            const int integerDigits = d.exponent + 1;
+            for (int i = 0; i < integerDigits; ++i) {
+                if (style.groupSeparator && i > 0 && (integerDigits - i) % 3 == 0) {
+                    out.putSeparator(style.groupSeparator);
+                }
+                out.put(i < d.count ? d.digits[i] : '0');
+            }
+            if (d.count > integerDigits) {
+                out.put('.');
+                out.put(d.digits + integerDigits, d.digits + d.count);
+            }
+        }
+        return out.size();
+    }
+
+    inline bool isSpace(char16_t c) { return c == ' ' || (c >= '\t' && c <= '\r'); }
+    inline bool isDigit(char16_t c) { return c >= '0' && c <= '9'; }
+
+    bool parseNarrow(const char *begin, const char *end, double *value)
+    {
+        double parsed;
+        const std::from_chars_result result = std::from_chars(begin, end, parsed);
+        if (result.ec != std::errc() || result.ptr != end) {
+            return false;
+        }
+        *value = parsed;
+        return true;
+    }
+
+    // The length of the separator at text[i], or 0 when there is none there. It only
+    // counts between two digits of the integer part.
+    template <typename CharT>
+    size_t separatorAt(std::basic_string_view<CharT> text, size_t i, std::basic_string_view<CharT> separator,
+                       bool inFraction)
+    {
+        if (separator.empty() || inFraction || i == 0 || !isDigit(static_cast<char16_t>(text[i - 1]))
+            || text.substr(i, separator.size()) != separator || i + separator.size() >= text.size()
+            || !isDigit(static_cast<char16_t>(text[i + separator.size()]))) {
+            return 0;
+        }
+        return separator.size();
+    }
+
+    template <typename CharT>
+    bool parseText(std::basic_string_view<CharT> text, double *value, std::basic_string_view<CharT> separator)
+    {
+        while (!text.empty() && isSpace(static_cast<char16_t>(text.front()))) text.remove_prefix(1);
+        while (!text.empty() && isSpace(static_cast<char16_t>(text.back()))) text.remove_suffix(1);
+        // from_chars takes no '+', and must not be left to accept a sign after one.
+        if (!text.empty() && text.front() == '+') {
+            text.remove_prefix(1);
+            if (!text.empty() && text.front() == '-') return false;
+        }
+
+        if constexpr (sizeof(CharT) == 1) {
+            if (separator.empty()) {
+                return parseNarrow(text.data(), text.data() + text.size(), value);
+            }
+        }
+
+        // Numbers are pure ASCII, so narrowing is a plain copy. Only text longer than any
+        // number format() writes, such as a high-precision decimal result, needs the heap.
+        char buffer[128];
+        std::string longText;
+        char *narrow = buffer;
+        if (text.size() > sizeof(buffer)) {
+            longText.resize(text.size());
+            narrow = longText.data();
+        }
+        size_t length = 0;
+        bool inFraction = false;
+        for (size_t i = 0; i < text.size();) {
+            if (const size_t skip = separatorAt(text, i, separator, inFraction)) {
+                i += skip;
+                continue;
+            }
+            const auto c = static_cast<char16_t>(text[i++]);
+            if (c >= 0x80) {
+                return false;
+            }
+            inFraction = inFraction || c == '.' || c == 'e' || c == 'E';
+            narrow[length++] = static_cast<char>(c);
+        }
+        return parseNarrow(narrow, narrow + length, value);
+    }
+}
+
+size_t NumberFormat::format(double value, char *buffer, const NumberStyle &style)
+{
+    return formatTo(value, buffer, style);
+}
+
+size_t NumberFormat::format(double value, char16_t *buffer, const NumberStyle &style)
+{
+    return formatTo(value, buffer, style);
+}
+
+QString NumberFormat::toString(double value, const NumberStyle &style)
+{
+    char16_t buffer[MaxLength];
+    const size_t length = formatTo(value, buffer, style);
+    return QString::fromUtf16(buffer, static_cast<qsizetype>(length));
+}
+
+bool NumberFormat::parse(std::string_view text, double *value, char16_t groupSeparator)
+{
+    char separator[3];
+    Writer<char> encoder(separator);
+    if (groupSeparator) {
+        encoder.putSeparator(groupSeparator);
+    }
+    return parseText(text, value, std::string_view(separator, encoder.size()));
+}
+
+bool NumberFormat::parse(std::u16string_view text, double *value, char16_t groupSeparator)
+{
+    return parseText(text, value, std::u16string_view(&groupSeparator, groupSeparator ? 1 : 0));
+}
+
+bool NumberFormat::parse(QStringView text, double *value, char16_t groupSeparator)
+{
+    return parse(std::u16string_view(text.utf16(), static_cast<size_t>(text.size())), value, groupSeparator);
+}
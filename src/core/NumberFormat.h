@@ -0,0 +1,44 @@
+#ifndef NUMBERFORMAT_H
+#define NUMBERFORMAT_H
+
+#include <QString>
+#include <cstddef>
+#include <string_view>
+
+// How NumberFormat writes a number.
+struct NumberStyle
+{
+    int significantDigits = 0; // 0 for the shortest round-trip digits; otherwise at most 17
+    // Fixed notation for exponents in [minFixedExponent, maxFixedExponent), so by default
+    // 1e-5 and 1e15 are written out in full and 1e-6 and 1e16 are not.
+    int minFixedExponent = -5;
+    int maxFixedExponent = 16;
+    char16_t groupSeparator = 0; // Between groups of three integer digits; 0 for none
+};
+
+// Number text in and out of the calculator, written into and read from caller buffers
+// of UTF-8 or UTF-16 without allocating. Output is by default the shortest text that
+// reads back as the same double (0.1 + 0.2 shows as 0.30000000000000004 rather than
+// QString::number's 0.3), in fixed notation unless the exponent is outside the style's
+// range. Parsing is locale independent and accepts what format() writes.
+class NumberFormat
+{
+public:
+    // Longest text format() writes, in code units, for any style.
+    static constexpr size_t MaxLength = 96;
+
+    // Writes value into buffer, which has room for MaxLength code units, and returns the
+    // number written. Infinities and NaN are written as "inf", "-inf" and "nan".
+    static size_t format(double value, char *buffer, const NumberStyle &style = NumberStyle());
+    static size_t format(double value, char16_t *buffer, const NumberStyle &style = NumberStyle());
+    static QString toString(double value, const NumberStyle &style = NumberStyle());
+
+    // Reads the whole of text as a number, allowing surrounding spaces, a leading '+' and,
+    // when groupSeparator is set, that character between integer digits. On failure,
+    // including values out of the range of a double, *value is left alone.
+    static bool parse(std::string_view text, double *value, char16_t groupSeparator = 0);
+    static bool parse(std::u16string_view text, double *value, char16_t groupSeparator = 0);
+    static bool parse(QStringView text, double *value, char16_t groupSeparator = 0);
+};
+
+#endif // NUMBERFORMAT_H
@@ -0,0 +1,54 @@
+#include "PreviewEvaluator.h"
+#include "IncrementalEvaluator.h"
+
+PreviewEvaluator::PreviewEvaluator(CalculatorCore *core, QObject *parent)
+    : QThread(parent),
+      core(core)
+{
+}
+
+PreviewEvaluator::~PreviewEvaluator()
+{
+    {
+        QMutexLocker locker(&mutex);
+        stopping = true;
+        requestAvailable.wakeOne();
+    }
+    wait();
+}
+
+quint64 PreviewEvaluator::evaluate(const QString &expression)
+{
+    QMutexLocker locker(&mutex);
+    pending = expression;
+    hasPending = true;
+    requestAvailable.wakeOne();
+    return ++lastGeneration;
+}
+
+void PreviewEvaluator::run()
+{
+    IncrementalEvaluator evaluator(*core);
+
+    QMutexLocker locker(&mutex);
+    for (;;) {
+        while (!hasPending && !stopping) {
+            requestAvailable.wait(&mutex);
+        }
+        if (stopping) {
+            break;
+        }
+        const QString expression = pending;
+        const quint64 generation = lastGeneration;
+        hasPending = false;
+        locker.unlock();
+
+        const CalcResult result = evaluator.evaluate(
+            std::u16string_view(reinterpret_cast<const char16_t *>(expression.utf16()), expression.size()));
+
+        locker.relock();
+        if (generation == lastGeneration) {
+            emit previewReady(generation, result);
+        }
+    }
+}
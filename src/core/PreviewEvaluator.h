@@ -0,0 +1,46 @@
+#ifndef PREVIEWEVALUATOR_H
+#define PREVIEWEVALUATOR_H
+
+#include <QMutex>
+#include <QString>
+#include <QThread>
+#include <QWaitCondition>
+#include "ExpressionGrammar.h"
+
+class CalculatorCore;
+
+// Background thread that evaluates the expression being typed for the live preview, so
+// keystrokes never wait on a long expression. It keeps one IncrementalEvaluator across
+// requests, which makes each evaluation proportional to the edit rather than to the
+// whole text. Only the latest text is kept: keystrokes that arrive while an evaluation
+// runs are coalesced into the next one, and every result carries the generation number
+// of its request so stale previews can be dropped. Expressions that name a symbol are
+// evaluated by core, which must outlive the thread.
+class PreviewEvaluator : public QThread
+{
+    Q_OBJECT
+
+public:
+    explicit PreviewEvaluator(CalculatorCore *core, QObject *parent = nullptr);
+    ~PreviewEvaluator() override;
+
+    // Returns the generation number that previewReady() will report for this request.
+    quint64 evaluate(const QString &expression);
+
+signals:
+    void previewReady(quint64 generation, const CalcResult &result);
+
+protected:
+    void run() override;
+
+private:
+    CalculatorCore *core;
+    QMutex mutex;
+    QWaitCondition requestAvailable;
+    QString pending;            // Guarded by mutex
+    bool hasPending = false;    // Guarded by mutex
+    quint64 lastGeneration = 0; // Guarded by mutex
+    bool stopping = false;      // Guarded by mutex
+};
+
+#endif // PREVIEWEVALUATOR_H
@@ -0,0 +1,35 @@
+#ifndef RESULTMEMO_H
+#define RESULTMEMO_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Persistent store of decimal results keyed by normalized expression text (see
+// ExpressionCache::normalize) and precision. CalculatorCore consults it before evaluating
+// expressions that are expensive to compute and records their results afterwards;
+// DatabaseManager implements it on top of the memo table that history entries reference,
+// with the same keys, so an expression and its result are stored once.
+class ResultMemo
+{
+public:
+    virtual ~ResultMemo() = default;
+
+    // Stores the result text for key at precision significant digits in *result and
+    // counts the use. Returns false if the key is unknown at that precision.
+    virtual bool lookup(std::string_view key, int precision, std::string *result) = 0;
+    virtual void store(std::string_view key, int precision, std::string_view result) = 0;
+
+    // 64-bit FNV-1a. Unlike std::hash it is the same on every platform and in every run,
+    // so it can be stored on disk and indexed.
+    static std::uint64_t hashKey(std::string_view key)
+    {
+        std::uint64_t hash = 14695981039346656037ull;
+        for (const char c : key) {
+            hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+        }
+        return hash;
+    }
+};
+
+#endif // RESULTMEMO_H
@@ -0,0 +1,68 @@
+#include "SymbolDatabase.h"
+#include <sqlite3.h>
+
+namespace
+{
+    // As long as the calculator window's connections wait for each other.
+    constexpr int BusyTimeoutMs = 5000;
+}
+
+SymbolDatabase::~SymbolDatabase()
+{
+    sqlite3_finalize(m_store);
+    sqlite3_close(m_db);
+}
+
+bool SymbolDatabase::open(const std::string &path, std::string *error)
+{
+    if (sqlite3_open_v2(path.c_str(), &m_db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, nullptr) != SQLITE_OK) {
+        *error = m_db ? sqlite3_errmsg(m_db) : "out of memory";
+        sqlite3_close(m_db);
+        m_db = nullptr;
+        return false;
+    }
+    sqlite3_busy_timeout(m_db, BusyTimeoutMs);
+    // A new file gets the layout DatabaseManager would have given it (both settings are
+    // kept in the file), since the window may open it later.
+    sqlite3_exec(m_db, "PRAGMA auto_vacuum=INCREMENTAL", nullptr, nullptr, nullptr);
+    sqlite3_exec(m_db, "PRAGMA journal_mode=WAL", nullptr, nullptr, nullptr);
+    const bool ok = sqlite3_exec(m_db, CreateTableSql, nullptr, nullptr, nullptr) == SQLITE_OK
+                    // Updated in place, so definitions keep the order in which they were first made.
+                    && sqlite3_prepare_v2(m_db,
+                                          "INSERT INTO symbols (name, definition) VALUES (?, ?) "
+                                          "ON CONFLICT (name) DO UPDATE SET definition = excluded.definition",
+                                          -1, &m_store, nullptr) == SQLITE_OK;
+    if (!ok) {
+        *error = sqlite3_errmsg(m_db);
+        sqlite3_close(m_db);
+        m_db = nullptr;
+        return false;
+    }
+    return true;
+}
+
+std::vector<std::string> SymbolDatabase::definitions() const
+{
+    std::vector<std::string> definitions;
+    sqlite3_stmt *query = nullptr;
+    if (m_db && sqlite3_prepare_v2(m_db, "SELECT definition FROM symbols ORDER BY id", -1, &query, nullptr) == SQLITE_OK) {
+        while (sqlite3_step(query) == SQLITE_ROW) {
+            const char *text = reinterpret_cast<const char *>(sqlite3_column_text(query, 0));
+            definitions.emplace_back(text ? text : "", static_cast<size_t>(sqlite3_column_bytes(query, 0)));
+        }
+    }
+    sqlite3_finalize(query);
+    return definitions;
+}
+
+void SymbolDatabase::storeDefinition(std::string_view name, std::string_view definition)
+{
+    if (!m_store) {
+        return;
+    }
+    // A definition that cannot be written is only lost for later runs.
+    sqlite3_bind_text(m_store, 1, name.data(), static_cast<int>(name.size()), SQLITE_TRANSIENT);
+    sqlite3_bind_text(m_store, 2, definition.data(), static_cast<int>(definition.size()), SQLITE_TRANSIENT);
+    sqlite3_step(m_store);
+    sqlite3_reset(m_store);
+}
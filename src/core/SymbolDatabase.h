@@ -0,0 +1,48 @@
+#ifndef SYMBOLDATABASE_H
+#define SYMBOLDATABASE_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include "SymbolStore.h"
+
+struct sqlite3;
+struct sqlite3_stmt;
+
+// The symbols table of a history database, read and written through SQLite directly so
+// that the headless modes keep definitions across runs without Qt. It shares the table
+// with DatabaseManager, so a definition made in batch mode or the service is known to
+// the calculator window and the other way round. Each definition is committed as it is
+// stored. Not thread safe.
+class SymbolDatabase : public SymbolStore
+{
+public:
+    // Also run by DatabaseManager, so both create the same table.
+    static constexpr const char *CreateTableSql = "CREATE TABLE IF NOT EXISTS symbols ("
+                                                  "id INTEGER PRIMARY KEY," // Order in which names were first defined
+                                                  "name TEXT NOT NULL UNIQUE,"
+                                                  "definition TEXT NOT NULL" // As accepted by CalculatorCore::define()
+                                                  ")";
+
+    SymbolDatabase() = default;
+    ~SymbolDatabase() override;
+
+    SymbolDatabase(const SymbolDatabase &) = delete;
+    SymbolDatabase &operator=(const SymbolDatabase &) = delete;
+
+    // Opens the database at path, creating it and the table if needed. On failure
+    // *error describes the problem.
+    bool open(const std::string &path, std::string *error);
+
+    // The stored definitions in the order their names were first defined, for replaying
+    // through CalculatorCore::define() before the store is attached.
+    std::vector<std::string> definitions() const;
+
+    void storeDefinition(std::string_view name, std::string_view definition) override;
+
+private:
+    sqlite3 *m_db = nullptr;
+    sqlite3_stmt *m_store = nullptr;
+};
+
+#endif // SYMBOLDATABASE_H
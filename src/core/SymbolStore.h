@@ -0,0 +1,19 @@
+#ifndef SYMBOLSTORE_H
+#define SYMBOLSTORE_H
+
+#include <string_view>
+
+// Persistent store of the definitions made through CalculatorCore::define(), such as
+// "rate = 0.07" or "f(x) = x^2 + 1". CalculatorCore hands every successful definition to
+// it; DatabaseManager implements it on top of the symbols table and gives the stored
+// definitions back at startup so they can be replayed.
+class SymbolStore
+{
+public:
+    virtual ~SymbolStore() = default;
+
+    // Replaces any earlier definition of name. definition is accepted by define().
+    virtual void storeDefinition(std::string_view name, std::string_view definition) = 0;
+};
+
+#endif // SYMBOLSTORE_H
@@ -0,0 +1,115 @@
+#include "SymbolTable.h"
+#include <utility>
+#include "ExpressionGrammar.h"
+
+namespace
+{
+    constexpr size_t InitialBuckets = 16;
+
+    // 64-bit FNV-1a over the code units, which are all ASCII for a valid identifier.
+    template <typename CharT>
+    std::uint64_t hashName(std::basic_string_view<CharT> name)
+    {
+        std::uint64_t hash = 14695981039346656037ull;
+        for (const CharT c : name) {
+            hash = (hash ^ static_cast<std::uint64_t>(c)) * 1099511628211ull;
+        }
+        return hash;
+    }
+
+    template <typename CharT>
+    bool sameName(const std::string &stored, std::basic_string_view<CharT> name)
+    {
+        if (stored.size() != name.size()) return false;
+        for (size_t i = 0; i < name.size(); ++i) {
+            if (static_cast<CharT>(stored[i]) != name[i]) return false;
+        }
+        return true;
+    }
+}
+
+SymbolTable::SymbolTable()
+    : m_buckets(InitialBuckets, -1)
+{
+    for (const ExpressionGrammar::Constant &constant : ExpressionGrammar::BuiltinConstants) {
+        defineConstant(constant.name, constant.value);
+    }
+}
+
+template <typename CharT>
+int SymbolTable::find(std::basic_string_view<CharT> name) const
+{
+    const size_t mask = m_buckets.size() - 1;
+    const std::uint64_t hash = hashName(name);
+    for (size_t bucket = static_cast<size_t>(hash) & mask;; bucket = (bucket + 1) & mask) {
+        const std::int32_t slot = m_buckets[bucket];
+        if (slot < 0) {
+            return -1;
+        }
+        const Symbol &symbol = m_symbols[static_cast<size_t>(slot)];
+        if (symbol.hash == hash && sameName(symbol.name, name)) {
+            return slot;
+        }
+    }
+}
+
+template int SymbolTable::find(std::basic_string_view<char>) const;
+template int SymbolTable::find(std::basic_string_view<char16_t>) const;
+
+int SymbolTable::intern(std::string_view name)
+{
+    const int existing = find(name);
+    if (existing >= 0) {
+        return existing;
+    }
+    if ((m_symbols.size() + 1) * 2 > m_buckets.size()) {
+        grow();
+    }
+    const int slot = static_cast<int>(m_symbols.size());
+    const std::uint64_t hash = hashName(name);
+    m_symbols.push_back({ std::string(name), hash, Kind::Undefined, Function() });
+    m_values.push_back(0.0);
+    insertBucket(hash, slot);
+    return slot;
+}
+
+void SymbolTable::setVariable(int slot, double value)
+{
+    Symbol &symbol = m_symbols[static_cast<size_t>(slot)];
+    symbol.kind = Kind::Variable;
+    symbol.function = Function();
+    m_values[static_cast<size_t>(slot)] = value;
+}
+
+void SymbolTable::setFunction(int slot, Function function)
+{
+    Symbol &symbol = m_symbols[static_cast<size_t>(slot)];
+    symbol.kind = Kind::Function;
+    symbol.function = std::move(function);
+    m_values[static_cast<size_t>(slot)] = 0.0;
+}
+
+void SymbolTable::defineConstant(std::string_view name, double value)
+{
+    const int slot = intern(name);
+    m_symbols[static_cast<size_t>(slot)].kind = Kind::Constant;
+    m_values[static_cast<size_t>(slot)] = value;
+}
+
+void SymbolTable::insertBucket(std::uint64_t hash, int slot)
+{
+    const size_t mask = m_buckets.size() - 1;
+    size_t bucket = static_cast<size_t>(hash) & mask;
+    while (m_buckets[bucket] >= 0) {
+        bucket = (bucket + 1) & mask;
+    }
+    m_buckets[bucket] = slot;
+}
+
+void SymbolTable::grow()
+{
+    m_buckets.assign(m_buckets.size() * 2, -1);
+    for (size_t slot = 0; slot < m_symbols.size(); ++slot) {
+        insertBucket(m_symbols[slot].hash, static_cast<int>(slot));
+    }
+}
@@ -0,0 +1,72 @@
+#ifndef SYMBOLTABLE_H
+#define SYMBOLTABLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Names known to the expression engine: the built-in constants pi and e plus the
+// variables and functions defined through CalculatorCore::define(). Every name is
+// interned once and keeps its slot for the lifetime of the table, so the compiler can
+// resolve identifiers to slot indices and evaluation only ever indexes value(slot).
+//
+// Lookup is an open-addressing hash table with linear probing over slot indices, kept
+// at most half full. Names are never removed, so it needs no tombstones.
+class SymbolTable
+{
+public:
+    enum class Kind : std::uint8_t {
+        Undefined, // Interned but not bound, e.g. a function whose definition failed
+        Constant,  // Built in and read-only; folded into programs as a literal
+        Variable,
+        Function
+    };
+
+    struct Function
+    {
+        std::vector<std::string> parameters;
+        std::string body; // UTF-8 source, inlined at every call
+    };
+
+    SymbolTable();
+
+    // Slot of name, or -1 if it was never interned. Identifiers are ASCII, so a UTF-16
+    // spelling finds the same slot as the UTF-8 one.
+    template <typename CharT>
+    int find(std::basic_string_view<CharT> name) const;
+    // Slot of name, added as Undefined if it is new.
+    int intern(std::string_view name);
+
+    size_t size() const { return m_symbols.size(); }
+    const std::string &name(int slot) const { return m_symbols[static_cast<size_t>(slot)].name; }
+    Kind kind(int slot) const { return m_symbols[static_cast<size_t>(slot)].kind; }
+    double value(int slot) const { return m_values[static_cast<size_t>(slot)]; }
+    const Function &function(int slot) const { return m_symbols[static_cast<size_t>(slot)].function; }
+
+    void setVariable(int slot, double value);
+    void setFunction(int slot, Function function);
+
+private:
+    struct Symbol
+    {
+        std::string name;
+        std::uint64_t hash;
+        Kind kind;
+        Function function;
+    };
+
+    std::vector<Symbol> m_symbols;
+    std::vector<double> m_values;        // By slot, apart from the names so reading one stays cheap
+    std::vector<std::int32_t> m_buckets; // Slot or -1; the size is a power of two
+
+    void defineConstant(std::string_view name, double value);
+    void insertBucket(std::uint64_t hash, int slot);
+    void grow();
+};
+
+extern template int SymbolTable::find(std::basic_string_view<char>) const;
+extern template int SymbolTable::find(std::basic_string_view<char16_t>) const;
+
+#endif // SYMBOLTABLE_H
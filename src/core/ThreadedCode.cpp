@@ -0,0 +1,187 @@
+#include "ThreadedCode.h"
+#include "CompiledExpression.h"
+#include <cmath>
+
+namespace
+{
+    using Stack = ThreadedCode::Stack;
+    using Step = ThreadedCode::Step;
+
+    // Programs produced from typical input need only a handful of stack slots; deeper
+    // ones fall back to a heap buffer.
+    constexpr int InlineStackSize = 64;
+
+    // Where an operator finds an operand.
+    enum class Operand {
+        Stack,    // Pushed by earlier steps
+        Constant, // Step::constant
+        Variable  // values[Step::operand], or values[Step::operand2] for the second one
+    };
+
+    // Only these report errors; the other handlers need no check at all.
+    constexpr bool canFail(OpCode op)
+    {
+        return op == OpCode::Divide || op == OpCode::Modulo || op == OpCode::Sqrt;
+    }
+
+    Stack failed()
+    {
+        return { nullptr, NAN };
+    }
+
+    Stack pushConstant(const Step &step, Stack stack, const double *, CalcErrorCode &)
+    {
+        *++stack.below = stack.top;
+        stack.top = step.constant;
+        return stack;
+    }
+
+    Stack pushVariable(const Step &step, Stack stack, const double *values, CalcErrorCode &)
+    {
+        *++stack.below = stack.top;
+        stack.top = values[step.operand];
+        return stack;
+    }
+
+    template <OpCode Op>
+    Stack unary(const Step &, Stack stack, const double *, CalcErrorCode &status)
+    {
+        stack.top = ExpressionGrammar::applyUnary(Op, stack.top, status);
+        return canFail(Op) && status != CalcErrorCode::None ? failed() : stack;
+    }
+
+    Stack powInt(const Step &step, Stack stack, const double *, CalcErrorCode &)
+    {
+        stack.top = ExpressionGrammar::powInt(stack.top, static_cast<std::int32_t>(step.operand));
+        return stack;
+    }
+
+    // Lhs op Rhs. Operands taken from the stack are popped and the result is pushed, so
+    // with both operands fused the step is a push of "a op b".
+    template <OpCode Op, Operand Lhs, Operand Rhs>
+    Stack binary(const Step &step, Stack stack, const double *values, CalcErrorCode &status)
+    {
+        double lhs;
+        double rhs;
+        if constexpr (Lhs == Operand::Stack && Rhs == Operand::Stack) {
+            rhs = stack.top;
+            lhs = *stack.below--;
+        } else if constexpr (Lhs == Operand::Stack) {
+            lhs = stack.top;
+            rhs = Rhs == Operand::Constant ? step.constant : values[step.operand];
+        } else {
+            *++stack.below = stack.top;
+            lhs = Lhs == Operand::Constant ? step.constant : values[step.operand];
+            rhs = Rhs == Operand::Constant ? step.constant : values[Lhs == Operand::Variable ? step.operand2 : step.operand];
+        }
+        stack.top = ExpressionGrammar::applyBinary(Op, lhs, rhs, status);
+        return canFail(Op) && status != CalcErrorCode::None ? failed() : stack;
+    }
+
+    template <Operand Lhs, Operand Rhs>
+    ThreadedCode::Handler binaryHandler(OpCode op)
+    {
+        switch (op) {
+            case OpCode::Add:      return binary<OpCode::Add, Lhs, Rhs>;
+            case OpCode::Subtract: return binary<OpCode::Subtract, Lhs, Rhs>;
+            case OpCode::Multiply: return binary<OpCode::Multiply, Lhs, Rhs>;
+            case OpCode::Divide:   return binary<OpCode::Divide, Lhs, Rhs>;
+            case OpCode::Modulo:   return binary<OpCode::Modulo, Lhs, Rhs>;
+            default:               return binary<OpCode::Power, Lhs, Rhs>;
+        }
+    }
+
+    ThreadedCode::Handler unaryHandler(OpCode op)
+    {
+        switch (op) {
+            case OpCode::Negate:  return unary<OpCode::Negate>;
+            case OpCode::Sqrt:    return unary<OpCode::Sqrt>;
+            case OpCode::Percent: return unary<OpCode::Percent>;
+            case OpCode::Square:  return unary<OpCode::Square>;
+            default:              return powInt;
+        }
+    }
+
+    bool isPush(OpCode op)
+    {
+        return op == OpCode::PushConst || op == OpCode::PushVariable;
+    }
+}
+
+std::vector<ThreadedCode::Step> ThreadedCode::lower(const CompiledExpression &program)
+{
+    const std::vector<CompiledExpression::Instruction> &code = program.instructions();
+    const auto positionOf = [&](size_t i) { return static_cast<std::uint32_t>(program.sourcePosition(i)); };
+
+    std::vector<Step> steps;
+    steps.reserve(code.size());
+    for (size_t i = 0; i < code.size(); ++i) {
+        const CompiledExpression::Instruction &instruction = code[i];
+        Step step = { nullptr, 0.0, instruction.operand, 0, positionOf(i) };
+        if (instruction.op == OpCode::PushConst) {
+            step.constant = program.constants()[instruction.operand];
+        }
+
+        // Pushes are fused into the operator that consumes them: "a * b" and "x + 1" are
+        // one step each. Two constants never meet here, the optimizer folds them.
+        if (isPush(instruction.op) && i + 2 < code.size() && isPush(code[i + 1].op)
+            && ExpressionGrammar::isBinary(code[i + 2].op)
+            && !(instruction.op == OpCode::PushConst && code[i + 1].op == OpCode::PushConst)) {
+            const CompiledExpression::Instruction &second = code[i + 1];
+            const OpCode op = code[i + 2].op;
+            step.position = positionOf(i + 2);
+            if (instruction.op == OpCode::PushVariable && second.op == OpCode::PushVariable) {
+                step.operand2 = second.operand;
+                step.handler = binaryHandler<Operand::Variable, Operand::Variable>(op);
+            } else if (instruction.op == OpCode::PushVariable) {
+                step.constant = program.constants()[second.operand];
+                step.handler = binaryHandler<Operand::Variable, Operand::Constant>(op);
+            } else {
+                step.operand = second.operand;
+                step.handler = binaryHandler<Operand::Constant, Operand::Variable>(op);
+            }
+            i += 2;
+        } else if (isPush(instruction.op) && i + 1 < code.size() && ExpressionGrammar::isBinary(code[i + 1].op)) {
+            step.position = positionOf(++i);
+            step.handler = instruction.op == OpCode::PushConst
+                               ? binaryHandler<Operand::Stack, Operand::Constant>(code[i].op)
+                               : binaryHandler<Operand::Stack, Operand::Variable>(code[i].op);
+        } else if (instruction.op == OpCode::PushConst) {
+            step.handler = pushConstant;
+        } else if (instruction.op == OpCode::PushVariable) {
+            step.handler = pushVariable;
+        } else if (ExpressionGrammar::isBinary(instruction.op)) {
+            step.handler = binaryHandler<Operand::Stack, Operand::Stack>(instruction.op);
+        } else {
+            step.handler = unaryHandler(instruction.op);
+        }
+        steps.push_back(step);
+    }
+    return steps;
+}
+
+double ThreadedCode::run(const std::vector<Step> &steps, int maxStackDepth, const double *values, CalcError *error)
+{
+    double inlineStack[InlineStackSize];
+    std::vector<double> heapStack;
+    double *stack = inlineStack;
+    // One slot more than the program needs: the first push spills the still undefined
+    // top into slot 0.
+    if (maxStackDepth + 1 > InlineStackSize) {
+        heapStack.resize(static_cast<size_t>(maxStackDepth) + 1);
+        stack = heapStack.data();
+    }
+
+    CalcErrorCode status = CalcErrorCode::None;
+    Stack state = { stack, 0.0 };
+    for (const Step &step : steps) {
+        state = step.handler(step, state, values, status);
+        if (!state.below) {
+            if (error) *error = { status, static_cast<int>(step.position) };
+            return NAN;
+        }
+    }
+
+    if (error) *error = CalcError();
+    return state.top;
+}
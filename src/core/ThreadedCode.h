@@ -0,0 +1,46 @@
+#ifndef THREADEDCODE_H
+#define THREADEDCODE_H
+
+#include <cstdint>
+#include <vector>
+#include "ExpressionGrammar.h"
+
+class CompiledExpression;
+
+// Execution backend that runs a program as call-threaded code: every step holds a
+// pointer straight to its handler, so evaluation is a loop of indirect calls with no
+// opcode switch. Handlers are template instances per operator and per operand kind, and
+// a push directly followed by a binary operator becomes one step that reads its right
+// operand from the step itself ("x * 2") or from the variable array ("a + b"), which
+// removes most stack traffic. Operator semantics come from ExpressionGrammar, so results
+// and errors are the same as the interpreter's.
+class ThreadedCode
+{
+public:
+    // The evaluation stack with its top element cached apart from the rest, so a chain
+    // of operations passes its running value in a register instead of through memory.
+    struct Stack
+    {
+        double *below; // Highest element under the top; null once a step has failed
+        double top;
+    };
+
+    struct Step;
+    using Handler = Stack (*)(const Step &step, Stack stack, const double *values, CalcErrorCode &status);
+
+    struct Step
+    {
+        Handler handler;
+        double constant;        // Fused constant operand
+        std::uint32_t operand;  // Variable index, or the exponent of PowInt
+        std::uint32_t operand2; // Second variable index of a fused "a op b"
+        std::uint32_t position; // Source position reported if this step fails
+    };
+
+    static std::vector<Step> lower(const CompiledExpression &program);
+
+    // Runs steps produced by lower(); values and error as for CompiledExpression::evaluate().
+    static double run(const std::vector<Step> &steps, int maxStackDepth, const double *values, CalcError *error);
+};
+
+#endif // THREADEDCODE_H
@@ -0,0 +1,366 @@
+#include "VectorEvaluator.h"
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#if (defined(__x86_64__) || defined(_M_X64)) && (defined(__GNUC__) || defined(__clang__))
+#define CALC_X86_KERNELS 1
+#include <immintrin.h>
+#define CALC_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace
+{
+    // Per-block operations. Every kernel works in place on the left operand and, where an
+    // operation can fail, marks rows whose error slot is still None, so each row keeps
+    // the first error in program order, just like the scalar interpreter.
+    struct Kernels
+    {
+        const char *name;
+        void (*add)(double *lhs, const double *rhs, size_t count);
+        void (*subtract)(double *lhs, const double *rhs, size_t count);
+        void (*multiply)(double *lhs, const double *rhs, size_t count);
+        void (*divide)(double *lhs, const double *rhs, CalcErrorCode *errors, size_t count);
+        void (*negate)(double *values, size_t count);
+        void (*percent)(double *values, size_t count);
+        void (*squareRoot)(double *values, CalcErrorCode *errors, size_t count);
+    };
+
+    inline void markError(CalcErrorCode *errors, size_t row, CalcErrorCode code)
+    {
+        if (errors[row] == CalcErrorCode::None) errors[row] = code;
+    }
+
+    // ---- Portable kernels, built on the shared operator table ----------------------
+
+    void binaryScalar(OpCode op, double *lhs, const double *rhs, CalcErrorCode *errors, size_t begin, size_t count)
+    {
+        for (size_t i = begin; i < count; ++i) {
+            CalcErrorCode status = CalcErrorCode::None;
+            lhs[i] = ExpressionGrammar::applyBinary(op, lhs[i], rhs[i], status);
+            if (status != CalcErrorCode::None) markError(errors, i, status);
+        }
+    }
+
+    void unaryScalar(OpCode op, double *values, CalcErrorCode *errors, size_t begin, size_t count)
+    {
+        for (size_t i = begin; i < count; ++i) {
+            CalcErrorCode status = CalcErrorCode::None;
+            values[i] = ExpressionGrammar::applyUnary(op, values[i], status);
+            if (status != CalcErrorCode::None) markError(errors, i, status);
+        }
+    }
+
+    void addScalar(double *lhs, const double *rhs, size_t count)
+    {
+        for (size_t i = 0; i < count; ++i) lhs[i] += rhs[i];
+    }
+
+    void subtractScalar(double *lhs, const double *rhs, size_t count)
+    {
+        for (size_t i = 0; i < count; ++i) lhs[i] -= rhs[i];
+    }
+
+    void multiplyScalar(double *lhs, const double *rhs, size_t count)
+    {
+        for (size_t i = 0; i < count; ++i) lhs[i] *= rhs[i];
+    }
+
+    void divideScalar(double *lhs, const double *rhs, CalcErrorCode *errors, size_t count)
+    {
+        binaryScalar(OpCode::Divide, lhs, rhs, errors, 0, count);
+    }
+
+    void negateScalar(double *values, size_t count)
+    {
+        for (size_t i = 0; i < count; ++i) values[i] = -values[i];
+    }
+
+    void percentScalar(double *values, size_t count)
+    {
+        for (size_t i = 0; i < count; ++i) values[i] /= 100.0;
+    }
+
+    void squareRootScalar(double *values, CalcErrorCode *errors, size_t count)
+    {
+        unaryScalar(OpCode::Sqrt, values, errors, 0, count);
+    }
+
+    constexpr Kernels ScalarKernels = {
+        "scalar", addScalar, subtractScalar, multiplyScalar, divideScalar, negateScalar, percentScalar, squareRootScalar
+    };
+
+#ifdef CALC_X86_KERNELS
+    // ---- SSE2: part of the x86-64 baseline, always available -------------------------
+
+    void addSse2(double *lhs, const double *rhs, size_t count)
+    {
+        size_t i = 0;
+        for (; i + 2 <= count; i += 2) {
+            _mm_storeu_pd(lhs + i, _mm_add_pd(_mm_loadu_pd(lhs + i), _mm_loadu_pd(rhs + i)));
+        }
+        for (; i < count; ++i) lhs[i] += rhs[i];
+    }
+
+    void subtractSse2(double *lhs, const double *rhs, size_t count)
+    {
+        size_t i = 0;
+        for (; i + 2 <= count; i += 2) {
+            _mm_storeu_pd(lhs + i, _mm_sub_pd(_mm_loadu_pd(lhs + i), _mm_loadu_pd(rhs + i)));
+        }
+        for (; i < count; ++i) lhs[i] -= rhs[i];
+    }
+
+    void multiplySse2(double *lhs, const double *rhs, size_t count)
+    {
+        size_t i = 0;
+        for (; i + 2 <= count; i += 2) {
+            _mm_storeu_pd(lhs + i, _mm_mul_pd(_mm_loadu_pd(lhs + i), _mm_loadu_pd(rhs + i)));
+        }
+        for (; i < count; ++i) lhs[i] *= rhs[i];
+    }
+
+    void divideSse2(double *lhs, const double *rhs, CalcErrorCode *errors, size_t count)
+    {
+        const __m128d zero = _mm_setzero_pd();
+        const __m128d nan = _mm_set1_pd(NAN);
+        size_t i = 0;
+        for (; i + 2 <= count; i += 2) {
+            const __m128d divisor = _mm_loadu_pd(rhs + i);
+            const __m128d isZero = _mm_cmpeq_pd(divisor, zero);
+            const __m128d quotient = _mm_div_pd(_mm_loadu_pd(lhs + i), divisor);
+            _mm_storeu_pd(lhs + i, _mm_or_pd(_mm_andnot_pd(isZero, quotient), _mm_and_pd(isZero, nan)));
+            if (const int lanes = _mm_movemask_pd(isZero)) {
+                if (lanes & 1) markError(errors, i, CalcErrorCode::DivisionByZero);
+                if (lanes & 2) markError(errors, i + 1, CalcErrorCode::DivisionByZero);
+            }
+        }
+        binaryScalar(OpCode::Divide, lhs, rhs, errors, i, count);
+    }
+
+    void negateSse2(double *values, size_t count)
+    {
+        const __m128d sign = _mm_set1_pd(-0.0);
+        size_t i = 0;
+        for (; i + 2 <= count; i += 2) {
+            _mm_storeu_pd(values + i, _mm_xor_pd(_mm_loadu_pd(values + i), sign));
+        }
+        for (; i < count; ++i) values[i] = -values[i];
+    }
+
+    void percentSse2(double *values, size_t count)
+    {
+        const __m128d hundred = _mm_set1_pd(100.0);
+        size_t i = 0;
+        for (; i + 2 <= count; i += 2) {
+            _mm_storeu_pd(values + i, _mm_div_pd(_mm_loadu_pd(values + i), hundred));
+        }
+        for (; i < count; ++i) values[i] /= 100.0;
+    }
+
+    void squareRootSse2(double *values, CalcErrorCode *errors, size_t count)
+    {
+        const __m128d zero = _mm_setzero_pd();
+        const __m128d nan = _mm_set1_pd(NAN);
+        size_t i = 0;
+        for (; i + 2 <= count; i += 2) {
+            const __m128d value = _mm_loadu_pd(values + i);
+            const __m128d isNegative = _mm_cmplt_pd(value, zero);
+            const __m128d root = _mm_sqrt_pd(value);
+            _mm_storeu_pd(values + i, _mm_or_pd(_mm_andnot_pd(isNegative, root), _mm_and_pd(isNegative, nan)));
+            if (const int lanes = _mm_movemask_pd(isNegative)) {
+                if (lanes & 1) markError(errors, i, CalcErrorCode::NegativeSquareRoot);
+                if (lanes & 2) markError(errors, i + 1, CalcErrorCode::NegativeSquareRoot);
+            }
+        }
+        unaryScalar(OpCode::Sqrt, values, errors, i, count);
+    }
+
+    constexpr Kernels Sse2Kernels = {
+        "sse2", addSse2, subtractSse2, multiplySse2, divideSse2, negateSse2, percentSse2, squareRootSse2
+    };
+
+    // ---- AVX2: only called after the CPU reported support ----------------------------
+
+    CALC_TARGET_AVX2 void addAvx2(double *lhs, const double *rhs, size_t count)
+    {
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4) {
+            _mm256_storeu_pd(lhs + i, _mm256_add_pd(_mm256_loadu_pd(lhs + i), _mm256_loadu_pd(rhs + i)));
+        }
+        for (; i < count; ++i) lhs[i] += rhs[i];
+    }
+
+    CALC_TARGET_AVX2 void subtractAvx2(double *lhs, const double *rhs, size_t count)
+    {
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4) {
+            _mm256_storeu_pd(lhs + i, _mm256_sub_pd(_mm256_loadu_pd(lhs + i), _mm256_loadu_pd(rhs + i)));
+        }
+        for (; i < count; ++i) lhs[i] -= rhs[i];
+    }
+
+    CALC_TARGET_AVX2 void multiplyAvx2(double *lhs, const double *rhs, size_t count)
+    {
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4) {
+            _mm256_storeu_pd(lhs + i, _mm256_mul_pd(_mm256_loadu_pd(lhs + i), _mm256_loadu_pd(rhs + i)));
+        }
+        for (; i < count; ++i) lhs[i] *= rhs[i];
+    }
+
+    CALC_TARGET_AVX2 void divideAvx2(double *lhs, const double *rhs, CalcErrorCode *errors, size_t count)
+    {
+        const __m256d zero = _mm256_setzero_pd();
+        const __m256d nan = _mm256_set1_pd(NAN);
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4) {
+            const __m256d divisor = _mm256_loadu_pd(rhs + i);
+            const __m256d isZero = _mm256_cmp_pd(divisor, zero, _CMP_EQ_OQ);
+            const __m256d quotient = _mm256_div_pd(_mm256_loadu_pd(lhs + i), divisor);
+            _mm256_storeu_pd(lhs + i, _mm256_blendv_pd(quotient, nan, isZero));
+            if (int lanes = _mm256_movemask_pd(isZero)) {
+                for (size_t lane = 0; lanes; ++lane, lanes >>= 1) {
+                    if (lanes & 1) markError(errors, i + lane, CalcErrorCode::DivisionByZero);
+                }
+            }
+        }
+        binaryScalar(OpCode::Divide, lhs, rhs, errors, i, count);
+    }
+
+    CALC_TARGET_AVX2 void negateAvx2(double *values, size_t count)
+    {
+        const __m256d sign = _mm256_set1_pd(-0.0);
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4) {
+            _mm256_storeu_pd(values + i, _mm256_xor_pd(_mm256_loadu_pd(values + i), sign));
+        }
+        for (; i < count; ++i) values[i] = -values[i];
+    }
+
+    CALC_TARGET_AVX2 void percentAvx2(double *values, size_t count)
+    {
+        const __m256d hundred = _mm256_set1_pd(100.0);
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4) {
+            _mm256_storeu_pd(values + i, _mm256_div_pd(_mm256_loadu_pd(values + i), hundred));
+        }
+        for (; i < count; ++i) values[i] /= 100.0;
+    }
+
+    CALC_TARGET_AVX2 void squareRootAvx2(double *values, CalcErrorCode *errors, size_t count)
+    {
+        const __m256d zero = _mm256_setzero_pd();
+        const __m256d nan = _mm256_set1_pd(NAN);
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4) {
+            const __m256d value = _mm256_loadu_pd(values + i);
+            const __m256d isNegative = _mm256_cmp_pd(value, zero, _CMP_LT_OQ);
+            _mm256_storeu_pd(values + i, _mm256_blendv_pd(_mm256_sqrt_pd(value), nan, isNegative));
+            if (int lanes = _mm256_movemask_pd(isNegative)) {
+                for (size_t lane = 0; lanes; ++lane, lanes >>= 1) {
+                    if (lanes & 1) markError(errors, i + lane, CalcErrorCode::NegativeSquareRoot);
+                }
+            }
+        }
+        unaryScalar(OpCode::Sqrt, values, errors, i, count);
+    }
+
+    constexpr Kernels Avx2Kernels = {
+        "avx2", addAvx2, subtractAvx2, multiplyAvx2, divideAvx2, negateAvx2, percentAvx2, squareRootAvx2
+    };
+#endif
+
+    const Kernels &selectKernels()
+    {
+#ifdef CALC_X86_KERNELS
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            return Avx2Kernels;
+        }
+        return Sse2Kernels;
+#else
+        return ScalarKernels;
+#endif
+    }
+
+    const Kernels &kernels()
+    {
+        static const Kernels &selected = selectKernels();
+        return selected;
+    }
+}
+
+const char *VectorEvaluator::instructionSet()
+{
+    return kernels().name;
+}
+
+size_t VectorEvaluator::evaluate(const CompiledExpression &program, const double *const *columns, size_t rows,
+                                 double *results, CalcErrorCode *rowErrors)
+{
+    if (program.isEmpty()) {
+        std::fill(results, results + rows, NAN);
+        if (rowErrors) std::fill(rowErrors, rowErrors + rows, CalcErrorCode::EmptyExpression);
+        return rows;
+    }
+
+    const Kernels &k = kernels();
+    const std::vector<CompiledExpression::Instruction> &code = program.instructions();
+    const double *constants = program.constants().data();
+
+    // One block-sized slot per stack level; slot 0 ends up holding the results.
+    std::vector<double> stack(static_cast<size_t>(std::max(program.maxStackDepth(), 1)) * BlockRows);
+    CalcErrorCode errors[BlockRows];
+    size_t failures = 0;
+
+    for (size_t start = 0; start < rows; start += BlockRows) {
+        const size_t count = std::min(BlockRows, rows - start);
+        std::fill(errors, errors + count, CalcErrorCode::None);
+
+        double *top = stack.data() - BlockRows;
+        for (const CompiledExpression::Instruction &instruction : code) {
+            switch (instruction.op) {
+                case OpCode::PushConst:
+                    top += BlockRows;
+                    std::fill(top, top + count, constants[instruction.operand]);
+                    break;
+                case OpCode::PushVariable:
+                    top += BlockRows;
+                    std::memcpy(top, columns[instruction.operand] + start, count * sizeof(double));
+                    break;
+                case OpCode::Negate:   k.negate(top, count); break;
+                case OpCode::Percent:  k.percent(top, count); break;
+                case OpCode::Sqrt:     k.squareRoot(top, errors, count); break;
+                case OpCode::Square:   k.multiply(top, top, count); break;
+                case OpCode::PowInt: {
+                    const int exponent = static_cast<std::int32_t>(instruction.operand);
+                    for (size_t i = 0; i < count; ++i) top[i] = ExpressionGrammar::powInt(top[i], exponent);
+                    break;
+                }
+                case OpCode::Add:      top -= BlockRows; k.add(top, top + BlockRows, count); break;
+                case OpCode::Subtract: top -= BlockRows; k.subtract(top, top + BlockRows, count); break;
+                case OpCode::Multiply: top -= BlockRows; k.multiply(top, top + BlockRows, count); break;
+                case OpCode::Divide:   top -= BlockRows; k.divide(top, top + BlockRows, errors, count); break;
+                case OpCode::Modulo:
+                case OpCode::Power:
+                    // No vector libm to lean on; these stay element-wise.
+                    top -= BlockRows;
+                    binaryScalar(instruction.op, top, top + BlockRows, errors, 0, count);
+                    break;
+            }
+        }
+
+        double *out = results + start;
+        std::memcpy(out, stack.data(), count * sizeof(double));
+        for (size_t i = 0; i < count; ++i) {
+            // Later operations may have turned NaN back into a number (pow(NaN, 0) == 1).
+            if (errors[i] != CalcErrorCode::None) {
+                out[i] = NAN;
+                ++failures;
+            }
+        }
+        if (rowErrors) std::memcpy(rowErrors + start, errors, count * sizeof(CalcErrorCode));
+    }
+    return failures;
+}
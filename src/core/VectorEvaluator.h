@@ -0,0 +1,30 @@
+#ifndef VECTOREVALUATOR_H
+#define VECTOREVALUATOR_H
+
+#include <cstddef>
+#include "CompiledExpression.h"
+
+// Runs one compiled program over many rows of variable values at once. Input is
+// struct-of-arrays (one contiguous column per variable) and rows are processed in blocks
+// of BlockRows: every instruction is applied to a whole block before moving on, so each
+// step is a tight loop over contiguous doubles executed with AVX2 or SSE2 kernels,
+// picked once at runtime from what the CPU supports, or plain C++ elsewhere.
+//
+// Rows fail independently. A failing row yields NaN and the code of the first error the
+// scalar interpreter would have hit for it.
+class VectorEvaluator
+{
+public:
+    static constexpr size_t BlockRows = 256;
+
+    // columns[i] holds rows values of program.variables()[i]; results receives rows
+    // values. rowErrors, if given, receives CalcErrorCode::None or the failure of each
+    // row. Returns the number of rows that failed.
+    static size_t evaluate(const CompiledExpression &program, const double *const *columns, size_t rows,
+                           double *results, CalcErrorCode *rowErrors = nullptr);
+
+    // Name of the kernel set in use: "avx2", "sse2" or "scalar".
+    static const char *instructionSet();
+};
+
+#endif // VECTOREVALUATOR_H
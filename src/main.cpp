@@ -1,10 +1,107 @@
 #include <QApplication>
+#include <QCoreApplication>
+#include <cstdio>
+#include <cstring>
+#include "cli/BatchRunner.h"
+#include "cli/CalcService.h"
+#include "cli/HistoryTool.h"
+#include "core/LatencyStats.h"
 #include "ui/MainWindow.h"
 
+namespace {
+
+// --stats: collect latency statistics and print them to standard error on exit.
+bool statsRequested(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--stats") == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// --history-store columnar: keep the window's history in the memory-mapped columnar file
+// instead of the SQLite database.
+HistoryBackend historyBackendRequested(int argc, char *argv[])
+{
+    for (int i = 1; i + 1 < argc; ++i) {
+        if (std::strcmp(argv[i], "--history-store") == 0 && std::strcmp(argv[i + 1], "columnar") == 0) {
+            return HistoryBackend::Columnar;
+        }
+    }
+    return HistoryBackend::Sqlite;
+}
+
+int printStats(int exitCode)
+{
+    std::fputs(LatencyStats::report().c_str(), stderr);
+    return exitCode;
+}
+
+} // namespace
+
 int main(int argc, char *argv[])
 {
-    QApplication a(argc, argv);
-    MainWindow w;
-    w.show();
-    return a.exec();
+    const bool stats = statsRequested(argc, argv);
+    LatencyStats::setEnabled(stats);
+
+    // Headless modes are handled before any Qt application object exists. The service
+    // comes first since it shares --threads with batch mode.
+    CalcService::Options serviceOptions;
+    std::string serviceError;
+    if (CalcService::parseArguments(argc, argv, &serviceOptions, &serviceError)) {
+        if (!serviceError.empty()) {
+            std::fprintf(stderr, "CalcPlusPlus: %s\n", serviceError.c_str());
+            return CalcService::UsageError;
+        }
+        int exitCode = 0;
+        {
+            CalcService service(serviceOptions);
+            exitCode = service.run();
+        }
+        return stats ? printStats(exitCode) : exitCode;
+    }
+
+    BatchRunner::Options batchOptions;
+    std::string batchError;
+    if (BatchRunner::parseArguments(argc, argv, &batchOptions, &batchError)) {
+        if (!batchError.empty()) {
+            std::fprintf(stderr, "CalcPlusPlus: %s\n", batchError.c_str());
+            return BatchRunner::UsageOrIoError;
+        }
+        const int exitCode = BatchRunner(batchOptions).run();
+        return stats ? printStats(exitCode) : exitCode;
+    }
+
+    // History export and import only need the SQL driver, not a window.
+    HistoryTool::Options historyOptions;
+    std::string historyError;
+    if (HistoryTool::parseArguments(argc, argv, &historyOptions, &historyError)) {
+        if (!historyError.empty()) {
+            std::fprintf(stderr, "CalcPlusPlus: %s\n", historyError.c_str());
+            return HistoryTool::UsageError;
+        }
+        int exitCode = 0;
+        {
+            QCoreApplication a(argc, argv);
+            exitCode = HistoryTool(historyOptions).run();
+        }
+        return stats ? printStats(exitCode) : exitCode;
+    }
+
+    HistoryRetention retention;
+    if (!HistoryTool::parseRetention(argc, argv, &retention, &historyError)) {
+        std::fprintf(stderr, "CalcPlusPlus: %s\n", historyError.c_str());
+        return HistoryTool::UsageError;
+    }
+
+    int exitCode = 0;
+    {
+        QApplication a(argc, argv);
+        MainWindow w(historyBackendRequested(argc, argv), retention);
+        w.show();
+        exitCode = a.exec();
+    }
+    return stats ? printStats(exitCode) : exitCode;
 }
@@ -0,0 +1,62 @@
+#include "HistoryItemDelegate.h"
+#include "HistoryModel.h"
+#include <QFontMetrics>
+#include <QPainter>
+
+namespace
+{
+    const int Padding = 5;     // Inside a row
+    const int LineSpacing = 2; // Between expression and result
+    const int RowSpacing = 5;  // Below each row
+    const qreal CornerRadius = 8.0;
+}
+
+HistoryItemDelegate::HistoryItemDelegate(QObject *parent)
+    : QStyledItemDelegate(parent)
+{
+    expressionFont.setPixelSize(14);
+    resultFont.setPixelSize(18);
+    resultFont.setBold(true);
+}
+
+void HistoryItemDelegate::paint(QPainter *painter, const QStyleOptionViewItem &option, const QModelIndex &index) const
+{
+    painter->save();
+    painter->setRenderHint(QPainter::Antialiasing);
+
+    const QRect row = option.rect.adjusted(0, 0, 0, -RowSpacing);
+    if (option.state & (QStyle::State_Selected | QStyle::State_MouseOver)) {
+        painter->setPen(Qt::NoPen);
+        painter->setBrush(QColor(option.state & QStyle::State_Selected ? "#555555" : "#444444"));
+        painter->drawRoundedRect(row, CornerRadius, CornerRadius);
+    }
+
+    const QRect content = row.adjusted(Padding, Padding, -Padding, -Padding);
+    const QFontMetrics expressionMetrics(expressionFont);
+    const QFontMetrics resultMetrics(resultFont);
+
+    // Long expressions keep their end, which is the part closest to the result.
+    QRect line(content.left(), content.top(), content.width(), expressionMetrics.height());
+    painter->setFont(expressionFont);
+    painter->setPen(QColor("#BBBBBB"));
+    painter->drawText(line, Qt::AlignRight | Qt::AlignVCenter,
+                      expressionMetrics.elidedText(index.data(HistoryModel::ExpressionRole).toString(),
+                                                   Qt::ElideLeft, line.width()));
+
+    line = QRect(content.left(), line.bottom() + 1 + LineSpacing, content.width(), resultMetrics.height());
+    painter->setFont(resultFont);
+    painter->setPen(QColor("#EEEEEE"));
+    painter->drawText(line, Qt::AlignRight | Qt::AlignVCenter,
+                      resultMetrics.elidedText(index.data(HistoryModel::ResultRole).toString(),
+                                               Qt::ElideRight, line.width()));
+
+    painter->restore();
+}
+
+QSize HistoryItemDelegate::sizeHint(const QStyleOptionViewItem &option, const QModelIndex &index) const
+{
+    Q_UNUSED(index);
+    const int height = 2 * Padding + QFontMetrics(expressionFont).height() + LineSpacing
+                       + QFontMetrics(resultFont).height() + RowSpacing;
+    return QSize(option.rect.width(), height);
+}
@@ -0,0 +1,25 @@
+#ifndef HISTORYITEMDELEGATE_H
+#define HISTORYITEMDELEGATE_H
+
+#include <QFont>
+#include <QStyledItemDelegate>
+
+// Paints a history row (expression above, result below, both right-aligned) straight
+// onto the view, so rows cost no widgets, layouts or style sheets and every row has the
+// same height, which lets the view skip measuring them.
+class HistoryItemDelegate : public QStyledItemDelegate
+{
+    Q_OBJECT
+
+public:
+    explicit HistoryItemDelegate(QObject *parent = nullptr);
+
+    void paint(QPainter *painter, const QStyleOptionViewItem &option, const QModelIndex &index) const override;
+    QSize sizeHint(const QStyleOptionViewItem &option, const QModelIndex &index) const override;
+
+private:
+    QFont expressionFont;
+    QFont resultFont;
+};
+
+#endif // HISTORYITEMDELEGATE_H
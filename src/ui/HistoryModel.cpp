@@ -0,0 +1,214 @@
+#include "HistoryModel.h"
+
+HistoryModel::HistoryModel(HistoryStore *store, QObject *parent)
+    : QAbstractListModel(parent),
+      store(store),
+      pages(MaxCachedPages)
+{
+    connect(store, &HistoryStore::historySearchFinished, this, &HistoryModel::searchFinished);
+    connect(store, &HistoryStore::historyPruned, this, &HistoryModel::dropEntriesBefore);
+}
+
+int HistoryModel::rowCount(const QModelIndex &parent) const
+{
+    if (parent.isValid()) {
+        return 0;
+    }
+    return searching ? searchResults.size() : sessionEntries.size() + storedRows;
+}
+
+QVariant HistoryModel::data(const QModelIndex &index, int role) const
+{
+    const HistoryEntry *entry = index.isValid() ? entryAt(index.row()) : nullptr;
+    if (!entry) {
+        return QVariant();
+    }
+
+    switch (role) {
+        case Qt::DisplayRole:
+            return entry->expression + " = " + entry->result;
+        case ExpressionRole:
+            return entry->expression;
+        case ResultRole:
+            return entry->result;
+        default:
+            return QVariant();
+    }
+}
+
+bool HistoryModel::canFetchMore(const QModelIndex &parent) const
+{
+    return !parent.isValid() && !exhausted && searchGeneration == 0;
+}
+
+void HistoryModel::fetchMore(const QModelIndex &parent)
+{
+    if (parent.isValid() || exhausted) {
+        return;
+    }
+    if (searching) {
+        if (searchGeneration == 0) {
+            const qint64 beforeId = searchResults.isEmpty() ? 0 : searchResults.last().id;
+            searchGeneration = store->searchHistory(search, beforeId, PageSize);
+            exhausted = searchGeneration == 0;
+        }
+        return;
+    }
+
+    const Page page = store->fetchHistoryPage(nextPageKey, PageSize);
+    if (page.size() < PageSize) {
+        exhausted = true;
+    }
+    if (page.isEmpty()) {
+        return;
+    }
+
+    // Pin the first page below its newest id, so re-fetching it later does not pick up
+    // entries added in the meantime (those are shown from sessionEntries instead).
+    pageKeys.append(pageKeys.isEmpty() ? page.first().id + 1 : nextPageKey);
+    nextPageKey = page.last().id;
+
+    const int first = rowCount();
+    beginInsertRows(QModelIndex(), first, first + page.size() - 1);
+    storedRows += page.size();
+    pages.insert(pageKeys.size() - 1, new Page(page));
+    endInsertRows();
+}
+
+void HistoryModel::prependEntry(const QString &expression, const QString &result)
+{
+    if (searching) {
+        return; // Listed once the search is cleared, which reloads from the store
+    }
+    beginInsertRows(QModelIndex(), 0, 0);
+    sessionEntries.append({ 0, QString(), expression, result });
+    endInsertRows();
+}
+
+void HistoryModel::reload()
+{
+    beginResetModel();
+    searching = false;
+    search = HistorySearch();
+    searchResults.clear();
+    searchGeneration = 0;
+    sessionEntries.clear();
+    pageKeys.clear();
+    nextPageKey = 0;
+    storedRows = 0;
+    exhausted = false;
+    pages.clear();
+    endResetModel();
+}
+
+void HistoryModel::setSearch(const HistorySearch &newSearch)
+{
+    if (newSearch.isEmpty()) {
+        if (searching) {
+            reload();
+        }
+        return;
+    }
+
+    beginResetModel();
+    searching = true;
+    search = newSearch;
+    searchResults.clear();
+    searchGeneration = 0; // Any page still in flight belongs to the previous search
+    exhausted = false;
+    endResetModel();
+    fetchMore(QModelIndex());
+}
+
+void HistoryModel::searchFinished(quint64 generation, const QList<HistoryEntry> &page)
+{
+    if (!searching || generation != searchGeneration) {
+        return; // Answer to a search that has since been replaced
+    }
+    searchGeneration = 0;
+    if (page.size() < PageSize) {
+        exhausted = true;
+    }
+    if (!page.isEmpty()) {
+        beginInsertRows(QModelIndex(), searchResults.size(), searchResults.size() + page.size() - 1);
+        searchResults.append(page);
+        endInsertRows();
+    }
+}
+
+void HistoryModel::dropEntriesBefore(qint64 firstKeptId)
+{
+    if (searching) {
+        // Matches are newest first, so the removed ones are at the end.
+        int kept = searchResults.size();
+        while (kept > 0 && searchResults[kept - 1].id < firstKeptId) {
+            --kept;
+        }
+        if (kept < searchResults.size()) {
+            beginRemoveRows(QModelIndex(), kept, searchResults.size() - 1);
+            searchResults.resize(kept);
+            endRemoveRows();
+        }
+        return;
+    }
+
+    // Page i ends with the entry whose id is the key of page i + 1 (nextPageKey for the
+    // last page), so whole pages before the first one reaching below firstKeptId stay.
+    int keptPages = 0;
+    while (keptPages < pageKeys.size()) {
+        const qint64 oldestId = keptPages + 1 < pageKeys.size() ? pageKeys[keptPages + 1] : nextPageKey;
+        if (oldestId < firstKeptId) {
+            break;
+        }
+        ++keptPages;
+    }
+    if (keptPages == pageKeys.size()) {
+        return; // Nothing loaded was removed
+    }
+    // Fetched again, the page holds just the entries that remain.
+    const Page rest = store->fetchHistoryPage(pageKeys[keptPages], PageSize);
+    const int keptRows = keptPages * PageSize + rest.size();
+    const int pageCount = pageKeys.size();
+    if (keptRows >= storedRows) {
+        return;
+    }
+
+    beginRemoveRows(QModelIndex(), sessionEntries.size() + keptRows, sessionEntries.size() + storedRows - 1);
+    nextPageKey = rest.isEmpty() ? pageKeys[keptPages] : rest.last().id;
+    pageKeys.resize(rest.isEmpty() ? keptPages : keptPages + 1);
+    for (int i = keptPages; i < pageCount; ++i) {
+        pages.remove(i);
+    }
+    if (!rest.isEmpty()) {
+        pages.insert(keptPages, new Page(rest));
+    }
+    storedRows = keptRows;
+    exhausted = true; // Everything older is gone
+    endRemoveRows();
+}
+
+const HistoryEntry *HistoryModel::entryAt(int row) const
+{
+    if (row < 0) {
+        return nullptr;
+    }
+    if (searching) {
+        return row < searchResults.size() ? &searchResults[row] : nullptr;
+    }
+    if (row < sessionEntries.size()) {
+        return &sessionEntries[sessionEntries.size() - 1 - row];
+    }
+
+    const int storedRow = row - sessionEntries.size();
+    if (storedRow >= storedRows) {
+        return nullptr;
+    }
+    const int pageIndex = storedRow / PageSize;
+    Page *page = pages.object(pageIndex);
+    if (!page) {
+        page = new Page(store->fetchHistoryPage(pageKeys[pageIndex], PageSize));
+        pages.insert(pageIndex, page);
+    }
+    const int offset = storedRow % PageSize;
+    return offset < page->size() ? &page->at(offset) : nullptr;
+}
@@ -0,0 +1,70 @@
+#ifndef HISTORYMODEL_H
+#define HISTORYMODEL_H
+
+#include <QAbstractListModel>
+#include <QCache>
+#include <QList>
+#include "../core/HistoryStore.h"
+
+// List model over the stored history, newest entry first. Rows are fetched lazily one
+// page at a time as the view scrolls (canFetchMore/fetchMore), and only the most
+// recently used MaxCachedPages pages are kept in memory; an evicted page is fetched
+// again by its keyset position when it scrolls back into view. Memory use therefore
+// stays bounded no matter how far the user scrolls through the history.
+//
+// With a search set, the model lists matches instead. Their pages are requested from
+// HistoryStore::searchHistory() and appended when they arrive, so the GUI thread
+// never runs a search query.
+class HistoryModel : public QAbstractListModel
+{
+    Q_OBJECT
+
+public:
+    enum Roles {
+        ExpressionRole = Qt::UserRole + 1,
+        ResultRole
+    };
+
+    static constexpr int PageSize = HistoryStore::DefaultPageSize;
+    static constexpr int MaxCachedPages = 16;
+
+    explicit HistoryModel(HistoryStore *store, QObject *parent = nullptr);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    bool canFetchMore(const QModelIndex &parent) const override;
+    void fetchMore(const QModelIndex &parent) override;
+
+    // Shows an entry that was just added to the store at the top of the list.
+    void prependEntry(const QString &expression, const QString &result);
+    // Drops everything loaded and starts again from the newest stored entry.
+    void reload();
+    // Lists only entries matching search; an empty search lists the whole history again.
+    void setSearch(const HistorySearch &newSearch);
+
+private slots:
+    void searchFinished(quint64 generation, const QList<HistoryEntry> &page);
+    // Removes the rows of entries a retention limit deleted, which are the oldest ones,
+    // without resetting the view.
+    void dropEntriesBefore(qint64 firstKeptId);
+
+private:
+    using Page = QList<HistoryEntry>;
+
+    HistoryStore *store;
+    QList<HistoryEntry> sessionEntries; // Added since the last reload, oldest first
+    QList<qint64> pageKeys;             // beforeId of every page fetched so far
+    qint64 nextPageKey = 0;
+    int storedRows = 0;
+    bool exhausted = false;
+    mutable QCache<int, Page> pages;
+
+    bool searching = false;
+    HistorySearch search;
+    QList<HistoryEntry> searchResults;
+    quint64 searchGeneration = 0; // Of the page request in flight, 0 if none
+
+    const HistoryEntry *entryAt(int row) const;
+};
+
+#endif // HISTORYMODEL_H
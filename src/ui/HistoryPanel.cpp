@@ -1,9 +1,11 @@
 #include "HistoryPanel.h"
-#include "HistoryItemWidget.h" // Include the new header for HistoryItemWidget
-#include <QListWidgetItem>
+#include "HistoryItemDelegate.h"
+#include "HistoryModel.h"
+#include "../core/LatencyStats.h"
 
-HistoryPanel::HistoryPanel(QWidget *parent)
-    : QWidget(parent)
+HistoryPanel::HistoryPanel(HistoryStore *store, QWidget *parent)
+    : QWidget(parent),
+      historyModel(new HistoryModel(store, this))
 {
     setupUi();
     setupConnections();
@@ -20,12 +22,24 @@ void HistoryPanel::setupUi()
     mainLayout->setContentsMargins(0, 0, 0, 0);
     mainLayout->setSpacing(0);
 
-    // List Widget for history items
-    historyListWidget = new QListWidget(this);
-    historyListWidget->setAlternatingRowColors(false);
-    historyListWidget->setFrameShape(QFrame::NoFrame);
-    historyListWidget->setVerticalScrollMode(QAbstractItemView::ScrollPerPixel);
-    mainLayout->addWidget(historyListWidget);
+    // Search box; also understands result bounds such as ">100" or "1..5"
+    searchEdit = new QLineEdit(this);
+    searchEdit->setPlaceholderText("Search history (e.g. sqrt, >100, 1..5)");
+    searchEdit->setClearButtonEnabled(true);
+    mainLayout->addWidget(searchEdit);
+
+    // List view for history items; rows are painted by the delegate and all share one
+    // height, so the view never has to measure them.
+    historyListView = new QListView(this);
+    historyListView->setModel(historyModel);
+    historyListView->setItemDelegate(new HistoryItemDelegate(historyListView));
+    historyListView->setUniformItemSizes(true);
+    historyListView->setMouseTracking(true); // Hover highlight
+    historyListView->setAlternatingRowColors(false);
+    historyListView->setFrameShape(QFrame::NoFrame);
+    historyListView->setVerticalScrollMode(QAbstractItemView::ScrollPerPixel);
+    historyListView->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    mainLayout->addWidget(historyListView);
 
     // Clear History Button
     clearButton = new QPushButton("Clear History", this);
@@ -39,7 +53,8 @@ void HistoryPanel::setupUi()
 
 void HistoryPanel::setupConnections()
 {
-    connect(historyListWidget, &QListWidget::itemClicked, this, &HistoryPanel::on_historyListWidget_itemClicked);
+    connect(historyListView, &QListView::clicked, this, &HistoryPanel::on_historyListView_clicked);
+    connect(searchEdit, &QLineEdit::textChanged, this, &HistoryPanel::on_searchEdit_textChanged);
     connect(clearButton, &QPushButton::clicked, this, &HistoryPanel::clearHistoryRequested);
 }
 
@@ -47,37 +62,39 @@ void HistoryPanel::applyStyles()
 {
     setStyleSheet(
         "HistoryPanel { background-color: #222222; border-left: 1px solid #444444; }"
-        "QListWidget { background-color: #222222; border: none; padding: 8px; }"
-        "QListWidget::item { margin-bottom: 5px; }"
-        "QListWidget::item:hover { background-color: #444444; border-radius: 8px; }"
-        "QListWidget::item:selected { background-color: #555555; border-radius: 8px; }"
-        "QListWidget::item QLabel { background-color: transparent; }"
+        "QLineEdit { background-color: #333333; color: #EEEEEE; border: none; padding: 8px; font-size: 14px; }"
+        "QListView { background-color: #222222; border: none; padding: 8px; }"
     );
 }
 
 void HistoryPanel::addHistoryEntry(const QString &expression, const QString &result)
 {
-    QListWidgetItem *listItem = new QListWidgetItem(historyListWidget);
-    HistoryItemWidget *itemWidget = new HistoryItemWidget(expression, result, historyListWidget);
-
-    listItem->setSizeHint(itemWidget->sizeHint()); // Set size hint based on widget
-    historyListWidget->addItem(listItem);
-    historyListWidget->setItemWidget(listItem, itemWidget);
-    historyListWidget->scrollToBottom();
+    const LatencyStats::Scope timing(LatencyStats::PanelAddHistoryEntry);
+    historyModel->prependEntry(expression, result);
+    historyListView->scrollToTop();
 }
 
 void HistoryPanel::clearHistoryList()
 {
-    historyListWidget->clear();
+    searchEdit->clear();
+    historyModel->reload();
+}
+
+void HistoryPanel::reloadHistory()
+{
+    historyModel->reload();
+}
+
+void HistoryPanel::on_searchEdit_textChanged(const QString &text)
+{
+    historyModel->setSearch(HistorySearch::parse(text));
+    historyListView->scrollToTop();
 }
 
-void HistoryPanel::on_historyListWidget_itemClicked(QListWidgetItem *item)
+void HistoryPanel::on_historyListView_clicked(const QModelIndex &index)
 {
-    HistoryItemWidget *itemWidget = qobject_cast<HistoryItemWidget*>(historyListWidget->itemWidget(item));
-    if (itemWidget) {
-        // Use the public getters to retrieve data
-        QString expression = itemWidget->getExpression();
-        QString result = itemWidget->getResult();
-        emit historyItemSelected(expression, result);
+    if (index.isValid()) {
+        emit historyItemSelected(index.data(HistoryModel::ExpressionRole).toString(),
+                                 index.data(HistoryModel::ResultRole).toString());
     }
 }
@@ -2,32 +2,41 @@
 #define HISTORYPANEL_H
 
 #include <QWidget>
-#include <QListWidget>
+#include <QLineEdit>
+#include <QListView>
 #include <QLabel>
 #include <QPushButton>
 #include <QVBoxLayout>
 #include <QHBoxLayout>
 
+class HistoryStore;
+class HistoryModel;
+
 class HistoryPanel : public QWidget
 {
     Q_OBJECT
 
 public:
-    explicit HistoryPanel(QWidget *parent = nullptr);
+    explicit HistoryPanel(HistoryStore *store, QWidget *parent = nullptr);
     ~HistoryPanel();
 
     void addHistoryEntry(const QString &expression, const QString &result);
     void clearHistoryList();
+    // Re-reads the history from the store, e.g. once the database has been opened.
+    void reloadHistory();
 
 signals:
     void historyItemSelected(const QString &expression, const QString &result);
     void clearHistoryRequested();
 
 private slots:
-    void on_historyListWidget_itemClicked(QListWidgetItem *item);
+    void on_historyListView_clicked(const QModelIndex &index);
+    void on_searchEdit_textChanged(const QString &text);
 
 private:
-    QListWidget *historyListWidget;
+    QLineEdit *searchEdit;
+    QListView *historyListView;
+    HistoryModel *historyModel;
     QPushButton *clearButton; // Re-added the clear button
 
     void setupUi();
@@ -35,4 +44,4 @@ private:
     void applyStyles();
 };
 
-#endif // HISTORYPANEL_H
\ No newline at end of file
+#endif // HISTORYPANEL_H
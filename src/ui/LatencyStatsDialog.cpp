@@ -0,0 +1,69 @@
+#include "LatencyStatsDialog.h"
+#include "../core/LatencyStats.h"
+#include <QFontDatabase>
+#include <QHBoxLayout>
+#include <QVBoxLayout>
+
+LatencyStatsDialog::LatencyStatsDialog(QWidget *parent)
+    : QDialog(parent),
+      refreshTimer(new QTimer(this))
+{
+    setWindowTitle("Latency Statistics");
+    setAttribute(Qt::WA_DeleteOnClose);
+    setupUi();
+
+    refreshTimer->setInterval(1000);
+    connect(refreshTimer, &QTimer::timeout, this, &LatencyStatsDialog::refresh);
+    connect(enabledCheckBox, &QCheckBox::toggled, this, &LatencyStatsDialog::on_enabledCheckBox_toggled);
+    connect(resetButton, &QPushButton::clicked, this, &LatencyStatsDialog::on_resetButton_clicked);
+}
+
+void LatencyStatsDialog::setupUi()
+{
+    QVBoxLayout *mainLayout = new QVBoxLayout(this);
+
+    reportView = new QPlainTextEdit(this);
+    reportView->setReadOnly(true);
+    reportView->setLineWrapMode(QPlainTextEdit::NoWrap);
+    reportView->setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+    reportView->setMinimumSize(640, 160);
+    mainLayout->addWidget(reportView);
+
+    QHBoxLayout *buttonLayout = new QHBoxLayout();
+    enabledCheckBox = new QCheckBox("Collect statistics", this);
+    enabledCheckBox->setChecked(LatencyStats::enabled());
+    buttonLayout->addWidget(enabledCheckBox);
+    buttonLayout->addStretch();
+    resetButton = new QPushButton("Reset", this);
+    buttonLayout->addWidget(resetButton);
+    mainLayout->addLayout(buttonLayout);
+}
+
+void LatencyStatsDialog::refresh()
+{
+    reportView->setPlainText(QString::fromStdString(LatencyStats::report()));
+}
+
+void LatencyStatsDialog::on_enabledCheckBox_toggled(bool checked)
+{
+    LatencyStats::setEnabled(checked);
+}
+
+void LatencyStatsDialog::on_resetButton_clicked()
+{
+    LatencyStats::reset();
+    refresh();
+}
+
+void LatencyStatsDialog::showEvent(QShowEvent *event)
+{
+    refresh();
+    refreshTimer->start();
+    QDialog::showEvent(event);
+}
+
+void LatencyStatsDialog::hideEvent(QHideEvent *event)
+{
+    refreshTimer->stop();
+    QDialog::hideEvent(event);
+}
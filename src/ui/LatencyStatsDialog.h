@@ -0,0 +1,35 @@
+#ifndef LATENCYSTATSDIALOG_H
+#define LATENCYSTATSDIALOG_H
+
+#include <QDialog>
+#include <QCheckBox>
+#include <QPlainTextEdit>
+#include <QPushButton>
+#include <QTimer>
+
+// Hidden debug dialog (Ctrl+Shift+F12 in the main window) showing the LatencyStats report
+// live, with switches to start or stop collecting and to reset the histograms.
+class LatencyStatsDialog : public QDialog
+{
+    Q_OBJECT
+
+public:
+    explicit LatencyStatsDialog(QWidget *parent = nullptr);
+
+private slots:
+    void refresh();
+    void on_enabledCheckBox_toggled(bool checked);
+    void on_resetButton_clicked();
+
+private:
+    QCheckBox *enabledCheckBox;
+    QPlainTextEdit *reportView;
+    QPushButton *resetButton;
+    QTimer *refreshTimer;
+
+    void setupUi();
+    void showEvent(QShowEvent *event) override;
+    void hideEvent(QHideEvent *event) override;
+};
+
+#endif // LATENCYSTATSDIALOG_H
@@ -1,15 +1,38 @@
 #include "MainWindow.h"
+#include "LatencyStatsDialog.h"
+#include "../core/ColumnarHistoryStore.h"
+#include "../core/LatencyStats.h"
+#include "../core/NumberFormat.h"
 #include <cmath>
+#include <utility>
+#include <QApplication>
 #include <QMessageBox>
 #include <QDockWidget>
+#include <QFileDialog>
+#include <QLocale>
+#include <QMenuBar>
+#include <QShortcut>
 
-MainWindow::MainWindow(QWidget *parent)
+namespace
+{
+    // The value of a number on the display, or 0 when it shows none (e.g. "Error").
+    double displayedValue(const QString &text)
+    {
+        double value = 0.0;
+        NumberFormat::parse(text, &value);
+        return value;
+    }
+}
+
+MainWindow::MainWindow(HistoryBackend historyBackend, const HistoryRetention &historyRetention, QWidget *parent)
     : QMainWindow(parent),
       errorHandler(new ErrorHandler(this)), // Initialize errorHandler first
-      calculatorCore(new CalculatorCore(errorHandler)), // Pass errorHandler to CalculatorCore
+      calculatorCore(new CalculatorCore()),
       dbManager(new DatabaseManager(this)),
-      historyPanel(new HistoryPanel(this)), // Parent historyPanel to MainWindow
+      historyStore(dbManager),
+      historyPanel(nullptr), // Built on first use, see ensureHistoryPanel()
       historyDock(new QDockWidget("History", this)), // Parent historyDock to MainWindow
+      previewEvaluator(new PreviewEvaluator(calculatorCore, this)),
       currentInput("0"), // Initialize currentInput to "0"
       fullExpression(""),
       lastResult(""),
@@ -23,26 +46,38 @@ MainWindow::MainWindow(QWidget *parent)
     setFixedSize(350, 500); // Set a fixed size for now, can be made responsive later
 
     // Connect error handler signal
-    connect(errorHandler, &ErrorHandler::errorOccurred, this, &MainWindow::handleCalculationError);
+    connect(errorHandler, &ErrorHandler::errorOccurred, this, qOverload<const QString &>(&MainWindow::handleCalculationError));
 
-    // Open database
-    if (!dbManager->openDatabase("calc_history.db")) {
-        errorHandler->handleError("Failed to open database!", "History will not be saved.");
-    }
+    // Open the database in the background so the window appears without waiting for it
+    connect(dbManager, &DatabaseManager::databaseOpened, this, &MainWindow::handleDatabaseOpened);
+    connect(dbManager, &DatabaseManager::historyMaintained, this, &MainWindow::handleHistoryMaintained);
+    dbManager->setHistoryRetention(historyRetention);
+    dbManager->openDatabaseAsync("calc_history.db");
+
+    // Long expressions are evaluated for the preview off the GUI thread
+    connect(previewEvaluator, &PreviewEvaluator::previewReady, this, &MainWindow::handlePreviewReady);
+    previewEvaluator->start();
 
     setupUi();
     setupConnections();
     resetDisplayStyles(); // Apply initial styles
 
-    // Load history from DB on startup
-    QList<QPair<QString, QString>> history = dbManager->getHistory();
-    for (const auto &entry : history) {
-        historyPanel->addHistoryEntry(entry.first, entry.second);
+    // --history-store columnar keeps the history in a memory-mapped file instead; the memo
+    // and definitions stay in the database. Opened after the UI exists so a failure can
+    // be shown.
+    if (historyBackend == HistoryBackend::Columnar) {
+        ColumnarHistoryStore *columnarStore = new ColumnarHistoryStore(this);
+        if (!columnarStore->open(ColumnarHistoryStore::DefaultPath)) {
+            errorHandler->handleError("Failed to open history file!", "History will not be saved.");
+        }
+        historyStore = columnarStore;
+        compactHistoryAction->setEnabled(false);
     }
 }
 
 MainWindow::~MainWindow()
 {
+    delete previewEvaluator; // Its thread may be using calculatorCore
     delete calculatorCore; // Manually delete as it's not parented to QObject
     // historyPanel and historyDock are parented to MainWindow, so they will be deleted automatically.
 }
@@ -52,6 +87,14 @@ void MainWindow::setupUi()
     QWidget *centralWidget = new QWidget(this);
     setCentralWidget(centralWidget);
 
+    // History menu: moving the history to and from CSV or JSON Lines files, and giving
+    // unused space back to the disk
+    QMenu *historyMenu = menuBar()->addMenu("&History");
+    historyMenu->addAction("&Export...", this, &MainWindow::exportHistory);
+    historyMenu->addAction("&Import...", this, &MainWindow::importHistory);
+    historyMenu->addSeparator();
+    compactHistoryAction = historyMenu->addAction("&Compact", this, &MainWindow::compactHistory);
+
     QVBoxLayout *mainLayout = new QVBoxLayout(centralWidget);
     mainLayout->setSpacing(5);
     mainLayout->setContentsMargins(10, 10, 10, 10);
@@ -63,6 +106,17 @@ void MainWindow::setupUi()
     expressionLabel->setSizePolicy(QSizePolicy::Preferred, QSizePolicy::Fixed);
     mainLayout->addWidget(expressionLabel);
 
+    // Preview Label (value of the expression so far, updated while typing)
+    previewLabel = new QLabel("", this);
+    previewLabel->setAlignment(Qt::AlignRight | Qt::AlignVCenter);
+    previewLabel->setTextFormat(Qt::PlainText);
+    previewLabel->setSizePolicy(QSizePolicy::Preferred, QSizePolicy::Fixed);
+    QFont previewFont = previewLabel->font();
+    previewFont.setPointSize(14);
+    previewLabel->setFont(previewFont);
+    previewLabel->setStyleSheet("QLabel { color: #888888; }");
+    mainLayout->addWidget(previewLabel);
+
     // Result Label (larger, for current input or final result)
     resultLabel = new QLabel("0", this);
     resultLabel->setAlignment(Qt::AlignRight | Qt::AlignVCenter);
@@ -138,8 +192,7 @@ void MainWindow::setupUi()
         }
     }
 
-    // Setup QDockWidget for HistoryPanel
-    historyDock->setWidget(historyPanel);
+    // Setup QDockWidget; the HistoryPanel inside is created the first time it is shown
     historyDock->setFeatures(QDockWidget::DockWidgetClosable | QDockWidget::DockWidgetMovable);
     historyDock->setAllowedAreas(Qt::RightDockWidgetArea);
     addDockWidget(Qt::RightDockWidgetArea, historyDock);
@@ -162,9 +215,9 @@ QPushButton *MainWindow::createButton(const QString &text, void (MainWindow::*me
 
 void MainWindow::setupConnections()
 {
-    // Connect signals from HistoryPanel
-    connect(historyPanel, &HistoryPanel::historyItemSelected, this, &MainWindow::handleHistoryItemSelected);
-    connect(historyPanel, &HistoryPanel::clearHistoryRequested, this, &MainWindow::handleClearHistoryRequested);
+    // Hidden debug dialog with the latency statistics
+    QShortcut *statsShortcut = new QShortcut(QKeySequence(Qt::CTRL | Qt::SHIFT | Qt::Key_F12), this);
+    connect(statsShortcut, &QShortcut::activated, this, &MainWindow::showLatencyStats);
 }
 
 void MainWindow::resetDisplayStyles()
@@ -212,6 +265,7 @@ void MainWindow::digitClicked()
     }
     resultLabel->setText(currentInput);
     expressionLabel->setText(fullExpression + currentInput);
+    updatePreview();
     resetDisplayStyles();
 }
 
@@ -225,6 +279,7 @@ void MainWindow::decimalClicked()
     }
     resultLabel->setText(currentInput);
     expressionLabel->setText(fullExpression + currentInput);
+    updatePreview();
     resetDisplayStyles();
 }
 
@@ -239,14 +294,14 @@ void MainWindow::operatorClicked()
         currentInput = lastResult;
     } else if (!waitingForOperand) {
         // If an operator was just pressed, perform the previous calculation first
-        operand2 = currentInput.toDouble();
+        operand2 = displayedValue(currentInput);
         fullExpression += currentInput;
         performCalculation(); // This updates lastResult and operand1
         fullExpression = lastResult; // Start new expression with the result
         currentInput = lastResult; // Update currentInput with the result
     }
 
-    operand1 = currentInput.toDouble();
+    operand1 = displayedValue(currentInput);
     waitingForOperand = true;
     justCalculated = false;
 
@@ -270,6 +325,7 @@ void MainWindow::operatorClicked()
     expressionLabel->setText(fullExpression);
     currentInput = "0"; // Clear current input for the next operand
     resultLabel->setText(currentInput);
+    updatePreview();
     resetDisplayStyles();
 }
 
@@ -278,7 +334,7 @@ void MainWindow::unaryOperatorClicked()
     QPushButton *clickedButton = qobject_cast<QPushButton *>(sender());
     if (!clickedButton) return;
 
-    double value = currentInput.toDouble();
+    double value = displayedValue(currentInput);
     QString opText = clickedButton->text();
     double result = value;
     QString expressionToSave = currentInput;
@@ -298,13 +354,15 @@ void MainWindow::unaryOperatorClicked()
     }
 
     if (!error) {
-        lastResult = QString::number(result);
+        lastResult = NumberFormat::toString(result);
         resultLabel->setText(lastResult);
         expressionLabel->setText(expressionToSave + " =");
         applyResultStyles();
 
-        dbManager->addHistoryEntry(expressionToSave, lastResult);
-        historyPanel->addHistoryEntry(expressionToSave, lastResult); // Add to history panel
+        historyStore->addHistoryEntry(expressionToSave, lastResult);
+        if (historyPanel) {
+            historyPanel->addHistoryEntry(expressionToSave, lastResult); // Add to history panel
+        }
 
         justCalculated = true;
         waitingForOperand = false;
@@ -313,6 +371,7 @@ void MainWindow::unaryOperatorClicked()
         currentInput = lastResult; // Update currentInput with the result
         operand1 = result;
         operand2 = 0.0;
+        updatePreview();
     } else {
         handleCalculationError("Error in unary operation."); // Error handler will reset state
     }
@@ -322,12 +381,14 @@ void MainWindow::equalsClicked()
 {
     if (justCalculated) return; // No new operation to perform
 
-    operand2 = currentInput.toDouble();
+    operand2 = displayedValue(currentInput);
     fullExpression += currentInput;
 
     performCalculation();
-    dbManager->addHistoryEntry(fullExpression, lastResult);
-    historyPanel->addHistoryEntry(fullExpression, lastResult); // Add to history panel
+    historyStore->addHistoryEntry(fullExpression, lastResult);
+    if (historyPanel) {
+        historyPanel->addHistoryEntry(fullExpression, lastResult); // Add to history panel
+    }
 
     expressionLabel->setText(fullExpression + " =");
     resultLabel->setText(lastResult);
@@ -339,26 +400,38 @@ void MainWindow::equalsClicked()
     lastOperator = None;
     fullExpression = lastResult; // For chaining operations after equals
     currentInput = lastResult; // Update currentInput with the result
-    operand1 = lastResult.toDouble();
+    operand1 = displayedValue(lastResult);
     operand2 = 0.0;
+    updatePreview();
 }
 
 void MainWindow::performCalculation()
 {
-    bool calculationOk = false;
-    double result = calculatorCore->calculate(fullExpression, &calculationOk);
+    const LatencyStats::Scope timing(LatencyStats::PerformCalculation);
+    const CalcResult result = calculatorCore->calculate(fullExpression);
 
-    if (calculationOk) {
-        lastResult = QString::number(result);
-        operand1 = result;
+    if (result.ok()) {
+        lastResult = NumberFormat::toString(result.value);
+        operand1 = result.value;
     } else {
+        handleCalculationError(result.error);
         lastResult = "Error";
         operand1 = 0.0;
-        // ErrorHandler already shows QMessageBox, just update internal state
     }
     waitingForOperand = true; // Ready for next operand or new operation
 }
 
+void MainWindow::handleCalculationError(const CalcError &error)
+{
+    // The engine only reports a code and position; the wording lives here in the UI.
+    if (error.isSyntaxError()) {
+        errorHandler->handleError("Invalid expression format: " + fullExpression,
+                                  QString("Error at position %1.").arg(error.position + 1));
+    } else {
+        errorHandler->handleError(calcErrorMessage(error.code));
+    }
+}
+
 void MainWindow::clearClicked()
 {
     currentInput = "0";
@@ -371,6 +444,7 @@ void MainWindow::clearClicked()
     operand2 = 0.0;
     expressionLabel->setText("");
     resultLabel->setText("0");
+    updatePreview();
     resetDisplayStyles();
 }
 
@@ -396,21 +470,91 @@ void MainWindow::backspaceClicked()
         // A better approach would be to manage fullExpression as a list of tokens.
         expressionLabel->setText(fullExpression + currentInput);
     }
+    updatePreview();
     resetDisplayStyles();
 }
 
+void MainWindow::updatePreview()
+{
+    // Nothing to preview for a finished calculation or a lone number, which the result
+    // label already shows
+    if (justCalculated || fullExpression.isEmpty()) {
+        previewGeneration = 0; // Drops any evaluation still in flight
+        previewLabel->clear();
+        return;
+    }
+    previewGeneration = previewEvaluator->evaluate(fullExpression + currentInput);
+}
+
+void MainWindow::handlePreviewReady(quint64 generation, const CalcResult &result)
+{
+    if (generation != previewGeneration) {
+        return; // The expression has changed since
+    }
+    // An incomplete or invalid expression shows nothing rather than flashing an error on
+    // every keystroke
+    previewLabel->setText(result.ok() ? "= " + NumberFormat::toString(result.value) : QString());
+}
+
 void MainWindow::toggleHistoryPanel()
 {
+    ensureHistoryPanel();
     historyDock->setVisible(!historyDock->isVisible());
 }
 
+void MainWindow::ensureHistoryPanel()
+{
+    if (historyPanel) {
+        return;
+    }
+    historyPanel = new HistoryPanel(historyStore, this);
+    historyDock->setWidget(historyPanel);
+
+    // Connect signals from HistoryPanel
+    connect(historyPanel, &HistoryPanel::historyItemSelected, this, &MainWindow::handleHistoryItemSelected);
+    connect(historyPanel, &HistoryPanel::clearHistoryRequested, this, &MainWindow::handleClearHistoryRequested);
+
+    // The panel pages history in from the database as it is scrolled
+    historyPanel->reloadHistory();
+}
+
+void MainWindow::handleDatabaseOpened(bool ok)
+{
+    if (!ok) {
+        errorHandler->handleError("Failed to open database!", "History will not be saved.");
+        return;
+    }
+    calculatorCore->setResultMemo(dbManager); // Reuse results stored by earlier sessions
+    // Definitions of earlier sessions are replayed before the store is attached, so they
+    // are not written back
+    for (const QString &definition : dbManager->symbolDefinitions()) {
+        calculatorCore->define(definition);
+    }
+    calculatorCore->setSymbolStore(dbManager);
+    if (historyPanel) {
+        historyPanel->reloadHistory(); // Opened before the database was ready
+    }
+}
+
+void MainWindow::paintEvent(QPaintEvent *event)
+{
+    if (!firstFramePainted) {
+        firstFramePainted = true;
+        if (LatencyStats::enabled()) {
+            LatencyStats::record(LatencyStats::FirstFrame,
+                                 std::chrono::steady_clock::now() - LatencyStats::processStart());
+        }
+    }
+    QMainWindow::paintEvent(event);
+}
+
 void MainWindow::handleHistoryItemSelected(const QString &expression, const QString &result)
 {
     // Update main calculator display with selected history item
     fullExpression = expression;
     currentInput = result;
     lastResult = result;
-    operand1 = result.toDouble();
+    operand1 = displayedValue(result);
     operand2 = 0.0;
     lastOperator = None;
     justCalculated = true;
@@ -418,6 +562,7 @@ void MainWindow::handleHistoryItemSelected(const QString &expression, const QStr
 
     expressionLabel->setText(fullExpression + " =");
     resultLabel->setText(lastResult);
+    updatePreview();
     applyResultStyles();
 
     // Optionally hide the history panel after selection
@@ -438,6 +583,7 @@ void MainWindow::handleCalculationError(const QString &errorMessage)
 
     expressionLabel->setText("");
     resultLabel->setText("Error");
+    updatePreview();
     // Apply error styles
     QFont resultFont = resultLabel->font();
     resultFont.setPointSize(48);
@@ -450,11 +596,88 @@ void MainWindow::handleCalculationError(const QString &errorMessage)
 
 void MainWindow::handleClearHistoryRequested()
 {
-    if (dbManager->clearHistory()) {
-        historyPanel->clearHistoryList(); // Clear the QListWidget in the panel
+    if (historyStore->clearHistory()) {
+        historyPanel->clearHistoryList(); // Reset the panel's list model
         CustomAlert *alert = new CustomAlert(CustomAlert::Info, "History", "Calculation history cleared.", this);
         alert->exec();
     } else {
         errorHandler->handleError("Failed to clear history.");
     }
 }
+
+void MainWindow::showLatencyStats()
+{
+    LatencyStatsDialog *dialog = findChild<LatencyStatsDialog *>();
+    if (!dialog) {
+        dialog = new LatencyStatsDialog(this); // Deletes itself on close
+    }
+    dialog->show();
+    dialog->raise();
+    dialog->activateWindow();
+}
+
+void MainWindow::exportHistory()
+{
+    const QString path = QFileDialog::getSaveFileName(this, "Export History", "history.csv",
+                                                      "CSV files (*.csv);;JSON Lines files (*.jsonl)");
+    if (path.isEmpty()) {
+        return;
+    }
+    qint64 count = 0;
+    QString error;
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    const bool ok = historyStore->exportHistory(path, HistoryExchange::formatForPath(path), &count, &error);
+    QApplication::restoreOverrideCursor();
+    if (!ok) {
+        errorHandler->handleError("Failed to export history.", error);
+        return;
+    }
+    CustomAlert *alert = new CustomAlert(CustomAlert::Info, "History",
+                                         QString("Exported %1 calculations.").arg(count), this);
+    alert->exec();
+}
+
+void MainWindow::importHistory()
+{
+    const QString path = QFileDialog::getOpenFileName(this, "Import History", QString(),
+                                                      "History files (*.csv *.jsonl *.ndjson *.json);;All files (*)");
+    if (path.isEmpty()) {
+        return;
+    }
+    qint64 count = 0;
+    QString error;
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    const bool ok = historyStore->importHistory(path, HistoryExchange::formatForPath(path), &count, &error);
+    QApplication::restoreOverrideCursor();
+    if (!ok) {
+        errorHandler->handleError("Failed to import history.", error);
+        return;
+    }
+    if (historyPanel) {
+        historyPanel->reloadHistory(); // Imported entries are the newest
+    }
+    CustomAlert *alert = new CustomAlert(CustomAlert::Info, "History",
+                                         QString("Imported %1 calculations.").arg(count), this);
+    alert->exec();
+}
+
+void MainWindow::compactHistory()
+{
+    // Runs on the maintenance thread; handleHistoryMaintained() reports the outcome.
+    compactRequested = true;
+    dbManager->compactHistory();
+}
+
+void MainWindow::handleHistoryMaintained(const HistoryMaintainer::Report &report)
+{
+    // Scheduled passes apply the retention limits silently.
+    if (!std::exchange(compactRequested, false)) {
+        return;
+    }
+    CustomAlert *alert = new CustomAlert(CustomAlert::Info, "History",
+                                         QString("Removed %1 old calculations and reclaimed %2.")
+                                             .arg(report.historyRowsRemoved)
+                                             .arg(QLocale().formattedDataSize(report.bytesReclaimed())),
+                                         this);
+    alert->exec();
+}
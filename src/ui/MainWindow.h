@@ -11,6 +11,7 @@
 
 #include "../core/CalculatorCore.h"
 #include "../core/DatabaseManager.h"
+#include "../core/PreviewEvaluator.h"
 #include "HistoryPanel.h" // Changed from HistoryWindow.h
 #include "../utils/ErrorHandler.h"
 
@@ -19,7 +20,8 @@ class MainWindow : public QMainWindow
     Q_OBJECT
 
 public:
-    explicit MainWindow(QWidget *parent = nullptr);
+    explicit MainWindow(HistoryBackend historyBackend = HistoryBackend::Sqlite,
+                        const HistoryRetention &historyRetention = HistoryRetention(), QWidget *parent = nullptr);
     ~MainWindow();
 
 private slots:
@@ -34,22 +36,39 @@ private slots:
     void handleHistoryItemSelected(const QString &expression, const QString &result); // New slot for history item click
     void handleCalculationError(const QString &errorMessage);
     void handleClearHistoryRequested(); // New slot for HistoryPanel clear request
+    void showLatencyStats();
+    void exportHistory();
+    void importHistory();
+    void compactHistory();
+    void handleHistoryMaintained(const HistoryMaintainer::Report &report);
+    void handleDatabaseOpened(bool ok);
+    void handlePreviewReady(quint64 generation, const CalcResult &result);
 
 private:
     QLabel *expressionLabel;
+    QLabel *previewLabel; // Live value of the expression being typed
     QLabel *resultLabel;
     QPushButton *createButton(const QString &text, void (MainWindow::*member)());
     void setupUi();
     void setupConnections();
+    void ensureHistoryPanel();
+    void paintEvent(QPaintEvent *event) override;
     void performCalculation();
+    void handleCalculationError(const CalcError &error); // Translates engine errors into alerts
     void resetDisplayStyles();
     void applyResultStyles();
+    void updatePreview();
 
     CalculatorCore *calculatorCore;
     DatabaseManager *dbManager;
-    HistoryPanel *historyPanel; // Changed from HistoryWindow
+    HistoryStore *historyStore; // dbManager unless the columnar store was chosen
+    HistoryPanel *historyPanel; // Null until the history is first shown
     QDockWidget *historyDock; // Dock widget for the history panel
     ErrorHandler *errorHandler;
+    PreviewEvaluator *previewEvaluator;
+    QAction *compactHistoryAction; // Only for the database; the columnar file has nothing to compact
+    bool compactRequested = false; // The next maintenance report answers the Compact action
+    quint64 previewGeneration = 0; // Request whose result the preview should show
 
     QString currentInput; // Stores the number currently being typed or the last result
     QString fullExpression; // Stores the entire expression being built
@@ -62,6 +81,8 @@ private:
 
     double operand1;
     double operand2;
+
+    bool firstFramePainted = false;
 };
 
 #endif // MAINWINDOW_H
\ No newline at end of file
@@ -0,0 +1,99 @@
+#include <cmath>
+#include <cstring>
+#include <string_view>
+#include "CalculatorCore.h"
+#include "ConstexprExpression.h"
+#include "TestSupport.h"
+
+namespace
+{
+    // Formulas compiled while building the tests. Between them they cover every operator,
+    // the '%' forms, signs, both constants, sqrt and every evaluation error.
+    constexpr char Arithmetic[] = "−3 × (1 − 20%) ÷ 4 + 2x3 - 2 x^y 3 + 50%-5";
+    constexpr char Constants[] = "pi * 2^2 + e^-1 + 1.5e-3 - .25 * -(-7)";
+    constexpr char Remainder[] = "7 % 3 + -7.5 % 2";
+    constexpr char SquareRoot[] = "sqrt(16) + sqrt(2) * 3";
+    constexpr char DivideByZero[] = "1 + 1   / 0";
+    constexpr char ModuloByZero[] = "5 % 0 + 1/0";
+    constexpr char NegativeRoot[] = "2 * sqrt(-4)";
+    constexpr char WithVariables[] = "x * 2 + y % 3 - x^2 / y";
+
+    static constexpr auto ArithmeticProgram = ConstexprExpression::compile(Arithmetic);
+    static constexpr auto ConstantsProgram = ConstexprExpression::compile(Constants);
+    static constexpr auto RemainderProgram = ConstexprExpression::compile(Remainder);
+    static constexpr auto SquareRootProgram = ConstexprExpression::compile(SquareRoot);
+    static constexpr auto DivideByZeroProgram = ConstexprExpression::compile(DivideByZero);
+    static constexpr auto ModuloByZeroProgram = ConstexprExpression::compile(ModuloByZero);
+    static constexpr auto NegativeRootProgram = ConstexprExpression::compile(NegativeRoot);
+    static constexpr auto WithVariablesProgram = ConstexprExpression::compile(WithVariables);
+
+    static_assert(ArithmeticProgram.ok() && ArithmeticProgram.variableCount == 0);
+    static_assert(ConstantsProgram.ok() && ConstantsProgram.variableCount == 0);
+    static_assert(DivideByZeroProgram.ok(), "division by zero is found when evaluating");
+    static_assert(ModuloByZeroProgram.ok(), "modulo by zero is found when evaluating");
+    static_assert(WithVariablesProgram.variableCount == 2 && WithVariablesProgram.variableIndex("y") == 1);
+
+    // Syntax errors are found at compile time, with the code and position the runtime
+    // compiler reports.
+    static_assert(ConstexprExpression::compile("1 +").error.code == CalcErrorCode::UnexpectedEnd);
+    static_assert(ConstexprExpression::compile("(2").error.code == CalcErrorCode::MismatchedParenthesis);
+    static_assert(ConstexprExpression::compile("2 $ 3").error.position == 2);
+
+    bool sameResult(const CalcResult &result, const CalcResult &expected)
+    {
+        return result.error.code == expected.error.code
+               && (!expected.error.isError() || result.error.position == expected.error.position)
+               && (std::memcmp(&result.value, &expected.value, sizeof(double)) == 0
+                   || (std::isnan(result.value) && std::isnan(expected.value)));
+    }
+
+    // The formula inlined by Formula<P>, P interpreted and the text compiled at run time
+    // all give what calculate() gives for text.
+    template <const auto &P>
+    bool matchesCalculate(CalculatorCore &core, std::string_view text, const double *values = nullptr)
+    {
+        const CalcResult expected = core.calculate(text);
+        const CalcResult results[] = { ConstexprExpression::Formula<P>::evaluate(values), P.evaluate(values),
+                                       ConstexprExpression::compile<64>(text).evaluate(values) };
+        for (const CalcResult &result : results) {
+            if (!sameResult(result, expected)) return false;
+        }
+        return true;
+    }
+}
+
+CALC_TEST(constexprFormulasMatchCalculate)
+{
+    CalculatorCore core;
+    CHECK(matchesCalculate<ArithmeticProgram>(core, Arithmetic));
+    CHECK(matchesCalculate<ConstantsProgram>(core, Constants));
+    CHECK(matchesCalculate<RemainderProgram>(core, Remainder));
+    CHECK(matchesCalculate<SquareRootProgram>(core, SquareRoot));
+
+    CHECK(matchesCalculate<DivideByZeroProgram>(core, DivideByZero));
+    CHECK(core.calculate(std::string_view(DivideByZero)).error.code == CalcErrorCode::DivisionByZero);
+    CHECK(matchesCalculate<ModuloByZeroProgram>(core, ModuloByZero));
+    CHECK(core.calculate(std::string_view(ModuloByZero)).error.code == CalcErrorCode::ModuloByZero);
+    CHECK(matchesCalculate<NegativeRootProgram>(core, NegativeRoot));
+    CHECK(core.calculate(std::string_view(NegativeRoot)).error.code == CalcErrorCode::NegativeSquareRoot);
+
+    // Variables are bound through definitions on the core's side.
+    const double samples[][2] = { { 3, 4 }, { -2.5, 0.1 }, { 0, 0 }, { 1e300, -7 } };
+    for (const auto &values : samples) {
+        CHECK(core.define(std::string_view("x = " + std::to_string(values[0]))).ok());
+        CHECK(core.define(std::string_view("y = " + std::to_string(values[1]))).ok());
+        CHECK(matchesCalculate<WithVariablesProgram>(core, WithVariables, values));
+    }
+}
+
+CALC_TEST(constexprCompileErrorsMatchCalculate)
+{
+    CalculatorCore core;
+    const char *invalid[] = { "1 +", "(2", "2 $ 3", "", "1..2", "3 * )", "unknown + 1", "sqrt(" };
+    for (const char *text : invalid) {
+        const CalcResult expected = core.calculate(std::string_view(text));
+        const CalcResult compiledAtRunTime = ConstexprExpression::compile<64>(text).evaluate();
+        CHECK(expected.error.isError());
+        CHECK(sameResult(compiledAtRunTime, expected));
+    }
+}
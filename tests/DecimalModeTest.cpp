@@ -0,0 +1,40 @@
+#include <cmath>
+#include "CalculatorCore.h"
+#include "TestSupport.h"
+
+namespace
+{
+    bool decimalEquals(CalculatorCore &core, const char *expression, const char *expected)
+    {
+        const DecimalResult result = core.calculateDecimal(std::string_view(expression));
+        BigDecimal value;
+        return result.ok() && BigDecimal::fromString(expected, &value) && BigDecimal::compare(result.value, value) == 0;
+    }
+}
+
+// Literals are read from their text, so the range of a double does not limit them.
+CALC_TEST(decimalLiteralsBeyondDoubleRange)
+{
+    CalculatorCore core;
+    CHECK(decimalEquals(core, "1e400", "1e400"));
+    CHECK(decimalEquals(core, "1e400 - 10^400", "0"));
+    CHECK(decimalEquals(core, "-1e400 / 1e399", "-10"));
+    CHECK(decimalEquals(core, "1e-400 * 1e400", "1"));
+    CHECK(decimalEquals(core, "2.5e-330 * 2", "5e-330"));
+    CHECK(decimalEquals(core, "0.1 + 0.2", "0.3"));
+
+    const DecimalResult huge = core.calculateDecimal(std::string_view("1 + 1e9999999999999999"));
+    CHECK(huge.error.code == CalcErrorCode::PrecisionExceeded && huge.error.position == 4);
+}
+
+// In double arithmetic the same literals saturate like the powers that spell them.
+CALC_TEST(doubleLiteralsBeyondRangeSaturate)
+{
+    CalculatorCore core;
+    const CalcResult large = core.calculate(std::string_view("1e400"));
+    CHECK(large.ok() && std::isinf(large.value) && large.value > 0);
+    CHECK(core.calculate(std::string_view("-1e400")).value == core.calculate(std::string_view("-10^400")).value);
+    const CalcResult tiny = core.calculate(std::string_view("1e-400"));
+    CHECK(tiny.ok() && tiny.value == 0.0);
+    CHECK(core.calculate(std::string_view("5e-324")).value > 0.0);
+}
@@ -0,0 +1,73 @@
+#include <cmath>
+#include <string>
+#include "CalculatorCore.h"
+#include "ExpressionCache.h"
+#include "TestSupport.h"
+
+namespace
+{
+    template <typename Text>
+    std::string cacheKey(Text source)
+    {
+        std::string key;
+        return ExpressionCache::normalize(source, key) ? key : std::string("<uncached>");
+    }
+}
+
+// After a name the parser expects an operator, so a lone 'x' there is multiplication and
+// must fold into '*' like any other spelling of it.
+CALC_TEST(cacheKeyReadsXAfterIdentifierLikeParser)
+{
+    CHECK(cacheKey(std::string_view("pi x 2")) == "pi*2");
+    CHECK(cacheKey(std::string_view("pi x2")) == cacheKey(std::string_view("pi × 2")));
+    CHECK(cacheKey(std::u16string_view(u"pi x 2")) == "pi*2");
+    CHECK(cacheKey(std::string_view("e x^y 2")) == "e^2");
+    CHECK(cacheKey(std::string_view("pi xy")) != cacheKey(std::string_view("pi*y")));
+    CHECK(cacheKey(std::string_view("sqrt (4)")) == cacheKey(std::string_view("sqrt(4)")));
+}
+
+CALC_TEST(cachedResultsMatchUncached)
+{
+    CalculatorCore cached;
+    CalculatorCore uncached;
+    uncached.setCacheCapacity(0);
+    for (CalculatorCore *core : { &cached, &uncached }) {
+        CHECK(core->define(std::string_view("r = 3")).ok());
+    }
+
+    const char *expressions[] = { "r x 2", "pi x r", "r*2", "r x r x 2", "2 x r", "sqrt(r x 3)" };
+    for (int pass = 0; pass < 2; ++pass) { // The second pass hits the cache
+        for (const char *expression : expressions) {
+            const CalcResult hit = cached.calculate(std::string_view(expression));
+            const CalcResult reference = uncached.calculate(std::string_view(expression));
+            CHECK(hit.ok() && reference.ok());
+            CHECK(hit.value == reference.value);
+        }
+    }
+    CHECK(cached.calculate(std::string_view("r x 2")).value == 6.0);
+    CHECK(cached.cacheStats().hits > 0);
+}
+
+// Spellings that share a cache entry differ in where each token sits, so an error must
+// point into the text being evaluated, not into the one that filled the entry.
+CALC_TEST(cachedErrorsPointIntoCurrentText)
+{
+    CalculatorCore cached;
+    CalculatorCore uncached;
+    uncached.setCacheCapacity(0);
+    for (CalculatorCore *core : { &cached, &uncached }) {
+        CHECK(core->define(std::string_view("r = 0")).ok());
+    }
+
+    const char *expressions[] = { "1   / 0", "1/0", "7   % 0", "7%0", "1   /   r", "1/r", "2 x (1   / r)", "2x(1/r)" };
+    for (int pass = 0; pass < 2; ++pass) {
+        for (const char *expression : expressions) {
+            const CalcError hit = cached.calculate(std::string_view(expression)).error;
+            const CalcError reference = uncached.calculate(std::string_view(expression)).error;
+            CHECK(hit.isError());
+            CHECK(hit.code == reference.code);
+            CHECK(hit.position == reference.position);
+        }
+    }
+    CHECK(cached.calculate(std::string_view("1/0")).error.position == 1);
+}
@@ -0,0 +1,100 @@
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDeadlineTimer>
+#include <QFile>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <unistd.h>
+#include "TestSupport.h"
+#include "core/DatabaseManager.h"
+#include "core/HistoryWriter.h"
+
+namespace
+{
+    // A history database that is removed, with its log and the import file, when the
+    // test ends.
+    struct TemporaryHistory
+    {
+        QString path = "/tmp/calc_history_test_" + QString::number(getpid()) + ".db";
+
+        ~TemporaryHistory()
+        {
+            for (const char *suffix : { "", "-wal", "-shm", ".jsonl" }) {
+                QFile::remove(path + suffix);
+            }
+        }
+    };
+
+    // Entries a minute apart and long ago, so a pass removes the oldest of them and the
+    // memo rows only those use.
+    bool writeOldEntries(const QString &path, int count)
+    {
+        QFile file(path);
+        if (!file.open(QIODevice::WriteOnly)) {
+            return false;
+        }
+        const QDateTime start(QDate(2001, 1, 1), QTime(0, 0));
+        for (int i = 0; i < count; ++i) {
+            file.write(QString("{\"timestamp\":\"%1\",\"expression\":\"%2 + 1\",\"result\":\"%3\"}\n")
+                           .arg(start.addSecs(60 * i).toString(Qt::ISODate))
+                           .arg(i)
+                           .arg(i + 1)
+                           .toUtf8());
+        }
+        return true;
+    }
+}
+
+// Merge steps and the writer's batches each take the write lock, so a pass that
+// removes rows from the search index while entries keep arriving must leave it intact.
+CALC_TEST(searchIndexSurvivesMergingDuringInserts)
+{
+    TemporaryHistory history;
+    {
+        DatabaseManager manager;
+        CHECK(manager.openDatabase(history.path));
+        CHECK(manager.hasFullTextSearch());
+        qint64 imported = 0;
+        CHECK(writeOldEntries(history.path + ".jsonl", 20000));
+        CHECK(manager.importHistory(history.path + ".jsonl", HistoryExchange::Format::JsonLines, &imported));
+        CHECK(imported == 20000);
+
+        HistoryRetention retention;
+        retention.maxRows = 1000;
+        manager.setHistoryRetention(retention);
+        HistoryMaintainer::Report report;
+        bool finished = false;
+        QObject::connect(&manager, &DatabaseManager::historyMaintained,
+                         [&](const HistoryMaintainer::Report &passReport) {
+                             report = passReport;
+                             finished = true;
+                         });
+        manager.compactHistory();
+
+        const QDeadlineTimer deadline(60 * 1000);
+        for (int i = 0; !finished && !deadline.hasExpired(); ++i) {
+            manager.addHistoryEntry(QString::number(i) + " * 3", QString::number(i * 3));
+            if (i % HistoryWriter::BatchSize == 0) {
+                manager.flushHistory(); // Commit now, between the steps of the pass
+            }
+            QCoreApplication::processEvents();
+        }
+        manager.flushHistory();
+        CHECK(finished);
+        CHECK(report.historyRowsRemoved > 0);
+        CHECK(report.memoRowsRemoved > 0);
+    }
+
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", "calc_tests.integrity");
+        db.setDatabaseName(history.path);
+        CHECK(db.open());
+        QSqlQuery query(db);
+        CHECK(query.exec("INSERT INTO memo_fts (memo_fts) VALUES ('integrity-check')"));
+        CHECK(query.exec("SELECT count(*) FROM memo_fts WHERE memo_fts MATCH '\"* 3\"'") && query.next()
+              && query.value(0).toLongLong() > 0);
+        query.finish();
+        db.close();
+    }
+    QSqlDatabase::removeDatabase("calc_tests.integrity");
+}
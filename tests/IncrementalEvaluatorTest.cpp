@@ -0,0 +1,66 @@
+#include <cmath>
+#include <string>
+#include "CalculatorCore.h"
+#include "IncrementalEvaluator.h"
+#include "TestSupport.h"
+
+namespace
+{
+    bool sameResult(const CalcResult &a, const CalcResult &b)
+    {
+        if (a.error.code != b.error.code) {
+            return false;
+        }
+        if (!a.ok()) {
+            return a.error.position == b.error.position;
+        }
+        return a.value == b.value || (std::isnan(a.value) && std::isnan(b.value));
+    }
+
+    // Types text one character at a time, as the preview sees it, comparing every prefix.
+    bool matchesWhileTyping(IncrementalEvaluator &evaluator, CalculatorCore &core, const std::u16string &text)
+    {
+        for (size_t length = 1; length <= text.size(); ++length) {
+            const std::u16string prefix = text.substr(0, length);
+            const CalcResult expected = core.calculate(QString::fromUtf16(prefix.data(), static_cast<qsizetype>(length)));
+            if (!sameResult(evaluator.evaluate(prefix), expected)) {
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+CALC_TEST(incrementalMatchesCalculateWithSymbols)
+{
+    CalculatorCore core;
+    CHECK(core.define(std::string_view("r = 3")).ok());
+    CHECK(core.define(std::string_view("f(x) = x^2 + 1")).ok());
+
+    const char16_t *expressions[] = {
+        u"pi*2", u"2 + e", u"r x 2", u"f(3) + 1", u"1 + 2*sqrt(r)", u"q + 1", u"(1 + pi", u"f(2",
+        u"2 ^ r % 4", u"-r^2", u"1/(r - 3)", u"sqrt(f(r)) - e",
+    };
+    for (const char16_t *expression : expressions) {
+        IncrementalEvaluator evaluator(core);
+        CHECK(matchesWhileTyping(evaluator, core, expression));
+    }
+}
+
+CALC_TEST(incrementalResumesAfterSymbolIsRemoved)
+{
+    CalculatorCore core;
+    CHECK(core.define(std::string_view("r = 3")).ok());
+    IncrementalEvaluator evaluator(core);
+
+    std::u16string sum = u"1";
+    for (int i = 0; i < 200; ++i) {
+        sum += u" + 1";
+    }
+    CHECK(evaluator.evaluate(sum).value == 201.0);
+    CHECK(evaluator.evaluate(sum + u" + r").value == 204.0);
+    // Back to plain arithmetic, continuing from the checkpoints before the name.
+    CHECK(evaluator.evaluate(sum + u" + 2").value == 203.0);
+    CHECK(evaluator.lastTokensScanned() < 2 * IncrementalEvaluator::CheckpointInterval);
+    CHECK(evaluator.evaluate(u"pi" + sum.substr(1)).value == core.calculate(std::string_view("pi")).value + 200.0);
+}
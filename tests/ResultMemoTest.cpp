@@ -0,0 +1,92 @@
+#include <map>
+#include <string>
+#include <thread>
+#include <utility>
+#include "CalculatorCore.h"
+#include "TestSupport.h"
+
+namespace
+{
+    class MapMemo : public ResultMemo
+    {
+    public:
+        std::map<std::pair<std::string, int>, std::string> results;
+        int lookups = 0;
+
+        bool lookup(std::string_view key, int precision, std::string *result) override
+        {
+            ++lookups;
+            const auto found = results.find({ std::string(key), precision });
+            if (found == results.end()) {
+                return false;
+            }
+            *result = found->second;
+            return true;
+        }
+
+        void store(std::string_view key, int precision, std::string_view result) override
+        {
+            results.emplace(std::make_pair(std::string(key), precision), std::string(result));
+        }
+    };
+
+    constexpr int Precision = DecimalContext::DefaultPrecision;
+}
+
+CALC_TEST(calculateDecimalConsultsMemoBeforeEvaluating)
+{
+    MapMemo memo;
+    memo.results[{ "1+2", Precision }] = "7"; // Not what evaluating gives, so a hit is visible
+    CalculatorCore core;
+    core.setResultMemo(&memo);
+
+    CHECK(core.calculateDecimal(std::string_view("1 + 2")).value.toString() == "7");
+    CHECK(core.calculateDecimal(std::string_view("1 + 2"), 10).value.toString() == "3");
+    CHECK(core.calculateDecimal(std::string_view("0.1 + 0.2")).value.toString() == "0.3");
+    // Keys are the normalized text history rows use, so both share one memo row.
+    CHECK((memo.results[{ "0.1+0.2", Precision }] == "0.3"));
+    CHECK((memo.results[{ "1+2", 10 }] == "3"));
+}
+
+CALC_TEST(calculateNeverConsultsMemo)
+{
+    MapMemo memo;
+    memo.results[{ "1+2", Precision }] = "7";
+    CalculatorCore core;
+    core.setResultMemo(&memo);
+
+    CHECK(core.calculate(std::string_view("1 + 2")).value == 3.0);
+    CHECK(core.calculate(std::string_view("0.1 + 0.2")).value == 0.1 + 0.2);
+    CHECK(memo.lookups == 0);
+    CHECK(memo.results.size() == 1);
+}
+
+CALC_TEST(calculateDecimalNeverMemoizesSymbols)
+{
+    MapMemo memo;
+    CalculatorCore core;
+    core.setResultMemo(&memo);
+    CHECK(core.define(std::string_view("r = 3")).ok());
+
+    CHECK(core.calculateDecimal(std::string_view("r * 2")).value.toString() == "6");
+    CHECK(core.calculateDecimal(std::string_view("1/0")).error.isError());
+    CHECK(memo.lookups == 1); // Only "1/0", whose error is not stored
+    CHECK(memo.results.empty());
+
+    CHECK(core.define(std::string_view("r = 4")).ok());
+    CHECK(core.calculateDecimal(std::string_view("r * 2")).value.toString() == "8");
+    CHECK(memo.results.empty());
+}
+
+CALC_TEST(memoIsOnlyUsedOnItsThread)
+{
+    MapMemo memo;
+    memo.results[{ "1+2", Precision }] = "7";
+    CalculatorCore core;
+    core.setResultMemo(&memo);
+
+    std::string value;
+    std::thread([&] { value = core.calculateDecimal(std::string_view("1 + 2")).value.toString(); }).join();
+    CHECK(value == "3");
+    CHECK(memo.lookups == 0);
+}
@@ -0,0 +1,123 @@
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <unistd.h>
+#include "TestSupport.h"
+#include "cli/BatchRunner.h"
+#include "cli/LineEvaluator.h"
+#include "cli/LineReader.h"
+#include "cli/OutputBuffer.h"
+#include "cli/ParallelBatchEvaluator.h"
+#include "core/SymbolDatabase.h"
+
+namespace
+{
+    // A database file that is removed, with its log, when the test ends.
+    struct TemporaryDatabase
+    {
+        std::string path = "/tmp/calc_symbols_test_" + std::to_string(getpid()) + ".db";
+
+        ~TemporaryDatabase()
+        {
+            for (const char *suffix : { "", "-wal", "-shm" }) {
+                std::remove((path + suffix).c_str());
+            }
+        }
+    };
+
+    // One batch run with single-threaded evaluation: replays the stored definitions,
+    // attaches the store and evaluates input.
+    std::string runBatch(const std::string &databasePath, std::string_view input)
+    {
+        SymbolDatabase symbols;
+        std::string error;
+        if (!symbols.open(databasePath, &error)) {
+            return "cannot open: " + error;
+        }
+        LineEvaluator evaluator;
+        for (const std::string &definition : symbols.definitions()) {
+            evaluator.applyDefinitions(definition);
+        }
+        evaluator.setSymbolStore(&symbols);
+        OutputBuffer out(OutputBuffer::NoFile);
+        evaluator.evaluateBlock(input, out);
+        return std::string(out.text());
+    }
+}
+
+CALC_TEST(definitionsSurviveRestart)
+{
+    TemporaryDatabase database;
+    CHECK(runBatch(database.path, "rate = 0.5\nf(x) = x^2 + rate\nf(2)\n") == "0.5\nf(x) = x^2 + rate\n4.5\n");
+    CHECK(runBatch(database.path, "f(2)\nrate = 1\n") == "4.5\n1\n");
+    CHECK(runBatch(database.path, "f(2)\n") == "5\n");
+
+    // Redefining a name keeps its place, so functions still follow what they use.
+    SymbolDatabase symbols;
+    std::string error;
+    CHECK(symbols.open(database.path, &error));
+    const std::vector<std::string> definitions = symbols.definitions();
+    CHECK(definitions.size() == 2);
+    CHECK(definitions.size() == 2 && definitions[0] == "rate = 1" && definitions[1] == "f(x) = x^2 + rate");
+}
+
+CALC_TEST(parallelBatchRestoresAndStoresDefinitions)
+{
+    TemporaryDatabase database;
+    CHECK(runBatch(database.path, "r = 3\n") == "3\n");
+
+    const std::string inputPath = database.path + ".txt";
+    std::ofstream(inputPath) << "r * 2\nq = r + 1\nq * 2\n";
+    {
+        SymbolDatabase symbols;
+        std::string error;
+        CHECK(symbols.open(database.path, &error));
+        std::string stored;
+        for (const std::string &definition : symbols.definitions()) {
+            stored.append(definition).append(1, '\n');
+        }
+        LineReader reader;
+        CHECK(reader.open(inputPath.c_str()));
+        OutputBuffer out(OutputBuffer::NoFile);
+        ParallelBatchEvaluator pipeline(4);
+        pipeline.restoreDefinitions(stored, &symbols);
+        CHECK(pipeline.run(reader, out, false) == 0);
+        CHECK(out.text() == "6\n4\n8\n");
+    }
+    std::remove(inputPath.c_str());
+    CHECK(runBatch(database.path, "q\n") == "4\n");
+}
+
+CALC_TEST(dumpIrCompilesAgainstDefinitions)
+{
+    TemporaryDatabase database;
+    CHECK(runBatch(database.path, "f(x) = 2 * x\n") == "f(x) = 2 * x\n");
+
+    SymbolDatabase symbols;
+    std::string error;
+    CHECK(symbols.open(database.path, &error));
+    LineEvaluator evaluator;
+    for (const std::string &definition : symbols.definitions()) {
+        evaluator.applyDefinitions(definition);
+    }
+    OutputBuffer out(OutputBuffer::NoFile);
+    CHECK(evaluator.dumpLine("r = 4", out));
+    CHECK(evaluator.dumpLine("f(r) + y", out));
+    const std::string_view dump = out.text();
+    const std::string_view definitionDump = "; r = 4\ndefined r = 4\n\n";
+    CHECK(dump.substr(0, definitionDump.size()) == definitionDump);
+    CHECK(dump.find("load  r") != std::string_view::npos);
+    CHECK(dump.find("load  y") != std::string_view::npos);
+    CHECK(dump.find("load  f") == std::string_view::npos);
+
+    char program[] = "CalcPlusPlus";
+    char batch[] = "--batch";
+    char input[] = "-";
+    char dumpIr[] = "--dump-ir";
+    char precision[] = "--precision";
+    char digits[] = "20";
+    char *argv[] = { program, batch, input, dumpIr, precision, digits };
+    BatchRunner::Options options;
+    CHECK(BatchRunner::parseArguments(6, argv, &options, &error));
+    CHECK(error == "--precision is not valid together with --dump-ir");
+}
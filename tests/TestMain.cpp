@@ -0,0 +1,46 @@
+// calc_tests: checks the engine and the history and symbol stores against what their
+// headers promise. Runs every case, or those whose name contains the first argument, and
+// exits with status 1 if any failed.
+#include <QCoreApplication>
+#include <cstdio>
+#include <cstring>
+#include "TestSupport.h"
+
+namespace
+{
+    int failedChecks = 0;
+}
+
+std::vector<TestSupport::Case> &TestSupport::cases()
+{
+    static std::vector<Case> registered;
+    return registered;
+}
+
+void TestSupport::fail(const char *file, int line, const char *condition)
+{
+    ++failedChecks;
+    std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", file, line, condition);
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication application(argc, argv); // For the SQLite driver plugin
+
+    const char *filter = argc > 1 ? argv[1] : "";
+    int failedCases = 0;
+    int run = 0;
+    for (const TestSupport::Case &testCase : TestSupport::cases()) {
+        if (!std::strstr(testCase.name, filter)) {
+            continue;
+        }
+        const int before = failedChecks;
+        testCase.body();
+        ++run;
+        const bool passed = failedChecks == before;
+        failedCases += passed ? 0 : 1;
+        std::fprintf(stderr, "%s %s\n", passed ? "PASS" : "FAIL", testCase.name);
+    }
+    std::fprintf(stderr, "%d of %d cases passed\n", run - failedCases, run);
+    return failedCases == 0 && run > 0 ? 0 : 1;
+}
@@ -0,0 +1,36 @@
+#ifndef TESTSUPPORT_H
+#define TESTSUPPORT_H
+
+#include <vector>
+
+// Self-registering test cases for calc_tests, so the suite needs nothing beyond the
+// application's own dependencies. A failed CHECK reports its location and marks the
+// case failed without stopping it.
+namespace TestSupport
+{
+    struct Case
+    {
+        const char *name;
+        void (*body)();
+    };
+
+    std::vector<Case> &cases();
+    void fail(const char *file, int line, const char *condition);
+
+    struct Registration
+    {
+        Registration(const char *name, void (*body)()) { cases().push_back({ name, body }); }
+    };
+}
+
+#define CALC_TEST(name)                                                              \
+    static void name();                                                              \
+    static const TestSupport::Registration name##Registration(#name, name);          \
+    static void name()
+
+#define CHECK(condition)                                                             \
+    do {                                                                             \
+        if (!(condition)) TestSupport::fail(__FILE__, __LINE__, #condition);         \
+    } while (false)
+
+#endif // TESTSUPPORT_H